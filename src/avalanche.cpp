@@ -4,13 +4,15 @@
 
 #include <avalanche.h>
 
+#include <blockindexworkcomparator.h>
 #include <chain.h>
 #include <netmessagemaker.h>
-#include <reverse_iterator.h>
 #include <scheduler.h>
+#include <txmempool.h>
 #include <util/bitmanip.h>
 #include <validation.h>
 
+#include <algorithm>
 #include <tuple>
 
 /**
@@ -18,10 +20,7 @@
  */
 static const int64_t AVALANCHE_TIME_STEP_MILLISECONDS = 10;
 
-/**
- * Maximum item count that can be polled at once.
- */
-static const size_t AVALANCHE_MAX_ELEMENT_POLL = 4096;
+std::unique_ptr<AvalancheProcessor> g_avalanche;
 
 bool VoteRecord::registerVote(NodeId nodeid, uint32_t error) {
     // We just got a new vote, so there is one less inflight request.
@@ -113,6 +112,59 @@ bool VoteRecord::registerPoll() const {
     return false;
 }
 
+AvalancheVoteItem::AvalancheVoteItem(const CBlockIndex *pindexIn, bool accepted)
+    : hash(pindexIn->GetBlockHash()), pindex(pindexIn), vote(accepted) {}
+
+AvalancheVoteItem::AvalancheVoteItem(const TxId &txid,
+                                     std::vector<COutPoint> prevoutsIn,
+                                     bool accepted)
+    : hash(txid), pindex(nullptr), prevouts(std::move(prevoutsIn)),
+      vote(accepted) {}
+
+bool AvalancheVoteItem::isAccepted() const {
+    LOCK(cs_vote);
+    return vote.isAccepted();
+}
+
+int AvalancheVoteItem::getConfidence() const {
+    LOCK(cs_vote);
+    return vote.getConfidence();
+}
+
+bool AvalancheVoteItem::registerVote(NodeId nodeid, uint32_t error,
+                                     Status &status) {
+    LOCK(cs_vote);
+    if (finalized) {
+        // The decision is made, the item is being removed.
+        return false;
+    }
+
+    if (!vote.registerVote(nodeid, error)) {
+        // This vote did not provide any extra information.
+        return false;
+    }
+
+    if (!vote.hasFinalized()) {
+        status = vote.isAccepted() ? Status::Accepted : Status::Rejected;
+        return true;
+    }
+
+    finalized = true;
+    status = vote.isAccepted() ? Status::Finalized : Status::Invalid;
+    return true;
+}
+
+/**
+ * Free the vote items whose last reference was dropped by this thread. Their
+ * deletion is queued on the thread dropping them, and only runs once that
+ * thread synchronizes, which the event loop and RPC threads otherwise never do.
+ */
+static void ReclaimDroppedItems() {
+    if (RCULock::hasPendingCleanups()) {
+        RCULock::synchronize();
+    }
+}
+
 static bool IsWorthPolling(const CBlockIndex *pindex) {
     AssertLockHeld(cs_main);
 
@@ -142,34 +194,163 @@ bool AvalancheProcessor::addBlockToReconcile(const CBlockIndex *pindex) {
         isAccepted = chainActive.Contains(pindex);
     }
 
-    return vote_records.getWriteView()
-        ->insert(std::make_pair(pindex, VoteRecord(isAccepted)))
-        .second;
+    return vote_records.insert(
+        RCUPtr<AvalancheVoteItem>::make(pindex, isAccepted));
 }
 
 bool AvalancheProcessor::isAccepted(const CBlockIndex *pindex) const {
-    auto r = vote_records.getReadView();
-    auto it = r->find(pindex);
-    if (it == r.end()) {
+    bool accepted;
+    {
+        auto item = vote_records.get(pindex->GetBlockHash());
+        accepted = item && item->isAccepted();
+    }
+    ReclaimDroppedItems();
+    return accepted;
+}
+
+int AvalancheProcessor::getConfidence(const CBlockIndex *pindex) const {
+    int confidence;
+    {
+        auto item = vote_records.get(pindex->GetBlockHash());
+        confidence = item ? item->getConfidence() : -1;
+    }
+    ReclaimDroppedItems();
+    return confidence;
+}
+
+bool AvalancheProcessor::addTxToReconcile(const CTransactionRef &tx) {
+    bool isAccepted;
+    // The mempool transactions conflicting with tx, and their prevouts.
+    std::map<TxId, std::vector<COutPoint>> conflicts;
+
+    {
+        LOCK(g_mempool.cs);
+        isAccepted = g_mempool.exists(tx->GetId());
+        if (!isAccepted) {
+            for (const CTxIn &txin : tx->vin) {
+                auto it = g_mempool.mapNextTx.find(txin.prevout);
+                if (it == g_mempool.mapNextTx.end() ||
+                    conflicts.count(it->second->GetId())) {
+                    continue;
+                }
+
+                std::vector<COutPoint> &prevouts =
+                    conflicts[it->second->GetId()];
+                for (const CTxIn &conflictin : it->second->vin) {
+                    prevouts.push_back(conflictin.prevout);
+                }
+            }
+        }
+    }
+
+    std::vector<COutPoint> prevouts;
+    prevouts.reserve(tx->vin.size());
+    for (const CTxIn &txin : tx->vin) {
+        prevouts.push_back(txin.prevout);
+    }
+    conflicts.emplace(tx->GetId(), std::move(prevouts));
+
+    bool inserted = false;
+    auto w = tx_spenders.getWriteView();
+    if (tx_vote_record_count + conflicts.size() >
+        AVALANCHE_MAX_TX_VOTE_RECORDS) {
+        // Too many transactions are being voted on already.
         return false;
     }
 
-    return it->second.isAccepted();
+    for (auto &p : conflicts) {
+        const TxId &txid = p.first;
+        // Only the transaction being added can be rejected, the ones it
+        // conflicts with are in the mempool.
+        if (!tx_vote_records.insert(RCUPtr<AvalancheVoteItem>::make(
+                txid, p.second, txid != tx->GetId() || isAccepted))) {
+            continue;
+        }
+
+        tx_vote_record_count++;
+        if (txid == tx->GetId()) {
+            inserted = true;
+        }
+
+        for (const COutPoint &prevout : p.second) {
+            (*w)[prevout].insert(txid);
+        }
+    }
+
+    return inserted;
 }
 
-int AvalancheProcessor::getConfidence(const CBlockIndex *pindex) const {
-    auto r = vote_records.getReadView();
-    auto it = r->find(pindex);
-    if (it == r.end()) {
-        return -1;
+bool AvalancheProcessor::isAccepted(const TxId &txid) const {
+    bool accepted;
+    {
+        auto item = tx_vote_records.get(txid);
+        accepted = item && item->isAccepted();
+    }
+    ReclaimDroppedItems();
+    return accepted;
+}
+
+int AvalancheProcessor::getConfidence(const TxId &txid) const {
+    int confidence;
+    {
+        auto item = tx_vote_records.get(txid);
+        confidence = item ? item->getConfidence() : -1;
+    }
+    ReclaimDroppedItems();
+    return confidence;
+}
+
+void AvalancheProcessor::removeTx(const CTransaction &tx) {
+    {
+        auto w = tx_spenders.getWriteView();
+        eraseTx(*w, tx.GetId());
+
+        for (const CTxIn &txin : tx.vin) {
+            auto itSpenders = w->find(txin.prevout);
+            if (itSpenders == w->end()) {
+                continue;
+            }
+
+            // Erasing the last spender erases the outpoint.
+            const std::set<TxId> spenders = itSpenders->second;
+            for (const TxId &txid : spenders) {
+                eraseTx(*w, txid);
+            }
+        }
     }
 
-    return it->second.getConfidence();
+    // Reclaim the items removed from the tree.
+    ReclaimDroppedItems();
+}
+
+RCUPtr<AvalancheVoteItem>
+AvalancheProcessor::eraseTx(std::map<COutPoint, std::set<TxId>> &spenders,
+                            const TxId &txid) {
+    RCUPtr<AvalancheVoteItem> item = tx_vote_records.remove(txid);
+    if (!item) {
+        return item;
+    }
+
+    tx_vote_record_count--;
+    for (const COutPoint &prevout : item->getPrevouts()) {
+        auto itSpenders = spenders.find(prevout);
+        if (itSpenders == spenders.end()) {
+            continue;
+        }
+
+        itSpenders->second.erase(txid);
+        if (itSpenders->second.empty()) {
+            spenders.erase(itSpenders);
+        }
+    }
+
+    return item;
 }
 
 bool AvalancheProcessor::registerVotes(
     NodeId nodeid, const AvalancheResponse &response,
-    std::vector<AvalancheBlockUpdate> &updates) {
+    std::vector<AvalancheBlockUpdate> &blockUpdates,
+    std::vector<AvalancheTxUpdate> &txUpdates) {
     {
         // Save the time at which we can query again.
         auto w = peerSet.getWriteView();
@@ -218,66 +399,115 @@ bool AvalancheProcessor::registerVotes(
         }
     }
 
-    std::map<CBlockIndex *, AvalancheVote> responseIndex;
+    struct ItemVote {
+        RCUPtr<AvalancheVoteItem> item;
+        uint32_t error;
+        CBlockIndex *pindex;
+    };
+
+    // Look up the items voted on. The vote record trees are read without
+    // locking, and each item guards its own vote, so responses from several
+    // peers are registered concurrently.
+    std::vector<ItemVote> blockVotes;
+    std::vector<ItemVote> txVotes;
+    for (size_t i = 0; i < size; i++) {
+        const bool isTx = invs[i].type == MSG_TX;
+        auto item = (isTx ? tx_vote_records : vote_records).get(invs[i].hash);
+        if (!item) {
+            // We are not voting on that item anymore.
+            continue;
+        }
 
-    {
-        LOCK(cs_main);
-        for (auto &v : votes) {
-            BlockMap::iterator mi = mapBlockIndex.find(BlockHash(v.GetHash()));
-            if (mi == mapBlockIndex.end()) {
-                // This should not happen, but just in case...
-                continue;
-            }
+        (isTx ? txVotes : blockVotes)
+            .push_back({std::move(item), votes[i].GetError(), nullptr});
+    }
 
-            CBlockIndex *pindex = mi->second;
-            if (!IsWorthPolling(pindex)) {
+    if (!blockVotes.empty()) {
+        LOCK(cs_main);
+        auto it = blockVotes.begin();
+        while (it != blockVotes.end()) {
+            it->pindex = LookupBlockIndex(BlockHash(it->item->getId()));
+            if (it->pindex == nullptr || !IsWorthPolling(it->pindex)) {
                 // There is no point polling this block.
+                it = blockVotes.erase(it);
                 continue;
             }
 
-            responseIndex.insert(std::make_pair(pindex, v));
+            it++;
         }
     }
 
-    {
-        // Register votes.
-        auto w = vote_records.getWriteView();
-        for (auto &p : responseIndex) {
-            CBlockIndex *pindex = p.first;
-            const AvalancheVote &v = p.second;
-
-            auto it = w->find(pindex);
-            if (it == w.end()) {
-                // We are not voting on that item anymore.
-                continue;
-            }
+    AvalancheVoteItem::Status status;
 
-            auto &vr = it->second;
-            if (!vr.registerVote(nodeid, v.GetError())) {
-                // This vote did not provide any extra information, move on.
-                continue;
-            }
+    // Register votes.
+    for (ItemVote &v : blockVotes) {
+        if (!v.item->registerVote(nodeid, v.error, status)) {
+            // This vote did not provide any extra information, move on.
+            continue;
+        }
+
+        if (status == AvalancheBlockUpdate::Status::Finalized ||
+            status == AvalancheBlockUpdate::Status::Invalid) {
+            // We just finalized a vote. Either way, remove the item from the
+            // tree.
+            vote_records.remove(v.item->getId());
+        }
+
+        blockUpdates.emplace_back(v.pindex, status);
+    }
+
+    for (ItemVote &v : txVotes) {
+        const TxId txid(v.item->getId());
+        if (!v.item->registerVote(nodeid, v.error, status)) {
+            // This vote did not provide any extra information, move on.
+            continue;
+        }
+
+        if (status == AvalancheTxUpdate::Status::Accepted ||
+            status == AvalancheTxUpdate::Status::Rejected) {
+            // This item has not been finalized, so we have nothing more to
+            // do.
+            txUpdates.emplace_back(txid, status);
+            continue;
+        }
 
-            if (!vr.hasFinalized()) {
-                // This item has note been finalized, so we have nothing more to
-                // do.
-                updates.emplace_back(
-                    pindex, vr.isAccepted()
-                                ? AvalancheBlockUpdate::Status::Accepted
-                                : AvalancheBlockUpdate::Status::Rejected);
+        auto w = tx_spenders.getWriteView();
+        if (!eraseTx(*w, txid)) {
+            // The transaction was removed meanwhile, by removeTx or because a
+            // conflicting transaction was finalized.
+            continue;
+        }
+
+        txUpdates.emplace_back(txid, status);
+        if (status == AvalancheTxUpdate::Status::Invalid) {
+            continue;
+        }
+
+        // We just finalized a transaction, so the ones conflicting with it are
+        // invalid. Either way, remove them from the tree.
+        for (const COutPoint &prevout : v.item->getPrevouts()) {
+            auto itSpenders = w->find(prevout);
+            if (itSpenders == w->end()) {
                 continue;
             }
 
-            // We just finalized a vote. If it is valid, then let the caller
-            // know. Either way, remove the item from the map.
-            updates.emplace_back(pindex,
-                                 vr.isAccepted()
-                                     ? AvalancheBlockUpdate::Status::Finalized
-                                     : AvalancheBlockUpdate::Status::Invalid);
-            w->erase(it);
+            // Erasing the last spender erases the outpoint.
+            const std::set<TxId> conflicts = itSpenders->second;
+            for (const TxId &conflict : conflicts) {
+                if (eraseTx(*w, conflict)) {
+                    txUpdates.emplace_back(conflict,
+                                           AvalancheTxUpdate::Status::Invalid);
+                }
+            }
         }
     }
 
+    // Reclaim the items removed from the trees, by this call or concurrently by
+    // other threads, once we dropped our own references to them.
+    blockVotes.clear();
+    txVotes.clear();
+    ReclaimDroppedItems();
+
     return true;
 }
 
@@ -338,34 +568,70 @@ bool AvalancheProcessor::stopEventLoop() {
 std::vector<CInv> AvalancheProcessor::getInvsForNextPoll(bool forPoll) const {
     std::vector<CInv> invs;
 
-    auto r = vote_records.getReadView();
-    for (const std::pair<const CBlockIndex *const, VoteRecord> &p :
-         reverse_iterate(r)) {
-        const CBlockIndex *pindex = p.first;
+    {
+        std::vector<RCUPtr<const AvalancheVoteItem>> blocks;
+        vote_records.forEachLeaf([&blocks](const AvalancheVoteItem &item) {
+            blocks.push_back(RCUPtr<const AvalancheVoteItem>::copy(&item));
+            return true;
+        });
 
         {
+            // Obviously do not poll if the block is not worth polling.
             LOCK(cs_main);
-            if (!IsWorthPolling(pindex)) {
-                // Obviously do not poll if the block is not worth polling.
+            blocks.erase(
+                std::remove_if(blocks.begin(), blocks.end(),
+                               [](const RCUPtr<const AvalancheVoteItem> &item) {
+                                   return !IsWorthPolling(
+                                       item->getBlockIndex());
+                               }),
+                blocks.end());
+        }
+
+        // Poll the blocks with the most work first.
+        std::sort(blocks.begin(), blocks.end(),
+                  [](const RCUPtr<const AvalancheVoteItem> &a,
+                     const RCUPtr<const AvalancheVoteItem> &b) {
+                      return CBlockIndexWorkComparator()(b->getBlockIndex(),
+                                                         a->getBlockIndex());
+                  });
+
+        for (const RCUPtr<const AvalancheVoteItem> &item : blocks) {
+            // Check if we can run poll.
+            const bool shouldPoll =
+                forPoll ? item->registerPoll() : item->shouldPoll();
+            if (!shouldPoll) {
                 continue;
             }
+
+            // We don't have a decision, we need more votes.
+            invs.emplace_back(MSG_BLOCK, item->getId());
+            if (invs.size() >= AVALANCHE_MAX_ELEMENT_POLL) {
+                break;
+            }
         }
+    }
+
+    // The blocks may have been finalized while we held them.
+    ReclaimDroppedItems();
+    if (invs.size() >= AVALANCHE_MAX_ELEMENT_POLL) {
+        // Make sure we do not produce more invs than specified by the
+        // protocol.
+        return invs;
+    }
 
+    // Fill the rest of the poll with transactions. Unlike blocks, they can be
+    // polled without cs_main so a single poll covers many of them. There are
+    // at most AVALANCHE_MAX_TX_VOTE_RECORDS of them to visit.
+    tx_vote_records.forEachLeaf([&](const AvalancheVoteItem &item) {
         // Check if we can run poll.
         const bool shouldPoll =
-            forPoll ? p.second.registerPoll() : p.second.shouldPoll();
-        if (!shouldPoll) {
-            continue;
+            forPoll ? item.registerPoll() : item.shouldPoll();
+        if (shouldPoll) {
+            invs.emplace_back(MSG_TX, item.getId());
         }
 
-        // We don't have a decision, we need more votes.
-        invs.emplace_back(MSG_BLOCK, pindex->GetBlockHash());
-        if (invs.size() >= AVALANCHE_MAX_ELEMENT_POLL) {
-            // Make sure we do not produce more invs than specified by the
-            // protocol.
-            return invs;
-        }
-    }
+        return invs.size() < AVALANCHE_MAX_ELEMENT_POLL;
+    });
 
     return invs;
 }
@@ -408,28 +674,17 @@ void AvalancheProcessor::clearTimedoutRequests() {
     // In flight request accounting.
     for (const auto &p : timedout_items) {
         const CInv &inv = p.first;
-        assert(inv.type == MSG_BLOCK);
-
-        CBlockIndex *pindex;
-
-        {
-            LOCK(cs_main);
-            BlockMap::iterator mi = mapBlockIndex.find(BlockHash(inv.hash));
-            if (mi == mapBlockIndex.end()) {
-                continue;
-            }
+        assert(inv.type == MSG_TX || inv.type == MSG_BLOCK);
 
-            pindex = mi->second;
+        auto item =
+            (inv.type == MSG_TX ? tx_vote_records : vote_records).get(inv.hash);
+        if (item) {
+            item->clearInflightRequest(p.second);
         }
-
-        auto w = vote_records.getWriteView();
-        auto it = w->find(pindex);
-        if (it == w.end()) {
-            continue;
-        }
-
-        it->second.clearInflightRequest(p.second);
     }
+
+    // The items may have been removed from the trees while we held them.
+    ReclaimDroppedItems();
 }
 
 void AvalancheProcessor::runEventLoop() {
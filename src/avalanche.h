@@ -5,11 +5,15 @@
 #ifndef BITCOIN_AVALANCHE_H
 #define BITCOIN_AVALANCHE_H
 
-#include <blockindexworkcomparator.h>
+#include <chain.h>
 #include <net.h>
+#include <primitives/transaction.h>
 #include <protocol.h> // for CInv
+#include <radix.h>
+#include <rcu.h>
 #include <rwcollection.h>
 #include <serialize.h>
+#include <sync.h>
 #include <uint256.h>
 
 #include <boost/multi_index/composite_key.hpp>
@@ -22,10 +26,12 @@
 #include <chrono>
 #include <condition_variable>
 #include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
 #include <vector>
 
 class Config;
-class CBlockIndex;
 class CScheduler;
 
 namespace {
@@ -44,6 +50,28 @@ static const int AVALANCHE_DEFAULT_QUERY_TIMEOUT_DURATION_MILLISECONDS = 10000;
  */
 static const int AVALANCHE_MAX_INFLIGHT_POLL = 10;
 
+/**
+ * Maximum item count that can be polled at once.
+ */
+static const size_t AVALANCHE_MAX_ELEMENT_POLL = 4096;
+
+/**
+ * Maximum number of transactions voted on at once. Building a poll visits the
+ * transactions being voted on, so this also bounds the work done per poll.
+ */
+static const size_t AVALANCHE_MAX_TX_VOTE_RECORDS =
+    2 * AVALANCHE_MAX_ELEMENT_POLL;
+
+/**
+ * How long, in milliseconds, a peer is asked to wait before polling us again.
+ */
+static const uint32_t AVALANCHE_DEFAULT_COOLDOWN = 100;
+
+/**
+ * Is avalanche enabled by default.
+ */
+static const bool AVALANCHE_DEFAULT_ENABLED = false;
+
 /**
  * Special NodeId that represent no node.
  */
@@ -116,9 +144,10 @@ public:
     bool shouldPoll() const { return inflight < AVALANCHE_MAX_INFLIGHT_POLL; }
 
     /**
-     * Clear `count` inflight requests.
+     * Clear `count` inflight requests. This is thread safe, so the method is
+     * made const like registerPoll.
      */
-    void clearInflightRequest(uint8_t count = 1) { inflight -= count; }
+    void clearInflightRequest(uint8_t count = 1) const { inflight -= count; }
 
 private:
     /**
@@ -157,6 +186,7 @@ class AvalancheResponse {
     std::vector<AvalancheVote> votes;
 
 public:
+    AvalancheResponse() : round(0), cooldown(0) {}
     AvalancheResponse(uint64_t roundIn, uint32_t cooldownIn,
                       std::vector<AvalancheVote> votesIn)
         : round(roundIn), cooldown(cooldownIn), votes(votesIn) {}
@@ -181,9 +211,11 @@ class AvalanchePoll {
     std::vector<CInv> invs;
 
 public:
+    AvalanchePoll() : round(0) {}
     AvalanchePoll(uint64_t roundIn, std::vector<CInv> invsIn)
         : round(roundIn), invs(invsIn) {}
 
+    uint64_t getRound() const { return round; }
     const std::vector<CInv> &GetInvs() const { return invs; }
 
     // serialization support
@@ -233,8 +265,76 @@ public:
     }
 };
 
-typedef std::map<const CBlockIndex *, VoteRecord, CBlockIndexWorkComparator>
-    BlockVoteMap;
+class AvalancheTxUpdate {
+public:
+    typedef AvalancheBlockUpdate::Status Status;
+
+private:
+    TxId txid;
+    Status status;
+
+public:
+    AvalancheTxUpdate(const TxId &txidIn, Status statusIn)
+        : txid(txidIn), status(statusIn) {}
+
+    Status getStatus() const { return status; }
+    const TxId &getTxId() const { return txid; }
+};
+
+/**
+ * An item being voted on, either a block or a transaction. Items are shared
+ * between threads through the RCU protected vote record trees, and the vote
+ * is guarded by a lock of its own so votes on different items are registered
+ * concurrently.
+ */
+class AvalancheVoteItem {
+public:
+    typedef AvalancheBlockUpdate::Status Status;
+
+private:
+    const uint256 hash;
+    //! The block voted on, nullptr for transactions.
+    const CBlockIndex *const pindex;
+    //! The outpoints spent by the transaction, so its conflicts can be found.
+    const std::vector<COutPoint> prevouts;
+
+    mutable Mutex cs_vote;
+    /**
+     * Only the inflight request counter of the vote, which is atomic, is
+     * accessed without cs_vote.
+     */
+    VoteRecord vote;
+    bool finalized GUARDED_BY(cs_vote) = false;
+
+public:
+    AvalancheVoteItem(const CBlockIndex *pindexIn, bool accepted);
+    AvalancheVoteItem(const TxId &txid, std::vector<COutPoint> prevoutsIn,
+                      bool accepted);
+
+    const uint256 &getId() const { return hash; }
+    const CBlockIndex *getBlockIndex() const { return pindex; }
+    const std::vector<COutPoint> &getPrevouts() const { return prevouts; }
+
+    bool isAccepted() const;
+    int getConfidence() const;
+
+    /**
+     * Register a vote for the item. Returns true and sets status if the
+     * acceptance or finalization state changed. Once the item is finalized, it
+     * ignores further votes, so only one caller ever sees it finalized.
+     */
+    bool registerVote(NodeId nodeid, uint32_t error, Status &status);
+
+    bool registerPoll() const { return vote.registerPoll(); }
+    bool shouldPoll() const { return vote.shouldPoll(); }
+    void clearInflightRequest(uint8_t count) const {
+        vote.clearInflightRequest(count);
+    }
+
+    IMPLEMENT_RCU_REFCOUNT(uint64_t);
+};
+
+typedef RadixTree<AvalancheVoteItem> VoteItemTree;
 
 struct next_request_time {};
 struct query_timeout {};
@@ -245,9 +345,26 @@ private:
     std::chrono::milliseconds queryTimeoutDuration;
 
     /**
-     * Blocks to run avalanche on.
+     * Blocks to run avalanche on, by block hash.
+     */
+    VoteItemTree vote_records;
+
+    /**
+     * Transactions to run avalanche on, by txid.
+     */
+    VoteItemTree tx_vote_records;
+    /**
+     * Number of items in tx_vote_records, only modified while holding the
+     * write view of tx_spenders.
+     */
+    std::atomic<size_t> tx_vote_record_count{0};
+
+    /**
+     * The transactions voted on spending each outpoint. Transactions spending
+     * the same outpoint conflict, so once one of them is finalized the others
+     * are invalidated.
      */
-    RWCollection<BlockVoteMap> vote_records;
+    RWCollection<std::map<COutPoint, std::set<TxId>>> tx_spenders;
 
     /**
      * Keep track of peers and queries sent.
@@ -334,8 +451,24 @@ public:
     bool isAccepted(const CBlockIndex *pindex) const;
     int getConfidence(const CBlockIndex *pindex) const;
 
+    /**
+     * Start voting on a transaction. The mempool transactions it conflicts
+     * with, found through mapNextTx, are voted on along with it. Returns false
+     * if the transaction is already voted on, or if voting on it would exceed
+     * AVALANCHE_MAX_TX_VOTE_RECORDS.
+     */
+    bool addTxToReconcile(const CTransactionRef &tx);
+    bool isAccepted(const TxId &txid) const;
+    int getConfidence(const TxId &txid) const;
+    /**
+     * Stop voting on a transaction and the ones conflicting with it, for
+     * instance once it is mined or removed from the mempool.
+     */
+    void removeTx(const CTransaction &tx);
+
     bool registerVotes(NodeId nodeid, const AvalancheResponse &response,
-                       std::vector<AvalancheBlockUpdate> &updates);
+                       std::vector<AvalancheBlockUpdate> &blockUpdates,
+                       std::vector<AvalancheTxUpdate> &txUpdates);
 
     bool addPeer(NodeId nodeid, int64_t score);
 
@@ -348,7 +481,19 @@ private:
     std::vector<CInv> getInvsForNextPoll(bool forPoll = true) const;
     NodeId getSuitableNodeToQuery();
 
+    /**
+     * Stop voting on a transaction. Returns the item if it was being voted on
+     * and this call removed it.
+     */
+    RCUPtr<AvalancheVoteItem>
+    eraseTx(std::map<COutPoint, std::set<TxId>> &spenders, const TxId &txid);
+
     friend struct AvalancheTest;
 };
 
+/**
+ * Global avalanche instance, only set when -enableavalanche is.
+ */
+extern std::unique_ptr<AvalancheProcessor> g_avalanche;
+
 #endif // BITCOIN_AVALANCHE_H
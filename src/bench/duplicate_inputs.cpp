@@ -41,7 +41,7 @@ static void DuplicateInputs(benchmark::State &state) {
         LOCK(cs_main);
         ::pblocktree.reset(new CBlockTreeDB(1 << 20, true));
         ::pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
-        ::pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+        ::pcoinsTip.reset(new CCoinsViewShardedCache(pcoinsdbview.get()));
     }
     {
         thread_group.create_thread(
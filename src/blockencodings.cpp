@@ -16,6 +16,7 @@
 #include <util/system.h>
 #include <validation.h>
 
+#include <algorithm>
 #include <unordered_map>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block)
@@ -51,6 +52,13 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const TxHash &txhash) const {
 ReadStatus PartiallyDownloadedBlock::InitData(
     const CBlockHeaderAndShortTxIDs &cmpctblock,
     const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txns) {
+    return InitData(cmpctblock, extra_txns, nScriptCheckThreads);
+}
+
+ReadStatus PartiallyDownloadedBlock::InitData(
+    const CBlockHeaderAndShortTxIDs &cmpctblock,
+    const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txns,
+    int nScanThreads) {
     if (cmpctblock.header.IsNull() ||
         (cmpctblock.shorttxids.empty() && cmpctblock.prefilledtxn.empty())) {
         return READ_STATUS_INVALID;
@@ -129,35 +137,80 @@ ReadStatus PartiallyDownloadedBlock::InitData(
     }
 
     std::vector<bool> have_txn(txns_available.size());
+    auto addMempoolTxn = [&](uint32_t index, const CTransactionRef &tx) {
+        if (!have_txn[index]) {
+            txns_available[index] = tx;
+            have_txn[index] = true;
+            mempool_count++;
+        } else {
+            // If we find two mempool txn that match the short id, just
+            // request it. This should be rare enough that the extra bandwidth
+            // doesn't matter, but eating a round-trip due to FillBlock failure
+            // would be annoying.
+            if (txns_available[index]) {
+                txns_available[index].reset();
+                mempool_count--;
+            }
+        }
+    };
     {
         LOCK(pool->cs);
         const std::vector<std::pair<TxHash, CTxMemPool::txiter>> &vTxHashes =
             pool->vTxHashes;
-        for (auto txHash : vTxHashes) {
-            uint64_t shortid = cmpctblock.GetShortID(txHash.first);
-            std::unordered_map<uint64_t, uint32_t>::iterator idit =
-                shorttxids.find(shortid);
-            if (idit != shorttxids.end()) {
-                if (!have_txn[idit->second]) {
-                    txns_available[idit->second] = txHash.second->GetSharedTx();
-                    have_txn[idit->second] = true;
-                    mempool_count++;
-                } else {
-                    // If we find two mempool txn that match the short id, just
-                    // request it. This should be rare enough that the extra
-                    // bandwidth doesn't matter, but eating a round-trip due to
-                    // FillBlock failure would be annoying.
-                    if (txns_available[idit->second]) {
-                        txns_available[idit->second].reset();
-                        mempool_count--;
+        const size_t nSlices = std::min<size_t>(
+            {size_t(std::max(nScanThreads, 1)), MAX_SHORTID_SCAN_THREADS,
+             vTxHashes.size() / MIN_SHORTID_SCAN_TXS_PER_THREAD});
+        if (nSlices > 1) {
+            // Hash large mempools on several threads, each looking up the
+            // short ids of a slice of the mempool. The matches are then added
+            // in mempool order, so the result does not depend on the number
+            // of threads.
+            const size_t nSliceSize =
+                (vTxHashes.size() + nSlices - 1) / nSlices;
+            std::vector<std::vector<std::pair<size_t, uint32_t>>> matches(
+                nSlices);
+            auto scanSlice = [&](size_t nSlice) {
+                const size_t begin = nSlice * nSliceSize;
+                const size_t end =
+                    std::min(begin + nSliceSize, vTxHashes.size());
+                for (size_t i = begin; i < end; i++) {
+                    auto idit = shorttxids.find(
+                        cmpctblock.GetShortID(vTxHashes[i].first));
+                    if (idit != shorttxids.end()) {
+                        matches[nSlice].emplace_back(i, idit->second);
                     }
                 }
+            };
+            std::vector<CWorkerTask> tasks;
+            for (size_t nSlice = 0; nSlice < nSlices; nSlice++) {
+                tasks.emplace_back([&scanSlice, nSlice]() {
+                    scanSlice(nSlice);
+                    return true;
+                });
             }
-            // Though ideally we'd continue scanning for the
-            // two-txn-match-shortid case, the performance win of an early exit
-            // here is too good to pass up and worth the extra risk.
-            if (mempool_count == shorttxids.size()) {
-                break;
+            RunWorkerTasks(tasks);
+
+            for (const auto &sliceMatches : matches) {
+                for (const auto &match : sliceMatches) {
+                    addMempoolTxn(
+                        match.second,
+                        vTxHashes[match.first].second->GetSharedTx());
+                }
+            }
+        } else {
+            for (auto txHash : vTxHashes) {
+                uint64_t shortid = cmpctblock.GetShortID(txHash.first);
+                std::unordered_map<uint64_t, uint32_t>::iterator idit =
+                    shorttxids.find(shortid);
+                if (idit != shorttxids.end()) {
+                    addMempoolTxn(idit->second, txHash.second->GetSharedTx());
+                }
+                // Though ideally we'd continue scanning for the
+                // two-txn-match-shortid case, the performance win of an early
+                // exit here is too good to pass up and worth the extra risk.
+                if (mempool_count == shorttxids.size()) {
+                    break;
+                }
             }
         }
     }
@@ -216,6 +216,12 @@ public:
     }
 };
 
+//! Minimum number of mempool transactions for each thread hashing the mempool
+//! into short ids when a compact block is reconstructed.
+static constexpr size_t MIN_SHORTID_SCAN_TXS_PER_THREAD = 4096;
+//! Maximum number of threads hashing the mempool into short ids.
+static constexpr size_t MAX_SHORTID_SCAN_THREADS = 8;
+
 class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txns_available;
@@ -233,6 +239,12 @@ public:
     ReadStatus
     InitData(const CBlockHeaderAndShortTxIDs &cmpctblock,
              const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txn);
+    //! Same, hashing the mempool into short ids on up to nScanThreads threads,
+    //! including the calling one.
+    ReadStatus
+    InitData(const CBlockHeaderAndShortTxIDs &cmpctblock,
+             const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txn,
+             int nScanThreads);
     bool IsTxAvailable(size_t index) const;
     ReadStatus FillBlock(CBlock &block,
                          const std::vector<CTransactionRef> &vtx_missing);
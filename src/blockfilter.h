@@ -12,6 +12,7 @@
 #include <util/bytevectorhash.h>
 
 #include <cstdint>
+#include <string>
 #include <unordered_set>
 #include <vector>
 
@@ -87,6 +88,20 @@ enum class BlockFilterType : uint8_t {
     INVALID = 255,
 };
 
+/** Get the human-readable name for a filter type. Returns empty string for
+ * unknown types. */
+const std::string &BlockFilterTypeName(BlockFilterType filter_type);
+
+/** Find a filter type by its human-readable name. */
+bool BlockFilterTypeByName(const std::string &name,
+                           BlockFilterType &filter_type);
+
+/** Get a list of known filter types. */
+const std::vector<BlockFilterType> &AllBlockFilterTypes();
+
+/** Get a comma-separated list of known filter type names. */
+const std::string &ListBlockFilterTypes();
+
 /**
  * Complete block filter struct as defined in BIP 157. Serialization matches
  * payload of "cfilter" messages.
@@ -125,7 +140,7 @@ public:
     uint256 ComputeHeader(const uint256 &prev_header) const;
 
     template <typename Stream> void Serialize(Stream &s) const {
-        s << m_block_hash << static_cast<uint8_t>(m_filter_type)
+        s << static_cast<uint8_t>(m_filter_type) << m_block_hash
           << m_filter.GetEncoded();
     }
 
@@ -133,7 +148,7 @@ public:
         std::vector<uint8_t> encoded_filter;
         uint8_t filter_type;
 
-        s >> m_block_hash >> filter_type >> encoded_filter;
+        s >> filter_type >> m_block_hash >> encoded_filter;
 
         m_filter_type = static_cast<BlockFilterType>(filter_type);
 
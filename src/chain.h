@@ -13,6 +13,8 @@
 #include <crypto/common.h> // for ReadLE64
 #include <flatfile.h>
 #include <primitives/block.h>
+#include <radix.h>
+#include <rcu.h>
 #include <sync.h>
 #include <tinyformat.h>
 #include <uint256.h>
@@ -266,10 +268,50 @@ extern CCriticalSection cs_main;
 typedef std::unordered_map<BlockHash, CBlockIndex *, BlockHasher> BlockMap;
 extern BlockMap &mapBlockIndex GUARDED_BY(cs_main);
 
+/**
+ * Entry of blockIndexTree, pointing to the CBlockIndex of a block hash.
+ */
+class BlockIndexTreeEntry {
+    const BlockHash hash;
+    CBlockIndex *const pindex;
+
+public:
+    BlockIndexTreeEntry(const BlockHash &hashIn, CBlockIndex *pindexIn)
+        : hash(hashIn), pindex(pindexIn) {}
+
+    const uint256 &getId() const { return hash; }
+    CBlockIndex *getBlockIndex() const { return pindex; }
+
+    IMPLEMENT_RCU_REFCOUNT(uint64_t);
+};
+
+typedef RadixTree<const BlockIndexTreeEntry> BlockIndexTree;
+
+/**
+ * Lock free copy of mapBlockIndex. Entries are inserted along with the ones of
+ * mapBlockIndex, under cs_main, and only removed when the block index is
+ * unloaded.
+ */
+extern BlockIndexTree &blockIndexTree;
+
+/**
+ * Make a block index entry, already in mapBlockIndex, found by
+ * LookupBlockIndex. The fields read without cs_main must be set before.
+ */
+inline void PublishBlockIndex(CBlockIndex *pindex) {
+    blockIndexTree.insert(RCUPtr<const BlockIndexTreeEntry>::make(
+        pindex->GetBlockHash(), pindex));
+}
+
+/**
+ * Find the CBlockIndex of a block hash. This does not require cs_main, as
+ * block index entries are never deleted until the block index is unloaded.
+ * Without cs_main, only the fields which no longer change once the block is
+ * indexed may be read: its hash, header, height and pprev.
+ */
 inline CBlockIndex *LookupBlockIndex(const BlockHash &hash) {
-    AssertLockHeld(cs_main);
-    BlockMap::const_iterator it = mapBlockIndex.find(hash);
-    return it == mapBlockIndex.end() ? nullptr : it->second;
+    auto entry = blockIndexTree.get(hash);
+    return entry ? entry->getBlockIndex() : nullptr;
 }
 
 arith_uint256 GetBlockProof(const CBlockIndex &block);
@@ -198,6 +198,8 @@ public:
     void Add(std::vector<T> &vChecks) {
         if (pqueue != nullptr) {
             pqueue->Add(vChecks);
+            // Checks added after Wait() are waited for again on destruction.
+            fDone = false;
         }
     }
 
@@ -194,6 +194,67 @@ void CCoinsViewCache::SetBestBlock(const BlockHash &hashBlockIn) {
     hashBlock = hashBlockIn;
 }
 
+/**
+ * Merge a dirty entry from a child cache into cacheCoins, keeping
+ * cachedCoinsUsage up to date.
+ */
+static void MergeDirtyCacheEntry(CCoinsMap &cacheCoins,
+                                 size_t &cachedCoinsUsage,
+                                 CCoinsMap::iterator it) {
+    CCoinsMap::iterator itUs = cacheCoins.find(it->first);
+    if (itUs == cacheCoins.end()) {
+        // The parent cache does not have an entry, while the child does
+        // We can ignore it if it's both FRESH and pruned in the child
+        if (!(it->second.flags & CCoinsCacheEntry::FRESH &&
+              it->second.coin.IsSpent())) {
+            // Otherwise we will need to create it in the parent and
+            // move the data up and mark it as dirty
+            CCoinsCacheEntry &entry = cacheCoins[it->first];
+            entry.coin = std::move(it->second.coin);
+            cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
+            entry.flags = CCoinsCacheEntry::DIRTY;
+            // We can mark it FRESH in the parent if it was FRESH in the
+            // child. Otherwise it might have just been flushed from the
+            // parent's cache and already exist in the grandparent
+            if (it->second.flags & CCoinsCacheEntry::FRESH) {
+                entry.flags |= CCoinsCacheEntry::FRESH;
+            }
+        }
+    } else {
+        // Assert that the child cache entry was not marked FRESH if the
+        // parent cache entry has unspent outputs. If this ever happens,
+        // it means the FRESH flag was misapplied and there is a logic
+        // error in the calling code.
+        if ((it->second.flags & CCoinsCacheEntry::FRESH) &&
+            !itUs->second.coin.IsSpent()) {
+            throw std::logic_error("FRESH flag misapplied to cache "
+                                   "entry for base transaction with "
+                                   "spendable outputs");
+        }
+
+        // Found the entry in the parent cache
+        if ((itUs->second.flags & CCoinsCacheEntry::FRESH) &&
+            it->second.coin.IsSpent()) {
+            // The grandparent does not have an entry, and the child is
+            // modified and being pruned. This means we can just delete
+            // it from the parent.
+            cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
+            cacheCoins.erase(itUs);
+        } else {
+            // A normal modification.
+            cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
+            itUs->second.coin = std::move(it->second.coin);
+            cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
+            itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+            // NOTE: It is possible the child has a FRESH flag here in
+            // the event the entry we found in the parent is pruned. But
+            // we must not copy that FRESH flag to the parent as that
+            // pruned state likely still needs to be communicated to the
+            // grandparent.
+        }
+    }
+}
+
 bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
                                  const BlockHash &hashBlockIn) {
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();
@@ -202,58 +263,7 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
         if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
             continue;
         }
-        CCoinsMap::iterator itUs = cacheCoins.find(it->first);
-        if (itUs == cacheCoins.end()) {
-            // The parent cache does not have an entry, while the child does
-            // We can ignore it if it's both FRESH and pruned in the child
-            if (!(it->second.flags & CCoinsCacheEntry::FRESH &&
-                  it->second.coin.IsSpent())) {
-                // Otherwise we will need to create it in the parent and
-                // move the data up and mark it as dirty
-                CCoinsCacheEntry &entry = cacheCoins[it->first];
-                entry.coin = std::move(it->second.coin);
-                cachedCoinsUsage += entry.coin.DynamicMemoryUsage();
-                entry.flags = CCoinsCacheEntry::DIRTY;
-                // We can mark it FRESH in the parent if it was FRESH in the
-                // child. Otherwise it might have just been flushed from the
-                // parent's cache and already exist in the grandparent
-                if (it->second.flags & CCoinsCacheEntry::FRESH) {
-                    entry.flags |= CCoinsCacheEntry::FRESH;
-                }
-            }
-        } else {
-            // Assert that the child cache entry was not marked FRESH if the
-            // parent cache entry has unspent outputs. If this ever happens,
-            // it means the FRESH flag was misapplied and there is a logic
-            // error in the calling code.
-            if ((it->second.flags & CCoinsCacheEntry::FRESH) &&
-                !itUs->second.coin.IsSpent()) {
-                throw std::logic_error("FRESH flag misapplied to cache "
-                                       "entry for base transaction with "
-                                       "spendable outputs");
-            }
-
-            // Found the entry in the parent cache
-            if ((itUs->second.flags & CCoinsCacheEntry::FRESH) &&
-                it->second.coin.IsSpent()) {
-                // The grandparent does not have an entry, and the child is
-                // modified and being pruned. This means we can just delete
-                // it from the parent.
-                cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                cacheCoins.erase(itUs);
-            } else {
-                // A normal modification.
-                cachedCoinsUsage -= itUs->second.coin.DynamicMemoryUsage();
-                itUs->second.coin = std::move(it->second.coin);
-                cachedCoinsUsage += itUs->second.coin.DynamicMemoryUsage();
-                itUs->second.flags |= CCoinsCacheEntry::DIRTY;
-                // NOTE: It is possible the child has a FRESH flag here in
-                // the event the entry we found in the parent is pruned. But
-                // we must not copy that FRESH flag to the parent as that
-                // pruned state likely still needs to be communicated to the
-                // grandparent.
-            }
-        }
+        MergeDirtyCacheEntry(cacheCoins, cachedCoinsUsage, it);
     }
     hashBlock = hashBlockIn;
     return true;
@@ -311,14 +321,199 @@ bool CCoinsViewCache::HaveInputs(const CTransaction &tx) const {
     return true;
 }
 
+CCoinsViewShardedCache::CCoinsViewShardedCache(CCoinsView *baseIn,
+                                               size_t nShards)
+    : CCoinsViewBacked(baseIn) {
+    assert(nShards > 0);
+    shards.reserve(nShards);
+    for (size_t i = 0; i < nShards; i++) {
+        shards.push_back(std::make_unique<Shard>());
+    }
+}
+
+CCoinsMap::iterator
+CCoinsViewShardedCache::FetchCoin(Shard &shard,
+                                  const COutPoint &outpoint) const {
+    CCoinsMap::iterator it = shard.cacheCoins.find(outpoint);
+    if (it != shard.cacheCoins.end()) {
+        return it;
+    }
+    Coin tmp;
+    if (!base->GetCoin(outpoint, tmp)) {
+        return shard.cacheCoins.end();
+    }
+    CCoinsMap::iterator ret =
+        shard.cacheCoins
+            .emplace(std::piecewise_construct, std::forward_as_tuple(outpoint),
+                     std::forward_as_tuple(std::move(tmp)))
+            .first;
+    if (ret->second.coin.IsSpent()) {
+        // The parent only has an empty entry for this outpoint; we can consider
+        // our version as fresh.
+        ret->second.flags = CCoinsCacheEntry::FRESH;
+    }
+    shard.cachedCoinsUsage += ret->second.coin.DynamicMemoryUsage();
+    return ret;
+}
+
+bool CCoinsViewShardedCache::GetCoin(const COutPoint &outpoint,
+                                     Coin &coin) const {
+    Shard &shard = GetShard(outpoint);
+    LOCK(shard.cs);
+    CCoinsMap::const_iterator it = FetchCoin(shard, outpoint);
+    if (it == shard.cacheCoins.end()) {
+        return false;
+    }
+    coin = it->second.coin;
+    return !coin.IsSpent();
+}
+
+bool CCoinsViewShardedCache::HaveCoin(const COutPoint &outpoint) const {
+    Shard &shard = GetShard(outpoint);
+    LOCK(shard.cs);
+    CCoinsMap::const_iterator it = FetchCoin(shard, outpoint);
+    return it != shard.cacheCoins.end() && !it->second.coin.IsSpent();
+}
+
+bool CCoinsViewShardedCache::HaveCoinInCache(const COutPoint &outpoint) const {
+    Shard &shard = GetShard(outpoint);
+    LOCK(shard.cs);
+    CCoinsMap::const_iterator it = shard.cacheCoins.find(outpoint);
+    return it != shard.cacheCoins.end() && !it->second.coin.IsSpent();
+}
+
+void CCoinsViewShardedCache::AddCoin(const COutPoint &outpoint, Coin coin,
+                                     bool possible_overwrite) {
+    assert(!coin.IsSpent());
+    if (coin.GetTxOut().scriptPubKey.IsUnspendable()) {
+        return;
+    }
+    Shard &shard = GetShard(outpoint);
+    LOCK(shard.cs);
+    CCoinsMap::iterator it;
+    bool inserted;
+    std::tie(it, inserted) = shard.cacheCoins.emplace(
+        std::piecewise_construct, std::forward_as_tuple(outpoint),
+        std::tuple<>());
+    bool fresh = false;
+    if (!inserted) {
+        shard.cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+    }
+    if (!possible_overwrite) {
+        if (!it->second.coin.IsSpent()) {
+            throw std::logic_error(
+                "Adding new coin that replaces non-pruned entry");
+        }
+        fresh = !(it->second.flags & CCoinsCacheEntry::DIRTY);
+    }
+    it->second.coin = std::move(coin);
+    it->second.flags |=
+        CCoinsCacheEntry::DIRTY | (fresh ? CCoinsCacheEntry::FRESH : 0);
+    shard.cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+}
+
+bool CCoinsViewShardedCache::SpendCoin(const COutPoint &outpoint,
+                                       Coin *moveout) {
+    Shard &shard = GetShard(outpoint);
+    LOCK(shard.cs);
+    CCoinsMap::iterator it = FetchCoin(shard, outpoint);
+    if (it == shard.cacheCoins.end()) {
+        return false;
+    }
+    shard.cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+    if (moveout) {
+        *moveout = std::move(it->second.coin);
+    }
+    if (it->second.flags & CCoinsCacheEntry::FRESH) {
+        shard.cacheCoins.erase(it);
+    } else {
+        it->second.flags |= CCoinsCacheEntry::DIRTY;
+        it->second.coin.Clear();
+    }
+    return true;
+}
+
+BlockHash CCoinsViewShardedCache::GetBestBlock() const {
+    LOCK(cs_hashBlock);
+    if (hashBlock.IsNull()) {
+        hashBlock = base->GetBestBlock();
+    }
+    return hashBlock;
+}
+
+void CCoinsViewShardedCache::SetBestBlock(const BlockHash &hashBlockIn) {
+    LOCK(cs_hashBlock);
+    hashBlock = hashBlockIn;
+}
+
+bool CCoinsViewShardedCache::BatchWrite(CCoinsMap &mapCoins,
+                                        const BlockHash &hashBlockIn) {
+    boost::unique_lock<boost::shared_mutex> lock(cs_write);
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();
+         it = mapCoins.erase(it)) {
+        // Ignore non-dirty entries (optimization).
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
+            continue;
+        }
+        Shard &shard = GetShard(it->first);
+        LOCK(shard.cs);
+        MergeDirtyCacheEntry(shard.cacheCoins, shard.cachedCoinsUsage, it);
+    }
+    SetBestBlock(hashBlockIn);
+    return true;
+}
+
+bool CCoinsViewShardedCache::Flush() {
+    boost::unique_lock<boost::shared_mutex> lock(cs_write);
+    CCoinsMap mapCoins;
+    for (const auto &shard : shards) {
+        LOCK(shard->cs);
+        for (auto &entry : shard->cacheCoins) {
+            mapCoins.emplace(entry.first, std::move(entry.second));
+        }
+        shard->cacheCoins.clear();
+        shard->cachedCoinsUsage = 0;
+    }
+    return base->BatchWrite(mapCoins, GetBestBlock());
+}
+
+void CCoinsViewShardedCache::Uncache(const COutPoint &outpoint) {
+    Shard &shard = GetShard(outpoint);
+    LOCK(shard.cs);
+    CCoinsMap::iterator it = shard.cacheCoins.find(outpoint);
+    if (it != shard.cacheCoins.end() && it->second.flags == 0) {
+        shard.cachedCoinsUsage -= it->second.coin.DynamicMemoryUsage();
+        shard.cacheCoins.erase(it);
+    }
+}
+
+unsigned int CCoinsViewShardedCache::GetCacheSize() const {
+    unsigned int nSize = 0;
+    for (const auto &shard : shards) {
+        LOCK(shard->cs);
+        nSize += shard->cacheCoins.size();
+    }
+    return nSize;
+}
+
+size_t CCoinsViewShardedCache::DynamicMemoryUsage() const {
+    size_t nUsage = memusage::DynamicUsage(shards);
+    for (const auto &shard : shards) {
+        LOCK(shard->cs);
+        nUsage += sizeof(Shard) + memusage::DynamicUsage(shard->cacheCoins) +
+                  shard->cachedCoinsUsage;
+    }
+    return nUsage;
+}
+
 // TODO: merge with similar definition in undo.h.
 static const size_t MAX_OUTPUTS_PER_TX =
     MAX_TX_SIZE / ::GetSerializeSize(CTxOut(), PROTOCOL_VERSION);
 
-const Coin &AccessByTxid(const CCoinsViewCache &view, const TxId &txid) {
+Coin AccessByTxid(const CCoinsView &view, const TxId &txid) {
+    Coin alternate;
     for (uint32_t n = 0; n < MAX_OUTPUTS_PER_TX; n++) {
-        const Coin &alternate = view.AccessCoin(COutPoint(txid, n));
-        if (!alternate.IsSpent()) {
+        if (view.GetCoin(COutPoint(txid, n), alternate)) {
             return alternate;
         }
     }
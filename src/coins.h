@@ -11,11 +11,17 @@
 #include <crypto/siphash.h>
 #include <memusage.h>
 #include <serialize.h>
+#include <sync.h>
 #include <uint256.h>
 
+#include <boost/thread/locks.hpp>
+#include <boost/thread/shared_mutex.hpp>
+
 #include <cassert>
 #include <cstdint>
+#include <memory>
 #include <unordered_map>
+#include <vector>
 
 /**
  * A UTXO entry.
@@ -184,6 +190,7 @@ public:
     BlockHash GetBestBlock() const override;
     std::vector<BlockHash> GetHeadBlocks() const override;
     void SetBackend(CCoinsView &viewIn);
+    CCoinsView *GetBackend() const { return base; }
     bool BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
     size_t EstimateSize() const override;
@@ -297,6 +304,117 @@ private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
 };
 
+/** Default number of shards of a CCoinsViewShardedCache */
+static const size_t DEFAULT_COINS_CACHE_SHARDS = 16;
+
+/**
+ * CCoinsView that adds a memory cache to another CCoinsView, like
+ * CCoinsViewCache, but split into shards that each have their own lock and
+ * memory accounting, so that it can be used from several threads at once.
+ * Outpoints are assigned to a shard by a SaltedOutpointHasher salted
+ * independently from the one the shard maps use to pick a bucket.
+ *
+ * Unlike CCoinsViewCache, no reference to a cached coin is ever handed out:
+ * coins are copied out under the shard lock. The backing view must support
+ * concurrent reads, which is the case of CCoinsViewDB. Flush() and
+ * BatchWrite() lock every shard and are best called by a single writer.
+ *
+ * Readers which do not hold the lock the writer holds (cs_main for pcoinsTip)
+ * must hold a ReadGuard, so that Flush() and BatchWrite() do not run while
+ * they read.
+ */
+class CCoinsViewShardedCache : public CCoinsViewBacked {
+private:
+    struct Shard {
+        mutable Mutex cs;
+        mutable CCoinsMap cacheCoins GUARDED_BY(cs);
+        /* Cached dynamic memory usage for the inner Coin objects. */
+        mutable size_t cachedCoinsUsage GUARDED_BY(cs) = 0;
+    };
+
+    const SaltedOutpointHasher shardHasher;
+    std::vector<std::unique_ptr<Shard>> shards;
+
+    mutable Mutex cs_hashBlock;
+    mutable BlockHash hashBlock GUARDED_BY(cs_hashBlock);
+
+    /**
+     * Held exclusively by Flush() and BatchWrite(), and shared by ReadGuard.
+     * Without it, a coin read from the base while Flush() is writing to it
+     * could be cached after the flushed entries were dropped, and go stale.
+     */
+    mutable boost::shared_mutex cs_write;
+
+    Shard &GetShard(const COutPoint &outpoint) const {
+        return *shards[shardHasher(outpoint) % shards.size()];
+    }
+
+    /**
+     * Find the entry for outpoint in the shard, fetching it from the backing
+     * view if needed.
+     */
+    CCoinsMap::iterator FetchCoin(Shard &shard, const COutPoint &outpoint) const
+        EXCLUSIVE_LOCKS_REQUIRED(shard.cs);
+
+public:
+    explicit CCoinsViewShardedCache(
+        CCoinsView *baseIn, size_t nShards = DEFAULT_COINS_CACHE_SHARDS);
+
+    CCoinsViewShardedCache(const CCoinsViewShardedCache &) = delete;
+
+    /**
+     * Keep the cache from being written to while held, so that the coins and
+     * best block read under it are consistent with each other.
+     */
+    class ReadGuard {
+    private:
+        boost::shared_lock<boost::shared_mutex> lock;
+
+    public:
+        explicit ReadGuard(const CCoinsViewShardedCache &cache)
+            : lock(cache.cs_write) {}
+    };
+
+    // Standard CCoinsView methods
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    BlockHash GetBestBlock() const override;
+    void SetBestBlock(const BlockHash &hashBlock);
+    bool BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) override;
+    CCoinsViewCursor *Cursor() const override {
+        throw std::logic_error(
+            "CCoinsViewShardedCache cursor iteration not supported.");
+    }
+
+    //! Same as CCoinsViewCache::HaveCoinInCache.
+    bool HaveCoinInCache(const COutPoint &outpoint) const;
+
+    //! Same as CCoinsViewCache::AddCoin.
+    void AddCoin(const COutPoint &outpoint, Coin coin,
+                 bool potential_overwrite);
+
+    //! Same as CCoinsViewCache::SpendCoin.
+    bool SpendCoin(const COutPoint &outpoint, Coin *moveto = nullptr);
+
+    /**
+     * Push the modifications applied to all shards to the base, in a single
+     * batch.
+     */
+    bool Flush();
+
+    //! Same as CCoinsViewCache::Uncache.
+    void Uncache(const COutPoint &outpoint);
+
+    //! Number of shards the cache is split into.
+    size_t GetShardCount() const { return shards.size(); }
+
+    //! Calculate the size of the cache (in number of transaction outputs)
+    unsigned int GetCacheSize() const;
+
+    //! Calculate the size of the cache (in bytes)
+    size_t DynamicMemoryUsage() const;
+};
+
 //! Utility function to add all of a transaction's outputs to a cache.
 // When check is false, this assumes that overwrites are only possible for
 // coinbase transactions.
@@ -311,6 +429,6 @@ void AddCoins(CCoinsViewCache &cache, const CTransaction &tx, int nHeight,
 // This function can be quite expensive because in the event of a transaction
 // which is not found in the cache, it can cause up to MAX_OUTPUTS_PER_BLOCK
 // lookups to database, so it should be used with care.
-const Coin &AccessByTxid(const CCoinsViewCache &cache, const TxId &txid);
+Coin AccessByTxid(const CCoinsView &view, const TxId &txid);
 
 #endif // BITCOIN_COINS_H
@@ -47,6 +47,16 @@
 #include <unistd.h>
 #endif
 
+#if HAVE_DECL_POLL
+#include <poll.h>
+#define USE_POLL
+#endif
+
+#if HAVE_DECL_EPOLL_CREATE1
+#include <sys/epoll.h>
+#define USE_EPOLL
+#endif
+
 #ifndef WIN32
 typedef unsigned int SOCKET;
 #include <cerrno>
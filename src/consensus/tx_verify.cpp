@@ -163,29 +163,53 @@ uint64_t GetSigOpCountWithoutP2SH(const CTransaction &tx, uint32_t flags) {
     return nSigOps;
 }
 
-uint64_t GetP2SHSigOpCount(const CTransaction &tx, const CCoinsViewCache &view,
-                           uint32_t flags) {
+template <typename GetPrevOut>
+static uint64_t GetP2SHSigOpCountImpl(const CTransaction &tx, uint32_t flags,
+                                      GetPrevOut getPrevOut) {
     if ((flags & SCRIPT_VERIFY_P2SH) == 0 || tx.IsCoinBase()) {
         return 0;
     }
 
     uint64_t nSigOps = 0;
-    for (auto &i : tx.vin) {
-        const CTxOut &prevout = view.GetOutputFor(i);
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        const CTxOut &prevout = getPrevOut(i);
         if (prevout.scriptPubKey.IsPayToScriptHash()) {
-            nSigOps += prevout.scriptPubKey.GetSigOpCount(flags, i.scriptSig);
+            nSigOps +=
+                prevout.scriptPubKey.GetSigOpCount(flags, tx.vin[i].scriptSig);
         }
     }
 
     return nSigOps;
 }
 
+uint64_t GetP2SHSigOpCount(const CTransaction &tx, const CCoinsViewCache &view,
+                           uint32_t flags) {
+    return GetP2SHSigOpCountImpl(tx, flags, [&](size_t i) -> const CTxOut & {
+        return view.GetOutputFor(tx.vin[i]);
+    });
+}
+
+uint64_t GetP2SHSigOpCount(const CTransaction &tx,
+                           const std::vector<Coin> &spentCoins,
+                           uint32_t flags) {
+    return GetP2SHSigOpCountImpl(tx, flags, [&](size_t i) -> const CTxOut & {
+        return spentCoins[i].GetTxOut();
+    });
+}
+
 uint64_t GetTransactionSigOpCount(const CTransaction &tx,
                                   const CCoinsViewCache &view, uint32_t flags) {
     return GetSigOpCountWithoutP2SH(tx, flags) +
            GetP2SHSigOpCount(tx, view, flags);
 }
 
+uint64_t GetTransactionSigOpCount(const CTransaction &tx,
+                                  const std::vector<Coin> &spentCoins,
+                                  uint32_t flags) {
+    return GetSigOpCountWithoutP2SH(tx, flags) +
+           GetP2SHSigOpCount(tx, spentCoins, flags);
+}
+
 static bool CheckTransactionCommon(const CTransaction &tx,
                                    CValidationState &state) {
     // Basic checks that don't depend on any context
@@ -271,20 +295,13 @@ bool CheckRegularTransaction(const CTransaction &tx, CValidationState &state) {
 }
 
 namespace Consensus {
-bool CheckTxInputs(const CTransaction &tx, CValidationState &state,
-                   const CCoinsViewCache &inputs, int nSpendHeight,
-                   Amount &txfee) {
-    // are the actual inputs available?
-    if (!inputs.HaveInputs(tx)) {
-        return state.DoS(100, false, REJECT_INVALID,
-                         "bad-txns-inputs-missingorspent", false,
-                         strprintf("%s: inputs missing/spent", __func__));
-    }
-
+template <typename GetCoin>
+static bool CheckTxInputAmounts(const CTransaction &tx,
+                                CValidationState &state, int nSpendHeight,
+                                Amount &txfee, GetCoin getCoin) {
     Amount nValueIn = Amount::zero();
-    for (const auto &in : tx.vin) {
-        const COutPoint &prevout = in.prevout;
-        const Coin &coin = inputs.AccessCoin(prevout);
+    for (size_t i = 0; i < tx.vin.size(); i++) {
+        const Coin &coin = getCoin(i);
         assert(!coin.IsSpent());
 
         // If prev is coinbase, check that it's matured
@@ -323,4 +340,30 @@ bool CheckTxInputs(const CTransaction &tx, CValidationState &state,
     txfee = txfee_aux;
     return true;
 }
+
+bool CheckTxInputs(const CTransaction &tx, CValidationState &state,
+                   const CCoinsViewCache &inputs, int nSpendHeight,
+                   Amount &txfee) {
+    // are the actual inputs available?
+    if (!inputs.HaveInputs(tx)) {
+        return state.DoS(100, false, REJECT_INVALID,
+                         "bad-txns-inputs-missingorspent", false,
+                         strprintf("%s: inputs missing/spent", __func__));
+    }
+
+    return CheckTxInputAmounts(
+        tx, state, nSpendHeight, txfee,
+        [&](size_t i) -> const Coin & {
+            return inputs.AccessCoin(tx.vin[i].prevout);
+        });
+}
+
+bool CheckTxInputs(const CTransaction &tx, CValidationState &state,
+                   const std::vector<Coin> &spentCoins, int nSpendHeight,
+                   Amount &txfee) {
+    assert(spentCoins.size() == tx.vin.size());
+    return CheckTxInputAmounts(
+        tx, state, nSpendHeight, txfee,
+        [&](size_t i) -> const Coin & { return spentCoins[i]; });
+}
 } // namespace Consensus
@@ -11,6 +11,7 @@
 struct Amount;
 class CBlockIndex;
 class CCoinsViewCache;
+class Coin;
 class CTransaction;
 class CValidationState;
 
@@ -35,6 +36,17 @@ bool CheckTxInputs(const CTransaction &tx, CValidationState &state,
                    const CCoinsViewCache &inputs, int nSpendHeight,
                    Amount &txfee);
 
+/**
+ * Same as above, but using the coins spent by this transaction, in input order,
+ * instead of a view. This is used when the inputs have already been removed
+ * from the UTXO set, for instance from the transaction's undo data.
+ * Preconditions: tx.IsCoinBase() is false and spentCoins.size() matches the
+ * number of inputs.
+ */
+bool CheckTxInputs(const CTransaction &tx, CValidationState &state,
+                   const std::vector<Coin> &spentCoins, int nSpendHeight,
+                   Amount &txfee);
+
 } // namespace Consensus
 
 /**
@@ -88,6 +100,8 @@ uint64_t GetSigOpCountWithoutP2SH(const CTransaction &tx, uint32_t flags);
  */
 uint64_t GetP2SHSigOpCount(const CTransaction &tx,
                            const CCoinsViewCache &mapInputs, uint32_t flags);
+uint64_t GetP2SHSigOpCount(const CTransaction &tx,
+                           const std::vector<Coin> &spentCoins, uint32_t flags);
 
 /**
  * Compute total signature operation of a transaction.
@@ -100,5 +114,8 @@ uint64_t GetP2SHSigOpCount(const CTransaction &tx,
 uint64_t GetTransactionSigOpCount(const CTransaction &tx,
                                   const CCoinsViewCache &inputs,
                                   uint32_t flags);
+uint64_t GetTransactionSigOpCount(const CTransaction &tx,
+                                  const std::vector<Coin> &spentCoins,
+                                  uint32_t flags);
 
 #endif // BITCOIN_CONSENSUS_TX_VERIFY_H
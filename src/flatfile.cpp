@@ -3,11 +3,16 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include <compat.h>
 #include <flatfile.h>
 #include <logging.h>
 #include <tinyformat.h>
 #include <util/system.h>
 
+#ifndef WIN32
+#include <sys/stat.h>
+#endif
+
 #include <stdexcept>
 
 FlatFileSeq::FlatFileSeq(fs::path dir, const char *prefix, size_t chunk_size)
@@ -94,3 +99,120 @@ bool FlatFileSeq::Flush(const FlatFilePos &pos, bool finalize) {
     fclose(file);
     return true;
 }
+
+MappedFlatFile::~MappedFlatFile() {
+#ifndef WIN32
+    munmap(const_cast<uint8_t *>(m_data), m_size);
+#endif
+}
+
+bool MappedFlatFile::IsSupported() {
+#ifndef WIN32
+    return sizeof(void *) >= 8;
+#else
+    return false;
+#endif
+}
+
+std::shared_ptr<const MappedFlatFile>
+MappedFlatFile::Open(const fs::path &path) {
+#ifndef WIN32
+    if (!IsSupported()) {
+        return nullptr;
+    }
+
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1) {
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    const size_t size = st.st_size;
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid once the descriptor is closed.
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+
+    return std::shared_ptr<const MappedFlatFile>(
+        new MappedFlatFile(static_cast<const uint8_t *>(addr), size));
+#else
+    return nullptr;
+#endif
+}
+
+std::shared_ptr<const MappedFlatFile>
+FlatFileMapCache::Get(const FlatFileSeq &seq, int file_num, size_t min_size) {
+    if (!MappedFlatFile::IsSupported()) {
+        return nullptr;
+    }
+
+    LOCK(m_mutex);
+    if (m_unmapped_files.count(file_num)) {
+        return nullptr;
+    }
+
+    for (auto it = m_files.begin(); it != m_files.end(); ++it) {
+        if (it->first != file_num) {
+            continue;
+        }
+        if (it->second->size() >= min_size) {
+            m_files.splice(m_files.begin(), m_files, it);
+            return it->second;
+        }
+        // The file grew since it was mapped, map it again. Readers still
+        // holding the previous mapping keep it alive.
+        m_mapped_bytes -= it->second->size();
+        m_files.erase(it);
+        break;
+    }
+
+    const fs::path path = seq.FileName(FlatFilePos(file_num, 0));
+    std::shared_ptr<const MappedFlatFile> file = MappedFlatFile::Open(path);
+    if (!file) {
+        // Missing and empty files may be mapped later. Others are read from
+        // instead, without trying to map them, and logging, on every read.
+        boost::system::error_code ec;
+        if (fs::file_size(path, ec) > 0 && !ec) {
+            LogPrintf("Unable to map file %s\n", path.string());
+            m_unmapped_files.insert(file_num);
+        }
+        return nullptr;
+    }
+    if (file->size() < min_size || file->size() > m_max_bytes) {
+        return nullptr;
+    }
+
+    m_files.emplace_front(file_num, file);
+    m_mapped_bytes += file->size();
+    while (m_files.size() > m_max_files || m_mapped_bytes > m_max_bytes) {
+        m_mapped_bytes -= m_files.back().second->size();
+        m_files.pop_back();
+    }
+    return file;
+}
+
+void FlatFileMapCache::Erase(int file_num) {
+    LOCK(m_mutex);
+    m_unmapped_files.erase(file_num);
+    for (auto it = m_files.begin(); it != m_files.end(); ++it) {
+        if (it->first == file_num) {
+            m_mapped_bytes -= it->second->size();
+            m_files.erase(it);
+            return;
+        }
+    }
+}
+
+void FlatFileMapCache::Clear() {
+    LOCK(m_mutex);
+    m_files.clear();
+    m_mapped_bytes = 0;
+    m_unmapped_files.clear();
+}
@@ -8,8 +8,15 @@
 
 #include <fs.h>
 #include <serialize.h>
+#include <span.h>
+#include <sync.h>
 
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <set>
 #include <string>
+#include <utility>
 
 struct FlatFilePos {
     int nFile;
@@ -97,4 +104,83 @@ public:
     bool Flush(const FlatFilePos &pos, bool finalize = false);
 };
 
+/**
+ * A read-only memory mapping of a whole flat file. Reading through it avoids
+ * opening and seeking the file, and copying its data out of the page cache, for
+ * every read. The mapping is released when the last reference is dropped.
+ *
+ * An I/O error while reading a mapping raises SIGBUS instead of failing the
+ * read, so the files are only mapped on 64 bits platforms, and the amount of
+ * mapped data is bounded by FlatFileMapCache.
+ */
+class MappedFlatFile {
+private:
+    const uint8_t *const m_data;
+    const size_t m_size;
+
+    MappedFlatFile(const uint8_t *data, size_t size)
+        : m_data(data), m_size(size) {}
+
+public:
+    ~MappedFlatFile();
+
+    MappedFlatFile(const MappedFlatFile &) = delete;
+    MappedFlatFile &operator=(const MappedFlatFile &) = delete;
+
+    /**
+     * Whether files are mapped on this platform. They are not on Windows, nor
+     * on 32 bits platforms whose address space is too small for them.
+     */
+    static bool IsSupported();
+
+    /**
+     * Map the file at the given path. Returns nullptr if the file cannot be
+     * mapped, or if memory mapping is not supported on this platform.
+     */
+    static std::shared_ptr<const MappedFlatFile> Open(const fs::path &path);
+
+    const uint8_t *data() const { return m_data; }
+    size_t size() const { return m_size; }
+};
+
+/**
+ * A small least recently used cache of the mappings of the files of a
+ * FlatFileSeq, bounded in number of files and in mapped bytes.
+ */
+class FlatFileMapCache {
+private:
+    const size_t m_max_files;
+    const size_t m_max_bytes;
+
+    Mutex m_mutex;
+    //! Mapped files by file number, most recently used first.
+    std::list<std::pair<int, std::shared_ptr<const MappedFlatFile>>>
+        m_files GUARDED_BY(m_mutex);
+    //! Total size of the mappings in m_files.
+    size_t m_mapped_bytes GUARDED_BY(m_mutex){0};
+    //! Files which could not be mapped, and are read from instead.
+    std::set<int> m_unmapped_files GUARDED_BY(m_mutex);
+
+public:
+    FlatFileMapCache(size_t max_files, size_t max_bytes)
+        : m_max_files(max_files), m_max_bytes(max_bytes) {}
+
+    /**
+     * Get a mapping of a file of the sequence which is at least min_size
+     * bytes long. The file is mapped again if it grew past the end of its
+     * cached mapping.
+     *
+     * @return The mapping, or nullptr if the file is not that long or cannot
+     * be mapped.
+     */
+    std::shared_ptr<const MappedFlatFile> Get(const FlatFileSeq &seq,
+                                              int file_num, size_t min_size);
+
+    /** Drop the mapping of a file, before it is deleted or replaced. */
+    void Erase(int file_num);
+
+    /** Drop all the mappings. */
+    void Clear();
+};
+
 #endif // BITCOIN_FLATFILE_H
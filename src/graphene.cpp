@@ -0,0 +1,266 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <graphene.h>
+
+#include <config.h>
+#include <consensus/consensus.h>
+#include <consensus/merkle.h>
+#include <crypto/sha256.h>
+#include <crypto/siphash.h>
+#include <random.h>
+#include <streams.h>
+#include <txmempool.h>
+#include <validation.h>
+#include <version.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <limits>
+#include <unordered_map>
+
+//! Number of differences every IBLT is sized for on top of the expected ones.
+static const size_t MIN_IBLT_ENTRIES = 8;
+//! Cells per listable difference. Tables with fewer cells per entry than this
+//! often cannot be listed.
+static const double IBLT_CELLS_PER_ENTRY = 1.5;
+//! Serialized size of an IBLT cell.
+static const size_t IBLT_CELL_SIZE = 16;
+
+//! SipHash keys of the IBLT cell hashes, the last one hashes the check sums.
+static const uint64_t IBLT_HASH_KEY = 0x69626c7468617368ULL;
+
+CIblt::CIblt(size_t nEntries) {
+    const size_t nPartitionCells =
+        size_t(std::ceil(nEntries * IBLT_CELLS_PER_ENTRY / HASH_FUNCS)) + 1;
+    cells.resize(nPartitionCells * HASH_FUNCS, Cell{0, 0, 0});
+}
+
+size_t CIblt::GetCellIndex(uint32_t nHashNum, uint64_t key) const {
+    const size_t nPartitionCells = cells.size() / HASH_FUNCS;
+    return nHashNum * nPartitionCells +
+           CSipHasher(IBLT_HASH_KEY, nHashNum).Write(key).Finalize() %
+               nPartitionCells;
+}
+
+static uint32_t GetCheckSum(uint64_t key) {
+    return CSipHasher(IBLT_HASH_KEY, CIblt::HASH_FUNCS).Write(key).Finalize();
+}
+
+void CIblt::Update(uint64_t key, int32_t count) {
+    assert(IsValid());
+    const uint32_t checkSum = GetCheckSum(key);
+    for (uint32_t i = 0; i < HASH_FUNCS; i++) {
+        Cell &cell = cells[GetCellIndex(i, key)];
+        cell.count += count;
+        cell.keySum ^= key;
+        cell.checkSum ^= checkSum;
+    }
+}
+
+bool CIblt::ListEntries(std::set<uint64_t> &positive,
+                        std::set<uint64_t> &negative) const {
+    CIblt table(*this);
+    // Peel the cells holding a single key, until none is left. Removing a key
+    // may leave a single key in the other cells it was added to.
+    std::vector<size_t> toCheck(cells.size());
+    for (size_t i = 0; i < toCheck.size(); i++) {
+        toCheck[i] = i;
+    }
+    while (!toCheck.empty()) {
+        const Cell &cell = table.cells[toCheck.back()];
+        toCheck.pop_back();
+        if ((cell.count != 1 && cell.count != -1) ||
+            cell.checkSum != GetCheckSum(cell.keySum)) {
+            continue;
+        }
+
+        const uint64_t key = cell.keySum;
+        const int32_t count = cell.count;
+        // A key can only be listed once, and a table cannot hold more keys
+        // than it has cells.
+        if (positive.count(key) || negative.count(key) ||
+            positive.size() + negative.size() >= cells.size()) {
+            return false;
+        }
+        (count > 0 ? positive : negative).insert(key);
+        table.Update(key, -count);
+        for (uint32_t i = 0; i < HASH_FUNCS; i++) {
+            toCheck.push_back(table.GetCellIndex(i, key));
+        }
+    }
+
+    return std::all_of(table.cells.begin(), table.cells.end(),
+                       [](const Cell &cell) {
+                           return cell.count == 0 && cell.keySum == 0 &&
+                                  cell.checkSum == 0;
+                       });
+}
+
+CGrapheneFilter::CGrapheneFilter(size_t nElements, double fpRate) {
+    const double ln2 = std::log(2.0);
+    const double nBits =
+        std::max(8.0, std::ceil(-double(nElements) * std::log(fpRate) /
+                                (ln2 * ln2)));
+    vData.resize(size_t(nBits + 7) / 8);
+    const double nFuncs =
+        nElements == 0 ? 1 : std::round(vData.size() * 8 * ln2 / nElements);
+    nHashFuncs = std::max<double>(1, std::min<double>(MAX_HASH_FUNCS, nFuncs));
+}
+
+size_t CGrapheneFilter::GetBitIndex(uint8_t nHashNum, uint64_t shortid) const {
+    // Double hashing from the two halves of the short id.
+    const uint32_t h1 = shortid;
+    const uint32_t h2 = (shortid >> 32) | 1;
+    return (h1 + uint64_t(nHashNum) * h2) % (vData.size() * 8);
+}
+
+void CGrapheneFilter::Insert(uint64_t shortid) {
+    for (uint8_t i = 0; i < nHashFuncs; i++) {
+        const size_t nIndex = GetBitIndex(i, shortid);
+        vData[nIndex >> 3] |= 1 << (nIndex & 7);
+    }
+}
+
+bool CGrapheneFilter::Contains(uint64_t shortid) const {
+    for (uint8_t i = 0; i < nHashFuncs; i++) {
+        const size_t nIndex = GetBitIndex(i, shortid);
+        if (!(vData[nIndex >> 3] & (1 << (nIndex & 7)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * Number of differences to size an IBLT for, when nExpected are expected on
+ * average.
+ */
+static size_t GetIbltEntries(double nExpected) {
+    return size_t(nExpected + 3 * std::sqrt(nExpected)) + MIN_IBLT_ENTRIES;
+}
+
+CGrapheneBlock::CGrapheneBlock(const CBlock &block, uint64_t nReceiverPoolTxs)
+    : nonce(GetRand(std::numeric_limits<uint64_t>::max())), header(block),
+      nTxs(block.vtx.size() - 1), coinbase(block.vtx[0]) {
+    FillShortTxIDSelector();
+
+    // The receiver mempool transactions that are not in the block, assuming
+    // it has all of the block transactions.
+    const double nOtherTxs =
+        nReceiverPoolTxs > nTxs ? double(nReceiverPoolTxs - nTxs) : 0;
+
+    // Pick the number of false positives to expect from the filter, which
+    // the IBLT must list, so that the filter and IBLT are the smallest.
+    // Without a filter, all the other transactions are false positives.
+    const double ln2 = std::log(2.0);
+    double nBestFalsePositives = nOtherTxs;
+    double nBestSize = GetIbltEntries(nOtherTxs) * IBLT_CELLS_PER_ENTRY *
+                       IBLT_CELL_SIZE;
+    for (double a = 1; a < nOtherTxs; a = std::max(a + 1, a * 1.05)) {
+        const double nFilterSize =
+            nTxs * std::log(nOtherTxs / a) / (ln2 * ln2) / 8;
+        const double nSize =
+            nFilterSize +
+            GetIbltEntries(a) * IBLT_CELLS_PER_ENTRY * IBLT_CELL_SIZE;
+        if (nSize < nBestSize) {
+            nBestFalsePositives = a;
+            nBestSize = nSize;
+        }
+    }
+
+    if (nBestFalsePositives < nOtherTxs) {
+        filter = CGrapheneFilter(nTxs, nBestFalsePositives / nOtherTxs);
+    }
+    iblt = CIblt(GetIbltEntries(nBestFalsePositives));
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const uint64_t shortid = GetShortID(block.vtx[i]->GetHash());
+        filter.Insert(shortid);
+        iblt.Insert(shortid);
+    }
+}
+
+void CGrapheneBlock::FillShortTxIDSelector() const {
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << header << nonce;
+    CSHA256 hasher;
+    hasher.Write((uint8_t *)&(*stream.begin()), stream.end() - stream.begin());
+    uint256 shorttxidhash;
+    hasher.Finalize(shorttxidhash.begin());
+    shorttxidk0 = shorttxidhash.GetUint64(0);
+    shorttxidk1 = shorttxidhash.GetUint64(1);
+}
+
+uint64_t CGrapheneBlock::GetShortID(const TxHash &txhash) const {
+    return SipHashUint256(shorttxidk0, shorttxidk1, txhash);
+}
+
+ReadStatus DecodeGrapheneBlock(const Config &config,
+                               const CGrapheneBlock &grblk,
+                               const CTxMemPool &pool, CBlock &block) {
+    const uint64_t nMaxTxs = config.GetMaxBlockSize() / MIN_TRANSACTION_SIZE;
+    if (grblk.header.IsNull() || grblk.nTxs >= nMaxTxs || !grblk.coinbase ||
+        !grblk.coinbase->IsCoinBase()) {
+        return READ_STATUS_INVALID;
+    }
+    if (!grblk.filter.IsValid() || grblk.filter.Size() > 8 * nMaxTxs ||
+        !grblk.iblt.IsValid() || grblk.iblt.CellCount() > 2 * nMaxTxs) {
+        return READ_STATUS_INVALID;
+    }
+
+    // Remove the short ids of the mempool transactions matching the filter
+    // from the IBLT of the block, which leaves the block transactions missing
+    // from the mempool and the filter false positives.
+    std::unordered_map<uint64_t, CTransactionRef> candidates;
+    CIblt iblt(grblk.iblt);
+    {
+        LOCK(pool.cs);
+        for (const auto &txHash : pool.vTxHashes) {
+            const uint64_t shortid = grblk.GetShortID(txHash.first);
+            if (!grblk.filter.Contains(shortid)) {
+                continue;
+            }
+            if (!candidates.emplace(shortid, txHash.second->GetSharedTx())
+                     .second) {
+                // Short id collision, the transactions cannot be told apart.
+                return READ_STATUS_FAILED;
+            }
+            iblt.Erase(shortid);
+        }
+    }
+
+    std::set<uint64_t> missing, falsePositives;
+    if (!iblt.ListEntries(missing, falsePositives) || !missing.empty()) {
+        return READ_STATUS_FAILED;
+    }
+    for (const uint64_t shortid : falsePositives) {
+        if (candidates.erase(shortid) == 0) {
+            return READ_STATUS_FAILED;
+        }
+    }
+    if (candidates.size() != grblk.nTxs) {
+        return READ_STATUS_FAILED;
+    }
+
+    block = grblk.header;
+    block.vtx.reserve(grblk.nTxs + 1);
+    block.vtx.push_back(grblk.coinbase);
+    for (const auto &candidate : candidates) {
+        block.vtx.push_back(candidate.second);
+    }
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+
+    // The block may not be in canonical order, or short ids may have
+    // collided with transactions that are not in the mempool.
+    bool mutated;
+    if (BlockMerkleRoot(block, &mutated) != block.hashMerkleRoot || mutated) {
+        return READ_STATUS_FAILED;
+    }
+
+    return READ_STATUS_OK;
+}
@@ -0,0 +1,189 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_GRAPHENE_H
+#define BITCOIN_GRAPHENE_H
+
+#include <blockencodings.h>
+#include <primitives/block.h>
+#include <serialize.h>
+
+#include <cstdint>
+#include <set>
+#include <vector>
+
+class Config;
+class CTxMemPool;
+
+/**
+ * Invertible Bloom Lookup Table of 64 bits keys. Erasing the keys of a set
+ * from the table of another set leaves their symmetric difference, which can
+ * be listed back as long as it is small enough for the table.
+ */
+class CIblt {
+public:
+    //! Number of cells each key is added to, one in each partition.
+    static const uint32_t HASH_FUNCS = 4;
+
+    struct Cell {
+        int32_t count;
+        uint64_t keySum;
+        uint32_t checkSum;
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream &s, Operation ser_action) {
+            READWRITE(count);
+            READWRITE(keySum);
+            READWRITE(checkSum);
+        }
+    };
+
+    CIblt() {}
+    //! A table from which differences of up to nEntries keys can be listed.
+    explicit CIblt(size_t nEntries);
+
+    void Insert(uint64_t key) { Update(key, 1); }
+    void Erase(uint64_t key) { Update(key, -1); }
+
+    /**
+     * List the keys inserted more than erased, and the ones erased more than
+     * inserted. Returns false if the table holds too many keys to list them.
+     */
+    bool ListEntries(std::set<uint64_t> &positive,
+                     std::set<uint64_t> &negative) const;
+
+    size_t CellCount() const { return cells.size(); }
+    bool IsValid() const {
+        return !cells.empty() && cells.size() % HASH_FUNCS == 0;
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(cells);
+    }
+
+private:
+    std::vector<Cell> cells;
+
+    void Update(uint64_t key, int32_t count);
+    size_t GetCellIndex(uint32_t nHashNum, uint64_t key) const;
+};
+
+/**
+ * Bloom filter of the short transaction ids of a graphene block, which the
+ * receiver runs its mempool through. Short ids are already uniformly
+ * distributed, so they are used directly as the filter hash.
+ */
+class CGrapheneFilter {
+public:
+    //! Limit on the number of hash functions of a filter.
+    static const uint8_t MAX_HASH_FUNCS = 32;
+
+    //! A filter matching everything.
+    CGrapheneFilter() : nHashFuncs(0) {}
+    CGrapheneFilter(size_t nElements, double fpRate);
+
+    void Insert(uint64_t shortid);
+    bool Contains(uint64_t shortid) const;
+
+    size_t Size() const { return vData.size(); }
+    bool IsValid() const {
+        return nHashFuncs <= MAX_HASH_FUNCS &&
+               (nHashFuncs == 0) == vData.empty();
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(nHashFuncs);
+        READWRITE(vData);
+    }
+
+private:
+    uint8_t nHashFuncs;
+    std::vector<uint8_t> vData;
+
+    size_t GetBitIndex(uint8_t nHashNum, uint64_t shortid) const;
+};
+
+class GrapheneBlockRequest {
+public:
+    // A "getgrblk" message
+    BlockHash blockhash;
+    //! Number of transactions in the mempool of the requesting node.
+    uint64_t nMempoolTxs;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(blockhash);
+        READWRITE(nMempoolTxs);
+    }
+};
+
+/**
+ * A block encoded against the mempool of its receiver: the receiver selects
+ * the mempool transactions matching a bloom filter of the block, and the
+ * IBLT of the block short ids tells apart the filter false positives. The
+ * transactions are then ordered by txid, as blocks are since CTOR, so their
+ * order is not sent.
+ */
+class CGrapheneBlock {
+private:
+    mutable uint64_t shorttxidk0, shorttxidk1;
+    uint64_t nonce;
+
+    void FillShortTxIDSelector() const;
+
+public:
+    CBlockHeader header;
+    //! Number of transactions in the block, excluding the coinbase.
+    uint32_t nTxs;
+    CTransactionRef coinbase;
+    CGrapheneFilter filter;
+    CIblt iblt;
+
+    // Dummy for deserialization
+    CGrapheneBlock() {}
+
+    //! Encode the block for a receiver with nReceiverPoolTxs transactions in
+    //! its mempool.
+    CGrapheneBlock(const CBlock &block, uint64_t nReceiverPoolTxs);
+
+    uint64_t GetShortID(const TxHash &txhash) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(header);
+        READWRITE(nonce);
+        READWRITE(nTxs);
+        READWRITE(TransactionCompressor(coinbase));
+        READWRITE(filter);
+        READWRITE(iblt);
+
+        if (ser_action.ForRead()) {
+            FillShortTxIDSelector();
+        }
+    }
+};
+
+/**
+ * Rebuild a graphene block from the transactions of the mempool. Returns
+ * READ_STATUS_FAILED if some of the transactions are missing from the mempool
+ * or cannot be identified, in which case the block must be downloaded some
+ * other way.
+ */
+ReadStatus DecodeGrapheneBlock(const Config &config,
+                               const CGrapheneBlock &grblk,
+                               const CTxMemPool &pool, CBlock &block);
+
+#endif // BITCOIN_GRAPHENE_H
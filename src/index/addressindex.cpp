@@ -0,0 +1,358 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/addressindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <config.h>
+#include <crypto/sha256.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores two kinds of entries per output paid to a
+ * spendable script:
+ *
+ * - [DB_ADDRESS_OUTPUT, script hash, height (BE), txid, n (BE)] maps to the
+ *   value of the output and the input spending it, if any. Keys are ordered
+ *   by height so that the history of a script is listed in chain order.
+ * - [DB_ADDRESS_UNSPENT, script hash, txid, n (BE)] maps to the height and
+ *   value of the output while it is unspent.
+ *
+ * Entries written for blocks that get disconnected are reverted by Rewind(),
+ * using the block and its undo data.
+ */
+constexpr char DB_ADDRESS_OUTPUT = 'a';
+constexpr char DB_ADDRESS_UNSPENT = 'u';
+
+std::unique_ptr<AddressIndex> g_addressindex;
+
+uint256 GetScriptHash(const CScript &script) {
+    uint256 hash;
+    CSHA256().Write(script.data(), script.size()).Finalize(hash.begin());
+    return hash;
+}
+
+namespace {
+
+struct DBOutputKey {
+    uint256 script_hash;
+    int height;
+    COutPoint outpoint;
+
+    DBOutputKey() : height(0) {}
+    DBOutputKey(const uint256 &script_hash_in, int height_in,
+                const COutPoint &outpoint_in)
+        : script_hash(script_hash_in), height(height_in),
+          outpoint(outpoint_in) {}
+
+    template <typename Stream> void Serialize(Stream &s) const {
+        ser_writedata8(s, DB_ADDRESS_OUTPUT);
+        s << script_hash;
+        ser_writedata32be(s, height);
+        s << outpoint.GetTxId();
+        ser_writedata32be(s, outpoint.GetN());
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_ADDRESS_OUTPUT) {
+            throw std::ios_base::failure(
+                "Invalid format for address index output key");
+        }
+        TxId txid;
+        s >> script_hash;
+        height = ser_readdata32be(s);
+        s >> txid;
+        outpoint = COutPoint(txid, ser_readdata32be(s));
+    }
+};
+
+struct DBOutputValue {
+    Amount value;
+    TxId spent_txid;
+    uint32_t spent_index;
+    int spent_height;
+
+    DBOutputValue()
+        : value(Amount::zero()), spent_index(0), spent_height(-1) {}
+    explicit DBOutputValue(const Amount value_in)
+        : value(value_in), spent_index(0), spent_height(-1) {}
+    DBOutputValue(const Amount value_in, const TxId &spent_txid_in,
+                  uint32_t spent_index_in, int spent_height_in)
+        : value(value_in), spent_txid(spent_txid_in),
+          spent_index(spent_index_in), spent_height(spent_height_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(value);
+        READWRITE(spent_txid);
+        READWRITE(spent_index);
+        READWRITE(spent_height);
+    }
+};
+
+struct DBUnspentKey {
+    uint256 script_hash;
+    COutPoint outpoint;
+
+    DBUnspentKey() {}
+    DBUnspentKey(const uint256 &script_hash_in, const COutPoint &outpoint_in)
+        : script_hash(script_hash_in), outpoint(outpoint_in) {}
+
+    template <typename Stream> void Serialize(Stream &s) const {
+        ser_writedata8(s, DB_ADDRESS_UNSPENT);
+        s << script_hash << outpoint.GetTxId();
+        ser_writedata32be(s, outpoint.GetN());
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        char prefix = ser_readdata8(s);
+        if (prefix != DB_ADDRESS_UNSPENT) {
+            throw std::ios_base::failure(
+                "Invalid format for address index unspent key");
+        }
+        TxId txid;
+        s >> script_hash >> txid;
+        outpoint = COutPoint(txid, ser_readdata32be(s));
+    }
+};
+
+struct DBUnspentValue {
+    int height;
+    Amount value;
+
+    DBUnspentValue() : height(0), value(Amount::zero()) {}
+    DBUnspentValue(int height_in, const Amount value_in)
+        : height(height_in), value(value_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(height);
+        READWRITE(value);
+    }
+};
+
+} // namespace
+
+/**
+ * Access to the address index database (indexes/addressindex/)
+ */
+class AddressIndex::DB : public BaseIndex::DB {
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false,
+                bool f_wipe = false);
+
+    /// Iterate over the entries of the given kind for a script hash, in key
+    /// order. Returns false if an entry could not be read.
+    template <typename Key, typename Value, typename Callback>
+    bool ForEachEntry(const Key &start_key, Callback fn);
+};
+
+AddressIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : BaseIndex::DB(GetDataDir() / "indexes" / "addressindex", n_cache_size,
+                    f_memory, f_wipe) {}
+
+template <typename Key, typename Value, typename Callback>
+bool AddressIndex::DB::ForEachEntry(const Key &start_key, Callback fn) {
+    std::unique_ptr<CDBIterator> it(NewIterator());
+    it->Seek(start_key);
+
+    Key key;
+    while (it->Valid() && it->GetKey(key) &&
+           key.script_hash == start_key.script_hash) {
+        Value value;
+        if (!it->GetValue(value)) {
+            return error("%s: unable to read value for script hash %s",
+                         __func__, key.script_hash.ToString());
+        }
+        fn(key, value);
+        it->Next();
+    }
+
+    return true;
+}
+
+AddressIndex::AddressIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<AddressIndex::DB>(n_cache_size, f_memory,
+                                              f_wipe)) {}
+
+AddressIndex::~AddressIndex() {}
+
+bool AddressIndex::WriteBlock(const CBlock &block, const CBlockIndex *pindex) {
+    CBlockUndo block_undo;
+    if (pindex->nHeight > 0) {
+        if (!UndoReadFromDisk(block_undo, pindex)) {
+            return error("%s: failed to read undo data for block %s",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: block and undo data inconsistent", __func__);
+        }
+    }
+
+    // All the outputs of the block are written before its spends, as the
+    // transactions are in canonical order and a transaction may come before
+    // the parent it spends in the same block.
+    CDBBatch batch(*m_db);
+    for (const auto &ptx : block.vtx) {
+        const CTransaction &tx = *ptx;
+        for (uint32_t n = 0; n < tx.vout.size(); n++) {
+            const CTxOut &out = tx.vout[n];
+            if (out.scriptPubKey.IsUnspendable()) {
+                continue;
+            }
+
+            const uint256 script_hash = GetScriptHash(out.scriptPubKey);
+            const COutPoint outpoint(tx.GetId(), n);
+            batch.Write(DBOutputKey(script_hash, pindex->nHeight, outpoint),
+                        DBOutputValue(out.nValue));
+
+            // The outputs of the genesis block are not spendable.
+            if (pindex->nHeight > 0) {
+                batch.Write(DBUnspentKey(script_hash, outpoint),
+                            DBUnspentValue(pindex->nHeight, out.nValue));
+            }
+        }
+    }
+
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *block.vtx[i];
+
+        // The spent coins carry the height of the block that created them, so
+        // their entries can be updated without a lookup.
+        const CTxUndo &tx_undo = block_undo.vtxundo[i - 1];
+        if (tx_undo.vprevout.size() != tx.vin.size()) {
+            return error("%s: transaction and undo data inconsistent",
+                         __func__);
+        }
+
+        for (uint32_t j = 0; j < tx.vin.size(); j++) {
+            const COutPoint &prevout = tx.vin[j].prevout;
+            const Coin &coin = tx_undo.vprevout[j];
+            const uint256 script_hash =
+                GetScriptHash(coin.GetTxOut().scriptPubKey);
+            batch.Write(DBOutputKey(script_hash, coin.GetHeight(), prevout),
+                        DBOutputValue(coin.GetTxOut().nValue, tx.GetId(), j,
+                                      pindex->nHeight));
+            batch.Erase(DBUnspentKey(script_hash, prevout));
+        }
+    }
+
+    return m_db->WriteBatch(batch);
+}
+
+bool AddressIndex::Rewind(const CBlockIndex *current_tip,
+                          const CBlockIndex *new_tip) {
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params &consensus_params =
+        GetConfig().GetChainParams().GetConsensus();
+
+    for (const CBlockIndex *pindex = current_tip; pindex != new_tip;
+         pindex = pindex->pprev) {
+        CBlock block;
+        CBlockUndo block_undo;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params) ||
+            !UndoReadFromDisk(block_undo, pindex)) {
+            return error("%s: failed to read block %s from disk", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+        if (block_undo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: block and undo data inconsistent", __func__);
+        }
+
+        // Restore the spent coins before erasing the outputs of the block, so
+        // that outputs created and spent within the block end up erased
+        // whatever the order of the transactions.
+        CDBBatch batch(*m_db);
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            const CTransaction &tx = *block.vtx[i];
+            const CTxUndo &tx_undo = block_undo.vtxundo[i - 1];
+            if (tx_undo.vprevout.size() != tx.vin.size()) {
+                return error("%s: transaction and undo data inconsistent",
+                             __func__);
+            }
+
+            for (uint32_t j = 0; j < tx.vin.size(); j++) {
+                const COutPoint &prevout = tx.vin[j].prevout;
+                const Coin &coin = tx_undo.vprevout[j];
+                const CTxOut &out = coin.GetTxOut();
+                const uint256 script_hash = GetScriptHash(out.scriptPubKey);
+                batch.Write(DBOutputKey(script_hash, coin.GetHeight(), prevout),
+                            DBOutputValue(out.nValue));
+                batch.Write(DBUnspentKey(script_hash, prevout),
+                            DBUnspentValue(coin.GetHeight(), out.nValue));
+            }
+        }
+
+        for (const auto &ptx : block.vtx) {
+            const CTransaction &tx = *ptx;
+            for (uint32_t n = 0; n < tx.vout.size(); n++) {
+                const CTxOut &out = tx.vout[n];
+                if (out.scriptPubKey.IsUnspendable()) {
+                    continue;
+                }
+
+                const uint256 script_hash = GetScriptHash(out.scriptPubKey);
+                const COutPoint outpoint(tx.GetId(), n);
+                batch.Erase(
+                    DBOutputKey(script_hash, pindex->nHeight, outpoint));
+                batch.Erase(DBUnspentKey(script_hash, outpoint));
+            }
+        }
+
+        if (!m_db->WriteBatch(batch)) {
+            return error("%s: failed to revert block %s", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB &AddressIndex::GetDB() const {
+    return *m_db;
+}
+
+bool AddressIndex::FindOutputs(const CScript &script,
+                               std::vector<AddressOutput> &outputs) const {
+    outputs.clear();
+    const DBOutputKey start_key(GetScriptHash(script), 0,
+                                COutPoint(TxId(), 0));
+    return m_db->ForEachEntry<DBOutputKey, DBOutputValue>(
+        start_key, [&outputs](const DBOutputKey &key,
+                              const DBOutputValue &value) {
+            AddressOutput output;
+            output.outpoint = key.outpoint;
+            output.height = key.height;
+            output.value = value.value;
+            output.spent_txid = value.spent_txid;
+            output.spent_index = value.spent_index;
+            output.spent_height = value.spent_height;
+            outputs.push_back(std::move(output));
+        });
+}
+
+bool AddressIndex::FindUnspentOutputs(
+    const CScript &script, std::vector<AddressOutput> &outputs) const {
+    outputs.clear();
+    const DBUnspentKey start_key(GetScriptHash(script),
+                                 COutPoint(TxId(), 0));
+    return m_db->ForEachEntry<DBUnspentKey, DBUnspentValue>(
+        start_key, [&outputs](const DBUnspentKey &key,
+                              const DBUnspentValue &value) {
+            AddressOutput output;
+            output.outpoint = key.outpoint;
+            output.height = value.height;
+            output.value = value.value;
+            outputs.push_back(std::move(output));
+        });
+}
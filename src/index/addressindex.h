@@ -0,0 +1,100 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_ADDRESSINDEX_H
+#define BITCOIN_INDEX_ADDRESSINDEX_H
+
+#include <amount.h>
+#include <index/base.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/**
+ * Hash of a scriptPubKey, by which the entries of the address index are keyed.
+ * This is the single SHA256 of the serialized script, as used by Electrum
+ * servers.
+ */
+uint256 GetScriptHash(const CScript &script);
+
+/**
+ * An output paid to an indexed script, along with the input spending it if
+ * it was spent on the chain the index is in sync with.
+ */
+struct AddressOutput {
+    COutPoint outpoint;
+    //! Height of the block that created the output.
+    int height;
+    Amount value;
+
+    //! Transaction spending the output, null if it is unspent.
+    TxId spent_txid;
+    //! Index of the spending input in spent_txid.
+    uint32_t spent_index;
+    //! Height of the block that spent the output.
+    int spent_height;
+
+    AddressOutput()
+        : height(-1), value(Amount::zero()), spent_index(0),
+          spent_height(-1) {}
+
+    bool IsSpent() const { return !spent_txid.IsNull(); }
+};
+
+/**
+ * AddressIndex records, for every scriptPubKey, the outputs paid to it and the
+ * inputs spending them, so that the history and unspent outputs of an address
+ * can be listed without scanning the chain or the UTXO set.
+ */
+class AddressIndex final : public BaseIndex {
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
+
+    bool Rewind(const CBlockIndex *current_tip,
+                const CBlockIndex *new_tip) override;
+
+    BaseIndex::DB &GetDB() const override;
+
+    const char *GetName() const override { return "addressindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit AddressIndex(size_t n_cache_size, bool f_memory = false,
+                          bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an
+    // incomplete type.
+    virtual ~AddressIndex() override;
+
+    /// Look up all the outputs ever paid to a script, ordered by height.
+    ///
+    /// @param[in]   script  The scriptPubKey the outputs pay to.
+    /// @param[out]  outputs  The outputs, including their spending input.
+    /// @return  false if the database could not be read
+    bool FindOutputs(const CScript &script,
+                     std::vector<AddressOutput> &outputs) const;
+
+    /// Look up the outputs paid to a script that are not spent.
+    ///
+    /// @param[in]   script  The scriptPubKey the outputs pay to.
+    /// @param[out]  outputs  The unspent outputs.
+    /// @return  false if the database could not be read
+    bool FindUnspentOutputs(const CScript &script,
+                            std::vector<AddressOutput> &outputs) const;
+};
+
+/// The global address index. May be null.
+extern std::unique_ptr<AddressIndex> g_addressindex;
+
+#endif // BITCOIN_INDEX_ADDRESSINDEX_H
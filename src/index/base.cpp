@@ -41,8 +41,9 @@ bool BaseIndex::DB::ReadBestBlock(CBlockLocator &locator) const {
     return success;
 }
 
-bool BaseIndex::DB::WriteBestBlock(const CBlockLocator &locator) {
-    return Write(DB_BEST_BLOCK, locator);
+void BaseIndex::DB::WriteBestBlock(CDBBatch &batch,
+                                   const CBlockLocator &locator) {
+    batch.Write(DB_BEST_BLOCK, locator);
 }
 
 BaseIndex::~BaseIndex() {
@@ -104,6 +105,18 @@ void BaseIndex::ThreadSync() {
                     m_synced = true;
                     break;
                 }
+                if (pindex_next->pprev != pindex) {
+                    // The chain reorganized while syncing; the best block has
+                    // only been tracked locally so far.
+                    m_best_block_index = pindex;
+                    if (!Rewind(pindex, pindex_next->pprev)) {
+                        FatalError(
+                            "%s: Failed to rewind index %s to a previous "
+                            "chain tip",
+                            __func__, GetName());
+                        return;
+                    }
+                }
                 pindex = pindex_next;
             }
 
@@ -142,13 +155,43 @@ void BaseIndex::ThreadSync() {
 }
 
 bool BaseIndex::WriteBestBlock(const CBlockIndex *block_index) {
-    LOCK(cs_main);
-    if (!GetDB().WriteBestBlock(chainActive.GetLocator(block_index))) {
+    CBlockLocator locator;
+    {
+        LOCK(cs_main);
+        locator = chainActive.GetLocator(block_index);
+    }
+    return Commit(locator);
+}
+
+bool BaseIndex::Commit(const CBlockLocator &locator) {
+    CDBBatch batch(GetDB());
+    if (!CommitInternal(batch)) {
+        return error("%s: Failed to commit latest %s state", __func__,
+                     GetName());
+    }
+    GetDB().WriteBestBlock(batch, locator);
+    if (!GetDB().WriteBatch(batch)) {
         return error("%s: Failed to write locator to disk", __func__);
     }
     return true;
 }
 
+bool BaseIndex::Rewind(const CBlockIndex *current_tip,
+                       const CBlockIndex *new_tip) {
+    assert(current_tip == m_best_block_index);
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    // In the case of a reorg, ensure persisted block locator is not stale.
+    m_best_block_index = new_tip;
+    if (!WriteBestBlock(new_tip)) {
+        // If commit fails, revert the best block index to avoid corruption.
+        m_best_block_index = current_tip;
+        return false;
+    }
+
+    return true;
+}
+
 void BaseIndex::BlockConnected(
     const std::shared_ptr<const CBlock> &block, const CBlockIndex *pindex,
     const std::vector<CTransactionRef> &txn_conflicted) {
@@ -180,6 +223,12 @@ void BaseIndex::BlockConnected(
                       best_block_index->GetBlockHash().ToString());
             return;
         }
+        if (best_block_index != pindex->pprev &&
+            !Rewind(best_block_index, pindex->pprev)) {
+            FatalError("%s: Failed to rewind index %s to a previous chain tip",
+                       __func__, GetName());
+            return;
+        }
     }
 
     if (WriteBlock(*block, pindex)) {
@@ -225,9 +274,7 @@ void BaseIndex::ChainStateFlushed(const CBlockLocator &locator) {
         return;
     }
 
-    if (!GetDB().WriteBestBlock(locator)) {
-        error("%s: Failed to write locator to disk", __func__);
-    }
+    Commit(locator);
 }
 
 bool BaseIndex::BlockUntilSyncedToCurrentChain() {
@@ -30,7 +30,7 @@ protected:
         bool ReadBestBlock(CBlockLocator &locator) const;
 
         /// Write block locator of the chain that the txindex is in sync with.
-        bool WriteBestBlock(const CBlockLocator &locator);
+        void WriteBestBlock(CDBBatch &batch, const CBlockLocator &locator);
     };
 
 private:
@@ -55,6 +55,10 @@ private:
     /// Write the current chain block locator to the DB.
     bool WriteBestBlock(const CBlockIndex *block_index);
 
+    /// Write the given block locator to the DB, along with any state the
+    /// derived index commits in CommitInternal.
+    bool Commit(const CBlockLocator &locator);
+
 protected:
     void
     BlockConnected(const std::shared_ptr<const CBlock> &block,
@@ -71,6 +75,17 @@ protected:
         return true;
     }
 
+    /// Virtual method called internally by Commit that can be overridden to
+    /// atomically commit more index state along with the block locator.
+    virtual bool CommitInternal(CDBBatch &batch) { return true; }
+
+    /// Rewind index to an earlier chain tip during a chain reorg. The tip must
+    /// be an ancestor of the current best block. Indexes whose entries of
+    /// disconnected blocks would otherwise be returned by lookups override
+    /// this to remove them, then call the base implementation.
+    virtual bool Rewind(const CBlockIndex *current_tip,
+                        const CBlockIndex *new_tip);
+
     virtual DB &GetDB() const = 0;
 
     /// Get the name of the index for display in logs.
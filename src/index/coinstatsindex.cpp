@@ -0,0 +1,183 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+
+#include <chain.h>
+#include <coins.h>
+#include <undo.h>
+#include <util/system.h>
+#include <validation.h>
+#include <version.h>
+
+constexpr char DB_BLOCK_STATS = 's';
+
+std::unique_ptr<CoinStatsIndex> g_coinstatsindex;
+
+/**
+ * Access to the coinstats index database (indexes/coinstats/)
+ *
+ * The database stores the statistics for every block it processed, keyed by
+ * block hash, as well as a block locator of the chain it is synced to.
+ */
+class CoinStatsIndex::DB : public BaseIndex::DB {
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false,
+                bool f_wipe = false);
+
+    /// Read the statistics as of the block with the given hash.
+    /// Returns false if the block is not indexed.
+    bool ReadStats(const BlockHash &hash, BlockCoinStats &stats) const;
+
+    /// Write the statistics as of the block with the given hash.
+    bool WriteStats(const BlockHash &hash, const BlockCoinStats &stats);
+};
+
+CoinStatsIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : BaseIndex::DB(GetDataDir() / "indexes" / "coinstats", n_cache_size,
+                    f_memory, f_wipe) {}
+
+bool CoinStatsIndex::DB::ReadStats(const BlockHash &hash,
+                                   BlockCoinStats &stats) const {
+    return Read(std::make_pair(DB_BLOCK_STATS, hash), stats);
+}
+
+bool CoinStatsIndex::DB::WriteStats(const BlockHash &hash,
+                                    const BlockCoinStats &stats) {
+    return Write(std::make_pair(DB_BLOCK_STATS, hash), stats);
+}
+
+CoinStatsIndex::CoinStatsIndex(size_t n_cache_size, bool f_memory,
+                               bool f_wipe)
+    : m_db(std::make_unique<CoinStatsIndex::DB>(n_cache_size, f_memory,
+                                                f_wipe)) {}
+
+CoinStatsIndex::~CoinStatsIndex() {}
+
+/**
+ * The coinbases of these two blocks were overwritten by the duplicate
+ * coinbases of the blocks exempted from BIP30, so they never were part of the
+ * UTXO set as it is today.
+ */
+static bool IsBIP30Unspendable(const CBlockIndex *pindex) {
+    return (pindex->nHeight == 91722 &&
+            pindex->GetBlockHash() ==
+                uint256S("0x00000000000271a2dc26e7667f8419f2e15416dc6955e5a6c6"
+                         "cdf3f2574dd08e")) ||
+           (pindex->nHeight == 91812 &&
+            pindex->GetBlockHash() ==
+                uint256S("0x00000000000af0aed4792b1acee3d966af36cf5def14935db8"
+                         "de83d6f9306f2f"));
+}
+
+static size_t GetUtxoSize(const CTxOut &out) {
+    return GetSerializeSize(out, PROTOCOL_VERSION) + PER_UTXO_OVERHEAD;
+}
+
+static void AddCoin(BlockCoinStats &stats, const COutPoint &outpoint,
+                    const Coin &coin) {
+    const CTxOut &out = coin.GetTxOut();
+    stats.nTransactionOutputs++;
+    stats.nTotalAmount += out.nValue;
+    stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ +
+                       4 /* height + coinbase */ + 8 /* amount */ +
+                       2 /* scriptPubKey len */ +
+                       out.scriptPubKey.size() /* scriptPubKey */;
+    stats.nUtxoSize += GetUtxoSize(out);
+    stats.commitment.Add(outpoint, coin);
+}
+
+static void RemoveCoin(BlockCoinStats &stats, const COutPoint &outpoint,
+                       const Coin &coin) {
+    const CTxOut &out = coin.GetTxOut();
+    stats.nTransactionOutputs--;
+    stats.nTotalAmount -= out.nValue;
+    stats.nBogoSize -= 32 + 4 + 4 + 8 + 2 + out.scriptPubKey.size();
+    stats.nUtxoSize -= GetUtxoSize(out);
+    stats.commitment.Remove(outpoint, coin);
+}
+
+bool CoinStatsIndex::WriteBlock(const CBlock &block,
+                                const CBlockIndex *pindex) {
+    BlockCoinStats stats;
+
+    // The outputs of the genesis block are not spendable, so the UTXO set is
+    // empty as of the genesis block.
+    const bool fUpdateSet = pindex->nHeight > 0;
+    CBlockUndo blockundo;
+    if (fUpdateSet) {
+        if (!m_db->ReadStats(pindex->pprev->GetBlockHash(), stats)) {
+            return error("%s: previous block %s is not indexed", __func__,
+                         pindex->pprev->GetBlockHash().ToString());
+        }
+
+        if (!UndoReadFromDisk(blockundo, pindex)) {
+            return error("%s: failed to read undo data for block %s",
+                         __func__, pindex->GetBlockHash().ToString());
+        }
+        if (blockundo.vtxundo.size() + 1 != block.vtx.size()) {
+            return error("%s: block and undo data inconsistent", __func__);
+        }
+    }
+
+    // Reset the statistics of the previous block.
+    stats.nBlockInputs = 0;
+    stats.nBlockOutputs = 0;
+    stats.nBlockTotalOut = Amount::zero();
+    stats.nBlockTotalFee = Amount::zero();
+    stats.nBlockUtxoSizeInc = 0;
+
+    const bool fSkipCoinbase = IsBIP30Unspendable(pindex);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *block.vtx[i];
+        const bool fCoinBase = tx.IsCoinBase();
+
+        Amount tx_total_out = Amount::zero();
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            const CTxOut &out = tx.vout[o];
+            stats.nBlockOutputs++;
+            stats.nBlockUtxoSizeInc += GetUtxoSize(out);
+            tx_total_out += out.nValue;
+
+            if (fUpdateSet && !out.scriptPubKey.IsUnspendable() &&
+                !(fCoinBase && fSkipCoinbase)) {
+                AddCoin(stats, COutPoint(tx.GetId(), o),
+                        Coin(out, pindex->nHeight, fCoinBase));
+            }
+        }
+
+        if (fCoinBase) {
+            continue;
+        }
+
+        const CTxUndo &txundo = blockundo.vtxundo[i - 1];
+        if (txundo.vprevout.size() != tx.vin.size()) {
+            return error("%s: transaction and undo data inconsistent",
+                         __func__);
+        }
+
+        Amount tx_total_in = Amount::zero();
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            const Coin &coin = txundo.vprevout[j];
+            stats.nBlockInputs++;
+            stats.nBlockUtxoSizeInc -= GetUtxoSize(coin.GetTxOut());
+            tx_total_in += coin.GetTxOut().nValue;
+            RemoveCoin(stats, tx.vin[j].prevout, coin);
+        }
+
+        stats.nBlockTotalOut += tx_total_out;
+        stats.nBlockTotalFee += tx_total_in - tx_total_out;
+    }
+
+    return m_db->WriteStats(pindex->GetBlockHash(), stats);
+}
+
+BaseIndex::DB &CoinStatsIndex::GetDB() const {
+    return *m_db;
+}
+
+bool CoinStatsIndex::LookUpStats(const CBlockIndex *pindex,
+                                 BlockCoinStats &stats) const {
+    return m_db->ReadStats(pindex->GetBlockHash(), stats);
+}
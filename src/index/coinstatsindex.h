@@ -0,0 +1,117 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_COINSTATSINDEX_H
+#define BITCOIN_INDEX_COINSTATSINDEX_H
+
+#include <amount.h>
+#include <index/base.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+#include <utxocommit.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/**
+ * Overhead of a UTXO on top of its serialized output, used to estimate the
+ * size of the UTXO set: outpoint (needed for the utxo index) + nHeight +
+ * fCoinBase.
+ */
+static constexpr size_t PER_UTXO_OVERHEAD =
+    sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
+
+/**
+ * Statistics about the UTXO set as of a given block, along with the statistics
+ * of the block itself that need the spent outputs to be computed.
+ */
+struct BlockCoinStats {
+    //! Number of unspent outputs.
+    uint64_t nTransactionOutputs;
+    //! Database-independent metric for the UTXO set size.
+    uint64_t nBogoSize;
+    //! Serialized size of the unspent outputs, including PER_UTXO_OVERHEAD.
+    uint64_t nUtxoSize;
+    //! Total amount of the unspent outputs.
+    Amount nTotalAmount;
+    //! ECMH commitment to the UTXO set.
+    CUtxoCommit commitment;
+
+    //! Number of inputs of the block, excluding the coinbase.
+    uint64_t nBlockInputs;
+    //! Number of outputs of the block, including the coinbase.
+    uint64_t nBlockOutputs;
+    //! Total amount of the outputs of the block, excluding the coinbase.
+    Amount nBlockTotalOut;
+    //! Total fees of the block.
+    Amount nBlockTotalFee;
+    //! Change in the serialized size of the UTXO set due to the block.
+    int64_t nBlockUtxoSizeInc;
+
+    BlockCoinStats()
+        : nTransactionOutputs(0), nBogoSize(0), nUtxoSize(0),
+          nTotalAmount(Amount::zero()), nBlockInputs(0), nBlockOutputs(0),
+          nBlockTotalOut(Amount::zero()), nBlockTotalFee(Amount::zero()),
+          nBlockUtxoSizeInc(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(VARINT(nTransactionOutputs));
+        READWRITE(VARINT(nBogoSize));
+        READWRITE(VARINT(nUtxoSize));
+        READWRITE(nTotalAmount);
+        READWRITE(commitment);
+        READWRITE(VARINT(nBlockInputs));
+        READWRITE(VARINT(nBlockOutputs));
+        READWRITE(nBlockTotalOut);
+        READWRITE(nBlockTotalFee);
+        READWRITE(nBlockUtxoSizeInc);
+    }
+};
+
+/**
+ * CoinStatsIndex maintains statistics about the UTXO set for every block, so
+ * that they can be looked up for any height without scanning the chainstate.
+ * Entries are computed incrementally from the previous block's entry, the
+ * block and its undo data, and are keyed by block hash so that blocks on
+ * stale branches don't need to be rewound.
+ */
+class CoinStatsIndex final : public BaseIndex {
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
+
+    BaseIndex::DB &GetDB() const override;
+
+    const char *GetName() const override { return "coinstatsindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit CoinStatsIndex(size_t n_cache_size, bool f_memory = false,
+                            bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an
+    // incomplete type.
+    virtual ~CoinStatsIndex() override;
+
+    /// Look up the statistics as of a given block.
+    ///
+    /// @param[in]   pindex  The block the statistics are requested for.
+    /// @param[out]  stats  The statistics of the UTXO set and the block.
+    /// @return  true if the block is indexed, false otherwise
+    bool LookUpStats(const CBlockIndex *pindex, BlockCoinStats &stats) const;
+};
+
+/// The global UTXO set statistics index. May be null.
+extern std::unique_ptr<CoinStatsIndex> g_coinstatsindex;
+
+#endif // BITCOIN_INDEX_COINSTATSINDEX_H
@@ -0,0 +1,109 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/spentindex.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <config.h>
+#include <util/system.h>
+#include <validation.h>
+
+/* The index database stores one entry per spent outpoint, mapping
+ * [DB_SPENTINDEX, outpoint] to the txid, input index and height of the
+ * spending transaction. The entries of blocks that get disconnected are erased
+ * by Rewind().
+ */
+constexpr char DB_SPENTINDEX = 's';
+
+std::unique_ptr<SpentIndex> g_spentindex;
+
+/**
+ * Access to the spent index database (indexes/spentindex/)
+ */
+class SpentIndex::DB : public BaseIndex::DB {
+public:
+    explicit DB(size_t n_cache_size, bool f_memory = false,
+                bool f_wipe = false);
+
+    /// Read the spending input of an outpoint. Returns false if the outpoint
+    /// is not in the index.
+    bool ReadSpentInfo(const COutPoint &outpoint, SpentInfo &info) const;
+};
+
+SpentIndex::DB::DB(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : BaseIndex::DB(GetDataDir() / "indexes" / "spentindex", n_cache_size,
+                    f_memory, f_wipe) {}
+
+bool SpentIndex::DB::ReadSpentInfo(const COutPoint &outpoint,
+                                   SpentInfo &info) const {
+    return Read(std::make_pair(DB_SPENTINDEX, outpoint), info);
+}
+
+SpentIndex::SpentIndex(size_t n_cache_size, bool f_memory, bool f_wipe)
+    : m_db(std::make_unique<SpentIndex::DB>(n_cache_size, f_memory, f_wipe)) {}
+
+SpentIndex::~SpentIndex() {}
+
+bool SpentIndex::WriteBlock(const CBlock &block, const CBlockIndex *pindex) {
+    CDBBatch batch(*m_db);
+    for (const auto &tx : block.vtx) {
+        if (tx->IsCoinBase()) {
+            continue;
+        }
+
+        for (uint32_t i = 0; i < tx->vin.size(); i++) {
+            batch.Write(std::make_pair(DB_SPENTINDEX, tx->vin[i].prevout),
+                        SpentInfo(tx->GetId(), i, pindex->nHeight));
+        }
+    }
+
+    return m_db->WriteBatch(batch);
+}
+
+bool SpentIndex::Rewind(const CBlockIndex *current_tip,
+                        const CBlockIndex *new_tip) {
+    assert(current_tip->GetAncestor(new_tip->nHeight) == new_tip);
+
+    const Consensus::Params &consensus_params =
+        GetConfig().GetChainParams().GetConsensus();
+
+    // The outpoints spent by the disconnected blocks are unspent again, unless
+    // the new chain spends them, in which case their entries are overwritten
+    // when its blocks get connected.
+    CDBBatch batch(*m_db);
+    for (const CBlockIndex *pindex = current_tip; pindex != new_tip;
+         pindex = pindex->pprev) {
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, consensus_params)) {
+            return error("%s: failed to read block %s from disk", __func__,
+                         pindex->GetBlockHash().ToString());
+        }
+
+        for (const auto &tx : block.vtx) {
+            if (tx->IsCoinBase()) {
+                continue;
+            }
+            for (const CTxIn &txin : tx->vin) {
+                batch.Erase(std::make_pair(DB_SPENTINDEX, txin.prevout));
+            }
+        }
+    }
+
+    if (!m_db->WriteBatch(batch)) {
+        return error("%s: failed to erase entries of disconnected blocks",
+                     __func__);
+    }
+
+    return BaseIndex::Rewind(current_tip, new_tip);
+}
+
+BaseIndex::DB &SpentIndex::GetDB() const {
+    return *m_db;
+}
+
+bool SpentIndex::FindSpentInfo(const COutPoint &outpoint,
+                               SpentInfo &info) const {
+    return m_db->ReadSpentInfo(outpoint, info);
+}
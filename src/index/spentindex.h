@@ -0,0 +1,79 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_INDEX_SPENTINDEX_H
+#define BITCOIN_INDEX_SPENTINDEX_H
+
+#include <index/base.h>
+#include <primitives/transaction.h>
+#include <serialize.h>
+
+#include <cstdint>
+#include <memory>
+
+/** The input spending an output, as recorded by the spent index. */
+struct SpentInfo {
+    TxId txid;
+    //! Index of the spending input in txid.
+    uint32_t index;
+    //! Height of the block that includes the spending transaction.
+    int height;
+
+    SpentInfo() : index(0), height(-1) {}
+    SpentInfo(const TxId &txid_in, uint32_t index_in, int height_in)
+        : txid(txid_in), index(index_in), height(height_in) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(index);
+        READWRITE(height);
+    }
+};
+
+/**
+ * SpentIndex maps every spent outpoint to the input spending it, which the
+ * undo data only provides in the other direction.
+ */
+class SpentIndex final : public BaseIndex {
+protected:
+    class DB;
+
+private:
+    const std::unique_ptr<DB> m_db;
+
+protected:
+    bool WriteBlock(const CBlock &block, const CBlockIndex *pindex) override;
+
+    bool Rewind(const CBlockIndex *current_tip,
+                const CBlockIndex *new_tip) override;
+
+    BaseIndex::DB &GetDB() const override;
+
+    const char *GetName() const override { return "spentindex"; }
+
+public:
+    /// Constructs the index, which becomes available to be queried.
+    explicit SpentIndex(size_t n_cache_size, bool f_memory = false,
+                        bool f_wipe = false);
+
+    // Destructor is declared because this class contains a unique_ptr to an
+    // incomplete type.
+    virtual ~SpentIndex() override;
+
+    /// Look up the input spending an outpoint.
+    ///
+    /// @param[in]   outpoint  The output to look up.
+    /// @param[out]  info  The spending input, if the output is spent.
+    /// @return  true if the output is spent on the chain the index is synced
+    ///          to, false if it is unspent or unknown
+    bool FindSpentInfo(const COutPoint &outpoint, SpentInfo &info) const;
+};
+
+/// The global spent index. May be null.
+extern std::unique_ptr<SpentIndex> g_spentindex;
+
+#endif // BITCOIN_INDEX_SPENTINDEX_H
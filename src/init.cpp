@@ -11,7 +11,9 @@
 
 #include <addrman.h>
 #include <amount.h>
+#include <avalanche.h>
 #include <banman.h>
+#include <blockfilter.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -22,6 +24,10 @@
 #include <fs.h>
 #include <httprpc.h>
 #include <httpserver.h>
+#include <index/addressindex.h>
+#include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
+#include <index/spentindex.h>
 #include <index/txindex.h>
 #include <interfaces/chain.h>
 #include <key.h>
@@ -66,6 +72,7 @@
 #include <csignal>
 #include <sys/stat.h>
 #endif
+#include <algorithm>
 #include <cstdint>
 #include <cstdio>
 #include <memory>
@@ -77,6 +84,10 @@ static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 // Dump addresses to banlist.dat every 15 minutes (900s)
 static constexpr int DUMP_BANS_INTERVAL = 60 * 15;
 
+//! Block filter types for which an index is maintained (see
+//! -blockfilterindex).
+static std::vector<BlockFilterType> g_enabled_filter_types;
+
 std::unique_ptr<CConnman> g_connman;
 std::unique_ptr<PeerLogicValidation> peerLogic;
 std::unique_ptr<BanMan> g_banman;
@@ -159,6 +170,16 @@ void Interrupt() {
     if (g_txindex) {
         g_txindex->Interrupt();
     }
+    if (g_coinstatsindex) {
+        g_coinstatsindex->Interrupt();
+    }
+    if (g_addressindex) {
+        g_addressindex->Interrupt();
+    }
+    if (g_spentindex) {
+        g_spentindex->Interrupt();
+    }
+    ForEachBlockFilterIndex([](BlockFilterIndex &index) { index.Interrupt(); });
 }
 
 void Shutdown(InitInterfaces &interfaces) {
@@ -190,12 +211,26 @@ void Shutdown(InitInterfaces &interfaces) {
     if (peerLogic) {
         UnregisterValidationInterface(peerLogic.get());
     }
+    if (g_avalanche) {
+        // The event loop runs on the scheduler, stop it while it is running.
+        g_avalanche->stopEventLoop();
+    }
     if (g_connman) {
         g_connman->Stop();
     }
     if (g_txindex) {
         g_txindex->Stop();
     }
+    if (g_coinstatsindex) {
+        g_coinstatsindex->Stop();
+    }
+    if (g_addressindex) {
+        g_addressindex->Stop();
+    }
+    if (g_spentindex) {
+        g_spentindex->Stop();
+    }
+    ForEachBlockFilterIndex([](BlockFilterIndex &index) { index.Stop(); });
 
     StopTorControl();
 
@@ -206,10 +241,15 @@ void Shutdown(InitInterfaces &interfaces) {
 
     // After the threads that potentially access these pointers have been
     // stopped, destruct and reset all to nullptr.
+    g_avalanche.reset();
     peerLogic.reset();
     g_connman.reset();
     g_banman.reset();
     g_txindex.reset();
+    g_coinstatsindex.reset();
+    g_addressindex.reset();
+    g_spentindex.reset();
+    DestroyAllBlockFilterIndexes();
 
     if (::g_mempool.IsLoaded() &&
         gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
@@ -265,6 +305,7 @@ void Shutdown(InitInterfaces &interfaces) {
     UnregisterAllValidationInterfaces();
     GetMainSignals().UnregisterBackgroundSignalScheduler();
     GetMainSignals().UnregisterWithMempoolSignals(g_mempool);
+    g_block_template.reset();
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
@@ -343,6 +384,13 @@ void SetupServerArgs() {
                  OptionsCategory::OPTIONS);
     gArgs.AddArg("-version", "Print version and exit", false,
                  OptionsCategory::OPTIONS);
+    gArgs.AddArg("-addressindex",
+                 strprintf("Maintain an index of the outputs paid to every "
+                           "script and of their spending inputs, used by the "
+                           "getaddresshistory and getaddressutxos rpc calls "
+                           "(default: %d)",
+                           DEFAULT_ADDRESSINDEX),
+                 false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-alertnotify=<cmd>",
                  "Execute command when a relevant alert is received or we see "
                  "a really long fork (%s in cmd is replaced by message)",
@@ -374,6 +422,19 @@ void SetupServerArgs() {
         strprintf("Whether to operate in a blocks only mode (default: %d)",
                   DEFAULT_BLOCKSONLY),
         true, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockfilterindex=<type>",
+                 strprintf("Maintain an index of compact filters by block "
+                           "(default: %s, values: %s).",
+                           DEFAULT_BLOCKFILTERINDEX, ListBlockFilterTypes()) +
+                     " If <type> is not supplied or if <type> = 1, indexes for "
+                     "all known types are enabled.",
+                 false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-coinstatsindex",
+                 strprintf("Maintain an index of the UTXO set statistics as "
+                           "of every block, used by the gettxoutsetinfo and "
+                           "getblockstats rpc calls (default: %d)",
+                           DEFAULT_COINSTATSINDEX),
+                 false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-conf=<file>",
                  strprintf("Specify configuration file. Relative paths will be "
                            "prefixed by datadir location. (default: %s)",
@@ -432,6 +493,12 @@ void SetupServerArgs() {
                            "memory (default: %u)",
                            DEFAULT_MAX_ORPHAN_TRANSACTIONS),
                  false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-maxorphantxsize=<n>",
+                 strprintf("Keep the unconnectable transactions in memory "
+                           "below <n> megabytes. Each peer may use up to a "
+                           "quarter of this and of -maxorphantx (default: %u)",
+                           DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE),
+                 false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-mempoolexpiry=<n>",
                  strprintf("Do not keep transactions in the mempool longer "
                            "than <n> hours (default: %u)",
@@ -452,6 +519,12 @@ void SetupServerArgs() {
                   -GetNumCores(), MAX_SCRIPTCHECK_THREADS,
                   DEFAULT_SCRIPTCHECK_THREADS),
         false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-parallelconnect",
+                 strprintf("Check the inputs of block transactions "
+                           "concurrently, on as many threads as set by -par, "
+                           "when connecting blocks (default: %u)",
+                           DEFAULT_PARALLEL_CONNECT),
+                 false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool",
                  strprintf("Whether to save the mempool on shutdown and load "
                            "on restart (default: %u)",
@@ -472,7 +545,9 @@ void SetupServerArgs() {
                   "of old blocks. This allows the pruneblockchain RPC to be "
                   "called to delete specific blocks, and enables automatic "
                   "pruning of old blocks if a target size in MiB is provided. "
-                  "This mode is incompatible with -txindex and -rescan. "
+                  "This mode is incompatible with -txindex, -coinstatsindex, "
+                  "-blockfilterindex, -addressindex, -spentindex and "
+                  "-rescan. "
                   "Warning: Reverting this setting requires re-downloading the "
                   "entire blockchain. (default: 0 = disable pruning blocks, 1 "
                   "= allow manual pruning via RPC, >=%u = automatically prune "
@@ -488,6 +563,19 @@ void SetupServerArgs() {
         "-reindex",
         "Rebuild chain state and block index from the blk*.dat files on disk",
         false, OptionsCategory::OPTIONS);
+    gArgs.AddArg(
+        "-reindexthreads=<n>",
+        strprintf("Set the number of threads reading block files during "
+                  "-reindex (%u to %d, 0 = auto, <0 = leave that many cores "
+                  "free, default: %d)",
+                  -GetNumCores(), MAX_REINDEX_THREADS, DEFAULT_REINDEX_THREADS),
+        false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-spentindex",
+                 strprintf("Maintain an index of the input spending every "
+                           "spent output, used by the getspentinfo rpc call "
+                           "(default: %d)",
+                           DEFAULT_SPENTINDEX),
+                 false, OptionsCategory::OPTIONS);
 #ifndef WIN32
     gArgs.AddArg(
         "-sysperms",
@@ -506,6 +594,12 @@ void SetupServerArgs() {
                  "Use Cash Address for destination encoding instead of base58 "
                  "(activate by default on Jan, 14)",
                  false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-utxocommitment",
+                 strprintf("Maintain a commitment to the UTXO set as blocks "
+                           "are connected, available with the "
+                           "getutxocommitment RPC (default: %u)",
+                           DEFAULT_UTXO_COMMITMENT),
+                 false, OptionsCategory::OPTIONS);
 
     gArgs.AddArg("-addnode=<ip>",
                  "Add a node to connect to and attempt to keep the connection "
@@ -543,6 +637,11 @@ void SetupServerArgs() {
                  "Query for peer addresses via DNS lookup, if low on addresses "
                  "(default: 1 unless -connect used)",
                  false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-enableavalanche",
+                 strprintf("Vote on mempool transactions with avalanche "
+                           "pre-consensus (default: %u)",
+                           AVALANCHE_DEFAULT_ENABLED),
+                 false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-enablebip61",
                  strprintf("Send reject messages per BIP61 (default: %u)",
                            DEFAULT_ENABLE_BIP61),
@@ -556,6 +655,12 @@ void SetupServerArgs() {
             "Always query for peer addresses via DNS lookup (default: %d)",
             DEFAULT_FORCEDNSSEED),
         false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-graphene",
+                 strprintf("Download new blocks from the peers supporting it "
+                           "as graphene blocks, encoded against our mempool, "
+                           "and serve them to peers (default: %d)",
+                           DEFAULT_GRAPHENE),
+                 false, OptionsCategory::CONNECTION);
     gArgs.AddArg(
         "-listen",
         "Accept connections from outside (default: 1 if no -proxy or -connect)",
@@ -588,6 +693,12 @@ void SetupServerArgs() {
                   "backward by this amount. (default: %u seconds)",
                   DEFAULT_MAX_TIME_ADJUSTMENT),
         false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-msghandlerthreads=<n>",
+                 strprintf("Number of threads processing the messages of "
+                           "peers, each peer being processed by one thread at "
+                           "a time (1 to %d, default: %d)",
+                           MAX_MSGHANDLER_THREADS, DEFAULT_MSGHANDLER_THREADS),
+                 false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onion=<ip:port>",
                  strprintf("Use separate SOCKS5 proxy to reach peers via Tor "
                            "hidden services (default: %s)",
@@ -596,6 +707,11 @@ void SetupServerArgs() {
     gArgs.AddArg("-onlynet=<net>",
                  "Only connect to nodes in network <net> (ipv4, ipv6 or onion)",
                  false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-peerblockfilters",
+                 strprintf("Serve compact block filters to peers per BIP 157 "
+                           "(default: %u)",
+                           DEFAULT_PEERBLOCKFILTERS),
+                 false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-peerbloomfilters",
                  strprintf("Support filtering of blocks and transaction with "
                            "bloom filters (default: %d)",
@@ -622,6 +738,13 @@ void SetupServerArgs() {
     gArgs.AddArg("-seednode=<ip>",
                  "Connect to a node to retrieve peer addresses, and disconnect",
                  false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-socketevents=<mode>",
+                 strprintf("Interface used to wait for socket events, one of "
+                           "%s. Only select limits the number of connections "
+                           "to FD_SETSIZE (default: %s)",
+                           GetSupportedSocketEventsModes(),
+                           DEFAULT_SOCKETEVENTS),
+                 false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-timeout=<n>",
                  strprintf("Specify connection timeout in milliseconds "
                            "(minimum: 1, default: %d)",
@@ -673,6 +796,9 @@ void SetupServerArgs() {
     g_wallet_init_interface.AddWalletOptions();
 
 #if ENABLE_ZMQ
+    gArgs.AddArg("-zmqpubavalanchetx=<address>",
+                 "Enable publish avalanche transaction decisions in <address>",
+                 false, OptionsCategory::ZMQ);
     gArgs.AddArg("-zmqpubhashblock=<address>",
                  "Enable publish hash block in <address>", false,
                  OptionsCategory::ZMQ);
@@ -686,6 +812,7 @@ void SetupServerArgs() {
                  "Enable publish raw transaction in <address>", false,
                  OptionsCategory::ZMQ);
 #else
+    hidden_args.emplace_back("-zmqpubavalanchetx=<address>");
     hidden_args.emplace_back("-zmqpubhashblock=<address>");
     hidden_args.emplace_back("-zmqpubhashtx=<address>");
     hidden_args.emplace_back("-zmqpubrawblock=<address>");
@@ -731,6 +858,9 @@ void SetupServerArgs() {
     gArgs.AddArg("-dropmessagestest=<n>",
                  "Randomly drop 1 of every <n> network messages", true,
                  OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-fastprune",
+                 "Use smaller block files for testing purposes", true,
+                 OptionsCategory::DEBUG_TEST);
     gArgs.AddArg(
         "-stopafterblockimport",
         strprintf("Stop running after importing blocks from disk (default: %d)",
@@ -915,6 +1045,16 @@ void SetupServerArgs() {
                            FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE_PER_KB)),
                  false, OptionsCategory::BLOCK_CREATION);
 
+    gArgs.AddArg(
+        "-incrementalblocktemplate",
+        strprintf("Reuse the transactions selected for the previous block "
+                  "template on the same tip, only appending the new mempool "
+                  "transactions which fit. Faster, but templates may pay less "
+                  "in fees until transactions are selected again, at most "
+                  "every %d seconds (default: %d)",
+                  BLOCK_TEMPLATE_REBUILD_INTERVAL,
+                  DEFAULT_INCREMENTAL_BLOCK_TEMPLATE),
+        false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>",
                  "Override block version to test forking scenarios", true,
                  OptionsCategory::BLOCK_CREATION);
@@ -1116,22 +1256,18 @@ static void ThreadImport(const Config &config,
 
         // -reindex
         if (fReindex) {
-            int nFile = 0;
-            while (true) {
-                FlatFilePos pos(nFile, 0);
-                if (!fs::exists(GetBlockPosFilename(pos))) {
-                    // No block files left to reindex
-                    break;
-                }
-                FILE *file = OpenBlockFile(pos, true);
-                if (!file) {
-                    // This error is logged in OpenBlockFile
-                    break;
-                }
-                LogPrintf("Reindexing block file blk%05u.dat...\n",
-                          (unsigned int)nFile);
-                LoadExternalBlockFile(config, file, &pos);
-                nFile++;
+            int num_threads =
+                gArgs.GetArg("-reindexthreads", DEFAULT_REINDEX_THREADS);
+            if (num_threads <= 0) {
+                num_threads += GetNumCores();
+            }
+            num_threads =
+                std::max(1, std::min(num_threads, MAX_REINDEX_THREADS));
+            if (!ReindexBlockFiles(config, num_threads)) {
+                // Keep the reindexing flag so it resumes on the next start.
+                LogPrintf("Reindexing failed\n");
+                StartShutdown();
+                return;
             }
             pblocktree->WriteReindexing(false);
             fReindex = false;
@@ -1473,11 +1609,58 @@ bool AppInitParameterInteraction(Config &config) {
                       gArgs.GetArg("-blocksdir", "").c_str()));
     }
 
-    // if using block pruning, then disallow txindex
+    // parse and validate enabled filter types
+    std::string blockfilterindex_value =
+        gArgs.GetArg("-blockfilterindex", DEFAULT_BLOCKFILTERINDEX);
+    if (blockfilterindex_value == "" || blockfilterindex_value == "1") {
+        g_enabled_filter_types = AllBlockFilterTypes();
+    } else if (blockfilterindex_value != "0") {
+        const std::vector<std::string> names =
+            gArgs.GetArgs("-blockfilterindex");
+        g_enabled_filter_types.reserve(names.size());
+        for (const auto &name : names) {
+            BlockFilterType filter_type;
+            if (!BlockFilterTypeByName(name, filter_type)) {
+                return InitError(
+                    strprintf(_("Unknown -blockfilterindex value %s."), name));
+            }
+            g_enabled_filter_types.push_back(filter_type);
+        }
+    }
+
+    // Basic filters are the only supported filter type now.
+    if (gArgs.GetBoolArg("-peerblockfilters", DEFAULT_PEERBLOCKFILTERS)) {
+        if (std::find(g_enabled_filter_types.begin(),
+                      g_enabled_filter_types.end(),
+                      BlockFilterType::BASIC) == g_enabled_filter_types.end()) {
+            return InitError(
+                _("Cannot set -peerblockfilters without -blockfilterindex."));
+        }
+
+        nLocalServices = ServiceFlags(nLocalServices | NODE_COMPACT_FILTERS);
+    }
+
+    // if using block pruning, then disallow indexes needing the block data
     if (gArgs.GetArg("-prune", 0)) {
         if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
             return InitError(_("Prune mode is incompatible with -txindex."));
         }
+        if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+            return InitError(
+                _("Prune mode is incompatible with -coinstatsindex."));
+        }
+        if (!g_enabled_filter_types.empty()) {
+            return InitError(
+                _("Prune mode is incompatible with -blockfilterindex."));
+        }
+        if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+            return InitError(
+                _("Prune mode is incompatible with -addressindex."));
+        }
+        if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+            return InitError(
+                _("Prune mode is incompatible with -spentindex."));
+        }
     }
 
     // -bind and -whitebind can't be set when not listening
@@ -1488,18 +1671,30 @@ bool AppInitParameterInteraction(Config &config) {
             "Cannot set -bind or -whitebind together with -listen=0");
     }
 
+    const std::string socket_events =
+        gArgs.GetArg("-socketevents", DEFAULT_SOCKETEVENTS);
+    if (!ParseSocketEventsMode(socket_events, g_socket_events_mode)) {
+        return InitError(strprintf(_("Invalid -socketevents ('%s'), only %s "
+                                     "are supported on this platform"),
+                                   socket_events,
+                                   GetSupportedSocketEventsModes()));
+    }
+
     // Make sure enough file descriptors are available
     int nBind = std::max(nUserBind, size_t(1));
     nUserMaxConnections =
         gArgs.GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
-    // Trim requested connection counts, to fit into system limitations
-    nMaxConnections =
-        std::max(std::min(nMaxConnections, FD_SETSIZE - nBind -
-                                               MIN_CORE_FILEDESCRIPTORS -
-                                               MAX_ADDNODE_CONNECTIONS),
-                 0);
+    // Trim requested connection counts, to fit into system limitations. Only
+    // select() can't wait on descriptors above FD_SETSIZE.
+    if (g_socket_events_mode == SocketEventsMode::Select) {
+        nMaxConnections =
+            std::max(std::min(nMaxConnections, FD_SETSIZE - nBind -
+                                                   MIN_CORE_FILEDESCRIPTORS -
+                                                   MAX_ADDNODE_CONNECTIONS),
+                     0);
+    }
     nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS +
                                    MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS) {
@@ -1642,6 +1837,8 @@ bool AppInitParameterInteraction(Config &config) {
     } else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS) {
         nScriptCheckThreads = MAX_SCRIPTCHECK_THREADS;
     }
+    fParallelBlockConnect =
+        gArgs.GetBoolArg("-parallelconnect", DEFAULT_PARALLEL_CONNECT);
 
     // Configure excessive block size.
     const uint64_t nProposedExcessiveBlockSize =
@@ -1765,6 +1962,10 @@ bool AppInitParameterInteraction(Config &config) {
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
     }
 
+    if (gArgs.GetBoolArg("-enableavalanche", AVALANCHE_DEFAULT_ENABLED)) {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_AVALANCHE);
+    }
+
     // Signal Bitcoin Cash support.
     // TODO: remove some time after the hardfork when no longer needed
     // to differentiate the network nodes.
@@ -1863,6 +2064,8 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
     LogPrintf("Using at most %i automatic connections (%i file descriptors "
               "available)\n",
               nMaxConnections, nFD);
+    LogPrintf("Using %s to wait for socket events\n",
+              GetSocketEventsModeName(g_socket_events_mode));
 
     // Warn about relative -datadir path.
     if (gArgs.IsArgSet("-datadir") &&
@@ -1880,7 +2083,8 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
     InitSignatureCache();
     InitScriptExecutionCache();
 
-    LogPrintf("Using %u threads for script verification\n",
+    LogPrintf("Using %u threads for script verification and message "
+              "hashing\n",
               nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++) {
@@ -1896,6 +2100,11 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
 
     GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
     GetMainSignals().RegisterWithMempoolSignals(g_mempool);
+    if (gArgs.GetBoolArg("-incrementalblocktemplate",
+                         DEFAULT_INCREMENTAL_BLOCK_TEMPLATE)) {
+        g_block_template =
+            std::make_unique<IncrementalBlockTemplate>(g_mempool);
+    }
 
     // Create client interfaces for wallets that are supposed to be loaded
     // according to -wallet and -disablewallet options. This only constructs
@@ -1958,6 +2167,11 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         gArgs.GetBoolArg("-enablebip61", DEFAULT_ENABLE_BIP61)));
     RegisterValidationInterface(peerLogic.get());
 
+    if (gArgs.GetBoolArg("-enableavalanche", AVALANCHE_DEFAULT_ENABLED)) {
+        assert(!g_avalanche);
+        g_avalanche = std::make_unique<AvalancheProcessor>(g_connman.get());
+    }
+
     // sanitize comments per BIP-0014, format user agent and check total size
     std::vector<std::string> uacomments;
     for (const std::string &cmt : gArgs.GetArgs("-uacomment")) {
@@ -2103,6 +2317,30 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
                                       ? nMaxTxIndexCache << 20
                                       : 0);
     nTotalCache -= nTxIndexCache;
+    int64_t nCoinStatsIndexCache = std::min(
+        nTotalCache / 8,
+        gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)
+            ? nMaxCoinStatsIndexCache << 20
+            : 0);
+    nTotalCache -= nCoinStatsIndexCache;
+    int64_t nAddressIndexCache = std::min(
+        nTotalCache / 8, gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)
+                             ? nMaxAddressIndexCache << 20
+                             : 0);
+    nTotalCache -= nAddressIndexCache;
+    int64_t nSpentIndexCache = std::min(
+        nTotalCache / 8, gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)
+                             ? nMaxSpentIndexCache << 20
+                             : 0);
+    nTotalCache -= nSpentIndexCache;
+    int64_t filter_index_cache = 0;
+    if (!g_enabled_filter_types.empty()) {
+        size_t n_indexes = g_enabled_filter_types.size();
+        int64_t max_cache =
+            std::min(nTotalCache / 8, nMaxFilterIndexCache << 20);
+        filter_index_cache = max_cache / n_indexes;
+        nTotalCache -= filter_index_cache * n_indexes;
+    }
     // use 25%-50% of the remainder for disk cache
     int64_t nCoinDBCache =
         std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23));
@@ -2120,6 +2358,23 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         LogPrintf("* Using %.1fMiB for transaction index database\n",
                   nTxIndexCache * (1.0 / 1024 / 1024));
     }
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        LogPrintf("* Using %.1fMiB for coinstats index database\n",
+                  nCoinStatsIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        LogPrintf("* Using %.1fMiB for address index database\n",
+                  nAddressIndexCache * (1.0 / 1024 / 1024));
+    }
+    if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+        LogPrintf("* Using %.1fMiB for spent index database\n",
+                  nSpentIndexCache * (1.0 / 1024 / 1024));
+    }
+    for (BlockFilterType filter_type : g_enabled_filter_types) {
+        LogPrintf("* Using %.1fMiB for %s block filter index database\n",
+                  filter_index_cache * (1.0 / 1024 / 1024),
+                  BlockFilterTypeName(filter_type));
+    }
     LogPrintf("* Using %.1fMiB for chain state database\n",
               nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of "
@@ -2227,7 +2482,8 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
                 }
 
                 // The on-disk coinsdb is now in a good state, create the cache
-                pcoinsTip.reset(new CCoinsViewCache(pcoinscatcher.get()));
+                pcoinsTip.reset(
+                    new CCoinsViewShardedCache(pcoinscatcher.get()));
 
                 bool is_coinsview_empty = fReset || fReindexChainState ||
                                           pcoinsTip->GetBestBlock().IsNull();
@@ -2272,6 +2528,15 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
                         break;
                     }
                 }
+
+                if (gArgs.GetBoolArg("-utxocommitment",
+                                     DEFAULT_UTXO_COMMITMENT)) {
+                    uiInterface.InitMessage(_("Loading UTXO commitment..."));
+                    if (!LoadUtxoCommitment()) {
+                        strLoadError = _("Error loading UTXO commitment");
+                        break;
+                    }
+                }
             } catch (const std::exception &e) {
                 LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -2326,6 +2591,26 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         g_txindex = std::make_unique<TxIndex>(nTxIndexCache, false, fReindex);
         g_txindex->Start();
     }
+    if (gArgs.GetBoolArg("-coinstatsindex", DEFAULT_COINSTATSINDEX)) {
+        g_coinstatsindex = std::make_unique<CoinStatsIndex>(
+            nCoinStatsIndexCache, false, fReindex);
+        g_coinstatsindex->Start();
+    }
+    if (gArgs.GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX)) {
+        g_addressindex = std::make_unique<AddressIndex>(nAddressIndexCache,
+                                                        false, fReindex);
+        g_addressindex->Start();
+    }
+    if (gArgs.GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
+        g_spentindex =
+            std::make_unique<SpentIndex>(nSpentIndexCache, false, fReindex);
+        g_spentindex->Start();
+    }
+
+    for (const auto &filter_type : g_enabled_filter_types) {
+        InitBlockFilterIndex(filter_type, filter_index_cache, false, fReindex);
+        GetBlockFilterIndex(filter_type)->Start();
+    }
 
     // Step 9: load wallet
     for (const auto &client : interfaces.chain_clients) {
@@ -2434,6 +2719,8 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         1000 * gArgs.GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize =
         1000 * gArgs.GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.nMessageHandlerThreads =
+        gArgs.GetArg("-msghandlerthreads", DEFAULT_MSGHANDLER_THREADS);
     connOptions.m_added_nodes = gArgs.GetArgs("-addnode");
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
@@ -2483,6 +2770,10 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         return false;
     }
 
+    if (g_avalanche) {
+        g_avalanche->startEventLoop(scheduler);
+    }
+
     // Step 13: finished
 
     SetRPCWarmupFinished();
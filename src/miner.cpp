@@ -30,6 +30,7 @@
 #include <validationinterface.h>
 
 #include <algorithm>
+#include <functional>
 #include <queue>
 #include <utility>
 
@@ -41,6 +42,8 @@
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 
+std::unique_ptr<IncrementalBlockTemplate> g_block_template;
+
 int64_t UpdateTime(CBlockHeader *pblock, const Consensus::Params &params,
                    const CBlockIndex *pindexPrev) {
     int64_t nOldTime = pblock->nTime;
@@ -64,15 +67,111 @@ uint64_t CTxMemPoolModifiedEntry::GetVirtualSizeWithAncestors() const {
                                      nSigOpCountWithAncestors);
 }
 
+IncrementalBlockTemplate::IncrementalBlockTemplate(CTxMemPool &pool)
+    : mempool(pool) {
+    m_connNotifyEntryAdded = pool.NotifyEntryAdded.connect(std::bind(
+        &IncrementalBlockTemplate::TransactionAdded, this,
+        std::placeholders::_1));
+    m_connNotifyEntryRemoved = pool.NotifyEntryRemoved.connect(std::bind(
+        &IncrementalBlockTemplate::TransactionRemoved, this,
+        std::placeholders::_1, std::placeholders::_2));
+}
+
+void IncrementalBlockTemplate::TransactionAdded(CTransactionRef tx) {
+    LOCK(cs);
+    // Nothing to append to until the next template selects transactions.
+    if (!hashPrevBlock.IsNull()) {
+        pending.push_back(tx->GetId());
+    }
+}
+
+void IncrementalBlockTemplate::TransactionRemoved(CTransactionRef tx,
+                                                  MemPoolRemovalReason reason) {
+    LOCK(cs);
+    if (reason == MemPoolRemovalReason::BLOCK ||
+        reason == MemPoolRemovalReason::REORG) {
+        // The tip is changing, so is the next block.
+        Clear();
+        return;
+    }
+
+    auto it = selectedSequence.find(tx->GetId());
+    if (it == selectedSequence.end()) {
+        return;
+    }
+
+    // The descendants of the transaction are removed from the mempool as well,
+    // so the selection remains consistent.
+    auto sit = selected.find(it->second);
+    assert(sit != selected.end());
+    nSelectedSize -= sit->second.nTxSize;
+    nSelectedSigOps -= sit->second.entry.sigOpCount;
+    nSelectedFees -= sit->second.entry.fees;
+    selected.erase(sit);
+    selectedSequence.erase(it);
+}
+
+void IncrementalBlockTemplate::Clear() {
+    hashPrevBlock = BlockHash();
+    selected.clear();
+    selectedSequence.clear();
+    nSelectedSize = 0;
+    nSelectedSigOps = 0;
+    nSelectedFees = Amount::zero();
+    pending.clear();
+}
+
+void IncrementalBlockTemplate::Reset(const CBlockIndex *pindexPrev,
+                                     uint64_t nMaxSize, uint64_t nMaxSigChecks,
+                                     const CFeeRate &minFeeRate,
+                                     int64_t nNow) {
+    Clear();
+    hashPrevBlock = pindexPrev->GetBlockHash();
+    nMaxGeneratedBlockSize = nMaxSize;
+    nMaxGeneratedBlockSigChecks = nMaxSigChecks;
+    blockMinFeeRate = minFeeRate;
+    nTimeSelected = nNow;
+    fMissedTxs = false;
+}
+
+bool IncrementalBlockTemplate::IsUsableFor(const CBlockIndex *pindexPrev,
+                                           uint64_t nMaxSize,
+                                           uint64_t nMaxSigChecks,
+                                           const CFeeRate &minFeeRate,
+                                           int64_t nNow) const {
+    if (hashPrevBlock.IsNull() ||
+        hashPrevBlock != pindexPrev->GetBlockHash() ||
+        nMaxGeneratedBlockSize != nMaxSize ||
+        nMaxGeneratedBlockSigChecks != nMaxSigChecks ||
+        blockMinFeeRate != minFeeRate) {
+        return false;
+    }
+
+    return !fMissedTxs ||
+           nNow - nTimeSelected < BLOCK_TEMPLATE_REBUILD_INTERVAL;
+}
+
+void IncrementalBlockTemplate::Select(const CBlockTemplateEntry &entry,
+                                      uint64_t nTxSize) {
+    selectedSequence.emplace(entry.tx->GetId(), nSequence);
+    selected.emplace(nSequence++, SelectedTx{entry, nTxSize});
+    nSelectedSize += nTxSize;
+    nSelectedSigOps += entry.sigOpCount;
+    nSelectedFees += entry.fees;
+}
+
 BlockAssembler::Options::Options()
     : nExcessiveBlockSize(DEFAULT_MAX_BLOCK_SIZE),
       nMaxGeneratedBlockSize(DEFAULT_MAX_GENERATED_BLOCK_SIZE),
-      blockMinFeeRate(DEFAULT_BLOCK_MIN_TX_FEE_PER_KB) {}
+      blockMinFeeRate(DEFAULT_BLOCK_MIN_TX_FEE_PER_KB),
+      incrementalTemplate(nullptr) {}
 
 BlockAssembler::BlockAssembler(const CChainParams &params,
                                const CTxMemPool &_mempool,
                                const Options &options)
-    : chainparams(params), mempool(&_mempool) {
+    : chainparams(params), mempool(&_mempool),
+      incrementalTemplate(options.incrementalTemplate) {
+    assert(!incrementalTemplate || incrementalTemplate->IsTracking(_mempool));
     blockMinFeeRate = options.blockMinFeeRate;
     // Limit size to between 1K and options.nExcessiveBlockSize -1K for sanity:
     nMaxGeneratedBlockSize = std::max<uint64_t>(
@@ -88,7 +187,8 @@ BlockAssembler::BlockAssembler(const CChainParams &params,
     nMaxGeneratedBlockSigChecks = nMaxBlockSigChecks;
 }
 
-static BlockAssembler::Options DefaultOptions(const Config &config) {
+static BlockAssembler::Options DefaultOptions(const Config &config,
+                                              const CTxMemPool &mempool) {
     // Block resource limits
     // If -blockmaxsize is not given, limit to DEFAULT_MAX_GENERATED_BLOCK_SIZE
     // If only one is given, only restrict the specified resource.
@@ -108,12 +208,16 @@ static BlockAssembler::Options DefaultOptions(const Config &config) {
         options.blockMinFeeRate = CFeeRate(n);
     }
 
+    if (g_block_template && g_block_template->IsTracking(mempool)) {
+        options.incrementalTemplate = g_block_template.get();
+    }
+
     return options;
 }
 
 BlockAssembler::BlockAssembler(const Config &config, const CTxMemPool &_mempool)
     : BlockAssembler(config.GetChainParams(), _mempool,
-                     DefaultOptions(config)) {}
+                     DefaultOptions(config, _mempool)) {}
 
 void BlockAssembler::resetBlock() {
     inBlock.clear();
@@ -172,7 +276,15 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    int nTxsAppended = 0;
+    if (incrementalTemplate) {
+        LOCK(incrementalTemplate->cs);
+        if (!addIncrementalTxs(pindexPrev, nTxsAppended)) {
+            addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+        }
+    } else {
+        addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     if (IsMagneticAnomalyEnabled(consensusParams, pindexPrev)) {
         // If magnetic anomaly is enabled, we make sure transaction are
@@ -242,6 +354,11 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
                            BlockValidationOptions(nMaxGeneratedBlockSize)
                                .withCheckPoW(false)
                                .withCheckMerkleRoot(false))) {
+        if (incrementalTemplate) {
+            // Do not hand out the same invalid selection again.
+            LOCK(incrementalTemplate->cs);
+            incrementalTemplate->Clear();
+        }
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s",
                                            __func__,
                                            FormatStateMessage(state)));
@@ -250,9 +367,10 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
 
     LogPrint(BCLog::BENCH,
              "CreateNewBlock() packages: %.2fms (%d packages, %d updated "
-             "descendants), validity: %.2fms (total %.2fms)\n",
+             "descendants, %d appended txs), validity: %.2fms (total "
+             "%.2fms)\n",
              0.001 * (nTime1 - nTimeStart), nPackagesSelected,
-             nDescendantsUpdated, 0.001 * (nTime2 - nTime1),
+             nDescendantsUpdated, nTxsAppended, 0.001 * (nTime2 - nTime1),
              0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
@@ -326,6 +444,12 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter) {
     nFees += iter->GetFee();
     inBlock.insert(iter);
 
+    if (incrementalTemplate) {
+        AssertLockHeld(incrementalTemplate->cs);
+        incrementalTemplate->Select(pblocktemplate->entries.back(),
+                                    iter->GetTxSize());
+    }
+
     bool fPrintPriority =
         gArgs.GetBoolArg("-printpriority", DEFAULT_PRINTPRIORITY);
     if (fPrintPriority) {
@@ -558,6 +682,77 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected,
     }
 }
 
+bool BlockAssembler::addIncrementalTxs(const CBlockIndex *pindexPrev,
+                                       int &nTxsAppended) {
+    IncrementalBlockTemplate &selection = *incrementalTemplate;
+    const int64_t nNow = GetTime();
+    bool fUsable = selection.IsUsableFor(pindexPrev, nMaxGeneratedBlockSize,
+                                         nMaxGeneratedBlockSigChecks,
+                                         blockMinFeeRate, nNow);
+    // The mempool can be cleared without notifying the removed transactions.
+    for (auto it = selection.selected.begin();
+         fUsable && it != selection.selected.end(); ++it) {
+        fUsable = mempool->mapTx.count(it->second.entry.tx->GetId()) != 0;
+    }
+    if (!fUsable) {
+        selection.Reset(pindexPrev, nMaxGeneratedBlockSize,
+                        nMaxGeneratedBlockSigChecks, blockMinFeeRate, nNow);
+        return false;
+    }
+
+    for (const auto &s : selection.selected) {
+        pblocktemplate->entries.push_back(s.second.entry);
+    }
+    nBlockTx += selection.selected.size();
+    nBlockSize += selection.nSelectedSize;
+    nBlockSigOps += selection.nSelectedSigOps;
+    nFees += selection.nSelectedFees;
+
+    // The transactions are appended by order of arrival in the mempool, so
+    // parents come before their children.
+    std::vector<TxId> pending;
+    pending.swap(selection.pending);
+    for (const TxId &txid : pending) {
+        CTxMemPool::txiter it = mempool->mapTx.find(txid);
+        if (it == mempool->mapTx.end() || selection.IsSelected(txid)) {
+            continue;
+        }
+
+        // A parent left out may now be worth selecting along with this
+        // transaction, which only a new selection will find out.
+        bool fParentsSelected = true;
+        for (CTxMemPool::txiter parent : mempool->GetMemPoolParents(it)) {
+            if (!selection.IsSelected(parent->GetTx().GetId())) {
+                fParentsSelected = false;
+                break;
+            }
+        }
+        if (!fParentsSelected) {
+            selection.fMissedTxs = true;
+            continue;
+        }
+
+        if (it->GetModifiedFee() < blockMinFeeRate.GetFee(it->GetTxSize())) {
+            continue;
+        }
+
+        if (!TestPackage(it->GetTxSize(), it->GetSigOpCount())) {
+            // The transaction may be worth more than some selected ones.
+            selection.fMissedTxs = true;
+            continue;
+        }
+
+        if (!TestPackageTransactions({it})) {
+            continue;
+        }
+
+        AddToBlock(it);
+        ++nTxsAppended;
+    }
+
+    return true;
+}
+
 static const std::vector<uint8_t>
 getExcessiveBlockSizeSig(uint64_t nExcessiveBlockSize) {
     std::string cbmsg = "/EB" + getSubVersionEB(nExcessiveBlockSize) + "/";
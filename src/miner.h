@@ -7,13 +7,17 @@
 #define BITCOIN_MINER_H
 
 #include <primitives/block.h>
+#include <sync.h>
 #include <txmempool.h>
 
 #include <boost/multi_index/ordered_index.hpp>
 #include <boost/multi_index_container.hpp>
 
 #include <cstdint>
+#include <map>
 #include <memory>
+#include <unordered_map>
+#include <vector>
 
 class CBlockIndex;
 class CChainParams;
@@ -25,6 +29,14 @@ struct Params;
 }
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -incrementalblocktemplate */
+static const bool DEFAULT_INCREMENTAL_BLOCK_TEMPLATE = false;
+/**
+ * Number of seconds a transaction selection which could not take all the new
+ * mempool transactions into account is reused, before transactions are
+ * selected from the whole mempool again.
+ */
+static const int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 30;
 
 struct CBlockTemplateEntry {
     CTransactionRef tx;
@@ -128,6 +140,88 @@ struct update_for_parent_inclusion {
     CTxMemPool::txiter iter;
 };
 
+/**
+ * Transactions selected for the next block, kept up to date with the mempool
+ * so that templates built on the same tip do not select packages from the
+ * whole mempool again.
+ *
+ * Transactions entering the mempool are queued, and appended to the selection
+ * by the next template if their unconfirmed parents are selected and they
+ * fit. Selected transactions leaving the mempool are removed right away. The
+ * transactions are selected from the whole mempool again when the tip or the
+ * block limits change, and at most every BLOCK_TEMPLATE_REBUILD_INTERVAL
+ * seconds when transactions could not be appended.
+ *
+ * Nothing is ever evicted from the selection: until the next full selection,
+ * a transaction paying more than selected ones but not fitting in the block,
+ * or one whose parent was left out, is not mined. Templates can therefore pay
+ * less in fees than a full selection would, which is why this is only used
+ * with -incrementalblocktemplate.
+ */
+class IncrementalBlockTemplate {
+public:
+    explicit IncrementalBlockTemplate(CTxMemPool &pool);
+
+    bool IsTracking(const CTxMemPool &pool) const { return &pool == &mempool; }
+
+private:
+    friend class BlockAssembler;
+
+    struct SelectedTx {
+        CBlockTemplateEntry entry;
+        uint64_t nTxSize;
+    };
+
+    const CTxMemPool &mempool;
+    boost::signals2::scoped_connection m_connNotifyEntryAdded;
+    boost::signals2::scoped_connection m_connNotifyEntryRemoved;
+
+    Mutex cs;
+
+    // The tip and the block limits the transactions were selected for
+    BlockHash hashPrevBlock GUARDED_BY(cs);
+    uint64_t nMaxGeneratedBlockSize GUARDED_BY(cs) = 0;
+    uint64_t nMaxGeneratedBlockSigChecks GUARDED_BY(cs) = 0;
+    CFeeRate blockMinFeeRate GUARDED_BY(cs);
+    int64_t nTimeSelected GUARDED_BY(cs) = 0;
+    // Whether transactions were left out since the selection was made
+    bool fMissedTxs GUARDED_BY(cs) = false;
+
+    // The selected transactions, by order of selection
+    std::map<uint64_t, SelectedTx> selected GUARDED_BY(cs);
+    std::unordered_map<TxId, uint64_t, SaltedTxidHasher>
+        selectedSequence GUARDED_BY(cs);
+    uint64_t nSequence GUARDED_BY(cs) = 0;
+    uint64_t nSelectedSize GUARDED_BY(cs) = 0;
+    uint64_t nSelectedSigOps GUARDED_BY(cs) = 0;
+    Amount nSelectedFees GUARDED_BY(cs) = Amount::zero();
+
+    // Transactions which entered the mempool since the last template
+    std::vector<TxId> pending GUARDED_BY(cs);
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+
+    /** Drop the selection, the next template selects transactions again */
+    void Clear() EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Start a new selection for the given tip and limits */
+    void Reset(const CBlockIndex *pindexPrev, uint64_t nMaxSize,
+               uint64_t nMaxSigChecks, const CFeeRate &minFeeRate,
+               int64_t nNow) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Whether the selection can be reused for the given tip and limits */
+    bool IsUsableFor(const CBlockIndex *pindexPrev, uint64_t nMaxSize,
+                     uint64_t nMaxSigChecks, const CFeeRate &minFeeRate,
+                     int64_t nNow) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void Select(const CBlockTemplateEntry &entry, uint64_t nTxSize)
+        EXCLUSIVE_LOCKS_REQUIRED(cs);
+    bool IsSelected(const TxId &txid) const EXCLUSIVE_LOCKS_REQUIRED(cs) {
+        return selectedSequence.count(txid) != 0;
+    }
+};
+
+/** The selection tracking the global mempool, if any */
+extern std::unique_ptr<IncrementalBlockTemplate> g_block_template;
+
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler {
 private:
@@ -156,6 +250,7 @@ private:
     bool fUseSigChecks;
 
     const CTxMemPool *mempool;
+    IncrementalBlockTemplate *incrementalTemplate;
 
 public:
     struct Options {
@@ -163,6 +258,8 @@ public:
         uint64_t nExcessiveBlockSize;
         uint64_t nMaxGeneratedBlockSize;
         CFeeRate blockMinFeeRate;
+        // Selection to reuse and keep up to date, it must track the mempool
+        IncrementalBlockTemplate *incrementalTemplate;
     };
 
     BlockAssembler(const Config &config, const CTxMemPool &_mempool);
@@ -197,6 +294,14 @@ private:
      */
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
         EXCLUSIVE_LOCKS_REQUIRED(mempool->cs);
+    /**
+     * Add the transactions of the incremental template, and append the ones
+     * which entered the mempool since the last template. Returns false, with
+     * the selection reset and nothing added, if the selection cannot be
+     * reused for this block.
+     */
+    bool addIncrementalTxs(const CBlockIndex *pindexPrev, int &nTxsAppended)
+        EXCLUSIVE_LOCKS_REQUIRED(mempool->cs, incrementalTemplate->cs);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
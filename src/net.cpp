@@ -20,6 +20,7 @@
 #include <netbase.h>
 #include <primitives/transaction.h>
 #include <scheduler.h>
+#include <span.h>
 #include <ui_interface.h>
 #include <util/strencodings.h>
 
@@ -27,6 +28,7 @@
 #include <cstring>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_UPNP
@@ -36,7 +38,9 @@
 #include <miniupnpc/upnperrors.h>
 #endif
 
+#include <array>
 #include <cmath>
+#include <unordered_map>
 
 // Dump addresses to peers.dat every 15 minutes (900s)
 static constexpr int DUMP_PEERS_INTERVAL = 15 * 60;
@@ -45,6 +49,26 @@ static constexpr int DUMP_PEERS_INTERVAL = 15 * 60;
 // synchronization.
 #define FEELER_SLEEP_WINDOW 1
 
+// How long the socket handler waits for socket events before polling the send
+// queues of the peers again.
+static const int SELECT_TIMEOUT_MILLISECONDS = 50;
+
+// Maximum number of queued buffers written by one send call. There is no
+// sendmsg on Windows, so buffers are sent one at a time there.
+#ifdef WIN32
+static const size_t MAX_SEND_BUFFERS = 1;
+#else
+static const size_t MAX_SEND_BUFFERS = 64;
+#endif
+
+#ifdef USE_EPOLL
+// Maximum number of events read from the epoll instance per wait.
+static const int EPOLL_MAX_EVENTS = 256;
+// Tags the epoll data of the listening sockets, which otherwise holds the id
+// of the peer using the socket.
+static const uint64_t EPOLL_LISTEN_SOCKET = uint64_t(1) << 63;
+#endif
+
 // MSG_NOSIGNAL is not available on some platforms, if it doesn't exist define
 // it as 0
 #if !defined(MSG_NOSIGNAL)
@@ -534,6 +558,7 @@ void CNode::copyStats(CNodeStats &stats) {
         stats.mapRecvBytesPerMsgCmd = mapRecvBytesPerMsgCmd;
         stats.nRecvBytes = nRecvBytes;
     }
+    stats.nSocketChecks = nSocketChecks;
     stats.fWhitelisted = fWhitelisted;
     {
         LOCK(cs_feeFilter);
@@ -583,8 +608,8 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
     while (nBytes > 0) {
         // Get current incomplete message, or create a new one.
         if (vRecvMsg.empty() || vRecvMsg.back().complete()) {
-            vRecvMsg.push_back(CNetMessage(config.GetChainParams().NetMagic(),
-                                           SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.emplace_back(config.GetChainParams().NetMagic(),
+                                  SER_NETWORK, INIT_PROTO_VERSION);
         }
 
         CNetMessage &msg = vRecvMsg.back();
@@ -657,6 +682,62 @@ int CNode::GetSendVersion() const {
     return nSendVersion;
 }
 
+CNetMessageBufferPool g_net_message_buffer_pool;
+
+CNetMessageBufferPool::Buffer CNetMessageBufferPool::Get(size_t nSize) {
+    const unsigned int nBits = std::min<unsigned int>(
+        std::max<unsigned int>(CountBits(nSize > 0 ? nSize - 1 : 0),
+                               MIN_CLASS_BITS),
+        MAX_CLASS_BITS);
+    {
+        LOCK(m_mutex);
+        std::vector<Buffer> &buffers = m_buffers[nBits - MIN_CLASS_BITS];
+        if (!buffers.empty()) {
+            Buffer buffer = std::move(buffers.back());
+            buffers.pop_back();
+            m_pooled_bytes -= buffer.capacity();
+            m_hits++;
+            return buffer;
+        }
+        m_misses++;
+    }
+
+    Buffer buffer;
+    buffer.reserve(size_t(1) << nBits);
+    return buffer;
+}
+
+void CNetMessageBufferPool::Release(Buffer &&buffer) {
+    const size_t nCapacity = buffer.capacity();
+    if (nCapacity < (size_t(1) << MIN_CLASS_BITS) ||
+        nCapacity >= (size_t(2) << MAX_CLASS_BITS)) {
+        return;
+    }
+    // The class of a buffer is the largest one its capacity covers.
+    const unsigned int nBits = CountBits(nCapacity) - 1;
+
+    buffer.clear();
+    LOCK(m_mutex);
+    if (m_pooled_bytes + nCapacity > MAX_POOLED_BYTES) {
+        return;
+    }
+    m_buffers[nBits - MIN_CLASS_BITS].push_back(std::move(buffer));
+    m_pooled_bytes += nCapacity;
+}
+
+CNetMessageBufferPool::Stats CNetMessageBufferPool::GetStats() const {
+    LOCK(m_mutex);
+    Stats stats;
+    stats.nHits = m_hits;
+    stats.nMisses = m_misses;
+    stats.nBuffers = 0;
+    for (const std::vector<Buffer> &buffers : m_buffers) {
+        stats.nBuffers += buffers.size();
+    }
+    stats.nBytes = m_pooled_bytes;
+    return stats;
+}
+
 int CNetMessage::readHeader(const Config &config, const char *pch,
                             uint32_t nBytes) {
     // copy data to temporary parsing buffer
@@ -684,6 +765,13 @@ int CNetMessage::readHeader(const Config &config, const char *pch,
         return -1;
     }
 
+    // Take a recycled buffer for the payload, sized from the header but no
+    // larger than the largest pooled size class, as the header is not proof
+    // that the payload will follow.
+    if (hdr.nMessageSize > 0) {
+        vRecv.SetBuffer(g_net_message_buffer_pool.Get(hdr.nMessageSize));
+    }
+
     // switch state to reading message data
     in_data = true;
 
@@ -715,30 +803,65 @@ const uint256 &CNetMessage::GetMessageHash() const {
     return data_hash;
 }
 
+/**
+ * Write the buffers to the socket with a single call, returning the number of
+ * bytes written as send does.
+ */
+static int SendBuffers(SOCKET hSocket,
+                       const std::array<Span<const uint8_t>, MAX_SEND_BUFFERS>
+                           &buffers,
+                       size_t nBuffers) {
+#ifdef WIN32
+    assert(nBuffers == 1);
+    return send(hSocket, reinterpret_cast<const char *>(buffers[0].data()),
+                buffers[0].size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+    std::array<struct iovec, MAX_SEND_BUFFERS> iov;
+    for (size_t i = 0; i < nBuffers; i++) {
+        iov[i].iov_base = const_cast<uint8_t *>(buffers[i].data());
+        iov[i].iov_len = buffers[i].size();
+    }
+    struct msghdr msg = {};
+    msg.msg_iov = iov.data();
+    msg.msg_iovlen = nBuffers;
+    return sendmsg(hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
 size_t CConnman::SocketSendData(CNode *pnode) const
     EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend) {
     size_t nSentSize = 0;
     size_t nMsgCount = 0;
 
-    for (const auto &data : pnode->vSendMsg) {
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = 0;
+    while (nMsgCount < pnode->vSendMsg.size()) {
+        // Gather the unsent part of the queued messages, so that the headers
+        // and payloads of several messages are written with one call.
+        std::array<Span<const uint8_t>, MAX_SEND_BUFFERS> buffers;
+        size_t nBuffers = 0;
+        size_t nBytesQueued = 0;
+        for (auto it = pnode->vSendMsg.begin() + nMsgCount;
+             it != pnode->vSendMsg.end() && nBuffers < MAX_SEND_BUFFERS;
+             ++it) {
+            const size_t nOffset = nBuffers == 0 ? pnode->nSendOffset : 0;
+            assert(it->size() > nOffset);
+            buffers[nBuffers++] =
+                Span<const uint8_t>(it->data() + nOffset, it->size() - nOffset);
+            nBytesQueued += it->size() - nOffset;
+        }
 
+        int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET) {
                 break;
             }
 
-            nBytes = send(pnode->hSocket,
-                          reinterpret_cast<const char *>(data.data()) +
-                              pnode->nSendOffset,
-                          data.size() - pnode->nSendOffset,
-                          MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = SendBuffers(pnode->hSocket, buffers, nBuffers);
         }
 
         if (nBytes == 0) {
             // couldn't send anything at all
+            pnode->m_sock_send_ready = false;
             break;
         }
 
@@ -751,23 +874,36 @@ size_t CConnman::SocketSendData(CNode *pnode) const
                 pnode->CloseSocketDisconnect();
             }
 
+            pnode->m_sock_send_ready = false;
             break;
         }
 
         assert(nBytes > 0);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size()) {
-            // could not send full message; stop sending more
-            break;
+
+        // Pop the messages that were fully sent.
+        size_t nBytesLeft = nBytes;
+        while (nBytesLeft > 0) {
+            const CSendBuffer &data = pnode->vSendMsg[nMsgCount];
+            const size_t nUnsent = data.size() - pnode->nSendOffset;
+            if (nBytesLeft < nUnsent) {
+                pnode->nSendOffset += nBytesLeft;
+                break;
+            }
+            nBytesLeft -= nUnsent;
+            pnode->nSendOffset = 0;
+            pnode->nSendSize -= data.size();
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            nMsgCount++;
         }
 
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
-        pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
+        if (size_t(nBytes) != nBytesQueued) {
+            // could not send everything; stop sending more
+            pnode->m_sock_send_ready = false;
+            break;
+        }
     }
 
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(),
@@ -1004,7 +1140,8 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket)) {
+    if (g_socket_events_mode == SocketEventsMode::Select &&
+        !IsSelectableSocket(hSocket)) {
         LogPrintf("connection from %s dropped: non-selectable socket\n",
                   addr.ToString());
         CloseSocket(hSocket);
@@ -1057,6 +1194,11 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+#ifdef USE_EPOLL
+        if (g_socket_events_mode == SocketEventsMode::Epoll) {
+            m_epoll_new_nodes.push_back(pnode);
+        }
+#endif
     }
 }
 
@@ -1083,6 +1225,14 @@ void CConnman::DisconnectNodes() {
                 // remove from vNodes
                 vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode),
                              vNodes.end());
+#ifdef USE_EPOLL
+                // Closing the socket below unregisters it from epoll.
+                m_epoll_new_nodes.erase(remove(m_epoll_new_nodes.begin(),
+                                               m_epoll_new_nodes.end(), pnode),
+                                        m_epoll_new_nodes.end());
+                m_epoll_nodes.erase(pnode->GetId());
+                m_epoll_ready_nodes.erase(pnode->GetId());
+#endif
 
                 // release outbound grant (if any)
                 pnode->grantOutbound.Release();
@@ -1168,33 +1318,17 @@ void CConnman::InactivityCheck(CNode *pnode) {
     }
 }
 
-void CConnman::SocketHandler() {
-    //
-    // Find which sockets have data to receive
-    //
-    struct timeval timeout;
-    timeout.tv_sec = 0;
-    // Frequency to poll pnode->vSend
-    timeout.tv_usec = 50000;
-
-    fd_set fdsetRecv;
-    fd_set fdsetSend;
-    fd_set fdsetError;
-    FD_ZERO(&fdsetRecv);
-    FD_ZERO(&fdsetSend);
-    FD_ZERO(&fdsetError);
-    SOCKET hSocketMax = 0;
-    bool have_fds = false;
-
+bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set,
+                                 std::set<SOCKET> &send_set,
+                                 std::set<SOCKET> &error_set) {
     for (const ListenSocket &hListenSocket : vhListenSocket) {
-        FD_SET(hListenSocket.socket, &fdsetRecv);
-        hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-        have_fds = true;
+        recv_set.insert(hListenSocket.socket);
     }
 
     {
         LOCK(cs_vNodes);
         for (CNode *pnode : vNodes) {
+            pnode->nSocketChecks++;
             // Implement the following logic:
             // * If there is data to send, select() for sending data. As this
             //   only happens when optimistic write failed, we choose to first
@@ -1219,20 +1353,56 @@ void CConnman::SocketHandler() {
                 continue;
             }
 
-            FD_SET(pnode->hSocket, &fdsetError);
-            hSocketMax = std::max(hSocketMax, pnode->hSocket);
-            have_fds = true;
-
+            error_set.insert(pnode->hSocket);
             if (select_send) {
-                FD_SET(pnode->hSocket, &fdsetSend);
+                send_set.insert(pnode->hSocket);
                 continue;
             }
             if (select_recv) {
-                FD_SET(pnode->hSocket, &fdsetRecv);
+                recv_set.insert(pnode->hSocket);
             }
         }
     }
 
+    return !recv_set.empty() || !send_set.empty() || !error_set.empty();
+}
+
+void CConnman::SocketEventsSelect(std::set<SOCKET> &recv_set,
+                                  std::set<SOCKET> &send_set,
+                                  std::set<SOCKET> &error_set) {
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    const bool have_fds =
+        GenerateSelectSet(recv_select_set, send_select_set, error_select_set);
+
+    //
+    // Find which sockets have data to receive
+    //
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    // Frequency to poll pnode->vSend
+    timeout.tv_usec = SELECT_TIMEOUT_MILLISECONDS * 1000;
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+
+    for (SOCKET hSocket : recv_select_set) {
+        FD_SET(hSocket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : send_select_set) {
+        FD_SET(hSocket, &fdsetSend);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+    for (SOCKET hSocket : error_select_set) {
+        FD_SET(hSocket, &fdsetError);
+        hSocketMax = std::max(hSocketMax, hSocket);
+    }
+
     int nSelect = select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv, &fdsetSend,
                          &fdsetError, &timeout);
     if (interruptNet) {
@@ -1250,17 +1420,248 @@ void CConnman::SocketHandler() {
         FD_ZERO(&fdsetSend);
         FD_ZERO(&fdsetError);
         if (!interruptNet.sleep_for(
-                std::chrono::milliseconds(timeout.tv_usec / 1000))) {
+                std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS))) {
             return;
         }
     }
 
+    for (SOCKET hSocket : recv_select_set) {
+        if (FD_ISSET(hSocket, &fdsetRecv)) {
+            recv_set.insert(hSocket);
+        }
+    }
+    for (SOCKET hSocket : send_select_set) {
+        if (FD_ISSET(hSocket, &fdsetSend)) {
+            send_set.insert(hSocket);
+        }
+    }
+    for (SOCKET hSocket : error_select_set) {
+        if (FD_ISSET(hSocket, &fdsetError)) {
+            error_set.insert(hSocket);
+        }
+    }
+}
+
+#ifdef USE_POLL
+void CConnman::SocketEventsPoll(std::set<SOCKET> &recv_set,
+                                std::set<SOCKET> &send_set,
+                                std::set<SOCKET> &error_set) {
+    std::set<SOCKET> recv_select_set, send_select_set, error_select_set;
+    if (!GenerateSelectSet(recv_select_set, send_select_set,
+                           error_select_set)) {
+        interruptNet.sleep_for(
+            std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        return;
+    }
+
+    std::unordered_map<SOCKET, struct pollfd> pollfds;
+    for (SOCKET socket_id : recv_select_set) {
+        pollfds[socket_id].fd = socket_id;
+        pollfds[socket_id].events |= POLLIN;
+    }
+    for (SOCKET socket_id : send_select_set) {
+        pollfds[socket_id].fd = socket_id;
+        pollfds[socket_id].events |= POLLOUT;
+    }
+    for (SOCKET socket_id : error_select_set) {
+        pollfds[socket_id].fd = socket_id;
+        // These flags are ignored, but we set them for clarity
+        pollfds[socket_id].events |= POLLERR | POLLHUP;
+    }
+
+    std::vector<struct pollfd> vpollfds;
+    vpollfds.reserve(pollfds.size());
+    for (const auto &it : pollfds) {
+        vpollfds.push_back(it.second);
+    }
+
+    if (poll(vpollfds.data(), vpollfds.size(), SELECT_TIMEOUT_MILLISECONDS) <
+        0) {
+        return;
+    }
+
+    if (interruptNet) {
+        return;
+    }
+
+    for (const struct pollfd &pollfd_entry : vpollfds) {
+        if (pollfd_entry.revents & POLLIN) {
+            recv_set.insert(pollfd_entry.fd);
+        }
+        if (pollfd_entry.revents & POLLOUT) {
+            send_set.insert(pollfd_entry.fd);
+        }
+        if (pollfd_entry.revents & (POLLERR | POLLHUP)) {
+            error_set.insert(pollfd_entry.fd);
+        }
+    }
+}
+#endif
+
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll(std::set<SOCKET> &recv_set,
+                                 std::set<SOCKET> &send_set,
+                                 std::set<SOCKET> &error_set) {
+    // The sockets stay registered until they are closed, and the edges reported
+    // for them are remembered by the nodes until a recv() or send() would
+    // block. Only the nodes with events, and the ones which were still ready
+    // after the last pass, are checked, so idle peers cost nothing.
+    m_epoll_service_nodes.clear();
+    {
+        LOCK(cs_vNodes);
+        for (CNode *pnode : m_epoll_new_nodes) {
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET) {
+                continue;
+            }
+
+            // The readiness of the socket is reported by the next wait.
+            struct epoll_event event = {};
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.u64 = uint64_t(pnode->GetId());
+            if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, pnode->hSocket, &event) ==
+                SOCKET_ERROR) {
+                LogPrintf("epoll_ctl for peer=%d failed: %s\n", pnode->GetId(),
+                          NetworkErrorString(WSAGetLastError()));
+                pnode->fDisconnect = true;
+                continue;
+            }
+            m_epoll_nodes.emplace(pnode->GetId(), pnode);
+        }
+        m_epoll_new_nodes.clear();
+    }
+
+    std::array<struct epoll_event, EPOLL_MAX_EVENTS> events;
+    int nEvents =
+        epoll_wait(m_epoll_fd, events.data(), events.size(),
+                   m_epoll_pending ? 0 : SELECT_TIMEOUT_MILLISECONDS);
+    if (interruptNet) {
+        return;
+    }
+
+    if (nEvents == SOCKET_ERROR) {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(nErr));
+        }
+        if (!interruptNet.sleep_for(
+                std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS))) {
+            return;
+        }
+        nEvents = 0;
+    }
+
+    std::unordered_map<NodeId, uint32_t> node_events;
+    for (int i = 0; i < nEvents; i++) {
+        const uint64_t data = events[i].data.u64;
+        if (data & EPOLL_LISTEN_SOCKET) {
+            recv_set.insert(vhListenSocket[data & ~EPOLL_LISTEN_SOCKET].socket);
+            continue;
+        }
+        node_events[NodeId(data)] |= events[i].events;
+    }
+    for (const NodeId id : m_epoll_ready_nodes) {
+        node_events.emplace(id, 0);
+    }
+
+    m_epoll_pending = false;
+    m_epoll_ready_nodes.clear();
+
+    for (const auto &node_event : node_events) {
+        auto it = m_epoll_nodes.find(node_event.first);
+        if (it == m_epoll_nodes.end()) {
+            continue;
+        }
+        CNode *pnode = it->second;
+        const uint32_t event_mask = node_event.second;
+        pnode->nSocketChecks++;
+
+        if (event_mask & (EPOLLIN | EPOLLRDHUP | EPOLLERR | EPOLLHUP)) {
+            pnode->m_sock_recv_ready = true;
+        }
+
+        // Same logic as GenerateSelectSet(): drain the write buffer before
+        // receiving more.
+        bool select_send;
+        bool send_ready;
+        {
+            LOCK(pnode->cs_vSend);
+            if (event_mask & EPOLLOUT) {
+                pnode->m_sock_send_ready = true;
+            }
+            select_send = !pnode->vSendMsg.empty();
+            send_ready = pnode->m_sock_send_ready;
+        }
+
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET) {
+            continue;
+        }
+
+        bool service = false;
+        if (event_mask & (EPOLLERR | EPOLLHUP)) {
+            error_set.insert(pnode->hSocket);
+            service = true;
+        }
+        if (select_send) {
+            // Otherwise, an EPOLLOUT event comes once the socket is writable.
+            if (send_ready) {
+                send_set.insert(pnode->hSocket);
+                m_epoll_ready_nodes.insert(pnode->GetId());
+                m_epoll_pending = true;
+                service = true;
+            }
+        } else if (pnode->m_sock_recv_ready) {
+            // Paused nodes are checked again on each pass, until the message
+            // handler has room for what they send.
+            m_epoll_ready_nodes.insert(pnode->GetId());
+            if (!pnode->fPauseRecv) {
+                recv_set.insert(pnode->hSocket);
+                m_epoll_pending = true;
+                service = true;
+            }
+        }
+        if (service) {
+            m_epoll_service_nodes.push_back(pnode);
+        }
+    }
+}
+#endif
+
+void CConnman::SocketEvents(std::set<SOCKET> &recv_set,
+                            std::set<SOCKET> &send_set,
+                            std::set<SOCKET> &error_set) {
+    switch (g_socket_events_mode) {
+#ifdef USE_POLL
+        case SocketEventsMode::Poll:
+            SocketEventsPoll(recv_set, send_set, error_set);
+            return;
+#endif
+#ifdef USE_EPOLL
+        case SocketEventsMode::Epoll:
+            SocketEventsEpoll(recv_set, send_set, error_set);
+            return;
+#endif
+        default:
+            SocketEventsSelect(recv_set, send_set, error_set);
+            return;
+    }
+}
+
+void CConnman::SocketHandler() {
+    std::set<SOCKET> recv_set, send_set, error_set;
+    SocketEvents(recv_set, send_set, error_set);
+
+    if (interruptNet) {
+        return;
+    }
+
     //
     // Accept new connections
     //
     for (const ListenSocket &hListenSocket : vhListenSocket) {
         if (hListenSocket.socket != INVALID_SOCKET &&
-            FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
+            recv_set.count(hListenSocket.socket) > 0) {
             AcceptConnection(hListenSocket);
         }
     }
@@ -1272,6 +1673,20 @@ void CConnman::SocketHandler() {
     {
         LOCK(cs_vNodes);
         vNodesCopy = vNodes;
+#ifdef USE_EPOLL
+        if (g_socket_events_mode == SocketEventsMode::Epoll) {
+            // Only the nodes with ready sockets are serviced, so the idle ones
+            // are checked for inactivity separately.
+            const int64_t nTime = GetSystemTimeInSeconds();
+            if (nTime != m_epoll_inactivity_check_time) {
+                m_epoll_inactivity_check_time = nTime;
+                for (CNode *pnode : vNodes) {
+                    InactivityCheck(pnode);
+                }
+            }
+            vNodesCopy = m_epoll_service_nodes;
+        }
+#endif
         for (CNode *pnode : vNodesCopy) {
             pnode->AddRef();
         }
@@ -1292,9 +1707,9 @@ void CConnman::SocketHandler() {
             if (pnode->hSocket == INVALID_SOCKET) {
                 continue;
             }
-            recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-            sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-            errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
+            recvSet = recv_set.count(pnode->hSocket) > 0;
+            sendSet = send_set.count(pnode->hSocket) > 0;
+            errorSet = error_set.count(pnode->hSocket) > 0;
         }
         if (recvSet || errorSet) {
             // typical socket buffer is 8K-64K
@@ -1309,6 +1724,10 @@ void CConnman::SocketHandler() {
                     recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
             }
             if (nBytes > 0) {
+                if (size_t(nBytes) < sizeof(pchBuf)) {
+                    // The socket buffer was drained.
+                    pnode->m_sock_recv_ready = false;
+                }
                 bool notify = false;
                 if (!pnode->ReceiveMsgBytes(*config, pchBuf, nBytes, notify)) {
                     pnode->CloseSocketDisconnect();
@@ -1344,6 +1763,9 @@ void CConnman::SocketHandler() {
             } else if (nBytes < 0) {
                 // error
                 int nErr = WSAGetLastError();
+                if (nErr == WSAEWOULDBLOCK) {
+                    pnode->m_sock_recv_ready = false;
+                }
                 if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE &&
                     nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
                     if (!pnode->fDisconnect) {
@@ -1966,61 +2388,100 @@ void CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
+#ifdef USE_EPOLL
+        if (g_socket_events_mode == SocketEventsMode::Epoll) {
+            m_epoll_new_nodes.push_back(pnode);
+        }
+#endif
     }
 }
 
 void CConnman::ThreadMessageHandler() {
-    while (!flagInterruptMsgProc) {
-        std::vector<CNode *> vNodesCopy;
+    CNode *pnode = nullptr;
+    bool fMoreNodeWork = false;
+    while (true) {
         {
-            LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode *pnode : vNodesCopy) {
-                pnode->AddRef();
-            }
-        }
-
-        bool fMoreWork = false;
-
-        for (CNode *pnode : vNodesCopy) {
-            if (pnode->fDisconnect) {
-                continue;
+            WAIT_LOCK(mutexMsgProc, lock);
+            if (pnode) {
+                // Hand back the node processed last.
+                pnode->m_msgproc_busy = false;
+                m_msgproc_more_work |= fMoreNodeWork;
+                if (pnode->m_msgproc_requeue && !flagInterruptMsgProc) {
+                    m_msgproc_queue.push_back(pnode);
+                    condMsgProc.notify_one();
+                } else {
+                    pnode->Release();
+                }
+                pnode->m_msgproc_requeue = false;
+                pnode = nullptr;
             }
 
-            // Receive messages
-            bool fMoreNodeWork = m_msgproc->ProcessMessages(
-                *config, pnode, flagInterruptMsgProc);
-            fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
             if (flagInterruptMsgProc) {
                 return;
             }
 
-            // Send messages
-            {
-                LOCK(pnode->cs_sendProcessing);
-                m_msgproc->SendMessages(*config, pnode, flagInterruptMsgProc);
-            }
+            if (m_msgproc_queue.empty()) {
+                // Start another round when a node has more work or received
+                // messages, or every 100ms.
+                const auto next_round =
+                    m_msgproc_round_start + std::chrono::milliseconds(100);
+                if (!m_msgproc_more_work && !fMsgProcWake &&
+                    std::chrono::steady_clock::now() < next_round) {
+                    condMsgProc.wait_until(
+                        lock, next_round,
+                        [this]() EXCLUSIVE_LOCKS_REQUIRED(mutexMsgProc) {
+                            return fMsgProcWake || m_msgproc_more_work ||
+                                   !m_msgproc_queue.empty() ||
+                                   flagInterruptMsgProc;
+                        });
+                    continue;
+                }
 
-            if (flagInterruptMsgProc) {
-                return;
+                fMsgProcWake = false;
+                m_msgproc_more_work = false;
+                m_msgproc_round_start = std::chrono::steady_clock::now();
+                {
+                    LOCK(cs_vNodes);
+                    for (CNode *pnode_queued : vNodes) {
+                        pnode_queued->AddRef();
+                        m_msgproc_queue.push_back(pnode_queued);
+                    }
+                }
+                condMsgProc.notify_all();
+                continue;
             }
-        }
 
-        {
-            LOCK(cs_vNodes);
-            for (CNode *pnode : vNodesCopy) {
+            pnode = m_msgproc_queue.front();
+            m_msgproc_queue.pop_front();
+            if (pnode->m_msgproc_busy) {
+                // Another thread is processing the node, which is queued again
+                // once it is done.
+                pnode->m_msgproc_requeue = true;
+                pnode->Release();
+                pnode = nullptr;
+                continue;
+            }
+            if (pnode->fDisconnect) {
                 pnode->Release();
+                pnode = nullptr;
+                continue;
             }
+            pnode->m_msgproc_busy = true;
         }
 
-        WAIT_LOCK(mutexMsgProc, lock);
-        if (!fMoreWork) {
-            condMsgProc.wait_until(lock,
-                                   std::chrono::steady_clock::now() +
-                                       std::chrono::milliseconds(100),
-                                   [this] { return fMsgProcWake; });
+        // Receive messages
+        fMoreNodeWork =
+            m_msgproc->ProcessMessages(*config, pnode, flagInterruptMsgProc);
+        fMoreNodeWork &= !pnode->fPauseSend;
+        if (flagInterruptMsgProc) {
+            continue;
+        }
+
+        // Send messages
+        {
+            LOCK(pnode->cs_sendProcessing);
+            m_msgproc->SendMessages(*config, pnode, flagInterruptMsgProc);
         }
-        fMsgProcWake = false;
     }
 }
 
@@ -2241,6 +2702,35 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
         return false;
     }
 
+#ifdef USE_EPOLL
+    if (g_socket_events_mode == SocketEventsMode::Epoll) {
+        m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        if (m_epoll_fd == -1) {
+            if (clientInterface) {
+                clientInterface->ThreadSafeMessageBox(
+                    strprintf(_("Failed to create the epoll instance (%s). "
+                                "Try -socketevents=poll."),
+                              NetworkErrorString(WSAGetLastError())),
+                    "", CClientUIInterface::MSG_ERROR);
+            }
+            return false;
+        }
+        m_epoll_pending = false;
+
+        // Node sockets are registered by the socket handler thread.
+        for (size_t i = 0; i < vhListenSocket.size(); i++) {
+            struct epoll_event event = {};
+            event.events = EPOLLIN;
+            event.data.u64 = EPOLL_LISTEN_SOCKET | i;
+            if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, vhListenSocket[i].socket,
+                          &event) == SOCKET_ERROR) {
+                LogPrintf("epoll_ctl for listening socket failed: %s\n",
+                          NetworkErrorString(WSAGetLastError()));
+            }
+        }
+    }
+#endif
+
     for (const auto &strDest : connOptions.vSeedNodes) {
         AddOneShot(strDest);
     }
@@ -2288,6 +2778,8 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
     {
         LOCK(mutexMsgProc);
         fMsgProcWake = false;
+        m_msgproc_more_work = false;
+        m_msgproc_round_start = std::chrono::steady_clock::now();
     }
 
     // Send and receive from sockets, accept connections
@@ -2330,10 +2822,15 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
     }
 
     // Process messages
-    threadMessageHandler =
-        std::thread(&TraceThread<std::function<void()>>, "msghand",
-                    std::function<void()>(
-                        std::bind(&CConnman::ThreadMessageHandler, this)));
+    const int nMessageHandlerThreads = std::max(
+        1, std::min(connOptions.nMessageHandlerThreads, MAX_MSGHANDLER_THREADS));
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        const std::string name =
+            i == 0 ? "msghand" : strprintf("msghand.%d", i);
+        threadMessageHandlers.emplace_back([this, name]() {
+            TraceThread(name.c_str(), [this]() { ThreadMessageHandler(); });
+        });
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(
@@ -2382,8 +2879,18 @@ void CConnman::Interrupt() {
 }
 
 void CConnman::Stop() {
-    if (threadMessageHandler.joinable()) {
-        threadMessageHandler.join();
+    for (std::thread &thread : threadMessageHandlers) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threadMessageHandlers.clear();
+    {
+        LOCK(mutexMsgProc);
+        for (CNode *pnode : m_msgproc_queue) {
+            pnode->Release();
+        }
+        m_msgproc_queue.clear();
     }
     if (threadOpenConnections.joinable()) {
         threadOpenConnections.join();
@@ -2415,6 +2922,12 @@ void CConnman::Stop() {
             }
         }
     }
+#ifdef USE_EPOLL
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+#endif
 
     // clean up some globals (to help leak detection)
     for (CNode *pnode : vNodes) {
@@ -2425,6 +2938,12 @@ void CConnman::Stop() {
     }
     vNodes.clear();
     vNodesDisconnected.clear();
+#ifdef USE_EPOLL
+    m_epoll_new_nodes.clear();
+    m_epoll_nodes.clear();
+    m_epoll_ready_nodes.clear();
+    m_epoll_service_nodes.clear();
+#endif
     vhListenSocket.clear();
     semOutbound.reset();
     semAddnode.reset();
@@ -2709,14 +3228,17 @@ bool CConnman::NodeFullyConnected(const CNode *pnode) {
 }
 
 void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
-    size_t nMessageSize = msg.data.size();
+    size_t nMessageSize =
+        msg.shared_payload ? msg.shared_payload->data.size() : msg.data.size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",
              SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
 
     std::vector<uint8_t> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    uint256 hash = msg.shared_payload
+                       ? msg.shared_payload->hash
+                       : Hash(msg.data.data(), msg.data.data() + nMessageSize);
     CMessageHeader hdr(config->GetChainParams().NetMagic(), msg.command.c_str(),
                        nMessageSize);
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
@@ -2735,9 +3257,13 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
         if (pnode->nSendSize > nSendBufferMaxSize) {
             pnode->fPauseSend = true;
         }
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.emplace_back(std::move(serializedHeader));
         if (nMessageSize) {
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            if (msg.shared_payload) {
+                pnode->vSendMsg.emplace_back(std::move(msg.shared_payload));
+            } else {
+                pnode->vSendMsg.emplace_back(std::move(msg.data));
+            }
         }
 
         // If write queue empty, attempt "optimistic write"
@@ -2764,15 +3290,20 @@ bool CConnman::ForNode(NodeId id, std::function<bool(CNode *pnode)> func) {
 
 int64_t CConnman::PoissonNextSendInbound(int64_t now,
                                          int average_interval_seconds) {
-    if (m_next_send_inv_to_incoming < now) {
-        // If this function were called from multiple threads simultaneously
-        // it would be possible that both update the next send variable, and
-        // return a different result to their caller. This is not possible in
-        // practice as only the net processing thread invokes this function.
-        m_next_send_inv_to_incoming =
+    // The message handler threads call this function concurrently. Only one
+    // of them replaces an expired time, and the others return the time it
+    // stored, so that all the inbound peers share the same timer.
+    int64_t next = m_next_send_inv_to_incoming.load();
+    while (next < now) {
+        const int64_t candidate =
             PoissonNextSend(now, average_interval_seconds);
+        if (m_next_send_inv_to_incoming.compare_exchange_weak(next,
+                                                              candidate)) {
+            return candidate;
+        }
+        // On failure, next was set to the time stored by another thread.
     }
-    return m_next_send_inv_to_incoming;
+    return next;
 }
 
 int64_t PoissonNextSend(int64_t now, int average_interval_seconds) {
@@ -24,12 +24,16 @@
 #include <threadinterrupt.h>
 #include <uint256.h>
 
+#include <array>
 #include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <cstdint>
 #include <deque>
 #include <memory>
+#include <set>
 #include <thread>
+#include <unordered_map>
 
 #ifndef WIN32
 #include <arpa/inet.h>
@@ -87,6 +91,10 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER = 1 * 1000;
+/** Default number of message handler threads (-msghandlerthreads) */
+static const int DEFAULT_MSGHANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MSGHANDLER_THREADS = 16;
 
 typedef int64_t NodeId;
 
@@ -100,6 +108,19 @@ struct AddedNodeInfo {
 struct CNodeStats;
 class CClientUIInterface;
 
+/**
+ * A message payload that is serialized and checksummed once, and queued for
+ * any number of peers without copying it.
+ */
+struct CSharedNetMsgPayload {
+    explicit CSharedNetMsgPayload(std::vector<uint8_t> &&dataIn)
+        : data(std::move(dataIn)), hash(Hash(data.begin(), data.end())) {}
+
+    const std::vector<uint8_t> data;
+    //! Double SHA256 of the payload, the message checksum is its prefix.
+    const uint256 hash;
+};
+
 struct CSerializedNetMsg {
     CSerializedNetMsg() = default;
     CSerializedNetMsg(CSerializedNetMsg &&) = default;
@@ -109,9 +130,34 @@ struct CSerializedNetMsg {
     CSerializedNetMsg &operator=(const CSerializedNetMsg &) = delete;
 
     std::vector<uint8_t> data;
+    //! Payload sent instead of data when set.
+    std::shared_ptr<const CSharedNetMsgPayload> shared_payload;
     std::string command;
 };
 
+/**
+ * Bytes queued for sending to a peer, either owned by the queue or shared with
+ * the queues of other peers.
+ */
+class CSendBuffer {
+private:
+    std::vector<uint8_t> m_owned;
+    std::shared_ptr<const CSharedNetMsgPayload> m_shared;
+
+public:
+    explicit CSendBuffer(std::vector<uint8_t> &&owned)
+        : m_owned(std::move(owned)) {}
+    explicit CSendBuffer(std::shared_ptr<const CSharedNetMsgPayload> shared)
+        : m_shared(std::move(shared)) {}
+
+    const uint8_t *data() const {
+        return m_shared ? m_shared->data.data() : m_owned.data();
+    }
+    size_t size() const {
+        return m_shared ? m_shared->data.size() : m_owned.size();
+    }
+};
+
 class NetEventsInterface;
 class CConnman {
 public:
@@ -134,6 +180,7 @@ public:
         BanMan *m_banman = nullptr;
         unsigned int nSendBufferMaxSize = 0;
         unsigned int nReceiveFloodSize = 0;
+        int nMessageHandlerThreads = DEFAULT_MSGHANDLER_THREADS;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
         std::vector<std::string> vSeedNodes;
@@ -327,6 +374,28 @@ private:
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
+    bool GenerateSelectSet(std::set<SOCKET> &recv_set,
+                           std::set<SOCKET> &send_set,
+                           std::set<SOCKET> &error_set);
+    void SocketEventsSelect(std::set<SOCKET> &recv_set,
+                            std::set<SOCKET> &send_set,
+                            std::set<SOCKET> &error_set);
+#ifdef USE_POLL
+    void SocketEventsPoll(std::set<SOCKET> &recv_set,
+                          std::set<SOCKET> &send_set,
+                          std::set<SOCKET> &error_set);
+#endif
+#ifdef USE_EPOLL
+    void SocketEventsEpoll(std::set<SOCKET> &recv_set,
+                           std::set<SOCKET> &send_set,
+                           std::set<SOCKET> &error_set);
+#endif
+    /**
+     * Wait for events on the listening and peer sockets with the backend
+     * selected by -socketevents, and return the sockets to service.
+     */
+    void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set,
+                      std::set<SOCKET> &error_set);
     void SocketHandler();
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
@@ -414,15 +483,46 @@ private:
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
+    /**
+     * Nodes waiting for a message handler thread, each holding a reference.
+     * All the nodes are queued at the start of every round, and each node is
+     * processed by at most one thread at a time.
+     */
+    std::deque<CNode *> m_msgproc_queue GUARDED_BY(mutexMsgProc);
+    /** Whether a node processed during this round has more work. */
+    bool m_msgproc_more_work GUARDED_BY(mutexMsgProc){false};
+    std::chrono::steady_clock::time_point
+        m_msgproc_round_start GUARDED_BY(mutexMsgProc);
     std::atomic<bool> flagInterruptMsgProc{false};
 
     CThreadInterrupt interruptNet;
 
+#ifdef USE_EPOLL
+    /** The epoll instance, when using -socketevents=epoll. */
+    int m_epoll_fd{-1};
+    /** Whether sockets were still ready after the last epoll pass. */
+    bool m_epoll_pending{false};
+    /** Nodes added since the last epoll pass, to register with epoll. */
+    std::vector<CNode *> m_epoll_new_nodes GUARDED_BY(cs_vNodes);
+    // The following are only accessed by the socket handler thread.
+    /** Registered nodes, by the id tagging their epoll events. */
+    std::unordered_map<NodeId, CNode *> m_epoll_nodes;
+    /**
+     * Nodes to check again on the next pass without waiting for an event:
+     * their sockets were still ready after this pass, or receiving is paused.
+     */
+    std::set<NodeId> m_epoll_ready_nodes;
+    /** Nodes with ready sockets, the only ones serviced by this pass. */
+    std::vector<CNode *> m_epoll_service_nodes;
+    /** Time of the last inactivity check of all the nodes. */
+    int64_t m_epoll_inactivity_check_time{0};
+#endif
+
     std::thread threadDNSAddressSeed;
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     /**
      * Flag for deciding to connect to an extra outbound peer, in excess of
@@ -544,6 +644,7 @@ struct CNodeStats {
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    uint64_t nSocketChecks;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -557,6 +658,52 @@ struct CNodeStats {
     CAddress addrBind;
 };
 
+/**
+ * Pool of the buffers receiving message payloads, so that they are recycled
+ * between messages instead of being allocated and grown for each of them.
+ * Buffers are pooled by power of two size classes, up to a size above which
+ * payloads keep being allocated as they arrive.
+ */
+class CNetMessageBufferPool {
+public:
+    typedef CSerializeData Buffer;
+
+    struct Stats {
+        //! Buffers taken from the pool.
+        uint64_t nHits;
+        //! Buffers allocated because the pool had none of the size class.
+        uint64_t nMisses;
+        //! Buffers currently pooled and their total capacity.
+        size_t nBuffers;
+        size_t nBytes;
+    };
+
+    //! Smallest and largest size classes, as powers of two.
+    static constexpr unsigned int MIN_CLASS_BITS = 9;
+    static constexpr unsigned int MAX_CLASS_BITS = 18;
+    //! Limit on the total capacity of the pooled buffers.
+    static constexpr size_t MAX_POOLED_BYTES = 16 * 1024 * 1024;
+
+    /**
+     * Get an empty buffer with a capacity of at least nSize bytes, or of the
+     * largest size class for larger sizes.
+     */
+    Buffer Get(size_t nSize);
+    //! Return a buffer to the pool, or free it if it does not fit the pool.
+    void Release(Buffer &&buffer);
+    Stats GetStats() const;
+
+private:
+    mutable Mutex m_mutex;
+    std::array<std::vector<Buffer>, MAX_CLASS_BITS - MIN_CLASS_BITS + 1>
+        m_buffers GUARDED_BY(m_mutex);
+    size_t m_pooled_bytes GUARDED_BY(m_mutex){0};
+    uint64_t m_hits GUARDED_BY(m_mutex){0};
+    uint64_t m_misses GUARDED_BY(m_mutex){0};
+};
+
+extern CNetMessageBufferPool g_net_message_buffer_pool;
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
@@ -589,6 +736,9 @@ public:
         nDataPos = 0;
         nTime = 0;
     }
+    CNetMessage(CNetMessage &&) = default;
+    CNetMessage &operator=(CNetMessage &&) = default;
+    ~CNetMessage() { g_net_message_buffer_pool.Release(vRecv.TakeBuffer()); }
 
     bool complete() const {
         if (!in_data) {
@@ -622,7 +772,7 @@ public:
     // Offset inside the first vSendMsg already sent.
     size_t nSendOffset{0};
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<uint8_t>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CSendBuffer> vSendMsg GUARDED_BY(cs_vSend);
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -633,6 +783,13 @@ public:
 
     CCriticalSection cs_sendProcessing;
 
+    // Scheduling by the message handler threads, under CConnman::mutexMsgProc.
+    //! Whether a message handler thread is processing this node.
+    bool m_msgproc_busy{false};
+    //! Whether this node was dequeued again while busy, and must be queued
+    //! once the thread processing it is done.
+    bool m_msgproc_requeue{false};
+
     std::deque<CInv> vRecvGetData;
     uint64_t nRecvBytes GUARDED_BY(cs_vRecv){0};
     std::atomic<int> nRecvVersion{INIT_PROTO_VERSION};
@@ -685,6 +842,14 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
+    //! Number of times the socket handler checked the socket of the node.
+    std::atomic<uint64_t> nSocketChecks{0};
+
+    // Readiness of the socket as reported by the edge-triggered epoll backend,
+    // remembered until a recv() or send() would block.
+    //! Only accessed by the socket handler thread.
+    bool m_sock_recv_ready{false};
+    bool m_sock_send_ready GUARDED_BY(cs_vSend){false};
 
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -704,8 +869,10 @@ public:
 
     // Inventory based relay.
     CRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_inventory);
-    // Set of transaction ids we still have to announce. They are sorted by the
-    // mempool before relay, so the order is not important.
+    // Set of transaction ids we still have to announce to this peer only. They
+    // are sorted by the mempool before relay, so the order is not important.
+    // Transactions relayed to all the peers are announced from batches shared
+    // by the peers instead.
     std::set<TxId> setInventoryTxToSend;
     // List of block ids we still have announce. There is no final sorting
     // before sending, as they are always sent immediately and in the order
@@ -7,14 +7,18 @@
 
 #include <addrman.h>
 #include <arith_uint256.h>
+#include <avalanche.h>
 #include <banman.h>
 #include <blockencodings.h>
+#include <blockfilter.h>
 #include <blockvalidity.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <config.h>
 #include <consensus/validation.h>
+#include <graphene.h>
 #include <hash.h>
+#include <index/blockfilterindex.h>
 #include <merkleblock.h>
 #include <net.h>
 #include <netbase.h>
@@ -28,6 +32,8 @@
 #include <scheduler.h>
 #include <tinyformat.h>
 #include <txmempool.h>
+#include <txorphanpool.h>
+#include <txrelaybatches.h>
 #include <ui_interface.h>
 #include <util/moneystr.h>
 #include <util/strencodings.h>
@@ -35,7 +41,10 @@
 #include <validation.h>
 #include <validationinterface.h>
 
+#include <limits>
+#include <list>
 #include <memory>
+#include <unordered_map>
 
 #if defined(NDEBUG)
 #error "Bitcoin cannot be compiled without assertions."
@@ -43,8 +52,6 @@
 
 /** Expiration time for orphan transactions in seconds */
 static constexpr int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
-/** Minimum time between orphan transactions expire time checks in seconds */
-static constexpr int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /**
  * Headers download timeout expressed in microseconds.
  * Timeout = base + per_header * (expected number of headers)
@@ -120,15 +127,15 @@ static const unsigned int MAX_GETDATA_SZ = 1000;
 /// How many non standard orphan do we consider from a node before ignoring it.
 static constexpr uint32_t MAX_NON_STANDARD_ORPHAN_PER_NODE = 5;
 
-struct COrphanTx {
-    // When modifying, adapt the copy of this definition in tests/DoS_tests.
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
+/** Maximum number of compact filters that may be requested with one
+ * getcfilters. See BIP 157. */
+static constexpr uint32_t MAX_GETCFILTERS_SIZE = 1000;
+/** Maximum number of cf hashes that may be requested with one getcfheaders.
+ * See BIP 157. */
+static constexpr uint32_t MAX_GETCFHEADERS_SIZE = 2000;
 
 CCriticalSection g_cs_orphans;
-std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
+COrphanTxPool g_orphans GUARDED_BY(g_cs_orphans);
 
 void EraseOrphansFor(NodeId peer);
 
@@ -153,6 +160,11 @@ static const unsigned int INVENTORY_BROADCAST_INTERVAL = 5;
  */
 static constexpr unsigned int INVENTORY_BROADCAST_MAX_PER_MB =
     7 * INVENTORY_BROADCAST_INTERVAL;
+/**
+ * Time in seconds after which the relayed transactions which are not
+ * announced to a peer yet are no longer announced to it.
+ */
+static constexpr int64_t TX_RELAY_BATCH_EXPIRY = 15 * 60;
 /**
  * Average delay between feefilter broadcasts in seconds.
  */
@@ -226,8 +238,18 @@ int g_outbound_peers_with_protect_from_disconnect GUARDED_BY(cs_main) = 0;
 /** When our tip was last updated. */
 std::atomic<int64_t> g_last_tip_update(0);
 
-/** Relay map. */
-typedef std::map<uint256, CTransactionRef> MapRelay;
+/**
+ * Relay map entry. The transaction is shared with the mempool, and it is only
+ * kept serialized while queued for some peers, so that it is serialized once
+ * for all the peers requesting it at the same time.
+ */
+struct RelayTx {
+    CTransactionRef tx;
+    std::weak_ptr<const CSharedNetMsgPayload> payload;
+};
+
+/** Relay map, holding the transactions announced to peers. */
+typedef std::map<uint256, RelayTx> MapRelay;
 MapRelay mapRelay GUARDED_BY(cs_main);
 /**
  * Expiration-time ordered list of (expire time, relay map entry) pairs,
@@ -236,17 +258,14 @@ MapRelay mapRelay GUARDED_BY(cs_main);
 std::deque<std::pair<int64_t, MapRelay::iterator>>
     vRelayExpiration GUARDED_BY(cs_main);
 
+/** Transactions relayed to all the peers, in the order to announce them. */
+CTxRelayBatches g_tx_relay_batches GUARDED_BY(cs_main);
+
 // Used only to inform the wallet of when we last received a block
 std::atomic<int64_t> nTimeBestReceived(0);
 
-struct IteratorComparator {
-    template <typename I> bool operator()(const I &a, const I &b) const {
-        return &(*a) < &(*b);
-    }
-};
-std::map<COutPoint,
-         std::set<std::map<uint256, COrphanTx>::iterator, IteratorComparator>>
-    mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
+/** Whether graphene blocks are enabled, set once from -graphene. */
+bool fGrapheneEnabled = DEFAULT_GRAPHENE;
 
 static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
 static std::vector<std::pair<TxHash, CTransactionRef>>
@@ -325,6 +344,8 @@ struct CNodeState {
      * non-witnesses in cmpctblocks/blocktxns.
      */
     bool fSupportsDesiredCmpctVersion;
+    //! Whether this peer will send us grblks if we request them.
+    bool fProvidesGrapheneBlocks;
 
     /**
      * State used to enforce CHAIN_SYNC_TIMEOUT
@@ -358,6 +379,9 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
+    //! Relay sequence number of the next relayed transaction to announce.
+    uint64_t nTxRelaySeq;
+
     /*
      * State associated with transaction download.
      *
@@ -393,8 +417,8 @@ struct CNodeState {
      *   We add an additional delay for inbound peers, again to prefer
      *   attempting download from outbound peers first.
      *   We also add an extra small random delay up to 2 seconds
-     *   to avoid biasing some peers over others. (e.g., due to fixed ordering
-     *   of peer processing in ThreadMessageHandler).
+     *   to avoid biasing some peers over others. (e.g., due to the order in
+     *   which the message handler threads pick the peers to process).
      *
      *   When we receive a transaction from a peer, we remove the txid from the
      *   peer's m_tx_in_flight set and from their recently announced set
@@ -443,8 +467,10 @@ struct CNodeState {
         fPreferHeaderAndIDs = false;
         fProvidesHeaderAndIDs = false;
         fSupportsDesiredCmpctVersion = false;
+        fProvidesGrapheneBlocks = false;
         m_chain_sync = {0, nullptr, false, false};
         m_last_block_announcement = 0;
+        nTxRelaySeq = 0;
     }
 };
 
@@ -658,6 +684,11 @@ static void MaybeSetPeerAsAnnouncingHeaderAndIDs(NodeId nodeid,
     if (!nodestate->fProvidesHeaderAndIDs) {
         return;
     }
+    // Peers providing graphene blocks announce with headers, so that the
+    // blocks can be requested as graphene blocks.
+    if (nodestate->fProvidesGrapheneBlocks && fGrapheneEnabled) {
+        return;
+    }
     for (std::list<NodeId>::iterator it = lNodesAnnouncingHeaderAndIDs.begin();
          it != lNodesAnnouncingHeaderAndIDs.end(); it++) {
         if (*it == nodeid) {
@@ -862,7 +893,8 @@ int64_t CalculateTxGetDataTime(const TxId &txid, int64_t current_time,
         process_time = current_time;
     } else {
         // Randomize the delay to avoid biasing some peers over others (such as
-        // due to fixed ordering of peer processing in ThreadMessageHandler)
+        // due to the order in which the message handler threads pick the
+        // peers to process)
         process_time = last_request_time + GETDATA_TX_INTERVAL +
                        GetRand(MAX_GETDATA_RANDOM_DELAY);
     }
@@ -922,10 +954,12 @@ void PeerLogicValidation::InitializeNode(const Config &config, CNode *pnode) {
     NodeId nodeid = pnode->GetId();
     {
         LOCK(cs_main);
-        mapNodeState.emplace_hint(
+        auto it = mapNodeState.emplace_hint(
             mapNodeState.end(), std::piecewise_construct,
             std::forward_as_tuple(nodeid),
             std::forward_as_tuple(addr, std::move(addrName)));
+        // Only the transactions relayed from now on are announced.
+        it->second.nTxRelaySeq = g_tx_relay_batches.NextSeq();
     }
     if (!pnode->fInbound) {
         PushNodeVersion(config, pnode, connman, GetTime());
@@ -992,7 +1026,7 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// mapOrphanTransactions
+// g_orphans
 //
 
 static void AddToCompactExtraTransactions(const CTransactionRef &tx)
@@ -1014,8 +1048,8 @@ static void AddToCompactExtraTransactions(const CTransactionRef &tx)
 
 bool AddOrphanTx(const CTransactionRef &tx, NodeId peer)
     EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
-    const uint256 &txid = tx->GetId();
-    if (mapOrphanTransactions.count(txid)) {
+    const TxId &txid = tx->GetId();
+    if (g_orphans.HaveTx(txid)) {
         return false;
     }
 
@@ -1023,8 +1057,8 @@ bool AddOrphanTx(const CTransactionRef &tx, NodeId peer)
     // attack. If a peer has a legitimate large transaction with a missing
     // parent then we assume it will rebroadcast it later, after the parent
     // transaction(s) have been mined or received.
-    // 100 orphans, each of which is at most 99,999 bytes big is at most 10
-    // megabytes of orphans and somewhat more byprev index (in the worst case):
+    // The orphans of a peer are also limited to a share of the orphan pool,
+    // see LimitOrphanTxSize.
     unsigned int sz = tx->GetTotalSize();
     if (sz >= MAX_STANDARD_TX_SIZE) {
         LogPrint(BCLog::MEMPOOL,
@@ -1033,101 +1067,42 @@ bool AddOrphanTx(const CTransactionRef &tx, NodeId peer)
         return false;
     }
 
-    auto ret = mapOrphanTransactions.emplace(
-        txid, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME});
-    assert(ret.second);
-    for (const CTxIn &txin : tx->vin) {
-        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
-    }
+    bool inserted =
+        g_orphans.AddTx(tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME);
+    assert(inserted);
 
     AddToCompactExtraTransactions(tx);
 
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n",
-             txid.ToString(), mapOrphanTransactions.size(),
-             mapOrphanTransactionsByPrev.size());
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u, %u bytes)\n",
+             txid.ToString(), g_orphans.Size(), g_orphans.TotalTxSize());
     return true;
 }
 
-static int EraseOrphanTx(uint256 hash) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
-    std::map<uint256, COrphanTx>::iterator it =
-        mapOrphanTransactions.find(hash);
-    if (it == mapOrphanTransactions.end()) {
-        return 0;
-    }
-    for (const CTxIn &txin : it->second.tx->vin) {
-        auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-        if (itPrev == mapOrphanTransactionsByPrev.end()) {
-            continue;
-        }
-        itPrev->second.erase(it);
-        if (itPrev->second.empty()) {
-            mapOrphanTransactionsByPrev.erase(itPrev);
-        }
-    }
-    mapOrphanTransactions.erase(it);
-    return 1;
+static int EraseOrphanTx(const TxId &txid)
+    EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
+    return g_orphans.EraseTx(txid);
 }
 
 void EraseOrphansFor(NodeId peer) {
     LOCK(g_cs_orphans);
-    int nErased = 0;
-    std::map<uint256, COrphanTx>::iterator iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end()) {
-        // Increment to avoid iterator becoming invalid.
-        std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
-        if (maybeErase->second.fromPeer == peer) {
-            nErased += EraseOrphanTx(maybeErase->second.tx->GetId());
-        }
-    }
+    int nErased = g_orphans.EraseForPeer(peer);
     if (nErased > 0) {
         LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased,
                  peer);
     }
 }
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) {
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans,
+                               uint64_t nMaxOrphansSize) {
     LOCK(g_cs_orphans);
 
-    unsigned int nEvicted = 0;
-    static int64_t nNextSweep;
-    int64_t nNow = GetTime();
-    if (nNextSweep <= nNow) {
-        // Sweep out expired orphan pool entries:
-        int nErased = 0;
-        int64_t nMinExpTime =
-            nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-        std::map<uint256, COrphanTx>::iterator iter =
-            mapOrphanTransactions.begin();
-        while (iter != mapOrphanTransactions.end()) {
-            std::map<uint256, COrphanTx>::iterator maybeErase = iter++;
-            if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx->GetId());
-            } else {
-                nMinExpTime =
-                    std::min(maybeErase->second.nTimeExpire, nMinExpTime);
-            }
-        }
-        // Sweep again 5 minutes after the next entry that expires in order to
-        // batch the linear scan.
-        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
-        if (nErased > 0) {
-            LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n",
-                     nErased);
-        }
-    }
-    FastRandomContext rng;
-    while (mapOrphanTransactions.size() > nMaxOrphans) {
-        // Evict a random orphan:
-        uint256 randomhash = rng.rand256();
-        std::map<uint256, COrphanTx>::iterator it =
-            mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end()) {
-            it = mapOrphanTransactions.begin();
-        }
-        EraseOrphanTx(it->first);
-        ++nEvicted;
+    // Sweep out expired orphan pool entries:
+    int nErased = g_orphans.EraseExpired(GetTime());
+    if (nErased > 0) {
+        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n",
+                 nErased);
     }
-    return nEvicted;
+    return g_orphans.LimitOrphans(nMaxOrphans, nMaxOrphansSize);
 }
 
 /**
@@ -1198,6 +1173,7 @@ PeerLogicValidation::PeerLogicValidation(CConnman *connmanIn, BanMan *banman,
       m_enable_bip61(enable_bip61) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    fGrapheneEnabled = gArgs.GetBoolArg("-graphene", DEFAULT_GRAPHENE);
 
     const Consensus::Params &consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
@@ -1217,30 +1193,29 @@ PeerLogicValidation::PeerLogicValidation(CConnman *connmanIn, BanMan *banman,
 
 /**
  * Evict orphan txn pool entries (EraseOrphanTx) based on a newly connected
- * block. Also save the time of the last tip update.
+ * block, and stop avalanche from voting on its transactions. Also save the
+ * time of the last tip update.
  */
 void PeerLogicValidation::BlockConnected(
     const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex,
     const std::vector<CTransactionRef> &vtxConflicted) {
     LOCK(g_cs_orphans);
 
-    std::vector<uint256> vOrphanErase;
+    std::vector<TxId> vOrphanErase;
 
     for (const CTransactionRef &ptx : pblock->vtx) {
         const CTransaction &tx = *ptx;
 
+        // Mined transactions and their double spends are no longer voted on.
+        if (g_avalanche) {
+            g_avalanche->removeTx(tx);
+        }
+
         // Which orphan pool entries must we evict?
         for (const auto &txin : tx.vin) {
-            auto itByPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-            if (itByPrev == mapOrphanTransactionsByPrev.end()) {
-                continue;
-            }
-
-            for (auto mi = itByPrev->second.begin();
-                 mi != itByPrev->second.end(); ++mi) {
-                const CTransaction &orphanTx = *(*mi)->second.tx;
-                const uint256 &orphanHash = orphanTx.GetHash();
-                vOrphanErase.push_back(orphanHash);
+            for (const COrphanTx &orphan :
+                 g_orphans.GetChildren(txin.prevout)) {
+                vOrphanErase.push_back(orphan.tx->GetId());
             }
         }
     }
@@ -1248,7 +1223,7 @@ void PeerLogicValidation::BlockConnected(
     // Erase orphan transactions included or precluded by this block
     if (vOrphanErase.size()) {
         int nErased = 0;
-        for (const uint256 &orphanId : vOrphanErase) {
+        for (const TxId &orphanId : vOrphanErase) {
             nErased += EraseOrphanTx(orphanId);
         }
         LogPrint(BCLog::MEMPOOL,
@@ -1259,6 +1234,17 @@ void PeerLogicValidation::BlockConnected(
     g_last_tip_update = GetTime();
 }
 
+/**
+ * Stop avalanche from voting on a transaction evicted from the mempool, and on
+ * its double spends.
+ */
+void PeerLogicValidation::TransactionRemovedFromMempool(
+    const CTransactionRef &ptx) {
+    if (g_avalanche) {
+        g_avalanche->removeTx(*ptx);
+    }
+}
+
 // All of the following cache a recent block, and are protected by
 // cs_most_recent_block
 static CCriticalSection cs_most_recent_block;
@@ -1266,7 +1252,144 @@ static std::shared_ptr<const CBlock>
     most_recent_block GUARDED_BY(cs_most_recent_block);
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs>
     most_recent_compact_block GUARDED_BY(cs_most_recent_block);
+//! most_recent_compact_block serialized, shared by the peers it is sent to.
+static std::shared_ptr<const CSharedNetMsgPayload>
+    most_recent_compact_block_payload GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
+//! most_recent_block serialized once it is first requested, shared by the
+//! peers it is sent to.
+static std::shared_ptr<const CSharedNetMsgPayload>
+    most_recent_block_payload GUARDED_BY(cs_most_recent_block);
+
+/**
+ * The most recent blocks of the active chain, published on tip updates so that
+ * getheaders requests from peers close to the tip are served without walking
+ * chainActive under cs_main. The snapshot is only used while its last block is
+ * the active tip.
+ * The header fields of a CBlockIndex never change once it is added to the
+ * block index, so they can be read without the lock.
+ */
+struct HeadersSnapshot {
+    //! The blocks by ascending height, ending with the tip.
+    std::vector<const CBlockIndex *> blocks;
+    //! Offset of every block in blocks.
+    std::unordered_map<BlockHash, size_t, BlockHasher> offsets;
+};
+
+//! Number of blocks in the headers snapshot.
+static const size_t HEADERS_SNAPSHOT_SIZE = 2 * MAX_HEADERS_RESULTS;
+
+static Mutex g_headers_snapshot_mutex;
+//! Not maintained during initial block download.
+static std::shared_ptr<const HeadersSnapshot>
+    g_headers_snapshot GUARDED_BY(g_headers_snapshot_mutex);
+
+static void UpdateHeadersSnapshot(const CBlockIndex *pindexTip,
+                                  bool fInitialDownload) {
+    std::shared_ptr<HeadersSnapshot> snapshot;
+    if (!fInitialDownload) {
+        snapshot = std::make_shared<HeadersSnapshot>();
+        snapshot->blocks.resize(std::min<size_t>(HEADERS_SNAPSHOT_SIZE,
+                                                 pindexTip->nHeight + 1));
+        snapshot->offsets.reserve(snapshot->blocks.size());
+        const CBlockIndex *pindex = pindexTip;
+        for (size_t i = snapshot->blocks.size(); i-- > 0;
+             pindex = pindex->pprev) {
+            snapshot->blocks[i] = pindex;
+            snapshot->offsets.emplace(pindex->GetBlockHash(), i);
+        }
+    }
+
+    LOCK(g_headers_snapshot_mutex);
+    g_headers_snapshot = std::move(snapshot);
+}
+
+//! Number of serialized blocks kept by the raw block cache.
+static const size_t RAW_BLOCK_CACHE_SIZE = 4;
+
+/**
+ * The serialized blocks most recently served from the block files, most
+ * recently used first. Peers requesting the same block, typically a new tip,
+ * queue the same buffer instead of copies of it.
+ */
+static Mutex g_raw_block_cache_mutex;
+static std::list<
+    std::pair<BlockHash, std::shared_ptr<const CSharedNetMsgPayload>>>
+    g_raw_block_cache GUARDED_BY(g_raw_block_cache_mutex);
+
+static std::shared_ptr<const CSharedNetMsgPayload>
+LookupRawBlock(const BlockHash &hash)
+    EXCLUSIVE_LOCKS_REQUIRED(g_raw_block_cache_mutex) {
+    for (auto it = g_raw_block_cache.begin(); it != g_raw_block_cache.end();
+         ++it) {
+        if (it->first == hash) {
+            g_raw_block_cache.splice(g_raw_block_cache.begin(),
+                                     g_raw_block_cache, it);
+            return it->second;
+        }
+    }
+    return nullptr;
+}
+
+static std::shared_ptr<const CSharedNetMsgPayload>
+GetRawBlock(const CBlockIndex *pindex) {
+    const BlockHash hash = pindex->GetBlockHash();
+    {
+        LOCK(g_raw_block_cache_mutex);
+        std::shared_ptr<const CSharedNetMsgPayload> payload =
+            LookupRawBlock(hash);
+        if (payload) {
+            return payload;
+        }
+    }
+
+    std::vector<uint8_t> block;
+    if (!ReadRawBlockFromDisk(block, pindex)) {
+        return nullptr;
+    }
+    auto payload = std::make_shared<const CSharedNetMsgPayload>(
+        std::move(block));
+
+    LOCK(g_raw_block_cache_mutex);
+    // Another thread may have read the same block in the meantime.
+    std::shared_ptr<const CSharedNetMsgPayload> cached = LookupRawBlock(hash);
+    if (cached) {
+        return cached;
+    }
+    g_raw_block_cache.emplace_front(hash, payload);
+    if (g_raw_block_cache.size() > RAW_BLOCK_CACHE_SIZE) {
+        g_raw_block_cache.pop_back();
+    }
+    return payload;
+}
+
+/**
+ * The serialization of a block fetched from most_recent_block. It is made once
+ * for as long as the block remains the most recent one.
+ */
+static std::shared_ptr<const CSharedNetMsgPayload>
+GetRecentBlockPayload(const std::shared_ptr<const CBlock> &pblock) {
+    {
+        LOCK(cs_most_recent_block);
+        if (most_recent_block == pblock && most_recent_block_payload) {
+            return most_recent_block_payload;
+        }
+    }
+
+    std::shared_ptr<const CSharedNetMsgPayload> payload =
+        CNetMsgMaker(PROTOCOL_VERSION).MakePayload(0, *pblock);
+
+    LOCK(cs_most_recent_block);
+    if (most_recent_block != pblock) {
+        // A new block came in the meantime, only this request uses this one.
+        return payload;
+    }
+    // Another thread may have serialized the same block in the meantime.
+    if (!most_recent_block_payload) {
+        most_recent_block_payload = std::move(payload);
+    }
+    return most_recent_block_payload;
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
@@ -1277,6 +1400,8 @@ void PeerLogicValidation::NewPoWValidBlock(
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock =
         std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    std::shared_ptr<const CSharedNetMsgPayload> cmpctblock_payload =
+        msgMaker.MakePayload(0, *pcmpctblock);
 
     LOCK(cs_main);
 
@@ -1293,13 +1418,14 @@ void PeerLogicValidation::NewPoWValidBlock(
         most_recent_block_hash = hashBlock;
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
+        most_recent_compact_block_payload = cmpctblock_payload;
+        most_recent_block_payload.reset();
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker,
+    connman->ForEachNode([this, &cmpctblock_payload, pindex, &msgMaker,
                           &hashBlock](CNode *pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect) {
             return;
         }
@@ -1312,8 +1438,9 @@ void PeerLogicValidation::NewPoWValidBlock(
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n",
                      "PeerLogicValidation::NewPoWValidBlock",
                      hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(
-                pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushMessage(pnode,
+                                 msgMaker.MakeShared(NetMsgType::CMPCTBLOCK,
+                                                     cmpctblock_payload));
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1329,6 +1456,8 @@ void PeerLogicValidation::UpdatedBlockTip(const CBlockIndex *pindexNew,
     const int nNewHeight = pindexNew->nHeight;
     connman->SetBestHeight(nNewHeight);
 
+    UpdateHeadersSnapshot(pindexNew, fInitialDownload);
+
     SetServiceFlagsIBDCache(!fInitialDownload);
     if (!fInitialDownload) {
         // Find the hashes of all blocks that weren't previously in the best
@@ -1428,7 +1557,7 @@ static bool AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
 
             {
                 LOCK(g_cs_orphans);
-                if (mapOrphanTransactions.count(inv.hash)) {
+                if (g_orphans.HaveTx(TxId(inv.hash))) {
                     return true;
                 }
             }
@@ -1451,9 +1580,9 @@ static bool AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     return true;
 }
 
-static void RelayTransaction(const CTransaction &tx, CConnman *connman) {
-    CInv inv(MSG_TX, tx.GetId());
-    connman->ForEachNode([&inv](CNode *pnode) { pnode->PushInventory(inv); });
+static void RelayTransaction(const CTransaction &tx)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    g_tx_relay_batches.Queue(tx.GetId());
 }
 
 static void RelayAddress(const CAddress &addr, bool fReachable,
@@ -1592,19 +1721,39 @@ static void ProcessGetBlockData(const Config &config, CNode *pfrom,
     // Pruned nodes may have deleted the block, so check whether it's available
     // before trying to send.
     if (send && pindex->nStatus.hasData()) {
+        // Full blocks are sent as a serialization shared by all the peers
+        // requesting them: the most recent block is serialized once, and
+        // other blocks are serialized the same way in the block files and on
+        // the network, so they are sent without deserializing them.
+        std::shared_ptr<const CSharedNetMsgPayload> raw_block;
         std::shared_ptr<const CBlock> pblock;
         if (a_recent_block &&
             a_recent_block->GetHash() == pindex->GetBlockHash()) {
-            pblock = a_recent_block;
+            if (inv.type == MSG_BLOCK) {
+                raw_block = GetRecentBlockPayload(a_recent_block);
+            } else {
+                pblock = a_recent_block;
+            }
         } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
-                assert(!"cannot load block from disk");
+            if (inv.type == MSG_BLOCK) {
+                raw_block = GetRawBlock(pindex);
+            }
+            if (!raw_block) {
+                // Send block from disk
+                std::shared_ptr<CBlock> pblockRead =
+                    std::make_shared<CBlock>();
+                if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+                    assert(!"cannot load block from disk");
+                }
+                pblock = pblockRead;
             }
-            pblock = pblockRead;
         }
-        if (inv.type == MSG_BLOCK) {
+        if (raw_block) {
+            CSerializedNetMsg msg;
+            msg.command = NetMsgType::BLOCK;
+            msg.shared_payload = std::move(raw_block);
+            connman->PushMessage(pfrom, std::move(msg));
+        } else if (inv.type == MSG_BLOCK) {
             connman->PushMessage(pfrom,
                                  msgMaker.Make(NetMsgType::BLOCK, *pblock));
         } else if (inv.type == MSG_FILTERED_BLOCK) {
@@ -1701,9 +1850,14 @@ static void ProcessGetData(const Config &config, CNode *pfrom,
             auto mi = mapRelay.find(inv.hash);
             int nSendFlags = 0;
             if (mi != mapRelay.end()) {
+                std::shared_ptr<const CSharedNetMsgPayload> payload =
+                    mi->second.payload.lock();
+                if (!payload) {
+                    payload = msgMaker.MakePayload(0, *mi->second.tx);
+                    mi->second.payload = payload;
+                }
                 connman->PushMessage(
-                    pfrom,
-                    msgMaker.Make(nSendFlags, NetMsgType::TX, *mi->second));
+                    pfrom, msgMaker.MakeShared(NetMsgType::TX, payload));
                 push = true;
             } else if (pfrom->timeLastMempoolReq) {
                 auto txinfo = g_mempool.info(TxId(inv.hash));
@@ -1787,7 +1941,21 @@ static bool ProcessHeadersMessage(const Config &config, CNode *pfrom,
         return true;
     }
 
-    bool received_new_header = false;
+    // Hash the headers and look the last one up before taking cs_main. The
+    // hashes are reused to accept the headers.
+    const std::vector<BlockHash> hashes = HashBlockHeaders(headers);
+    const BlockHash &hashLastBlock = hashes.back();
+    bool fContinuous = true;
+    for (size_t i = 1; i < nCount; i++) {
+        if (headers[i].hashPrevBlock != hashes[i - 1]) {
+            fContinuous = false;
+            break;
+        }
+    }
+
+    // If we don't have the last header, then they'll have given us
+    // something new (if these headers are valid).
+    bool received_new_header = !LookupBlockIndex(hashLastBlock);
     const CBlockIndex *pindexLast = nullptr;
     {
         LOCK(cs_main);
@@ -1812,13 +1980,13 @@ static bool ProcessHeadersMessage(const Config &config, CNode *pfrom,
                 BCLog::NET,
                 "received header %s: missing prev block %s, sending getheaders "
                 "(%d) to end (peer=%d, nUnconnectingHeaders=%d)\n",
-                headers[0].GetHash().ToString(),
-                headers[0].hashPrevBlock.ToString(), pindexBestHeader->nHeight,
+                hashes[0].ToString(), headers[0].hashPrevBlock.ToString(),
+                pindexBestHeader->nHeight,
                 pfrom->GetId(), nodestate->nUnconnectingHeaders);
             // Set hashLastUnknownBlock for this peer, so that if we eventually
             // get the headers - even from a different peer - we can use this
             // peer to download.
-            UpdateBlockAvailability(pfrom->GetId(), headers.back().GetHash());
+            UpdateBlockAvailability(pfrom->GetId(), hashLastBlock);
 
             if (nodestate->nUnconnectingHeaders % MAX_UNCONNECTING_HEADERS ==
                 0) {
@@ -1828,26 +1996,15 @@ static bool ProcessHeadersMessage(const Config &config, CNode *pfrom,
             return true;
         }
 
-        BlockHash hashLastBlock;
-        for (const CBlockHeader &header : headers) {
-            if (!hashLastBlock.IsNull() &&
-                header.hashPrevBlock != hashLastBlock) {
-                Misbehaving(pfrom, 20, "disconnected-header");
-                return error("non-continuous headers sequence");
-            }
-            hashLastBlock = header.GetHash();
-        }
-
-        // If we don't have the last header, then they'll have given us
-        // something new (if these headers are valid).
-        if (!LookupBlockIndex(hashLastBlock)) {
-            received_new_header = true;
+        if (!fContinuous) {
+            Misbehaving(pfrom, 20, "disconnected-header");
+            return error("non-continuous headers sequence");
         }
     }
 
     CValidationState state;
     CBlockHeader first_invalid_header;
-    if (!ProcessNewBlockHeaders(config, headers, state, &pindexLast,
+    if (!ProcessNewBlockHeaders(config, headers, hashes, state, &pindexLast,
                                 &first_invalid_header)) {
         int nDoS;
         if (state.IsInvalid(nDoS)) {
@@ -1980,14 +2137,24 @@ static bool ProcessHeadersMessage(const Config &config, CNode *pfrom,
                              pindexLast->GetBlockHash().ToString(),
                              pindexLast->nHeight);
                 }
-                if (vGetData.size() > 0) {
-                    if (nodestate->fSupportsDesiredCmpctVersion &&
-                        vGetData.size() == 1 && mapBlocksInFlight.size() == 1 &&
-                        pindexLast->pprev->IsValid(BlockValidity::CHAIN)) {
+                if (vGetData.size() == 1 && mapBlocksInFlight.size() == 1 &&
+                    pindexLast->pprev->IsValid(BlockValidity::CHAIN)) {
+                    if (fGrapheneEnabled &&
+                        nodestate->fProvidesGrapheneBlocks) {
+                        // Download the block encoded against our mempool.
+                        GrapheneBlockRequest req;
+                        req.blockhash = BlockHash(vGetData[0].hash);
+                        req.nMempoolTxs = g_mempool.size();
+                        connman->PushMessage(
+                            pfrom, msgMaker.Make(NetMsgType::GETGRAPHENE, req));
+                        vGetData.clear();
+                    } else if (nodestate->fSupportsDesiredCmpctVersion) {
                         // In any case, we want to download using a compact
                         // block, not a regular one.
                         vGetData[0] = CInv(MSG_CMPCT_BLOCK, vGetData[0].hash);
                     }
+                }
+                if (vGetData.size() > 0) {
                     connman->PushMessage(
                         pfrom, msgMaker.Make(NetMsgType::GETDATA, vGetData));
                 }
@@ -2039,6 +2206,332 @@ static bool ProcessHeadersMessage(const Config &config, CNode *pfrom,
     return true;
 }
 
+/**
+ * Validation logic for compact filters request handling.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   filter_type     The filter type the request is for. Must be
+ *                              basic filters.
+ * @param[in]   start_height    The start height for the request
+ * @param[in]   stop_hash       The stop_hash for the request
+ * @param[in]   max_height_diff The maximum number of items permitted to
+ *                              request, as specified in BIP 157
+ * @param[out]  stop_index      The CBlockIndex for the stop_hash block, if the
+ *                              request can be serviced.
+ * @param[out]  filter_index    The filter index, if the request can be
+ *                              serviced.
+ * @return                      True if the request can be serviced.
+ */
+static bool PrepareBlockFilterRequest(CNode *pfrom,
+                                      const CChainParams &chain_params,
+                                      BlockFilterType filter_type,
+                                      uint32_t start_height,
+                                      const BlockHash &stop_hash,
+                                      uint32_t max_height_diff,
+                                      const CBlockIndex *&stop_index,
+                                      BlockFilterIndex *&filter_index) {
+    const bool supported_filter_type =
+        (filter_type == BlockFilterType::BASIC &&
+         (pfrom->GetLocalServices() & NODE_COMPACT_FILTERS));
+    if (!supported_filter_type) {
+        LogPrint(BCLog::NET,
+                 "peer %d requested unsupported block filter type: %d\n",
+                 pfrom->GetId(), static_cast<uint8_t>(filter_type));
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    {
+        LOCK(cs_main);
+        stop_index = LookupBlockIndex(stop_hash);
+
+        // Check that the stop block exists and the peer would be allowed to
+        // fetch it.
+        if (!stop_index ||
+            !BlockRequestAllowed(stop_index, chain_params.GetConsensus())) {
+            LogPrint(BCLog::NET, "peer %d requested invalid block hash: %s\n",
+                     pfrom->GetId(), stop_hash.ToString());
+            pfrom->fDisconnect = true;
+            return false;
+        }
+    }
+
+    uint32_t stop_height = stop_index->nHeight;
+    if (start_height > stop_height) {
+        LogPrint(BCLog::NET,
+                 "peer %d sent invalid getcfilters/getcfheaders with start "
+                 "height %d and stop height %d\n",
+                 pfrom->GetId(), start_height, stop_height);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+    if (stop_height - start_height >= max_height_diff) {
+        LogPrint(BCLog::NET,
+                 "peer %d requested too many cfilters/cfheaders: %d / %d\n",
+                 pfrom->GetId(), stop_height - start_height + 1,
+                 max_height_diff);
+        pfrom->fDisconnect = true;
+        return false;
+    }
+
+    filter_index = GetBlockFilterIndex(filter_type);
+    if (!filter_index) {
+        LogPrint(BCLog::NET, "Filter index for supported type %s not found\n",
+                 BlockFilterTypeName(filter_type));
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * Handle a getcfilters request.
+ *
+ * May disconnect from the peer in the case of a bad request. The filters of
+ * the requested range are read sequentially from the filter files and each one
+ * is sent in its own cfilter message.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFilters(CNode *pfrom, CDataStream &vRecv,
+                               const CChainParams &chain_params,
+                               CConnman *connman) {
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    BlockHash stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type =
+        static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex *stop_index;
+    BlockFilterIndex *filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type,
+                                   start_height, stop_hash,
+                                   MAX_GETCFILTERS_SIZE, stop_index,
+                                   filter_index)) {
+        return;
+    }
+
+    std::vector<BlockFilter> filters;
+    if (!filter_index->LookupFilterRange(start_height, stop_index, filters)) {
+        LogPrint(BCLog::NET,
+                 "Failed to find block filter in index: filter_type=%s, "
+                 "start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height,
+                 stop_hash.ToString());
+        return;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom->GetSendVersion());
+    for (const auto &filter : filters) {
+        connman->PushMessage(pfrom,
+                             msgMaker.Make(NetMsgType::CFILTER, filter));
+    }
+}
+
+/**
+ * Handle a getcfheaders request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFHeaders(CNode *pfrom, CDataStream &vRecv,
+                                const CChainParams &chain_params,
+                                CConnman *connman) {
+    uint8_t filter_type_ser;
+    uint32_t start_height;
+    BlockHash stop_hash;
+
+    vRecv >> filter_type_ser >> start_height >> stop_hash;
+
+    const BlockFilterType filter_type =
+        static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex *stop_index;
+    BlockFilterIndex *filter_index;
+    if (!PrepareBlockFilterRequest(pfrom, chain_params, filter_type,
+                                   start_height, stop_hash,
+                                   MAX_GETCFHEADERS_SIZE, stop_index,
+                                   filter_index)) {
+        return;
+    }
+
+    uint256 prev_header;
+    if (start_height > 0) {
+        const CBlockIndex *const prev_block =
+            stop_index->GetAncestor(static_cast<int>(start_height - 1));
+        if (!filter_index->LookupFilterHeader(prev_block, prev_header)) {
+            LogPrint(BCLog::NET,
+                     "Failed to find block filter header in index: "
+                     "filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type),
+                     prev_block->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    std::vector<uint256> filter_hashes;
+    if (!filter_index->LookupFilterHashRange(start_height, stop_index,
+                                             filter_hashes)) {
+        LogPrint(BCLog::NET,
+                 "Failed to find block filter hashes in index: filter_type=%s, "
+                 "start_height=%d, stop_hash=%s\n",
+                 BlockFilterTypeName(filter_type), start_height,
+                 stop_hash.ToString());
+        return;
+    }
+
+    CSerializedNetMsg msg =
+        CNetMsgMaker(pfrom->GetSendVersion())
+            .Make(NetMsgType::CFHEADERS, filter_type_ser,
+                  stop_index->GetBlockHash(), prev_header, filter_hashes);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
+/**
+ * Handle a getcfcheckpt request.
+ *
+ * May disconnect from the peer in the case of a bad request.
+ *
+ * @param[in]   pfrom           The peer that we received the request from
+ * @param[in]   vRecv           The raw message received
+ * @param[in]   chain_params    Chain parameters
+ * @param[in]   connman         Pointer to the connection manager
+ */
+static void ProcessGetCFCheckPt(CNode *pfrom, CDataStream &vRecv,
+                                const CChainParams &chain_params,
+                                CConnman *connman) {
+    uint8_t filter_type_ser;
+    BlockHash stop_hash;
+
+    vRecv >> filter_type_ser >> stop_hash;
+
+    const BlockFilterType filter_type =
+        static_cast<BlockFilterType>(filter_type_ser);
+
+    const CBlockIndex *stop_index;
+    BlockFilterIndex *filter_index;
+    if (!PrepareBlockFilterRequest(
+            pfrom, chain_params, filter_type, /*start_height=*/0, stop_hash,
+            /*max_height_diff=*/std::numeric_limits<uint32_t>::max(),
+            stop_index, filter_index)) {
+        return;
+    }
+
+    std::vector<uint256> headers(stop_index->nHeight / CFCHECKPT_INTERVAL);
+
+    // Populate headers. The checkpoint headers are served from the index's
+    // headers cache once they have been looked up.
+    const CBlockIndex *block_index = stop_index;
+    for (int i = headers.size() - 1; i >= 0; i--) {
+        int height = (i + 1) * CFCHECKPT_INTERVAL;
+        block_index = block_index->GetAncestor(height);
+
+        if (!filter_index->LookupFilterHeader(block_index, headers[i])) {
+            LogPrint(BCLog::NET,
+                     "Failed to find block filter header in index: "
+                     "filter_type=%s, block_hash=%s\n",
+                     BlockFilterTypeName(filter_type),
+                     block_index->GetBlockHash().ToString());
+            return;
+        }
+    }
+
+    CSerializedNetMsg msg = CNetMsgMaker(pfrom->GetSendVersion())
+                                .Make(NetMsgType::CFCHECKPT, filter_type_ser,
+                                      stop_index->GetBlockHash(), headers);
+    connman->PushMessage(pfrom, std::move(msg));
+}
+
+/**
+ * Our vote about an item polled by avalanche: 0 if we accept it, 1 if we
+ * reject it and -1 if we do not know about it.
+ */
+static uint32_t GetAvalancheVote(const CInv &inv)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    if (inv.type == MSG_TX) {
+        if (g_mempool.exists(TxId(inv.hash))) {
+            return 0;
+        }
+
+        assert(recentRejects);
+        return recentRejects->contains(inv.hash) ? 1 : -1;
+    }
+
+    if (inv.type == MSG_BLOCK) {
+        const CBlockIndex *pindex = LookupBlockIndex(BlockHash(inv.hash));
+        if (!pindex) {
+            return -1;
+        }
+
+        return chainActive.Contains(pindex) ? 0 : 1;
+    }
+
+    return -1;
+}
+
+static void ProcessAvalanchePoll(CNode *pfrom, CDataStream &vRecv,
+                                 CConnman *connman) {
+    AvalanchePoll poll;
+    vRecv >> poll;
+
+    const std::vector<CInv> &invs = poll.GetInvs();
+    if (invs.size() > AVALANCHE_MAX_ELEMENT_POLL) {
+        LOCK(cs_main);
+        Misbehaving(pfrom, 20, "too-many-ava-poll");
+        return;
+    }
+
+    std::vector<AvalancheVote> votes;
+    votes.reserve(invs.size());
+
+    {
+        LOCK(cs_main);
+        for (const CInv &inv : invs) {
+            votes.emplace_back(GetAvalancheVote(inv), inv.hash);
+        }
+    }
+
+    connman->PushMessage(
+        pfrom, CNetMsgMaker(pfrom->GetSendVersion())
+                   .Make(NetMsgType::AVARESPONSE,
+                         AvalancheResponse(poll.getRound(),
+                                           AVALANCHE_DEFAULT_COOLDOWN,
+                                           std::move(votes))));
+}
+
+static void ProcessAvalancheResponse(CNode *pfrom, CDataStream &vRecv) {
+    AvalancheResponse response;
+    vRecv >> response;
+
+    std::vector<AvalancheBlockUpdate> blockUpdates;
+    std::vector<AvalancheTxUpdate> txUpdates;
+    if (!g_avalanche->registerVotes(pfrom->GetId(), response, blockUpdates,
+                                    txUpdates)) {
+        // The query may have timed out, so this is not misbehavior.
+        return;
+    }
+
+    // Blocks are not submitted to avalanche by the node, only transactions.
+    for (const AvalancheTxUpdate &update : txUpdates) {
+        LogPrint(BCLog::MEMPOOL, "avalanche: transaction %s status %d\n",
+                 update.getTxId().ToString(), int(update.getStatus()));
+        GetMainSignals().TransactionAvalancheUpdated(update);
+    }
+}
+
 static bool ProcessMessage(const Config &config, CNode *pfrom,
                            const std::string &strCommand, CDataStream &vRecv,
                            int64_t nTimeReceived, CConnman *connman,
@@ -2349,6 +2842,16 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT,
                                                       fAnnounceUsingCMPCTBLOCK,
                                                       nCMPCTBLOCKVersion));
+            if (fGrapheneEnabled) {
+                // Tell our peer we are willing to provide graphene blocks.
+                uint64_t nGrapheneVersion = 1;
+                connman->PushMessage(pfrom,
+                                     msgMaker.Make(NetMsgType::SENDGRAPHENE,
+                                                   nGrapheneVersion));
+            }
+        }
+        if (g_avalanche && (pfrom->nServices & NODE_AVALANCHE)) {
+            g_avalanche->addPeer(pfrom->GetId(), 0);
         }
         pfrom->fSuccessfullyConnected = true;
         return true;
@@ -2446,6 +2949,16 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         return true;
     }
 
+    if (strCommand == NetMsgType::SENDGRAPHENE) {
+        uint64_t nGrapheneVersion = 0;
+        vRecv >> nGrapheneVersion;
+        if (nGrapheneVersion == 1) {
+            LOCK(cs_main);
+            State(pfrom->GetId())->fProvidesGrapheneBlocks = true;
+        }
+        return true;
+    }
+
     if (strCommand == NetMsgType::INV) {
         std::vector<CInv> vInv;
         vRecv >> vInv;
@@ -2464,11 +2977,48 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             fBlocksOnly = false;
         }
 
+        const bool fRequestTxs = !fBlocksOnly && !fImporting && !fReindex &&
+                                 !IsInitialBlockDownload();
+
+        // The bookkeeping of the transaction announcements, and the ones for
+        // transactions already in the mempool, don't need cs_main.
+        std::vector<CInv> vInvToCheck;
+        for (CInv &inv : vInv) {
+            if (interruptMsgProc) {
+                return true;
+            }
+
+            if (inv.type != MSG_BLOCK) {
+                pfrom->AddInventoryKnown(inv);
+                if (fBlocksOnly) {
+                    LogPrint(BCLog::NET,
+                             "transaction (%s) inv sent in violation of "
+                             "protocol peer=%d\n",
+                             inv.hash.ToString(), pfrom->GetId());
+                    continue;
+                }
+                if (inv.type != MSG_TX || !fRequestTxs) {
+                    continue;
+                }
+                if (g_mempool.exists(TxId(inv.hash))) {
+                    LogPrint(BCLog::NET, "got inv: %s  have peer=%d\n",
+                             inv.ToString(), pfrom->GetId());
+                    continue;
+                }
+            }
+
+            vInvToCheck.push_back(inv);
+        }
+
+        if (vInvToCheck.empty()) {
+            return true;
+        }
+
         LOCK(cs_main);
 
         int64_t nNow = GetTimeMicros();
 
-        for (CInv &inv : vInv) {
+        for (const CInv &inv : vInvToCheck) {
             if (interruptMsgProc) {
                 return true;
             }
@@ -2498,17 +3048,8 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                              pindexBestHeader->nHeight, hash.ToString(),
                              pfrom->GetId());
                 }
-            } else {
-                pfrom->AddInventoryKnown(inv);
-                if (fBlocksOnly) {
-                    LogPrint(BCLog::NET,
-                             "transaction (%s) inv sent in violation of "
-                             "protocol peer=%d\n",
-                             inv.hash.ToString(), pfrom->GetId());
-                } else if (!fAlreadyHave && !fImporting && !fReindex &&
-                           !IsInitialBlockDownload()) {
-                    RequestTx(State(pfrom->GetId()), TxId(inv.hash), nNow);
-                }
+            } else if (!fAlreadyHave) {
+                RequestTx(State(pfrom->GetId()), TxId(inv.hash), nNow);
             }
         }
         return true;
@@ -2675,6 +3216,61 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         return true;
     }
 
+    if (strCommand == NetMsgType::GETGRAPHENE) {
+        GrapheneBlockRequest req;
+        vRecv >> req;
+
+        if (!fGrapheneEnabled) {
+            LogPrint(BCLog::NET,
+                     "Peer %d sent us a getgrblk but graphene is disabled\n",
+                     pfrom->GetId());
+            return true;
+        }
+
+        std::shared_ptr<const CBlock> pblock;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block_hash == req.blockhash) {
+                pblock = most_recent_block;
+            }
+            // Unlock cs_most_recent_block to avoid cs_main lock inversion
+        }
+        if (!pblock) {
+            LOCK(cs_main);
+
+            const CBlockIndex *pindex = LookupBlockIndex(req.blockhash);
+            if (!pindex || !pindex->nStatus.hasData()) {
+                LogPrint(
+                    BCLog::NET,
+                    "Peer %d sent us a getgrblk for a block we don't have\n",
+                    pfrom->GetId());
+                return true;
+            }
+
+            if (pindex->nHeight < chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
+                // The requester is unlikely to have the transactions of an
+                // older block in its mempool, send the full block instead, as
+                // for getblocktxn.
+                CInv inv;
+                inv.type = MSG_BLOCK;
+                inv.hash = req.blockhash;
+                pfrom->vRecvGetData.push_back(inv);
+                return true;
+            }
+
+            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            bool ret = ReadBlockFromDisk(*pblockRead, pindex,
+                                         chainparams.GetConsensus());
+            assert(ret);
+            pblock = pblockRead;
+        }
+
+        connman->PushMessage(
+            pfrom, msgMaker.Make(NetMsgType::GRAPHENEBLOCK,
+                                 CGrapheneBlock(*pblock, req.nMempoolTxs)));
+        return true;
+    }
+
     if (strCommand == NetMsgType::GETHEADERS) {
         CBlockLocator locator;
         BlockHash hashStop;
@@ -2688,7 +3284,6 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             return true;
         }
 
-        LOCK(cs_main);
         if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
             LogPrint(BCLog::NET,
                      "Ignoring getheaders from peer=%d because node is in "
@@ -2697,6 +3292,57 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             return true;
         }
 
+        std::shared_ptr<const HeadersSnapshot> snapshot;
+        {
+            LOCK(g_headers_snapshot_mutex);
+            snapshot = g_headers_snapshot;
+        }
+        if (snapshot && !locator.IsNull()) {
+            // Find the last block the caller has in the recent main chain, the
+            // first locator entry in the snapshot being the first one in the
+            // main chain.
+            for (const BlockHash &hash : locator.vHave) {
+                auto it = snapshot->offsets.find(hash);
+                if (it == snapshot->offsets.end()) {
+                    continue;
+                }
+
+                std::vector<CBlock> vHeaders;
+                const CBlockIndex *pindexLast = snapshot->blocks.back();
+                for (size_t i = it->second + 1; i < snapshot->blocks.size();
+                     i++) {
+                    pindexLast = snapshot->blocks[i];
+                    vHeaders.push_back(pindexLast->GetBlockHeader());
+                    if (vHeaders.size() >= MAX_HEADERS_RESULTS ||
+                        pindexLast->GetBlockHash() == hashStop) {
+                        break;
+                    }
+                }
+
+                // The snapshot is published from the validation interface
+                // queue, so it lags behind chainActive after a tip change.
+                // Only answer from it when it still ends at the active tip,
+                // and use the locked path below otherwise.
+                LOCK(cs_main);
+                if (snapshot->blocks.back() != chainActive.Tip()) {
+                    break;
+                }
+
+                LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n",
+                         it->second + 1 < snapshot->blocks.size()
+                             ? snapshot->blocks[it->second + 1]->nHeight
+                             : -1,
+                         hashStop.IsNull() ? "end" : hashStop.ToString(),
+                         pfrom->GetId());
+                // See below.
+                State(pfrom->GetId())->pindexBestHeaderSent = pindexLast;
+                connman->PushMessage(
+                    pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                return true;
+            }
+        }
+
+        LOCK(cs_main);
         CNodeState *nodestate = State(pfrom->GetId());
         const CBlockIndex *pindex = nullptr;
         if (locator.IsNull()) {
@@ -2767,7 +3413,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         }
 
         std::deque<COutPoint> vWorkQueue;
-        std::vector<uint256> vEraseQueue;
+        std::vector<TxId> vEraseQueue;
         CTransactionRef ptx;
         vRecv >> ptx;
         const CTransaction &tx = *ptx;
@@ -2791,7 +3437,10 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                                false /* bypass_limits */,
                                Amount::zero() /* nAbsurdFee */)) {
             g_mempool.check(pcoinsTip.get());
-            RelayTransaction(tx, connman);
+            RelayTransaction(tx);
+            if (g_avalanche) {
+                g_avalanche->addTxToReconcile(ptx);
+            }
             for (size_t i = 0; i < tx.vout.size(); i++) {
                 vWorkQueue.emplace_back(txid, i);
             }
@@ -2808,18 +3457,14 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
             // one
             std::unordered_map<NodeId, uint32_t> rejectCountPerNode;
             while (!vWorkQueue.empty()) {
-                auto itByPrev =
-                    mapOrphanTransactionsByPrev.find(vWorkQueue.front());
+                const std::vector<COrphanTx> children =
+                    g_orphans.GetChildren(vWorkQueue.front());
                 vWorkQueue.pop_front();
-                if (itByPrev == mapOrphanTransactionsByPrev.end()) {
-                    continue;
-                }
-                for (auto mi = itByPrev->second.begin();
-                     mi != itByPrev->second.end(); ++mi) {
-                    const CTransactionRef &porphanTx = (*mi)->second.tx;
+                for (const COrphanTx &child : children) {
+                    const CTransactionRef &porphanTx = child.tx;
                     const CTransaction &orphanTx = *porphanTx;
                     const TxId &orphanId = orphanTx.GetId();
-                    NodeId fromPeer = (*mi)->second.fromPeer;
+                    NodeId fromPeer = child.fromPeer;
                     bool fMissingInputs2 = false;
                     // Use a dummy CValidationState so someone can't setup nodes
                     // to counter-DoS based on orphan resolution (that is,
@@ -2839,7 +3484,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                                            Amount::zero() /* nAbsurdFee */)) {
                         LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n",
                                  orphanId.ToString());
-                        RelayTransaction(orphanTx, connman);
+                        RelayTransaction(orphanTx);
                         for (size_t i = 0; i < orphanTx.vout.size(); i++) {
                             vWorkQueue.emplace_back(orphanId, i);
                         }
@@ -2876,8 +3521,8 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                 }
             }
 
-            for (const uint256 &hash : vEraseQueue) {
-                EraseOrphanTx(hash);
+            for (const TxId &orphanId : vEraseQueue) {
+                EraseOrphanTx(orphanId);
             }
         } else if (fMissingInputs) {
             // It may be the case that the orphans parents have all been
@@ -2903,12 +3548,17 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                 }
                 AddOrphanTx(ptx, pfrom->GetId());
 
-                // DoS prevention: do not allow mapOrphanTransactions to grow
-                // unbounded
+                // DoS prevention: do not allow g_orphans to grow unbounded
                 unsigned int nMaxOrphanTx = (unsigned int)std::max(
                     int64_t(0), gArgs.GetArg("-maxorphantx",
                                              DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                const int64_t nMaxOrphanTxSizeMB =
+                    gArgs.GetArg("-maxorphantxsize",
+                                 DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE);
+                uint64_t nMaxOrphanTxSize =
+                    std::max(int64_t(0), nMaxOrphanTxSizeMB) * 1000000;
+                unsigned int nEvicted =
+                    LimitOrphanTxSize(nMaxOrphanTx, nMaxOrphanTxSize);
                 if (nEvicted > 0) {
                     LogPrint(BCLog::MEMPOOL,
                              "mapOrphan overflow, removed %u tx\n", nEvicted);
@@ -2934,6 +3584,12 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                 }
             }
 
+            if (g_avalanche &&
+                state.GetRejectReason() == "txn-mempool-conflict") {
+                // Let avalanche decide between the double spends.
+                g_avalanche->addTxToReconcile(ptx);
+            }
+
             if (pfrom->fWhitelisted &&
                 gArgs.GetBoolArg("-whitelistforcerelay",
                                  DEFAULT_WHITELISTFORCERELAY)) {
@@ -2949,7 +3605,7 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
                 if (!state.IsInvalid(nDoS) || nDoS == 0) {
                     LogPrintf("Force relaying tx %s from whitelisted peer=%d\n",
                               tx.GetId().ToString(), pfrom->GetId());
-                    RelayTransaction(tx, connman);
+                    RelayTransaction(tx);
                 } else {
                     LogPrintf("Not relaying invalid transaction %s from "
                               "whitelisted peer=%d (%s)\n",
@@ -3347,6 +4003,82 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         return true;
     }
 
+    if (strCommand == NetMsgType::GRAPHENEBLOCK && !fImporting && !fReindex) {
+        CGrapheneBlock grblk;
+        vRecv >> grblk;
+
+        const BlockHash hash = grblk.header.GetHash();
+        {
+            LOCK(cs_main);
+            auto it = mapBlocksInFlight.find(hash);
+            if (it == mapBlocksInFlight.end() ||
+                it->second.first != pfrom->GetId()) {
+                LogPrint(BCLog::NET,
+                         "Peer %d sent us a graphene block we weren't "
+                         "expecting\n",
+                         pfrom->GetId());
+                return true;
+            }
+        }
+
+        // Decoding runs the whole mempool through the filter of the block, so
+        // only hold the mempool lock for it, as PartiallyDownloadedBlock does.
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        ReadStatus status =
+            DecodeGrapheneBlock(config, grblk, g_mempool, *pblock);
+
+        {
+            LOCK(cs_main);
+            // The block may have been received some other way meanwhile.
+            auto it = mapBlocksInFlight.find(hash);
+            if (it == mapBlocksInFlight.end() ||
+                it->second.first != pfrom->GetId()) {
+                return true;
+            }
+
+            if (status == READ_STATUS_INVALID) {
+                // Reset in-flight state in case of whitelist
+                MarkBlockAsReceived(hash);
+                Misbehaving(pfrom, 100, "invalid-grblk");
+                LogPrintf("Peer %d sent us invalid graphene block\n",
+                          pfrom->GetId());
+                return true;
+            }
+            if (status == READ_STATUS_FAILED) {
+                // Some transactions are missing from our mempool, download
+                // a compact block instead, which requests them with
+                // getblocktxn.
+                LogPrint(BCLog::NET,
+                         "Failed to reconstruct graphene block %s from "
+                         "peer=%d, requesting a compact block\n",
+                         hash.ToString(), pfrom->GetId());
+                std::vector<CInv> invs;
+                invs.push_back(CInv(MSG_CMPCT_BLOCK, hash));
+                connman->PushMessage(pfrom,
+                                     msgMaker.Make(NetMsgType::GETDATA, invs));
+                return true;
+            }
+
+            MarkBlockAsReceived(hash);
+            // As for compact blocks, peers relay graphene blocks after
+            // validating the header only, so they are not punished if the
+            // block turns out to be invalid.
+            mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), false));
+        } // Don't hold cs_main when we call into ProcessNewBlock
+
+        bool fNewBlock = false;
+        // The block was requested, so force it to be processed, as for
+        // blocktxn.
+        ProcessNewBlock(config, pblock, /*fForceProcessing=*/true, &fNewBlock);
+        if (fNewBlock) {
+            pfrom->nLastBlockTime = GetTime();
+        } else {
+            LOCK(cs_main);
+            mapBlockSource.erase(pblock->GetHash());
+        }
+        return true;
+    }
+
     // Ignore headers received while importing
     if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) {
         std::vector<CBlockHeader> headers;
@@ -3615,6 +4347,35 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         return true;
     }
 
+    if (strCommand == NetMsgType::GETCFILTERS) {
+        ProcessGetCFilters(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
+    if (strCommand == NetMsgType::GETCFHEADERS) {
+        ProcessGetCFHeaders(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
+    if (strCommand == NetMsgType::GETCFCHECKPT) {
+        ProcessGetCFCheckPt(pfrom, vRecv, chainparams, connman);
+        return true;
+    }
+
+    if (strCommand == NetMsgType::AVAPOLL) {
+        if (g_avalanche) {
+            ProcessAvalanchePoll(pfrom, vRecv, connman);
+        }
+        return true;
+    }
+
+    if (strCommand == NetMsgType::AVARESPONSE) {
+        if (g_avalanche) {
+            ProcessAvalancheResponse(pfrom, vRecv);
+        }
+        return true;
+    }
+
     if (strCommand == NetMsgType::NOTFOUND) {
         // Remove the NOTFOUND transactions from the peer
         LOCK(cs_main);
@@ -4293,12 +5054,10 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                 {
                     LOCK(cs_most_recent_block);
                     if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                        CBlockHeaderAndShortTxIDs cmpctblock(
-                            *most_recent_block);
                         connman->PushMessage(
-                            pto,
-                            msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                          cmpctblock));
+                            pto, msgMaker.MakeShared(
+                                     NetMsgType::CMPCTBLOCK,
+                                     most_recent_compact_block_payload));
                         fGotBlockFromCache = true;
                     }
                 }
@@ -4404,6 +5163,7 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
             LOCK(pto->cs_filter);
             if (!pto->fRelayTxes) {
                 pto->setInventoryTxToSend.clear();
+                state.nTxRelaySeq = g_tx_relay_batches.NextSeq();
             }
         }
 
@@ -4457,45 +5217,23 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                 LOCK(pto->cs_feeFilter);
                 filterrate = pto->minFeeFilter;
             }
-            // Topologically and fee-rate sort the inventory we send for privacy
-            // and priority reasons. A heap is used so that not all items need
-            // sorting if only a few are being sent.
-            CompareInvMempoolOrder compareInvMempoolOrder(&g_mempool);
-            std::make_heap(vInvTx.begin(), vInvTx.end(),
-                           compareInvMempoolOrder);
             // No reason to drain out at many times the network's capacity,
             // especially since we have many peers and some will draw much
             // shorter delays.
+            const unsigned int nMaxRelayedTransactions =
+                INVENTORY_BROADCAST_MAX_PER_MB * config.GetMaxBlockSize() /
+                1000000;
             unsigned int nRelayedTransactions = 0;
             LOCK(pto->cs_filter);
-            while (!vInvTx.empty() &&
-                   nRelayedTransactions < INVENTORY_BROADCAST_MAX_PER_MB *
-                                              config.GetMaxBlockSize() /
-                                              1000000) {
-                // Fetch the top element from the heap
-                std::pop_heap(vInvTx.begin(), vInvTx.end(),
-                              compareInvMempoolOrder);
-                std::set<TxId>::iterator it = vInvTx.back();
-                vInvTx.pop_back();
-                TxId txid = *it;
-                // Remove it from the to-be-sent set
-                pto->setInventoryTxToSend.erase(it);
-                // Check if not in the filter already
-                if (pto->filterInventoryKnown.contains(txid)) {
-                    continue;
-                }
-                // Not in the mempool anymore? don't bother sending it.
-                auto txinfo = g_mempool.info(txid);
-                if (!txinfo.tx) {
-                    continue;
-                }
+            auto relayTx = [&](const TxMempoolInfo &txinfo) {
+                const TxId &txid = txinfo.tx->GetId();
                 if (filterrate != Amount::zero() &&
                     txinfo.feeRate.GetFeePerK() < filterrate) {
-                    continue;
+                    return;
                 }
                 if (pto->pfilter &&
                     !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) {
-                    continue;
+                    return;
                 }
                 // Send
                 vInv.push_back(CInv(MSG_TX, txid));
@@ -4508,8 +5246,7 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                         vRelayExpiration.pop_front();
                     }
 
-                    auto ret = mapRelay.insert(
-                        std::make_pair(txid, std::move(txinfo.tx)));
+                    auto ret = mapRelay.emplace(txid, RelayTx{txinfo.tx, {}});
                     if (ret.second) {
                         vRelayExpiration.push_back(std::make_pair(
                             nNow + 15 * 60 * 1000000, ret.first));
@@ -4521,6 +5258,54 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                     vInv.clear();
                 }
                 pto->filterInventoryKnown.insert(txid);
+            };
+
+            // Announce the transactions pushed to this peer only first.
+            // Topologically and fee-rate sort them for privacy and priority
+            // reasons. A heap is used so that not all items need sorting if
+            // only a few are being sent.
+            CompareInvMempoolOrder compareInvMempoolOrder(&g_mempool);
+            std::make_heap(vInvTx.begin(), vInvTx.end(),
+                           compareInvMempoolOrder);
+            while (!vInvTx.empty() &&
+                   nRelayedTransactions < nMaxRelayedTransactions) {
+                // Fetch the top element from the heap
+                std::pop_heap(vInvTx.begin(), vInvTx.end(),
+                              compareInvMempoolOrder);
+                std::set<TxId>::iterator it = vInvTx.back();
+                vInvTx.pop_back();
+                TxId txid = *it;
+                // Remove it from the to-be-sent set
+                pto->setInventoryTxToSend.erase(it);
+                // Check if not in the filter already
+                if (pto->filterInventoryKnown.contains(txid)) {
+                    continue;
+                }
+                // Not in the mempool anymore? don't bother sending it.
+                auto txinfo = g_mempool.info(txid);
+                if (!txinfo.tx) {
+                    continue;
+                }
+                relayTx(txinfo);
+            }
+
+            // Then the transactions relayed to all the peers, which are
+            // already sorted, from where this peer left off.
+            g_tx_relay_batches.MakeBatch(
+                g_mempool, nNow, nNow - TX_RELAY_BATCH_EXPIRY * 1000000);
+            if (nRelayedTransactions < nMaxRelayedTransactions) {
+                g_tx_relay_batches.ForEachFrom(
+                    state.nTxRelaySeq, [&](const TxId &txid) {
+                        if (!pto->filterInventoryKnown.contains(txid)) {
+                            // Not in the mempool anymore? don't bother
+                            // sending it.
+                            auto txinfo = g_mempool.info(txid);
+                            if (txinfo.tx) {
+                                relayTx(txinfo);
+                            }
+                        }
+                        return nRelayedTransactions < nMaxRelayedTransactions;
+                    });
             }
         }
     }
@@ -4757,7 +5542,6 @@ public:
     CNetProcessingCleanup() {}
     ~CNetProcessingCleanup() {
         // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
+        g_orphans.Clear();
     }
 } instance_of_cnetprocessingcleanup;
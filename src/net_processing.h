@@ -17,6 +17,11 @@ class Config;
  * memory.
  */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
+/**
+ * Default for -maxorphantxsize, maximum total size in megabytes of the orphan
+ * transactions kept in memory.
+ */
+static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS_SIZE = 5;
 /**
  * Default number of orphan+recently-replaced txn to keep around for block
  * reconstruction.
@@ -25,6 +30,8 @@ static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 
 /** Default for BIP61 (sending reject messages) */
 static constexpr bool DEFAULT_ENABLE_BIP61 = true;
+/** Default for -graphene, relaying new blocks as graphene blocks */
+static constexpr bool DEFAULT_GRAPHENE = false;
 
 class PeerLogicValidation final : public CValidationInterface,
                                   public NetEventsInterface {
@@ -46,6 +53,10 @@ public:
     BlockConnected(const std::shared_ptr<const CBlock> &pblock,
                    const CBlockIndex *pindexConnected,
                    const std::vector<CTransactionRef> &vtxConflicted) override;
+    /**
+     * Overridden from CValidationInterface.
+     */
+    void TransactionRemovedFromMempool(const CTransactionRef &ptx) override;
     /**
      * Overridden from CValidationInterface.
      */
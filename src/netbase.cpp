@@ -15,6 +15,7 @@
 #include <tinyformat.h>
 
 #include <atomic>
+#include <cassert>
 
 #ifndef WIN32
 #include <fcntl.h>
@@ -30,6 +31,9 @@ static proxyType proxyInfo[NET_MAX] GUARDED_BY(cs_proxyInfos);
 static proxyType nameProxy GUARDED_BY(cs_proxyInfos);
 int nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
 bool fNameLookup = DEFAULT_NAME_LOOKUP;
+// select() until set from -socketevents, so that sockets created for other
+// users of this file (e.g. the seeder) stay below FD_SETSIZE.
+SocketEventsMode g_socket_events_mode = SocketEventsMode::Select;
 
 // Need ample time for negotiation for very slow proxies such as Tor
 // (milliseconds)
@@ -68,6 +72,49 @@ std::string GetNetworkName(enum Network net) {
     }
 }
 
+bool ParseSocketEventsMode(const std::string &str, SocketEventsMode &mode) {
+    if (str == "select") {
+        mode = SocketEventsMode::Select;
+        return true;
+    }
+#ifdef USE_POLL
+    if (str == "poll") {
+        mode = SocketEventsMode::Poll;
+        return true;
+    }
+#endif
+#ifdef USE_EPOLL
+    if (str == "epoll") {
+        mode = SocketEventsMode::Epoll;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string GetSocketEventsModeName(SocketEventsMode mode) {
+    switch (mode) {
+        case SocketEventsMode::Select:
+            return "select";
+        case SocketEventsMode::Poll:
+            return "poll";
+        case SocketEventsMode::Epoll:
+            return "epoll";
+    }
+    assert(false);
+}
+
+std::string GetSupportedSocketEventsModes() {
+    std::string modes = "select";
+#ifdef USE_POLL
+    modes += ", poll";
+#endif
+#ifdef USE_EPOLL
+    modes += ", epoll";
+#endif
+    return modes;
+}
+
 static bool LookupIntern(const char *pszName, std::vector<CNetAddr> &vIP,
                          unsigned int nMaxSolutions, bool fAllowLookup) {
     vIP.clear();
@@ -281,6 +328,13 @@ static IntrRecvError InterruptibleRecv(uint8_t *data, size_t len, int timeout,
             int nErr = WSAGetLastError();
             if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK ||
                 nErr == WSAEINVAL) {
+#ifdef USE_POLL
+                struct pollfd pollfd = {};
+                pollfd.fd = hSocket;
+                pollfd.events = POLLIN;
+                int nRet =
+                    poll(&pollfd, 1, int(std::min(endTime - curTime, maxWait)));
+#else
                 if (!IsSelectableSocket(hSocket)) {
                     return IntrRecvError::NetworkError;
                 }
@@ -290,6 +344,7 @@ static IntrRecvError InterruptibleRecv(uint8_t *data, size_t len, int timeout,
                 FD_ZERO(&fdset);
                 FD_SET(hSocket, &fdset);
                 int nRet = select(hSocket + 1, &fdset, nullptr, nullptr, &tval);
+#endif
                 if (nRet == SOCKET_ERROR) {
                     return IntrRecvError::NetworkError;
                 }
@@ -497,7 +552,8 @@ SOCKET CreateSocket(const CService &addrConnect) {
         return INVALID_SOCKET;
     }
 
-    if (!IsSelectableSocket(hSocket)) {
+    if (g_socket_events_mode == SocketEventsMode::Select &&
+        !IsSelectableSocket(hSocket)) {
         CloseSocket(hSocket);
         LogPrintf("Cannot create connection: non-selectable socket created (fd "
                   ">= FD_SETSIZE ?)\n");
@@ -554,11 +610,18 @@ bool ConnectSocketDirectly(const CService &addrConnect, const SOCKET &hSocket,
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK ||
             nErr == WSAEINVAL) {
+#ifdef USE_POLL
+            struct pollfd pollfd = {};
+            pollfd.fd = hSocket;
+            pollfd.events = POLLOUT;
+            int nRet = poll(&pollfd, 1, nTimeout);
+#else
             struct timeval timeout = MillisToTimeval(nTimeout);
             fd_set fdset;
             FD_ZERO(&fdset);
             FD_SET(hSocket, &fdset);
             int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
+#endif
             if (nRet == 0) {
                 LogPrint(BCLog::NET, "connection to %s timeout\n",
                          addrConnect.ToString());
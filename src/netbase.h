@@ -17,13 +17,32 @@
 #include <string>
 #include <vector>
 
+/** The system interface used to wait for events on the peer sockets. */
+enum class SocketEventsMode {
+    //! select(), limited to sockets below FD_SETSIZE
+    Select,
+    //! poll()
+    Poll,
+    //! epoll with persistent, edge-triggered registrations (Linux only)
+    Epoll,
+};
+
 extern int nConnectTimeout;
 extern bool fNameLookup;
+extern SocketEventsMode g_socket_events_mode;
 
 //! -timeout default
 static const int DEFAULT_CONNECT_TIMEOUT = 5000;
 //! -dns default
 static const int DEFAULT_NAME_LOOKUP = true;
+//! -socketevents default
+#if defined(USE_EPOLL)
+static const char *const DEFAULT_SOCKETEVENTS = "epoll";
+#elif defined(USE_POLL)
+static const char *const DEFAULT_SOCKETEVENTS = "poll";
+#else
+static const char *const DEFAULT_SOCKETEVENTS = "select";
+#endif
 
 class proxyType {
 public:
@@ -40,6 +59,14 @@ public:
 
 enum Network ParseNetwork(std::string net);
 std::string GetNetworkName(enum Network net);
+/**
+ * Parse a -socketevents mode. Returns false if the mode is unknown or not
+ * supported on this platform.
+ */
+bool ParseSocketEventsMode(const std::string &str, SocketEventsMode &mode);
+std::string GetSocketEventsModeName(SocketEventsMode mode);
+/** Comma separated names of the modes supported on this platform. */
+std::string GetSupportedSocketEventsModes();
 bool SetProxy(enum Network net, const proxyType &addrProxy);
 bool GetProxy(enum Network net, proxyType &proxyInfoOut);
 bool IsProxy(const CNetAddr &addr);
@@ -9,6 +9,8 @@
 #include <net.h>
 #include <serialize.h>
 
+#include <memory>
+
 class CNetMsgMaker {
 public:
     explicit CNetMsgMaker(int nVersionIn) : nVersion(nVersionIn) {}
@@ -28,6 +30,28 @@ public:
         return Make(0, std::move(sCommand), std::forward<Args>(args)...);
     }
 
+    /**
+     * Serialize a payload once, to be sent to any number of peers with
+     * MakeShared.
+     */
+    template <typename... Args>
+    std::shared_ptr<const CSharedNetMsgPayload>
+    MakePayload(int nFlags, Args &&... args) const {
+        std::vector<uint8_t> data;
+        CVectorWriter{SER_NETWORK, nFlags | nVersion, data, 0,
+                      std::forward<Args>(args)...};
+        return std::make_shared<const CSharedNetMsgPayload>(std::move(data));
+    }
+
+    CSerializedNetMsg
+    MakeShared(std::string sCommand,
+               std::shared_ptr<const CSharedNetMsgPayload> payload) const {
+        CSerializedNetMsg msg;
+        msg.command = std::move(sCommand);
+        msg.shared_payload = std::move(payload);
+        return msg;
+    }
+
 private:
     const int nVersion;
 };
@@ -46,11 +46,21 @@ const char *GETBLOCKTXN = "getblocktxn";
 const char *BLOCKTXN = "blocktxn";
 const char *AVAPOLL = "avapoll";
 const char *AVARESPONSE = "avaresponse";
+const char *GETCFILTERS = "getcfilters";
+const char *CFILTER = "cfilter";
+const char *GETCFHEADERS = "getcfheaders";
+const char *CFHEADERS = "cfheaders";
+const char *GETCFCHECKPT = "getcfcheckpt";
+const char *CFCHECKPT = "cfcheckpt";
+const char *SENDGRAPHENE = "sendgraphene";
+const char *GETGRAPHENE = "getgrblk";
+const char *GRAPHENEBLOCK = "grblk";
 
 bool IsBlockLike(const std::string &strCommand) {
     return strCommand == NetMsgType::BLOCK ||
            strCommand == NetMsgType::CMPCTBLOCK ||
-           strCommand == NetMsgType::BLOCKTXN;
+           strCommand == NetMsgType::BLOCKTXN ||
+           strCommand == NetMsgType::GRAPHENEBLOCK;
 }
 }; // namespace NetMsgType
 
@@ -59,15 +69,19 @@ bool IsBlockLike(const std::string &strCommand) {
  * above and in protocol.h.
  */
 static const std::string allNetMessageTypes[] = {
-    NetMsgType::VERSION,     NetMsgType::VERACK,     NetMsgType::ADDR,
-    NetMsgType::INV,         NetMsgType::GETDATA,    NetMsgType::MERKLEBLOCK,
-    NetMsgType::GETBLOCKS,   NetMsgType::GETHEADERS, NetMsgType::TX,
-    NetMsgType::HEADERS,     NetMsgType::BLOCK,      NetMsgType::GETADDR,
-    NetMsgType::MEMPOOL,     NetMsgType::PING,       NetMsgType::PONG,
-    NetMsgType::NOTFOUND,    NetMsgType::FILTERLOAD, NetMsgType::FILTERADD,
-    NetMsgType::FILTERCLEAR, NetMsgType::REJECT,     NetMsgType::SENDHEADERS,
-    NetMsgType::FEEFILTER,   NetMsgType::SENDCMPCT,  NetMsgType::CMPCTBLOCK,
-    NetMsgType::GETBLOCKTXN, NetMsgType::BLOCKTXN,
+    NetMsgType::VERSION,      NetMsgType::VERACK,       NetMsgType::ADDR,
+    NetMsgType::INV,          NetMsgType::GETDATA,      NetMsgType::MERKLEBLOCK,
+    NetMsgType::GETBLOCKS,    NetMsgType::GETHEADERS,   NetMsgType::TX,
+    NetMsgType::HEADERS,      NetMsgType::BLOCK,        NetMsgType::GETADDR,
+    NetMsgType::MEMPOOL,      NetMsgType::PING,         NetMsgType::PONG,
+    NetMsgType::NOTFOUND,     NetMsgType::FILTERLOAD,   NetMsgType::FILTERADD,
+    NetMsgType::FILTERCLEAR,  NetMsgType::REJECT,       NetMsgType::SENDHEADERS,
+    NetMsgType::FEEFILTER,    NetMsgType::SENDCMPCT,    NetMsgType::CMPCTBLOCK,
+    NetMsgType::GETBLOCKTXN,  NetMsgType::BLOCKTXN,     NetMsgType::GETCFILTERS,
+    NetMsgType::CFILTER,      NetMsgType::GETCFHEADERS, NetMsgType::CFHEADERS,
+    NetMsgType::GETCFCHECKPT, NetMsgType::CFCHECKPT,
+    NetMsgType::SENDGRAPHENE, NetMsgType::GETGRAPHENE,
+    NetMsgType::GRAPHENEBLOCK,
 };
 static const std::vector<std::string>
     allNetMessageTypesVec(allNetMessageTypes,
@@ -891,6 +891,9 @@ QString formatServicesStr(quint64 mask) {
                 case NODE_BITCOIN_CASH:
                     strList.append("CASH");
                     break;
+                case NODE_COMPACT_FILTERS:
+                    strList.append("COMPACT_FILTERS");
+                    break;
                 case NODE_NETWORK_LIMITED:
                     strList.append("LIMITED");
                     break;
@@ -6,6 +6,7 @@
 #define BITCOIN_RADIX_H
 
 #include <rcu.h>
+#include <uint256.h>
 #include <util/system.h>
 
 #include <boost/noncopyable.hpp>
@@ -16,6 +17,26 @@
 #include <memory>
 #include <type_traits>
 
+/**
+ * Get the bits of a radix tree key starting at the given shift, a multiple of
+ * BITS. Integer keys are shifted. uint256 keys are read one byte at a time and
+ * from their least significant byte for the top levels of the tree: the most
+ * significant bytes of block hashes are zero, and would make every lookup walk
+ * through shared levels.
+ */
+template <int BITS, typename K>
+size_t GetRadixKeyBits(const K &key, uint32_t shift) {
+    return size_t(key >> shift);
+}
+
+template <int BITS>
+size_t GetRadixKeyBits(const uint256 &key, uint32_t shift) {
+    // A chunk of BITS bits must not straddle two bytes.
+    static_assert(8 % BITS == 0, "BITS must divide 8 for uint256 keys.");
+    const uint32_t bit = 256 - BITS - shift;
+    return key.begin()[bit / 8] >> (bit % 8);
+}
+
 /**
  * This is a radix tree storing values identified by a unique key.
  *
@@ -96,6 +117,17 @@ public:
         return RCUPtr<const T>::acquire(ptr);
     }
 
+    /**
+     * Call func on the values in the tree, in an unspecified order, until it
+     * returns false. Values inserted or removed concurrently may or may not be
+     * visited. The RCU lock is held during the walk, so func must not take it.
+     * Returns false if func interrupted the walk.
+     */
+    template <typename Callable> bool forEachLeaf(Callable &&func) const {
+        RCULock lock;
+        return forEachLeaf(root.load(), func);
+    }
+
     /**
      * Remove an element from the tree.
      * Returns the removed element, or nullptr if there isn't one.
@@ -136,6 +168,16 @@ public:
     }
 
 private:
+    template <typename Callable>
+    static bool forEachLeaf(RadixElement e, Callable &func) {
+        if (e.isNode()) {
+            return e.getNode()->forEachLeaf(func);
+        }
+
+        const T *leaf = e.getLeaf();
+        return leaf == nullptr || func(*leaf);
+    }
+
     bool insert(const K &key, RCUPtr<T> value) {
         uint32_t level = TOP_LEVEL;
 
@@ -272,7 +314,17 @@ private:
         }
 
         std::atomic<RadixElement> *get(uint32_t level, const K &key) {
-            return &children[(key >> (level * BITS)) & MASK];
+            return &children[GetRadixKeyBits<BITS>(key, level * BITS) & MASK];
+        }
+
+        template <typename Callable> bool forEachLeaf(Callable &func) const {
+            for (const std::atomic<RadixElement> &child : children) {
+                if (!RadixTree::forEachLeaf(child.load(), func)) {
+                    return false;
+                }
+            }
+
+            return true;
         }
     };
 
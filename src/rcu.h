@@ -46,6 +46,8 @@ class RCUInfos {
         cleanups.emplace(++revision, f);
     }
 
+    bool hasPendingCleanups() const { return !cleanups.empty(); }
+
     void synchronize();
     void runCleanups();
     uint64_t hasSyncedTo(uint64_t cutoff = UNLOCKED);
@@ -72,6 +74,14 @@ public:
         RCUInfos::infos.registerCleanup(f);
     }
 
+    /**
+     * Whether this thread registered cleanups that did not run yet. They only
+     * run when this thread synchronizes.
+     */
+    static bool hasPendingCleanups() {
+        return RCUInfos::infos.hasPendingCleanups();
+    }
+
     static void synchronize() { RCUInfos::infos.synchronize(); }
 };
 
@@ -220,17 +220,16 @@ static bool rest_block(const Config &config, HTTPRequest *req,
 
     const BlockHash hash(rawHash);
 
+    CBlockIndex *pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex) {
+        return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+    }
+
     CBlock block;
-    CBlockIndex *pblockindex = nullptr;
     CBlockIndex *tip = nullptr;
     {
         LOCK(cs_main);
         tip = chainActive.Tip();
-        pblockindex = LookupBlockIndex(hash);
-        if (!pblockindex) {
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
-        }
-
         if (IsBlockPruned(pblockindex)) {
             return RESTERR(req, HTTP_NOT_FOUND,
                            hashStr + " not available (pruned data)");
@@ -541,6 +540,7 @@ static bool rest_getutxos(Config &config, HTTPRequest *req,
     std::vector<CCoin> outs;
     std::string bitmapStringRepresentation;
     std::vector<bool> hits;
+    const CBlockIndex *pindexBest = nullptr;
     bitmap.resize((vOutPoints.size() + 7) / 8);
     {
         auto process_utxos = [&vOutPoints, &outs,
@@ -557,17 +557,25 @@ static bool rest_getutxos(Config &config, HTTPRequest *req,
             }
         };
 
+        // The coins cache is read without cs_main, under a guard which keeps
+        // its coins and best block consistent with each other.
         if (fCheckMemPool) {
             // use db+mempool as cache backend in case user likes to query
             // mempool
-            LOCK2(cs_main, g_mempool.cs);
-            CCoinsViewCache &viewChain = *pcoinsTip;
-            CCoinsViewMemPool viewMempool(&viewChain, g_mempool);
+            LOCK(g_mempool.cs);
+            CCoinsViewShardedCache::ReadGuard guard(*pcoinsTip);
+            CCoinsViewMemPool viewMempool(pcoinsTip.get(), g_mempool);
             process_utxos(viewMempool, g_mempool);
+            pindexBest = LookupBlockIndex(pcoinsTip->GetBestBlock());
         } else {
             // no need to lock mempool!
-            LOCK(cs_main);
+            CCoinsViewShardedCache::ReadGuard guard(*pcoinsTip);
             process_utxos(*pcoinsTip, CTxMemPool());
+            pindexBest = LookupBlockIndex(pcoinsTip->GetBestBlock());
+        }
+        if (!pindexBest) {
+            return RESTERR(req, HTTP_SERVICE_UNAVAILABLE,
+                           "Coins database not loaded");
         }
 
         for (size_t i = 0; i < hits.size(); ++i) {
@@ -584,9 +592,8 @@ static bool rest_getutxos(Config &config, HTTPRequest *req,
             // serialize data
             // use exact same output as mentioned in Bip64
             CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-            ssGetUTXOResponse << chainActive.Height()
-                              << chainActive.Tip()->GetBlockHash() << bitmap
-                              << outs;
+            ssGetUTXOResponse << pindexBest->nHeight
+                              << pindexBest->GetBlockHash() << bitmap << outs;
             std::string ssGetUTXOResponseString = ssGetUTXOResponse.str();
 
             req->WriteHeader("Content-Type", "application/octet-stream");
@@ -596,9 +603,8 @@ static bool rest_getutxos(Config &config, HTTPRequest *req,
 
         case RetFormat::HEX: {
             CDataStream ssGetUTXOResponse(SER_NETWORK, PROTOCOL_VERSION);
-            ssGetUTXOResponse << chainActive.Height()
-                              << chainActive.Tip()->GetBlockHash() << bitmap
-                              << outs;
+            ssGetUTXOResponse << pindexBest->nHeight
+                              << pindexBest->GetBlockHash() << bitmap << outs;
             std::string strHex =
                 HexStr(ssGetUTXOResponse.begin(), ssGetUTXOResponse.end()) +
                 "\n";
@@ -613,9 +619,9 @@ static bool rest_getutxos(Config &config, HTTPRequest *req,
 
             // pack in some essentials
             // use more or less the same output as mentioned in Bip64
-            objGetUTXOResponse.pushKV("chainHeight", chainActive.Height());
-            objGetUTXOResponse.pushKV(
-                "chaintipHash", chainActive.Tip()->GetBlockHash().GetHex());
+            objGetUTXOResponse.pushKV("chainHeight", pindexBest->nHeight);
+            objGetUTXOResponse.pushKV("chaintipHash",
+                                      pindexBest->GetBlockHash().GetHex());
             objGetUTXOResponse.pushKV("bitmap", bitmapStringRepresentation);
 
             UniValue utxos(UniValue::VARR);
@@ -0,0 +1,66 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <avalanche.h>
+#include <config.h>
+#include <rpc/server.h>
+#include <util/strencodings.h>
+
+#include <univalue.h>
+
+static UniValue getavalanchetxinfo(const Config &config,
+                                   const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "getavalanchetxinfo \"txid\"\n"
+            "\nReturn the avalanche state of a transaction which is being "
+            "voted on. Transactions are no longer voted on once they are "
+            "finalized, invalidated or mined.\n"
+            "\nArguments:\n"
+            "1. \"txid\"             (string, required) The transaction id\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"hash\",    (string) The transaction id\n"
+            "  \"accepted\" : true|false, (boolean) If the network currently "
+            "accepts the transaction\n"
+            "  \"confidence\" : n,   (numeric) The number of consecutive "
+            "votes agreeing with the acceptance state\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getavalanchetxinfo", "\"mytxid\"") +
+            HelpExampleRpc("getavalanchetxinfo", "\"mytxid\""));
+    }
+
+    if (!g_avalanche) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Avalanche is not enabled (see -enableavalanche)");
+    }
+
+    const TxId txid(ParseHashV(request.params[0], "txid"));
+    const int confidence = g_avalanche->getConfidence(txid);
+    if (confidence < 0) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                           "Transaction is not being voted on");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("txid", txid.GetHex());
+    ret.pushKV("accepted", g_avalanche->isAccepted(txid));
+    ret.pushKV("confidence", confidence);
+    return ret;
+}
+
+// clang-format off
+static const ContextFreeRPCCommand commands[] = {
+    //  category            name                      actor (function)        argNames
+    //  ------------------- ------------------------  ----------------------  ----------
+    { "avalanche",          "getavalanchetxinfo",     getavalanchetxinfo,     {"txid"}},
+};
+// clang-format on
+
+void RegisterAvalancheRPCCommands(CRPCTable &t) {
+    for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++) {
+        t.appendCommand(commands[vcidx].name, &commands[vcidx]);
+    }
+}
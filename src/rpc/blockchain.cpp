@@ -6,6 +6,7 @@
 #include <rpc/blockchain.h>
 
 #include <amount.h>
+#include <blockfilter.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -14,6 +15,10 @@
 #include <consensus/validation.h>
 #include <core_io.h>
 #include <hash.h>
+#include <index/addressindex.h>
+#include <index/blockfilterindex.h>
+#include <index/coinstatsindex.h>
+#include <index/spentindex.h>
 #include <index/txindex.h>
 #include <key_io.h>
 #include <policy/policy.h>
@@ -35,6 +40,7 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/thread/thread.hpp> // boost::thread::interrupt
 
+#include <algorithm>
 #include <cassert>
 #include <condition_variable>
 #include <cstdint>
@@ -967,6 +973,42 @@ static UniValue getblock(const Config &config, const JSONRPCRequest &request) {
     return blockToJSON(block, chainActive.Tip(), pblockindex, verbosity >= 2);
 }
 
+//! Find the block of the active chain designated by a hash or a height.
+static const CBlockIndex *ParseHashOrHeight(const UniValue &param)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    AssertLockHeld(cs_main);
+
+    if (param.isNum()) {
+        const int height = param.get_int();
+        const int current_tip = chainActive.Height();
+        if (height < 0) {
+            throw JSONRPCError(
+                RPC_INVALID_PARAMETER,
+                strprintf("Target block height %d is negative", height));
+        }
+        if (height > current_tip) {
+            throw JSONRPCError(
+                RPC_INVALID_PARAMETER,
+                strprintf("Target block height %d after current tip %d", height,
+                          current_tip));
+        }
+
+        return chainActive[height];
+    }
+
+    const BlockHash hash(ParseHashV(param, "hash_or_height"));
+    const CBlockIndex *pindex = LookupBlockIndex(hash);
+    if (!pindex) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    }
+    if (!chainActive.Contains(pindex)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           strprintf("Block is not in chain %s",
+                                     Params().NetworkIDString()));
+    }
+    return pindex;
+}
+
 struct CCoinsStats {
     int nHeight;
     BlockHash hashBlock;
@@ -1108,11 +1150,19 @@ static UniValue pruneblockchain(const Config &config,
 
 static UniValue gettxoutsetinfo(const Config &config,
                                 const JSONRPCRequest &request) {
-    if (request.fHelp || request.params.size() != 0) {
+    if (request.fHelp || request.params.size() > 2) {
         throw std::runtime_error(
-            "gettxoutsetinfo\n"
+            "gettxoutsetinfo ( hash_or_height use_index )\n"
             "\nReturns statistics about the unspent transaction output set.\n"
-            "Note this call may take some time.\n"
+            "Note this call may take some time, unless -coinstatsindex is "
+            "enabled.\n"
+            "\nArguments:\n"
+            "1. \"hash_or_height\"   (string or numeric, optional) The block "
+            "hash or height to return the statistics as of, requires "
+            "-coinstatsindex. Defaults to the current tip.\n"
+            "2. use_index          (boolean, optional, default=true) Look "
+            "the statistics up in the coinstats index, if enabled, instead of "
+            "scanning the UTXO set.\n"
             "\nResult:\n"
             "{\n"
             "  \"height\":n,     (numeric) The current block height (index)\n"
@@ -1127,11 +1177,60 @@ static UniValue gettxoutsetinfo(const Config &config,
             "chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
+            "When looked up in the coinstats index, transactions, "
+            "hash_serialized and disk_size are not returned, as they need the "
+            "UTXO set scan, and the following are returned instead:\n"
+            "{\n"
+            "  \"utxo_size\": n,           (numeric) The serialized size of "
+            "the unspent outputs\n"
+            "  \"utxo_commitment\": \"hash\", (string) The ECMH commitment to "
+            "the unspent outputs\n"
+            "}\n"
             "\nExamples:\n" +
             HelpExampleCli("gettxoutsetinfo", "") +
+            HelpExampleCli("gettxoutsetinfo", "1000") +
+            HelpExampleCli("gettxoutsetinfo", "null false") +
             HelpExampleRpc("gettxoutsetinfo", ""));
     }
 
+    const bool use_index =
+        g_coinstatsindex &&
+        (request.params[1].isNull() || request.params[1].get_bool());
+    if (!request.params[0].isNull() && !use_index) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Querying the statistics as of a given block "
+                           "requires -coinstatsindex and use_index");
+    }
+
+    if (use_index) {
+        g_coinstatsindex->BlockUntilSyncedToCurrentChain();
+
+        const CBlockIndex *pindex;
+        {
+            LOCK(cs_main);
+            pindex = request.params[0].isNull()
+                         ? chainActive.Tip()
+                         : ParseHashOrHeight(request.params[0]);
+        }
+
+        BlockCoinStats stats;
+        if (!g_coinstatsindex->LookUpStats(pindex, stats)) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR,
+                               "Unable to read UTXO set statistics, the "
+                               "coinstats index may still be syncing");
+        }
+
+        UniValue ret(UniValue::VOBJ);
+        ret.pushKV("height", int64_t(pindex->nHeight));
+        ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
+        ret.pushKV("txouts", int64_t(stats.nTransactionOutputs));
+        ret.pushKV("bogosize", int64_t(stats.nBogoSize));
+        ret.pushKV("utxo_size", int64_t(stats.nUtxoSize));
+        ret.pushKV("utxo_commitment", stats.commitment.GetHash().GetHex());
+        ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
+        return ret;
+    }
+
     UniValue ret(UniValue::VOBJ);
 
     CCoinsStats stats;
@@ -1151,6 +1250,42 @@ static UniValue gettxoutsetinfo(const Config &config,
     return ret;
 }
 
+static UniValue getutxocommitment(const Config &config,
+                                  const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            "getutxocommitment\n"
+            "\nReturns the commitment to the unspent transaction output set "
+            "at the current chain tip.\n"
+            "Requires the node to be started with -utxocommitment.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"height\":n,     (numeric) The current block height (index)\n"
+            "  \"bestblock\": \"hex\",   (string) the best block hash hex\n"
+            "  \"commitment\": \"hash\", (string) The ECMH commitment to the "
+            "UTXO set\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getutxocommitment", "") +
+            HelpExampleRpc("getutxocommitment", ""));
+    }
+
+    LOCK(cs_main);
+    uint256 commitment;
+    if (!GetUtxoCommitment(commitment)) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "UTXO commitment is not maintained, restart with "
+                           "-utxocommitment to enable it");
+    }
+
+    const CBlockIndex *tip = chainActive.Tip();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("height", tip ? tip->nHeight : -1);
+    ret.pushKV("bestblock", pcoinsTip->GetBestBlock().GetHex());
+    ret.pushKV("commitment", commitment.GetHex());
+    return ret;
+}
+
 UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() < 2 ||
         request.params.size() > 3) {
@@ -1196,8 +1331,6 @@ UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
             HelpExampleRpc("gettxout", "\"txid\", 1"));
     }
 
-    LOCK(cs_main);
-
     UniValue ret(UniValue::VOBJ);
 
     TxId txid(ParseHashV(request.params[0], "txid"));
@@ -1208,20 +1341,26 @@ UniValue gettxout(const Config &config, const JSONRPCRequest &request) {
         fMempool = request.params[2].get_bool();
     }
 
+    // The coins cache is read without cs_main, under a guard which keeps its
+    // coins and best block consistent with each other.
     Coin coin;
+    const CBlockIndex *pindex;
     if (fMempool) {
         LOCK(g_mempool.cs);
+        CCoinsViewShardedCache::ReadGuard guard(*pcoinsTip);
         CCoinsViewMemPool view(pcoinsTip.get(), g_mempool);
         if (!view.GetCoin(out, coin) || g_mempool.isSpent(out)) {
             return NullUniValue;
         }
+        pindex = LookupBlockIndex(pcoinsTip->GetBestBlock());
     } else {
+        CCoinsViewShardedCache::ReadGuard guard(*pcoinsTip);
         if (!pcoinsTip->GetCoin(out, coin)) {
             return NullUniValue;
         }
+        pindex = LookupBlockIndex(pcoinsTip->GetBestBlock());
     }
 
-    const CBlockIndex *pindex = LookupBlockIndex(pcoinsTip->GetBestBlock());
     ret.pushKV("bestblock", pindex->GetBlockHash().GetHex());
     if (coin.GetHeight() == MEMPOOL_HEIGHT) {
         ret.pushKV("confirmations", 0);
@@ -1632,14 +1771,9 @@ static UniValue preciousblock(const Config &config,
     }
 
     BlockHash hash(ParseHashV(request.params[0], "blockhash"));
-    CBlockIndex *pblockindex;
-
-    {
-        LOCK(cs_main);
-        pblockindex = LookupBlockIndex(hash);
-        if (!pblockindex) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        }
+    CBlockIndex *pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
     }
 
     CValidationState state;
@@ -1711,13 +1845,9 @@ static UniValue invalidateblock(const Config &config,
     const BlockHash hash(ParseHashV(request.params[0], "blockhash"));
     CValidationState state;
 
-    CBlockIndex *pblockindex;
-    {
-        LOCK(cs_main);
-        pblockindex = LookupBlockIndex(hash);
-        if (!pblockindex) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        }
+    CBlockIndex *pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
     }
     InvalidateBlock(config, state, pblockindex);
 
@@ -1749,14 +1879,9 @@ UniValue parkblock(const Config &config, const JSONRPCRequest &request) {
     const BlockHash hash(uint256S(strHash));
     CValidationState state;
 
-    CBlockIndex *pblockindex;
-    {
-        LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        }
-
-        pblockindex = mapBlockIndex[hash];
+    CBlockIndex *pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
     }
     ParkBlock(config, state, pblockindex);
 
@@ -1829,13 +1954,13 @@ UniValue unparkblock(const Config &config, const JSONRPCRequest &request) {
     const std::string strHash = request.params[0].get_str();
     const BlockHash hash(uint256S(strHash));
 
+    CBlockIndex *pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    }
+
     {
         LOCK(cs_main);
-        if (mapBlockIndex.count(hash) == 0) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        }
-
-        CBlockIndex *pblockindex = mapBlockIndex[hash];
         UnparkBlockAndChildren(pblockindex);
     }
 
@@ -1969,9 +2094,14 @@ static inline bool SetHasKeys(const std::set<T> &set, const Tk &key,
     return (set.count(key) != 0) || SetHasKeys(set, args...);
 }
 
-// outpoint (needed for the utxo index) + nHeight + fCoinBase
-static constexpr size_t PER_UTXO_OVERHEAD =
-    sizeof(COutPoint) + sizeof(uint32_t) + sizeof(bool);
+//! Whether a getblockstats statistic can be looked up in the coinstats index.
+static bool IsIndexedBlockStat(const std::string &stat) {
+    static const std::set<std::string> indexed_stats = {
+        "avgfee", "blockhash", "height", "ins", "mediantime", "outs",
+        "subsidy", "time", "total_out", "totalfee", "txs", "utxo_increase",
+        "utxo_size_inc"};
+    return indexed_stats.count(stat) != 0;
+}
 
 static UniValue getblockstats(const Config &config,
                               const JSONRPCRequest &request) {
@@ -1986,6 +2116,9 @@ static UniValue getblockstats(const Config &config,
             "It won't work for some heights with pruning.\n"
             "It won't work without -txindex for utxo_size_inc, *fee or "
             "*feerate stats.\n"
+            "With -coinstatsindex, the ins, outs, total_out, totalfee, avgfee, "
+            "utxo_increase and utxo_size_inc stats are looked up in the index "
+            "when only stats recorded in the index are selected.\n"
             "\nArguments:\n"
             "1. \"hash_or_height\"     (string or numeric, required) The block "
             "hash or height of the target block\n"
@@ -2053,36 +2186,7 @@ static UniValue getblockstats(const Config &config,
 
     LOCK(cs_main);
 
-    CBlockIndex *pindex;
-    if (request.params[0].isNum()) {
-        const int height = request.params[0].get_int();
-        const int current_tip = chainActive.Height();
-        if (height < 0) {
-            throw JSONRPCError(
-                RPC_INVALID_PARAMETER,
-                strprintf("Target block height %d is negative", height));
-        }
-        if (height > current_tip) {
-            throw JSONRPCError(
-                RPC_INVALID_PARAMETER,
-                strprintf("Target block height %d after current tip %d", height,
-                          current_tip));
-        }
-
-        pindex = chainActive[height];
-    } else {
-        const BlockHash hash(ParseHashV(request.params[0], "hash_or_height"));
-        pindex = LookupBlockIndex(hash);
-        if (!pindex) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
-        }
-        if (!chainActive.Contains(pindex)) {
-            throw JSONRPCError(RPC_INVALID_PARAMETER,
-                               strprintf("Block is not in chain %s",
-                                         Params().NetworkIDString()));
-        }
-    }
-
+    const CBlockIndex *pindex = ParseHashOrHeight(request.params[0]);
     assert(pindex != nullptr);
 
     std::set<std::string> stats;
@@ -2094,6 +2198,47 @@ static UniValue getblockstats(const Config &config,
         }
     }
 
+    // When all the selected stats are recorded by the coinstats index, look
+    // them up instead of reading the block and the spent outputs.
+    BlockCoinStats indexed;
+    if (g_coinstatsindex && !stats.empty() &&
+        std::all_of(stats.begin(), stats.end(),
+                    [](const std::string &stat) {
+                        return IsIndexedBlockStat(stat);
+                    }) &&
+        g_coinstatsindex->LookUpStats(pindex, indexed)) {
+        const int64_t inputs = indexed.nBlockInputs;
+        const int64_t outputs = indexed.nBlockOutputs;
+
+        UniValue ret_indexed(UniValue::VOBJ);
+        ret_indexed.pushKV(
+            "avgfee", ValueFromAmount((pindex->nTx > 1)
+                                          ? indexed.nBlockTotalFee /
+                                                int(pindex->nTx - 1)
+                                          : Amount::zero()));
+        ret_indexed.pushKV("blockhash", pindex->GetBlockHash().GetHex());
+        ret_indexed.pushKV("height", (int64_t)pindex->nHeight);
+        ret_indexed.pushKV("ins", inputs);
+        ret_indexed.pushKV("mediantime", pindex->GetMedianTimePast());
+        ret_indexed.pushKV("outs", outputs);
+        ret_indexed.pushKV("subsidy",
+                           ValueFromAmount(GetBlockSubsidy(
+                               pindex->nHeight, Params().GetConsensus())));
+        ret_indexed.pushKV("time", pindex->GetBlockTime());
+        ret_indexed.pushKV("total_out",
+                           ValueFromAmount(indexed.nBlockTotalOut));
+        ret_indexed.pushKV("totalfee", ValueFromAmount(indexed.nBlockTotalFee));
+        ret_indexed.pushKV("txs", (int64_t)pindex->nTx);
+        ret_indexed.pushKV("utxo_increase", outputs - inputs);
+        ret_indexed.pushKV("utxo_size_inc", indexed.nBlockUtxoSizeInc);
+
+        UniValue ret(UniValue::VOBJ);
+        for (const std::string &stat : stats) {
+            ret.pushKV(stat, ret_indexed[stat]);
+        }
+        return ret;
+    }
+
     const CBlock block = GetBlockChecked(config, pindex);
 
     // Calculate everything if nothing selected (default)
@@ -2557,14 +2702,314 @@ static UniValue scantxoutset(const Config &config,
     return result;
 }
 
+/**
+ * Parse the script of an address index query, given either as an address or
+ * as a hex-encoded scriptPubKey.
+ */
+static CScript ParseIndexedScript(const Config &config,
+                                  const UniValue &param) {
+    const std::string &str = param.get_str();
+    const CTxDestination dest =
+        DecodeDestination(str, config.GetChainParams());
+    if (IsValidDestination(dest)) {
+        return GetScriptForDestination(dest);
+    }
+    if (!str.empty() && IsHex(str)) {
+        const std::vector<uint8_t> data(ParseHex(str));
+        return CScript(data.begin(), data.end());
+    }
+    throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                       "Invalid address or script: " + str);
+}
+
+static void EnsureAddressIndexSynced() {
+    if (!g_addressindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Address index is not enabled. "
+                                           "Use -addressindex to enable it.");
+    }
+    if (!g_addressindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Address index is still in the process of being "
+                           "built.");
+    }
+}
+
+static UniValue getaddresshistory(const Config &config,
+                                  const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "getaddresshistory \"address\"\n"
+            "\nReturns all the outputs ever paid to an address or script, in "
+            "chain order, along with the inputs spending them.\n"
+            "Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The address, or the "
+            "hex-encoded scriptPubKey\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hex\",      (string) The id of the transaction "
+            "creating the output\n"
+            "    \"vout\" : n,          (numeric) The output index\n"
+            "    \"height\" : n,        (numeric) The height of the block "
+            "creating the output\n"
+            "    \"value\" : x.xxx,     (numeric) The value in " +
+            CURRENCY_UNIT +
+            "\n"
+            "    \"spent\" : {          (json object, only if the output is "
+            "spent)\n"
+            "      \"txid\" : \"hex\",    (string) The id of the spending "
+            "transaction\n"
+            "      \"vin\" : n,         (numeric) The index of the spending "
+            "input\n"
+            "      \"height\" : n       (numeric) The height of the block "
+            "spending the output\n"
+            "    }\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddresshistory",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"") +
+            HelpExampleRpc("getaddresshistory",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\""));
+    }
+
+    const CScript script = ParseIndexedScript(config, request.params[0]);
+    EnsureAddressIndexSynced();
+
+    std::vector<AddressOutput> outputs;
+    if (!g_addressindex->FindOutputs(script, outputs)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read address index");
+    }
+
+    UniValue ret(UniValue::VARR);
+    for (const AddressOutput &output : outputs) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", output.outpoint.GetTxId().GetHex());
+        entry.pushKV("vout", int64_t(output.outpoint.GetN()));
+        entry.pushKV("height", output.height);
+        entry.pushKV("value", ValueFromAmount(output.value));
+        if (output.IsSpent()) {
+            UniValue spent(UniValue::VOBJ);
+            spent.pushKV("txid", output.spent_txid.GetHex());
+            spent.pushKV("vin", int64_t(output.spent_index));
+            spent.pushKV("height", output.spent_height);
+            entry.pushKV("spent", spent);
+        }
+        ret.push_back(entry);
+    }
+
+    return ret;
+}
+
+static UniValue getaddressutxos(const Config &config,
+                                const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            "getaddressutxos \"address\"\n"
+            "\nReturns the unspent outputs paid to an address or script, "
+            "ordered by height.\n"
+            "Requires -addressindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"    (string, required) The address, or the "
+            "hex-encoded scriptPubKey\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"txid\" : \"hex\",      (string) The id of the transaction "
+            "creating the output\n"
+            "    \"vout\" : n,          (numeric) The output index\n"
+            "    \"height\" : n,        (numeric) The height of the block "
+            "creating the output\n"
+            "    \"value\" : x.xxx      (numeric) The value in " +
+            CURRENCY_UNIT +
+            "\n"
+            "  },\n"
+            "  ...\n"
+            "]\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getaddressutxos",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\"") +
+            HelpExampleRpc("getaddressutxos",
+                           "\"1PSSGeFHDnKNxiEyFrD1wcEaHr9hrQDDWc\""));
+    }
+
+    const CScript script = ParseIndexedScript(config, request.params[0]);
+    EnsureAddressIndexSynced();
+
+    std::vector<AddressOutput> outputs;
+    if (!g_addressindex->FindUnspentOutputs(script, outputs)) {
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Unable to read address index");
+    }
+
+    std::stable_sort(outputs.begin(), outputs.end(),
+                     [](const AddressOutput &a, const AddressOutput &b) {
+                         return a.height < b.height;
+                     });
+
+    UniValue ret(UniValue::VARR);
+    for (const AddressOutput &output : outputs) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("txid", output.outpoint.GetTxId().GetHex());
+        entry.pushKV("vout", int64_t(output.outpoint.GetN()));
+        entry.pushKV("height", output.height);
+        entry.pushKV("value", ValueFromAmount(output.value));
+        ret.push_back(entry);
+    }
+
+    return ret;
+}
+
+static UniValue getspentinfo(const Config &config,
+                             const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 2) {
+        throw std::runtime_error(
+            "getspentinfo \"txid\" n\n"
+            "\nReturns the input spending a transaction output.\n"
+            "Requires -spentindex.\n"
+            "\nArguments:\n"
+            "1. \"txid\"     (string, required) The transaction id\n"
+            "2. n          (numeric, required) The output index\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"txid\" : \"hex\",    (string) The id of the spending "
+            "transaction\n"
+            "  \"vin\" : n,         (numeric) The index of the spending input\n"
+            "  \"height\" : n       (numeric) The height of the block "
+            "spending the output\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getspentinfo", "\"txid\" 1") +
+            HelpExampleRpc("getspentinfo", "\"txid\", 1"));
+    }
+
+    const TxId txid(ParseHashV(request.params[0], "txid"));
+    const int n = request.params[1].get_int();
+    if (n < 0) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           "Invalid output index, must be positive");
+    }
+
+    if (!g_spentindex) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index is not enabled. "
+                                           "Use -spentindex to enable it.");
+    }
+    if (!g_spentindex->BlockUntilSyncedToCurrentChain()) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Spent index is still in the process of being "
+                           "built.");
+    }
+
+    SpentInfo info;
+    if (!g_spentindex->FindSpentInfo(COutPoint(txid, n), info)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY,
+                           "No spending input found for this output");
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("txid", info.txid.GetHex());
+    ret.pushKV("vin", int64_t(info.index));
+    ret.pushKV("height", info.height);
+    return ret;
+}
+
+static UniValue getblockfilter(const Config &config,
+                               const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() < 1 ||
+        request.params.size() > 2) {
+        throw std::runtime_error(
+            "getblockfilter \"blockhash\" ( \"filtertype\" )\n"
+            "\nRetrieve a BIP 157 content filter for a particular block.\n"
+            "\nArguments:\n"
+            "1. \"blockhash\"    (string, required) The hash of the block\n"
+            "2. \"filtertype\"   (string, optional, default=basic) The type "
+            "name of the filter\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"filter\" : (string) the hex-encoded filter data\n"
+            "  \"header\" : (string) the hex-encoded filter header\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getblockfilter",
+                           "\"00000000c937983704a73af28acdec37b049d214adbda81d"
+                           "7e2a3dd146f6ed09\" \"basic\"") +
+            HelpExampleRpc("getblockfilter",
+                           "\"00000000c937983704a73af28acdec37b049d214adbda81d"
+                           "7e2a3dd146f6ed09\", \"basic\""));
+    }
+
+    const BlockHash block_hash(ParseHashV(request.params[0], "blockhash"));
+    std::string filtertype_name = "basic";
+    if (!request.params[1].isNull()) {
+        filtertype_name = request.params[1].get_str();
+    }
+
+    BlockFilterType filtertype;
+    if (!BlockFilterTypeByName(filtertype_name, filtertype)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown filtertype");
+    }
+
+    BlockFilterIndex *index = GetBlockFilterIndex(filtertype);
+    if (!index) {
+        throw JSONRPCError(RPC_MISC_ERROR,
+                           "Index is not enabled for filtertype " +
+                               filtertype_name);
+    }
+
+    const CBlockIndex *block_index;
+    bool block_is_active;
+    {
+        LOCK(cs_main);
+        block_index = LookupBlockIndex(block_hash);
+        if (!block_index) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        }
+        block_is_active = chainActive.Contains(block_index);
+    }
+
+    bool index_ready = index->BlockUntilSyncedToCurrentChain();
+
+    BlockFilter filter;
+    uint256 filter_header;
+    if (!index->LookupFilter(block_index, filter) ||
+        !index->LookupFilterHeader(block_index, filter_header)) {
+        int err_code;
+        std::string errmsg = "Filter not found.";
+
+        if (!block_is_active) {
+            err_code = RPC_INVALID_ADDRESS_OR_KEY;
+            errmsg += " Block is not in the active chain.";
+        } else if (!index_ready) {
+            err_code = RPC_MISC_ERROR;
+            errmsg +=
+                " Block filters are still in the process of being indexed.";
+        } else {
+            err_code = RPC_INTERNAL_ERROR;
+            errmsg +=
+                " This error is unexpected and indicates index corruption.";
+        }
+
+        throw JSONRPCError(err_code, errmsg);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("filter", HexStr(filter.GetEncodedFilter()));
+    ret.pushKV("header", filter_header.GetHex());
+    return ret;
+}
+
 // clang-format off
 static const ContextFreeRPCCommand commands[] = {
     //  category            name                      actor (function)        argNames
     //  ------------------- ------------------------  ----------------------  ----------
+    { "blockchain",         "getaddresshistory",      getaddresshistory,      {"address"} },
+    { "blockchain",         "getaddressutxos",        getaddressutxos,        {"address"} },
     { "blockchain",         "getbestblockhash",       getbestblockhash,       {} },
     { "blockchain",         "getblock",               getblock,               {"blockhash","verbosity|verbose"} },
     { "blockchain",         "getblockchaininfo",      getblockchaininfo,      {} },
     { "blockchain",         "getblockcount",          getblockcount,          {} },
+    { "blockchain",         "getblockfilter",         getblockfilter,         {"blockhash", "filtertype"} },
     { "blockchain",         "getblockhash",           getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         getblockheader,         {"blockhash","verbose"} },
     { "blockchain",         "getblockstats",          getblockstats,          {"hash_or_height","stats"} },
@@ -2576,8 +3021,10 @@ static const ContextFreeRPCCommand commands[] = {
     { "blockchain",         "getmempoolentry",        getmempoolentry,        {"txid"} },
     { "blockchain",         "getmempoolinfo",         getmempoolinfo,         {} },
     { "blockchain",         "getrawmempool",          getrawmempool,          {"verbose"} },
+    { "blockchain",         "getspentinfo",           getspentinfo,           {"txid","n"} },
     { "blockchain",         "gettxout",               gettxout,               {"txid","n","include_mempool"} },
-    { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        {} },
+    { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        {"hash_or_height","use_index"} },
+    { "blockchain",         "getutxocommitment",      getutxocommitment,      {} },
     { "blockchain",         "pruneblockchain",        pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            savemempool,            {} },
     { "blockchain",         "verifychain",            verifychain,            {"checklevel","nblocks"} },
@@ -114,9 +114,12 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"combinepsbt", 0, "txs"},
     {"finalizepsbt", 1, "extract"},
     {"converttopsbt", 1, "permitsigdata"},
+    {"getspentinfo", 1, "n"},
     {"gettxout", 1, "n"},
     {"gettxout", 2, "include_mempool"},
     {"gettxoutproof", 0, "txids"},
+    {"gettxoutsetinfo", 0, "hash_or_height"},
+    {"gettxoutsetinfo", 1, "use_index"},
     {"lockunspent", 0, "unlock"},
     {"lockunspent", 1, "transactions"},
     {"importprivkey", 2, "rescan"},
@@ -22,6 +22,7 @@
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <shutdown.h>
+#include <streams.h>
 #include <txmempool.h>
 #include <util/strencodings.h>
 #include <util/system.h>
@@ -330,6 +331,89 @@ static UniValue BIP22ValidationResult(const Config &config,
     return "valid?";
 }
 
+/**
+ * The non-coinbase transactions of a template, as returned by getblocktemplate.
+ */
+static UniValue
+BlockTemplateTransactionsToJSON(const CBlockTemplate &blocktemplate) {
+    UniValue transactions(UniValue::VARR);
+    int index_in_template = 0;
+    for (const auto &it : blocktemplate.block.vtx) {
+        const CTransaction &tx = *it;
+        uint256 txId = tx.GetId();
+
+        if (tx.IsCoinBase()) {
+            index_in_template++;
+            continue;
+        }
+
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("data", EncodeHexTx(tx));
+        entry.pushKV("txid", txId.GetHex());
+        entry.pushKV("hash", tx.GetHash().GetHex());
+        entry.pushKV("fee",
+                     blocktemplate.entries[index_in_template].fees / SATOSHI);
+        int64_t nTxSigOps = blocktemplate.entries[index_in_template].sigOpCount;
+        entry.pushKV("sigops", nTxSigOps);
+
+        transactions.push_back(entry);
+        index_in_template++;
+    }
+
+    return transactions;
+}
+
+/**
+ * The non-coinbase transactions of a template, in the compact format of
+ * getblocktemplate.
+ */
+static std::string
+BlockTemplateTransactionsToCompact(const CBlockTemplate &blocktemplate) {
+    const std::vector<CTransactionRef> &vtx = blocktemplate.block.vtx;
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    WriteCompactSize(ss, vtx.size() - 1);
+    for (size_t i = 1; i < vtx.size(); i++) {
+        ss << *vtx[i] << int64_t(blocktemplate.entries[i].fees / SATOSHI)
+           << blocktemplate.entries[i].sigOpCount;
+    }
+    return HexStr(ss.begin(), ss.end());
+}
+
+/**
+ * A block template made by getblocktemplate, shared by the calls returning it
+ * until a new one is made. Its transactions are rendered once per format, and
+ * the calls copy the rendered transactions into their response after releasing
+ * cs_main.
+ */
+class RenderedBlockTemplate {
+public:
+    const std::unique_ptr<const CBlockTemplate> blocktemplate;
+
+    explicit RenderedBlockTemplate(std::unique_ptr<CBlockTemplate> tmpl)
+        : blocktemplate(std::move(tmpl)) {}
+
+    /**
+     * The transactions, as returned in the compact format or not. They are
+     * never modified once rendered, so the reference remains valid for the
+     * lifetime of the template.
+     */
+    const UniValue &GetTransactions(bool fCompact) {
+        LOCK(cs);
+        UniValue &txs = fCompact ? compactTxs : arrayTxs;
+        if (txs.isNull()) {
+            txs = fCompact ? UniValue(BlockTemplateTransactionsToCompact(
+                                 *blocktemplate))
+                           : BlockTemplateTransactionsToJSON(*blocktemplate);
+        }
+        return txs;
+    }
+
+private:
+    Mutex cs;
+    UniValue arrayTxs GUARDED_BY(cs);
+    UniValue compactTxs GUARDED_BY(cs);
+};
+
 static UniValue getblocktemplate(const Config &config,
                                  const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() > 1) {
@@ -362,7 +446,10 @@ static UniValue getblocktemplate(const Config &config,
             "feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', "
             "'serverlist', 'workid'\n"
             "           ,...\n"
-            "       ]\n"
+            "       ],\n"
+            "       \"format\":\"json\"      (string, optional) How the "
+            "transactions are returned, \"json\" (the default) or "
+            "\"compact\"\n"
             "     }\n"
             "\n"
 
@@ -404,6 +491,12 @@ static UniValue getblocktemplate(const Config &config,
             "      }\n"
             "      ,...\n"
             "  ],\n"
+            "  \"transactionsdata\" : \"xxxx\",      (string) with the "
+            "\"compact\" format, in place of 'transactions': the number of "
+            "non-coinbase transactions, then each transaction followed by its "
+            "fee in satoshis and its sigops count as 64 bits integers, "
+            "serialized as in the network protocol and encoded in "
+            "hexadecimal\n"
             "  \"coinbaseaux\" : {                 (json object) data that "
             "should be included in the coinbase's scriptSig content\n"
             "      \"flags\" : \"xx\"                  (string) key name is to "
@@ -444,200 +537,209 @@ static UniValue getblocktemplate(const Config &config,
             HelpExampleRpc("getblocktemplate", ""));
     }
 
-    LOCK(cs_main);
-
-    std::string strMode = "template";
-    UniValue lpval = NullUniValue;
-    std::set<std::string> setClientRules;
-    if (!request.params[0].isNull()) {
-        const UniValue &oparam = request.params[0].get_obj();
-        const UniValue &modeval = find_value(oparam, "mode");
-        if (modeval.isStr()) {
-            strMode = modeval.get_str();
-        } else if (modeval.isNull()) {
-            /* Do nothing */
-        } else {
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
-        }
-        lpval = find_value(oparam, "longpollid");
+    // The template is picked and the fields which change between calls are
+    // filled under cs_main, the response is built after releasing it.
+    std::string strFormat = "json";
+    std::shared_ptr<RenderedBlockTemplate> gbt;
+    CBlockHeader header;
+    int nHeight;
+    int64_t nMinTime;
+    std::string strLongPollId;
+    {
+        LOCK(cs_main);
 
-        if (strMode == "proposal") {
-            const UniValue &dataval = find_value(oparam, "data");
-            if (!dataval.isStr()) {
-                throw JSONRPCError(RPC_TYPE_ERROR,
-                                   "Missing data String key for proposal");
+        std::string strMode = "template";
+        UniValue lpval = NullUniValue;
+        std::set<std::string> setClientRules;
+        if (!request.params[0].isNull()) {
+            const UniValue &oparam = request.params[0].get_obj();
+            const UniValue &modeval = find_value(oparam, "mode");
+            if (modeval.isStr()) {
+                strMode = modeval.get_str();
+            } else if (modeval.isNull()) {
+                /* Do nothing */
+            } else {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
             }
+            lpval = find_value(oparam, "longpollid");
 
-            CBlock block;
-            if (!DecodeHexBlk(block, dataval.get_str())) {
-                throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
-                                   "Block decode failed");
+            const UniValue &formatval = find_value(oparam, "format");
+            if (formatval.isStr()) {
+                strFormat = formatval.get_str();
+            } else if (!formatval.isNull()) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid format");
+            }
+            if (strFormat != "json" && strFormat != "compact") {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid format");
             }
 
-            const BlockHash hash = block.GetHash();
-            const CBlockIndex *pindex = LookupBlockIndex(hash);
-            if (pindex) {
-                if (pindex->IsValid(BlockValidity::SCRIPTS)) {
-                    return "duplicate";
+            if (strMode == "proposal") {
+                const UniValue &dataval = find_value(oparam, "data");
+                if (!dataval.isStr()) {
+                    throw JSONRPCError(RPC_TYPE_ERROR,
+                                       "Missing data String key for proposal");
                 }
-                if (pindex->nStatus.isInvalid()) {
-                    return "duplicate-invalid";
+
+                CBlock block;
+                if (!DecodeHexBlk(block, dataval.get_str())) {
+                    throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
+                                       "Block decode failed");
                 }
-                return "duplicate-inconclusive";
-            }
 
-            CBlockIndex *const pindexPrev = chainActive.Tip();
-            // TestBlockValidity only supports blocks built on the current Tip
-            if (block.hashPrevBlock != pindexPrev->GetBlockHash()) {
-                return "inconclusive-not-best-prevblk";
+                const BlockHash hash = block.GetHash();
+                const CBlockIndex *pindex = LookupBlockIndex(hash);
+                if (pindex) {
+                    if (pindex->IsValid(BlockValidity::SCRIPTS)) {
+                        return "duplicate";
+                    }
+                    if (pindex->nStatus.isInvalid()) {
+                        return "duplicate-invalid";
+                    }
+                    return "duplicate-inconclusive";
+                }
+
+                CBlockIndex *const pindexPrev = chainActive.Tip();
+                // TestBlockValidity only supports blocks built on the current
+                // Tip
+                if (block.hashPrevBlock != pindexPrev->GetBlockHash()) {
+                    return "inconclusive-not-best-prevblk";
+                }
+                CValidationState state;
+                TestBlockValidity(state, config.GetChainParams(), block,
+                                  pindexPrev,
+                                  BlockValidationOptions(config)
+                                      .withCheckPoW(false)
+                                      .withCheckMerkleRoot(true));
+                return BIP22ValidationResult(config, state);
             }
-            CValidationState state;
-            TestBlockValidity(state, config.GetChainParams(), block, pindexPrev,
-                              BlockValidationOptions(config)
-                                  .withCheckPoW(false)
-                                  .withCheckMerkleRoot(true));
-            return BIP22ValidationResult(config, state);
         }
-    }
-
-    if (strMode != "template") {
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
-    }
-
-    if (!g_connman) {
-        throw JSONRPCError(
-            RPC_CLIENT_P2P_DISABLED,
-            "Error: Peer-to-peer functionality missing or disabled");
-    }
-
-    if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0) {
-        throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED,
-                           "Bitcoin is not connected!");
-    }
 
-    if (IsInitialBlockDownload()) {
-        throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD,
-                           "Bitcoin is downloading blocks...");
-    }
-
-    static unsigned int nTransactionsUpdatedLast;
+        if (strMode != "template") {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
+        }
 
-    if (!lpval.isNull()) {
-        // Wait to respond until either the best block changes, OR a minute has
-        // passed and there are more transactions
-        uint256 hashWatchedChain;
-        std::chrono::steady_clock::time_point checktxtime;
-        unsigned int nTransactionsUpdatedLastLP;
+        if (!g_connman) {
+            throw JSONRPCError(
+                RPC_CLIENT_P2P_DISABLED,
+                "Error: Peer-to-peer functionality missing or disabled");
+        }
 
-        if (lpval.isStr()) {
-            // Format: <hashBestChain><nTransactionsUpdatedLast>
-            std::string lpstr = lpval.get_str();
+        if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0) {
+            throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED,
+                               "Bitcoin is not connected!");
+        }
 
-            hashWatchedChain = ParseHashV(lpstr.substr(0, 64), "longpollid");
-            nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
-        } else {
-            // NOTE: Spec does not specify behaviour for non-string longpollid,
-            // but this makes testing easier
-            hashWatchedChain = chainActive.Tip()->GetBlockHash();
-            nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+        if (IsInitialBlockDownload()) {
+            throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD,
+                               "Bitcoin is downloading blocks...");
         }
 
-        // Release the wallet and main lock while waiting
-        LEAVE_CRITICAL_SECTION(cs_main);
-        {
-            checktxtime =
-                std::chrono::steady_clock::now() + std::chrono::minutes(1);
-
-            WAIT_LOCK(g_best_block_mutex, lock);
-            while (g_best_block == hashWatchedChain && IsRPCRunning()) {
-                if (g_best_block_cv.wait_until(lock, checktxtime) ==
-                    std::cv_status::timeout) {
-                    // Timeout: Check transactions for update
-                    if (g_mempool.GetTransactionsUpdated() !=
-                        nTransactionsUpdatedLastLP) {
-                        break;
+        static unsigned int nTransactionsUpdatedLast;
+
+        if (!lpval.isNull()) {
+            // Wait to respond until either the best block changes, OR a minute
+            // has passed and there are more transactions
+            uint256 hashWatchedChain;
+            std::chrono::steady_clock::time_point checktxtime;
+            unsigned int nTransactionsUpdatedLastLP;
+
+            if (lpval.isStr()) {
+                // Format: <hashBestChain><nTransactionsUpdatedLast>
+                std::string lpstr = lpval.get_str();
+
+                hashWatchedChain =
+                    ParseHashV(lpstr.substr(0, 64), "longpollid");
+                nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
+            } else {
+                // NOTE: Spec does not specify behaviour for non-string
+                // longpollid, but this makes testing easier
+                hashWatchedChain = chainActive.Tip()->GetBlockHash();
+                nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+            }
+
+            // Release the wallet and main lock while waiting
+            LEAVE_CRITICAL_SECTION(cs_main);
+            {
+                checktxtime =
+                    std::chrono::steady_clock::now() + std::chrono::minutes(1);
+
+                WAIT_LOCK(g_best_block_mutex, lock);
+                while (g_best_block == hashWatchedChain && IsRPCRunning()) {
+                    if (g_best_block_cv.wait_until(lock, checktxtime) ==
+                        std::cv_status::timeout) {
+                        // Timeout: Check transactions for update
+                        if (g_mempool.GetTransactionsUpdated() !=
+                            nTransactionsUpdatedLastLP) {
+                            break;
+                        }
+                        checktxtime += std::chrono::seconds(10);
                     }
-                    checktxtime += std::chrono::seconds(10);
                 }
             }
-        }
-        ENTER_CRITICAL_SECTION(cs_main);
+            ENTER_CRITICAL_SECTION(cs_main);
 
-        if (!IsRPCRunning()) {
-            throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
-        }
-        // TODO: Maybe recheck connections/IBD and (if something wrong) send an
-        // expires-immediately template to stop miners?
-    }
-
-    // Update block
-    static CBlockIndex *pindexPrev;
-    static int64_t nStart;
-    static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    if (pindexPrev != chainActive.Tip() ||
-        (g_mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
-         GetTime() - nStart > 5)) {
-        // Clear pindexPrev so future calls make a new block, despite any
-        // failures from here on
-        pindexPrev = nullptr;
-
-        // Store the pindexBest used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = g_mempool.GetTransactionsUpdated();
-        CBlockIndex *pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
-
-        // Create new block
-        CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate =
-            BlockAssembler(config, g_mempool).CreateNewBlock(scriptDummy);
-        if (!pblocktemplate) {
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+            if (!IsRPCRunning()) {
+                throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+            }
+            // TODO: Maybe recheck connections/IBD and (if something wrong) send
+            // an expires-immediately template to stop miners?
         }
 
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
-    }
-
-    assert(pindexPrev);
-    // pointer for convenience
-    CBlock *pblock = &pblocktemplate->block;
+        // Update block
+        static CBlockIndex *pindexPrev;
+        static int64_t nStart;
+        static std::shared_ptr<RenderedBlockTemplate> cachedTemplate;
+        if (pindexPrev != chainActive.Tip() ||
+            (g_mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
+             GetTime() - nStart > 5)) {
+            // Clear pindexPrev so future calls make a new block, despite any
+            // failures from here on
+            pindexPrev = nullptr;
+
+            // Store the pindexBest used before CreateNewBlock, to avoid races
+            nTransactionsUpdatedLast = g_mempool.GetTransactionsUpdated();
+            CBlockIndex *pindexPrevNew = chainActive.Tip();
+            nStart = GetTime();
+
+            // Create new block
+            CScript scriptDummy = CScript() << OP_TRUE;
+            std::unique_ptr<CBlockTemplate> pblocktemplate =
+                BlockAssembler(config, g_mempool).CreateNewBlock(scriptDummy);
+            if (!pblocktemplate) {
+                throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+            }
+            cachedTemplate = std::make_shared<RenderedBlockTemplate>(
+                std::move(pblocktemplate));
 
-    // Update nTime
-    UpdateTime(pblock, config.GetChainParams().GetConsensus(), pindexPrev);
-    pblock->nNonce = 0;
+            // Need to update only after we know CreateNewBlock succeeded
+            pindexPrev = pindexPrevNew;
+        }
 
-    UniValue aCaps(UniValue::VARR);
-    aCaps.push_back("proposal");
+        assert(pindexPrev);
+        gbt = cachedTemplate;
 
-    UniValue transactions(UniValue::VARR);
-    int index_in_template = 0;
-    for (const auto &it : pblock->vtx) {
-        const CTransaction &tx = *it;
-        uint256 txId = tx.GetId();
+        // Update nTime. The cached block is shared with the calls building
+        // their response, so it is left untouched.
+        header = gbt->blocktemplate->block.GetBlockHeader();
+        UpdateTime(&header, config.GetChainParams().GetConsensus(),
+                   pindexPrev);
+        header.nNonce = 0;
 
-        if (tx.IsCoinBase()) {
-            index_in_template++;
-            continue;
-        }
+        nHeight = pindexPrev->nHeight + 1;
+        nMinTime = int64_t(pindexPrev->GetMedianTimePast()) + 1;
+        strLongPollId = chainActive.Tip()->GetBlockHash().GetHex() +
+                        i64tostr(nTransactionsUpdatedLast);
+    }
 
-        UniValue entry(UniValue::VOBJ);
-        entry.pushKV("data", EncodeHexTx(tx));
-        entry.pushKV("txid", txId.GetHex());
-        entry.pushKV("hash", tx.GetHash().GetHex());
-        entry.pushKV("fee",
-                     pblocktemplate->entries[index_in_template].fees / SATOSHI);
-        int64_t nTxSigOps =
-            pblocktemplate->entries[index_in_template].sigOpCount;
-        entry.pushKV("sigops", nTxSigOps);
+    const CBlock &block = gbt->blocktemplate->block;
 
-        transactions.push_back(entry);
-        index_in_template++;
-    }
+    UniValue aCaps(UniValue::VARR);
+    aCaps.push_back("proposal");
 
     UniValue aux(UniValue::VOBJ);
     aux.pushKV("flags", HexStr(COINBASE_FLAGS.begin(), COINBASE_FLAGS.end()));
 
-    arith_uint256 hashTarget = arith_uint256().SetCompact(pblock->nBits);
+    arith_uint256 hashTarget = arith_uint256().SetCompact(header.nBits);
 
     UniValue aMutable(UniValue::VARR);
     aMutable.push_back("time");
@@ -647,25 +749,28 @@ static UniValue getblocktemplate(const Config &config,
     UniValue result(UniValue::VOBJ);
     result.pushKV("capabilities", aCaps);
 
-    result.pushKV("version", pblock->nVersion);
+    result.pushKV("version", header.nVersion);
 
-    result.pushKV("previousblockhash", pblock->hashPrevBlock.GetHex());
-    result.pushKV("transactions", transactions);
+    result.pushKV("previousblockhash", header.hashPrevBlock.GetHex());
+    if (strFormat == "compact") {
+        result.pushKV("transactionsdata", gbt->GetTransactions(true));
+    } else {
+        result.pushKV("transactions", gbt->GetTransactions(false));
+    }
     result.pushKV("coinbaseaux", aux);
     result.pushKV("coinbasevalue",
-                  int64_t(pblock->vtx[0]->vout[0].nValue / SATOSHI));
-    result.pushKV("longpollid", chainActive.Tip()->GetBlockHash().GetHex() +
-                                    i64tostr(nTransactionsUpdatedLast));
+                  int64_t(block.vtx[0]->vout[0].nValue / SATOSHI));
+    result.pushKV("longpollid", strLongPollId);
     result.pushKV("target", hashTarget.GetHex());
-    result.pushKV("mintime", int64_t(pindexPrev->GetMedianTimePast()) + 1);
+    result.pushKV("mintime", nMinTime);
     result.pushKV("mutable", aMutable);
     result.pushKV("noncerange", "00000000ffffffff");
     // FIXME: Allow for mining block greater than 1M.
     result.pushKV("sigoplimit", GetMaxBlockSigOpsCount(DEFAULT_MAX_BLOCK_SIZE));
     result.pushKV("sizelimit", DEFAULT_MAX_BLOCK_SIZE);
-    result.pushKV("curtime", pblock->GetBlockTime());
-    result.pushKV("bits", strprintf("%08x", pblock->nBits));
-    result.pushKV("height", int64_t(pindexPrev->nHeight) + 1);
+    result.pushKV("curtime", header.GetBlockTime());
+    result.pushKV("bits", strprintf("%08x", header.nBits));
+    result.pushKV("height", int64_t(nHeight));
 
     return result;
 }
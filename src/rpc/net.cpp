@@ -101,6 +101,8 @@ static UniValue getpeerinfo(const Config &config,
             "    \"bytessent\": n,            (numeric) The total bytes sent\n"
             "    \"bytesrecv\": n,            (numeric) The total bytes "
             "received\n"
+            "    \"socketchecks\": n,         (numeric) The number of times "
+            "the socket handler checked the socket of the peer\n"
             "    \"conntime\": ttt,           (numeric) The connection time in "
             "seconds since epoch (Jan 1 1970 GMT)\n"
             "    \"timeoffset\": ttt,         (numeric) The time offset in "
@@ -183,6 +185,7 @@ static UniValue getpeerinfo(const Config &config,
         obj.pushKV("lastrecv", stats.nLastRecv);
         obj.pushKV("bytessent", stats.nSendBytes);
         obj.pushKV("bytesrecv", stats.nRecvBytes);
+        obj.pushKV("socketchecks", stats.nSocketChecks);
         obj.pushKV("conntime", stats.nTimeConnected);
         obj.pushKV("timeoffset", stats.nTimeOffset);
         if (stats.dPingTime > 0.0) {
@@ -569,6 +572,17 @@ static UniValue getnetworkinfo(const Config &config,
             "  }\n"
             "  ,...\n"
             "  ]\n"
+            "  \"recvbufferpool\": {                   (json object) pool of "
+            "the buffers receiving message payloads\n"
+            "    \"hits\": xxx,                         (numeric) buffers "
+            "recycled from the pool\n"
+            "    \"misses\": xxx,                       (numeric) buffers "
+            "allocated because the pool had none of the size\n"
+            "    \"buffers\": xxx,                      (numeric) buffers "
+            "currently pooled\n"
+            "    \"bytes\": xxx                         (numeric) total size "
+            "of the pooled buffers\n"
+            "  }\n"
             "  \"warnings\": \"...\"                    (string) any network "
             "and blockchain warnings\n"
             "}\n"
@@ -610,6 +624,14 @@ static UniValue getnetworkinfo(const Config &config,
         }
     }
     obj.pushKV("localaddresses", localAddresses);
+    const CNetMessageBufferPool::Stats poolStats =
+        g_net_message_buffer_pool.GetStats();
+    UniValue recvBufferPool(UniValue::VOBJ);
+    recvBufferPool.pushKV("hits", poolStats.nHits);
+    recvBufferPool.pushKV("misses", poolStats.nMisses);
+    recvBufferPool.pushKV("buffers", uint64_t(poolStats.nBuffers));
+    recvBufferPool.pushKV("bytes", uint64_t(poolStats.nBytes));
+    obj.pushKV("recvbufferpool", recvBufferPool);
     obj.pushKV("warnings", GetWarnings("statusbar"));
     return obj;
 }
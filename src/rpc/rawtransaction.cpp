@@ -311,7 +311,7 @@ static UniValue gettxoutproof(const Config &config,
         // Loop through txids and try to find which block they're in. Exit loop
         // once a block is found.
         for (const auto &txid : setTxIds) {
-            const Coin &coin = AccessByTxid(*pcoinsTip, txid);
+            const Coin coin = AccessByTxid(*pcoinsTip, txid);
             if (!coin.IsSpent()) {
                 pblockindex = chainActive[coin.GetHeight()];
                 break;
@@ -804,8 +804,7 @@ static UniValue combinerawtransaction(const Config &config,
     {
         LOCK(cs_main);
         LOCK(g_mempool.cs);
-        CCoinsViewCache &viewChain = *pcoinsTip;
-        CCoinsViewMemPool viewMempool(&viewChain, g_mempool);
+        CCoinsViewMemPool viewMempool(pcoinsTip.get(), g_mempool);
         // temporarily switch cache backend to db+mempool view
         view.SetBackend(viewMempool);
 
@@ -859,8 +858,7 @@ UniValue SignTransaction(interfaces::Chain &chain, CMutableTransaction &mtx,
     CCoinsViewCache view(&viewDummy);
     {
         LOCK2(cs_main, g_mempool.cs);
-        CCoinsViewCache &viewChain = *pcoinsTip;
-        CCoinsViewMemPool viewMempool(&viewChain, g_mempool);
+        CCoinsViewMemPool viewMempool(pcoinsTip.get(), g_mempool);
         // Temporarily switch cache backend to db+mempool view.
         view.SetBackend(viewMempool);
 
@@ -1206,11 +1204,9 @@ static UniValue sendrawtransaction(const Config &config,
 
     { // cs_main scope
         LOCK(cs_main);
-        CCoinsViewCache &view = *pcoinsTip;
         bool fHaveChain = false;
         for (size_t o = 0; !fHaveChain && o < tx->vout.size(); o++) {
-            const Coin &existingCoin = view.AccessCoin(COutPoint(txid, o));
-            fHaveChain = !existingCoin.IsSpent();
+            fHaveChain = pcoinsTip->HaveCoin(COutPoint(txid, o));
         }
 
         bool fHaveMempool = g_mempool.exists(txid);
@@ -31,6 +31,9 @@ public:
     T *operator->() { return collection; }
     const T *operator->() const { return collection; }
 
+    T &operator*() { return *collection; }
+    const T &operator*() const { return *collection; }
+
     /**
      * Iterator mechanics.
      */
@@ -102,6 +102,38 @@ SECP256K1_API int secp256k1_multiset_finalize(
 ) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3);
 
 
+/** Serializes a multiset into 64 bytes: the affine coordinates x and y of
+ *  its group element, or zeros for the empty multiset. Unlike the layout of
+ *  secp256k1_multiset, this encoding is canonical and can be stored.
+ *
+ *  Returns: 1: success
+ *           0: invalid parameter
+ *  Args:    ctx:      pointer to a context object (cannot be NULL)
+ *  Out:     output64: the resulting 64-byte serialization
+ *  In:      multiset: the multiset to serialize
+ */
+SECP256K1_API int secp256k1_multiset_serialize(
+  const secp256k1_context* ctx,
+  unsigned char *output64,
+  const secp256k1_multiset *multiset
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3);
+
+
+/** Parses a multiset serialized with secp256k1_multiset_serialize
+ *
+ *  Returns: 1: success
+ *           0: the input is not a valid serialization
+ *  Args:    ctx:      pointer to a context object (cannot be NULL)
+ *  Out:     multiset: the resulting multiset
+ *  In:      input64:  the 64-byte serialization to parse
+ */
+SECP256K1_API SECP256K1_WARN_UNUSED_RESULT int secp256k1_multiset_parse(
+  const secp256k1_context* ctx,
+  secp256k1_multiset *multiset,
+  const unsigned char *input64
+) SECP256K1_ARG_NONNULL(1) SECP256K1_ARG_NONNULL(2) SECP256K1_ARG_NONNULL(3);
+
+
 
 # ifdef __cplusplus
 }
@@ -180,6 +180,65 @@ int secp256k1_multiset_finalize(const secp256k1_context* ctx, unsigned char *res
     return 1;
 }
 
+/** Serializes the multiset as the affine coordinates of its group element */
+int secp256k1_multiset_serialize(const secp256k1_context* ctx, unsigned char *output64, const secp256k1_multiset *multiset) {
+    secp256k1_gej gej;
+    secp256k1_ge ge;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(output64 != NULL);
+    ARG_CHECK(multiset != NULL);
+
+    gej_from_multiset_var(&gej, multiset);
+
+    if (gej.infinity) {
+        /* empty set is encoded as zeros */
+        memset(output64, 0x00, 64);
+        return 1;
+    }
+
+    secp256k1_ge_set_gej(&ge, &gej);
+    secp256k1_fe_normalize(&ge.x);
+    secp256k1_fe_normalize(&ge.y);
+    secp256k1_fe_get_b32(output64, &ge.x);
+    secp256k1_fe_get_b32(output64+32, &ge.y);
+
+    return 1;
+}
+
+/** Parses a multiset from the affine coordinates of its group element */
+int secp256k1_multiset_parse(const secp256k1_context* ctx, secp256k1_multiset *multiset, const unsigned char *input64) {
+    static const unsigned char zeros[64] = { 0 };
+    secp256k1_fe x, y;
+    secp256k1_ge ge;
+    secp256k1_gej gej;
+
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(multiset != NULL);
+    ARG_CHECK(input64 != NULL);
+
+    if (memcmp(input64, zeros, sizeof(zeros)) == 0) {
+        return secp256k1_multiset_init(ctx, multiset);
+    }
+
+    if (!secp256k1_fe_set_b32(&x, input64) ||
+        !secp256k1_fe_set_b32(&y, input64+32)) {
+        return 0;
+    }
+    secp256k1_ge_set_xy(&ge, &x, &y);
+    if (!secp256k1_ge_is_valid_var(&ge)) {
+        return 0;
+    }
+
+    secp256k1_gej_set_ge(&gej, &ge);
+    secp256k1_fe_normalize(&gej.x);
+    secp256k1_fe_normalize(&gej.y);
+    secp256k1_fe_normalize(&gej.z);
+    multiset_from_gej_var(multiset, &gej);
+
+    return 1;
+}
+
 /** Inits the multiset with the constant for empty data,
  *  represented by the Jacobian GE infinite
  */
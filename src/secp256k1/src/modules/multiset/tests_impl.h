@@ -253,6 +253,45 @@ void test_empty(void) {
     CHECK_EQUAL(&empty, &r1); /* M()+M()==M() */
 }
 
+void test_serialize(void) {
+
+    /* Test if serialized multisets parse back to the same multiset */
+
+    secp256k1_multiset empty, r1, r2;
+    unsigned char data[64];
+    int n;
+
+    secp256k1_multiset_init(ctx, &empty);
+    secp256k1_multiset_init(ctx, &r1);
+
+    CHECK(secp256k1_multiset_serialize(ctx, data, &empty));
+    for (n = 0; n < 64; n++) {
+        CHECK(data[n] == 0);
+    }
+    CHECK(secp256k1_multiset_parse(ctx, &r2, data));
+    CHECK_EQUAL(&empty, &r2); /* M()==parse(serialize(M())) */
+
+    for (n = 0; n < 10; n++) {
+        secp256k1_multiset_add(ctx, &r1, elements[n], DATALEN);
+        CHECK(secp256k1_multiset_serialize(ctx, data, &r1));
+        CHECK(secp256k1_multiset_parse(ctx, &r2, data));
+        CHECK_EQUAL(&r1, &r2);
+
+        /* the parsed multiset is usable like the original */
+        secp256k1_multiset_remove(ctx, &r2, elements[n], DATALEN);
+        secp256k1_multiset_add(ctx, &r2, elements[n], DATALEN);
+        CHECK_EQUAL(&r1, &r2);
+    }
+
+    /* points off the curve are rejected */
+    data[63] ^= 1;
+    CHECK(!secp256k1_multiset_parse(ctx, &r2, data));
+
+    /* coordinates not below the field size are rejected */
+    memset(data, 0xff, sizeof(data));
+    CHECK(!secp256k1_multiset_parse(ctx, &r2, data));
+}
+
 void test_testvector(void) {
     /* Tests known values from the specification */
 
@@ -321,6 +360,7 @@ void run_multiset_tests(void) {
     test_remove();
     test_empty();
     test_duplicate();
+    test_serialize();
     test_testvector();
 }
 
@@ -7,6 +7,7 @@
 #define BITCOIN_STREAMS_H
 
 #include <serialize.h>
+#include <span.h>
 #include <support/allocators/zeroafterfree.h>
 
 #include <algorithm>
@@ -184,6 +185,50 @@ public:
     }
 };
 
+/**
+ * Minimal stream for reading from an existing span of bytes, such as a memory
+ * mapped file, without copying it first.
+ */
+class SpanReader {
+private:
+    const int m_type;
+    const int m_version;
+    Span<const uint8_t> m_data;
+
+public:
+    /**
+     * @param[in]  type Serialization Type
+     * @param[in]  version Serialization Version (including any flags)
+     * @param[in]  data Referenced bytes to read from
+     */
+    SpanReader(int type, int version, Span<const uint8_t> data)
+        : m_type(type), m_version(version), m_data(data) {}
+
+    template <typename T> SpanReader &operator>>(T &&obj) {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    int GetVersion() const { return m_version; }
+    int GetType() const { return m_type; }
+
+    size_t size() const { return m_data.size(); }
+    bool empty() const { return m_data.size() == 0; }
+
+    void read(char *dst, size_t n) {
+        if (n == 0) {
+            return;
+        }
+
+        if (n > size()) {
+            throw std::ios_base::failure("SpanReader::read(): end of data");
+        }
+        memcpy(dst, m_data.data(), n);
+        m_data = m_data.subspan(n);
+    }
+};
+
 /**
  * Double ended buffer combining vector and stream-like interfaces.
  *
@@ -286,6 +331,19 @@ public:
         vch.clear();
         nReadPos = 0;
     }
+    //! Replace the storage with buffer, cleared but keeping its capacity.
+    void SetBuffer(vector_type &&buffer) {
+        vch = std::move(buffer);
+        vch.clear();
+        nReadPos = 0;
+    }
+    //! Take the storage out of the stream, leaving it empty.
+    vector_type TakeBuffer() {
+        vector_type buffer;
+        buffer.swap(vch);
+        nReadPos = 0;
+        return buffer;
+    }
     iterator insert(iterator it, const char x = char()) {
         return vch.insert(it, x);
     }
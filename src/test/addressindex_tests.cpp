@@ -0,0 +1,250 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/addressindex.h>
+
+#include <chain.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <script/sighashtype.h>
+#include <script/standard.h>
+#include <txmempool.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(addressindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(addressindex_initial_sync, TestChain100Setup) {
+    AddressIndex addressindex(1 << 20, true);
+
+    const CScript coinbase_script =
+        CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<AddressOutput> outputs;
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_script, outputs));
+    BOOST_CHECK(outputs.empty());
+
+    // BlockUntilSyncedToCurrentChain should return false before addressindex
+    // is started.
+    BOOST_CHECK(!addressindex.BlockUntilSyncedToCurrentChain());
+
+    addressindex.Start();
+
+    // Allow addressindex to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!addressindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // All the coinbases of the chain pay to the coinbase key and are unspent.
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_script, outputs));
+    BOOST_CHECK_EQUAL(outputs.size(), m_coinbase_txns.size());
+    for (size_t i = 0; i < outputs.size(); i++) {
+        BOOST_CHECK(outputs[i].outpoint ==
+                    COutPoint(m_coinbase_txns[i]->GetId(), 0));
+        BOOST_CHECK_EQUAL(outputs[i].height, int(i) + 1);
+        BOOST_CHECK_EQUAL(outputs[i].value,
+                          m_coinbase_txns[i]->vout[0].nValue);
+        BOOST_CHECK(!outputs[i].IsSpent());
+    }
+
+    std::vector<AddressOutput> unspent;
+    BOOST_CHECK(addressindex.FindUnspentOutputs(coinbase_script, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), m_coinbase_txns.size());
+
+    // Spend the first coinbase to a P2PKH script.
+    const CScript p2pkh_script =
+        GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetId(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = p2pkh_script;
+
+    std::vector<uint8_t> vchSig;
+    uint256 sighash = SignatureHash(coinbase_script, CTransaction(spend), 0,
+                                    SigHashType().withForkId(),
+                                    m_coinbase_txns[0]->vout[0].nValue);
+    BOOST_CHECK(coinbaseKey.SignECDSA(sighash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    spend.vin[0].scriptSig << vchSig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, coinbase_script);
+    const TxId spend_txid = CTransaction(spend).GetId();
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+
+    // The coinbase is now spent, and the new block added another one.
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_script, outputs));
+    BOOST_CHECK_EQUAL(outputs.size(), m_coinbase_txns.size() + 1);
+    BOOST_CHECK(outputs[0].IsSpent());
+    BOOST_CHECK(outputs[0].spent_txid == spend_txid);
+    BOOST_CHECK_EQUAL(outputs[0].spent_index, 0U);
+    BOOST_CHECK_EQUAL(outputs[0].spent_height, 101);
+    BOOST_CHECK(addressindex.FindUnspentOutputs(coinbase_script, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), m_coinbase_txns.size());
+
+    BOOST_CHECK(addressindex.FindOutputs(p2pkh_script, outputs));
+    BOOST_CHECK_EQUAL(outputs.size(), 1U);
+    BOOST_CHECK(outputs[0].outpoint == COutPoint(spend_txid, 0));
+    BOOST_CHECK_EQUAL(outputs[0].value, 11 * CENT);
+    BOOST_CHECK(addressindex.FindUnspentOutputs(p2pkh_script, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 1U);
+
+    // Replace the block with one that doesn't include the spend, the index
+    // must be rewound.
+    {
+        CValidationState state;
+        CBlockIndex *pindex;
+        {
+            LOCK(cs_main);
+            pindex = LookupBlockIndex(block.GetHash());
+        }
+        BOOST_CHECK(InvalidateBlock(GetConfig(), state, pindex));
+    }
+    // The disconnected transactions are back in the mempool, and their fees
+    // would be claimed by the coinbase of the next block.
+    g_mempool.clear();
+    CreateAndProcessBlock({}, coinbase_script);
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_script, outputs));
+    BOOST_CHECK_EQUAL(outputs.size(), m_coinbase_txns.size() + 1);
+    BOOST_CHECK(!outputs[0].IsSpent());
+    BOOST_CHECK(addressindex.FindUnspentOutputs(coinbase_script, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), m_coinbase_txns.size() + 1);
+
+    BOOST_CHECK(addressindex.FindOutputs(p2pkh_script, outputs));
+    BOOST_CHECK(outputs.empty());
+    BOOST_CHECK(addressindex.FindUnspentOutputs(p2pkh_script, unspent));
+    BOOST_CHECK(unspent.empty());
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    addressindex.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_FIXTURE_TEST_CASE(addressindex_child_before_parent, TestChain100Setup) {
+    AddressIndex addressindex(1 << 20, true);
+    addressindex.Start();
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!addressindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    const CScript coinbase_script =
+        CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const CScript p2pkh_script =
+        GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+    auto sign = [&](CMutableTransaction &tx, const Amount amount) {
+        std::vector<uint8_t> vchSig;
+        uint256 sighash =
+            SignatureHash(coinbase_script, CTransaction(tx), 0,
+                          SigHashType().withForkId(), amount);
+        BOOST_CHECK(coinbaseKey.SignECDSA(sighash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        tx.vin[0].scriptSig = CScript() << vchSig;
+    };
+
+    // The parent spends the first coinbase back to the coinbase key, and the
+    // child spends the parent. The child is made to sort before its parent in
+    // the block.
+    CMutableTransaction parent;
+    parent.nVersion = 1;
+    parent.vin.resize(1);
+    parent.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetId(), 0);
+    parent.vout.resize(1);
+    parent.vout[0].nValue = 49 * COIN;
+    parent.vout[0].scriptPubKey = coinbase_script;
+    sign(parent, m_coinbase_txns[0]->vout[0].nValue);
+    const TxId parent_txid = CTransaction(parent).GetId();
+
+    CMutableTransaction child;
+    child.nVersion = 1;
+    child.vin.resize(1);
+    child.vin[0].prevout = COutPoint(parent_txid, 0);
+    child.vout.resize(1);
+    child.vout[0].scriptPubKey = p2pkh_script;
+    Amount child_value = 48 * COIN;
+    do {
+        child_value -= SATOSHI;
+        child.vout[0].nValue = child_value;
+        sign(child, parent.vout[0].nValue);
+    } while (!(CTransaction(child).GetId() < parent_txid));
+    const TxId child_txid = CTransaction(child).GetId();
+
+    const CBlock block =
+        CreateAndProcessBlock({parent, child}, coinbase_script);
+    BOOST_REQUIRE_EQUAL(block.vtx.size(), 3U);
+    BOOST_CHECK(block.vtx[1]->GetId() == child_txid);
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+
+    // The output of the parent is spent by the child, despite the child coming
+    // first in the block.
+    std::vector<AddressOutput> outputs;
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_script, outputs));
+    BOOST_CHECK_EQUAL(outputs.size(), m_coinbase_txns.size() + 2);
+    for (const AddressOutput &output : outputs) {
+        if (output.outpoint == COutPoint(parent_txid, 0)) {
+            BOOST_CHECK(output.IsSpent());
+            BOOST_CHECK(output.spent_txid == child_txid);
+        }
+    }
+    std::vector<AddressOutput> unspent;
+    BOOST_CHECK(addressindex.FindUnspentOutputs(coinbase_script, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), m_coinbase_txns.size());
+    for (const AddressOutput &output : unspent) {
+        BOOST_CHECK(output.outpoint != COutPoint(parent_txid, 0));
+    }
+    BOOST_CHECK(addressindex.FindUnspentOutputs(p2pkh_script, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), 1U);
+
+    // Rewinding the block must not restore the output of the parent.
+    {
+        CValidationState state;
+        CBlockIndex *pindex;
+        {
+            LOCK(cs_main);
+            pindex = LookupBlockIndex(block.GetHash());
+        }
+        BOOST_CHECK(InvalidateBlock(GetConfig(), state, pindex));
+    }
+    // The disconnected transactions are back in the mempool, and their fees
+    // would be claimed by the coinbase of the next block.
+    g_mempool.clear();
+    CreateAndProcessBlock({}, coinbase_script);
+    BOOST_CHECK(addressindex.BlockUntilSyncedToCurrentChain());
+
+    BOOST_CHECK(addressindex.FindOutputs(coinbase_script, outputs));
+    BOOST_CHECK_EQUAL(outputs.size(), m_coinbase_txns.size() + 1);
+    for (const AddressOutput &output : outputs) {
+        BOOST_CHECK(output.outpoint != COutPoint(parent_txid, 0));
+        BOOST_CHECK(!output.IsSpent());
+    }
+    BOOST_CHECK(addressindex.FindUnspentOutputs(coinbase_script, unspent));
+    BOOST_CHECK_EQUAL(unspent.size(), m_coinbase_txns.size() + 1);
+    BOOST_CHECK(addressindex.FindUnspentOutputs(p2pkh_script, unspent));
+    BOOST_CHECK(unspent.empty());
+
+    addressindex.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
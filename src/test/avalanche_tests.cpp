@@ -6,11 +6,16 @@
 
 #include <config.h>
 #include <net_processing.h> // For PeerLogicValidation
+#include <txmempool.h>
+#include <validation.h>
 
 #include <test/test_bitcoin.h>
 
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
+#include <thread>
+
 struct AvalancheTest {
     static void runEventLoop(AvalancheProcessor &p) { p.runEventLoop(); }
 
@@ -23,6 +28,13 @@ struct AvalancheTest {
     }
 
     static uint64_t getRound(const AvalancheProcessor &p) { return p.round; }
+
+    static std::vector<CInv> getQueryInvs(const AvalancheProcessor &p,
+                                          NodeId nodeid, uint64_t round) {
+        auto r = p.queries.getReadView();
+        auto it = r->find(std::make_tuple(nodeid, round));
+        return it == r.end() ? std::vector<CInv>() : it->invs;
+    }
 };
 
 struct CConnmanTest : public CConnman {
@@ -218,6 +230,7 @@ BOOST_AUTO_TEST_CASE(block_register) {
 
     AvalancheProcessor p(connman.get());
     std::vector<AvalancheBlockUpdate> updates;
+    std::vector<AvalancheTxUpdate> txUpdates;
 
     CBlock block = CreateAndProcessBlock({}, CScript());
     const BlockHash blockHash = block.GetHash();
@@ -248,7 +261,7 @@ BOOST_AUTO_TEST_CASE(block_register) {
     auto registerNewVote = [&](const AvalancheResponse &resp) {
         AvalancheTest::runEventLoop(p);
         auto nodeid = avanodes[nextNodeIndex++ % avanodes.size()]->GetId();
-        BOOST_CHECK(p.registerVotes(nodeid, resp, updates));
+        BOOST_CHECK(p.registerVotes(nodeid, resp, updates, txUpdates));
     };
 
     // Let's vote for this block a few times.
@@ -388,6 +401,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     CBlockIndex indexA, indexB;
 
     std::vector<AvalancheBlockUpdate> updates;
+    std::vector<AvalancheTxUpdate> txUpdates;
 
     // Create several nodes that support avalanche.
     auto avanodes =
@@ -422,7 +436,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     AvalancheTest::runEventLoop(p);
     BOOST_CHECK(p.registerVotes(avanodes[0]->GetId(),
                                 {round, 0, {AvalancheVote(0, blockHashA)}},
-                                updates));
+                                updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // Start voting on block B after one vote.
@@ -444,7 +458,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     for (int i = 0; i < 4; i++) {
         NodeId nodeid = AvalancheTest::getSuitableNodeToQuery(p);
         AvalancheTest::runEventLoop(p);
-        BOOST_CHECK(p.registerVotes(nodeid, next(resp), updates));
+        BOOST_CHECK(p.registerVotes(nodeid, next(resp), updates, txUpdates));
         BOOST_CHECK_EQUAL(updates.size(), 0);
     }
 
@@ -452,7 +466,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     for (int i = 0; i < AVALANCHE_FINALIZATION_SCORE; i++) {
         NodeId nodeid = AvalancheTest::getSuitableNodeToQuery(p);
         AvalancheTest::runEventLoop(p);
-        BOOST_CHECK(p.registerVotes(nodeid, next(resp), updates));
+        BOOST_CHECK(p.registerVotes(nodeid, next(resp), updates, txUpdates));
         BOOST_CHECK_EQUAL(updates.size(), 0);
     }
 
@@ -466,7 +480,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     BOOST_CHECK(firstNodeid != secondNodeid);
 
     // Next vote will finalize block A.
-    BOOST_CHECK(p.registerVotes(firstNodeid, next(resp), updates));
+    BOOST_CHECK(p.registerVotes(firstNodeid, next(resp), updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 1);
     BOOST_CHECK(updates[0].getBlockIndex() == pindexA);
     BOOST_CHECK_EQUAL(updates[0].getStatus(),
@@ -480,7 +494,7 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     BOOST_CHECK(invs[0].hash == blockHashB);
 
     // Next vote will finalize block B.
-    BOOST_CHECK(p.registerVotes(secondNodeid, resp, updates));
+    BOOST_CHECK(p.registerVotes(secondNodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 1);
     BOOST_CHECK(updates[0].getBlockIndex() == pindexB);
     BOOST_CHECK_EQUAL(updates[0].getStatus(),
@@ -494,6 +508,321 @@ BOOST_AUTO_TEST_CASE(multi_block_register) {
     connman->ClearNodes();
 }
 
+static CTransactionRef MakeSpend(const COutPoint &prevout, int64_t value) {
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(prevout);
+    mtx.vout.emplace_back(value * SATOSHI, CScript() << OP_TRUE);
+    return MakeTransactionRef(mtx);
+}
+
+BOOST_AUTO_TEST_CASE(tx_register) {
+    const Config &config = GetConfig();
+
+    auto connman = std::make_unique<CConnmanTest>(config, 0x1337, 0x1337);
+    auto peerLogic = std::make_unique<PeerLogicValidation>(
+        connman.get(), nullptr, scheduler, false);
+
+    AvalancheProcessor p(connman.get());
+    std::vector<AvalancheBlockUpdate> updates;
+    std::vector<AvalancheTxUpdate> txUpdates;
+
+    // txA is in the mempool, and txB and txC are double spending it.
+    const COutPoint prevout(m_coinbase_txns[0]->GetId(), 0);
+    CTransactionRef txA = MakeSpend(prevout, 1000);
+    CTransactionRef txB = MakeSpend(prevout, 2000);
+    CTransactionRef txC = MakeSpend(prevout, 3000);
+    {
+        LOCK2(cs_main, g_mempool.cs);
+        TestMemPoolEntryHelper entry;
+        g_mempool.addUnchecked(entry.FromTx(txA));
+    }
+
+    auto avanodes =
+        ConnectNodes(config, p, NODE_AVALANCHE, *peerLogic, connman.get());
+
+    // Querying for random transaction returns nothing.
+    BOOST_CHECK(!p.isAccepted(txA->GetId()));
+    BOOST_CHECK_EQUAL(p.getConfidence(txA->GetId()), -1);
+
+    // Adding a double spend also adds the mempool transaction it conflicts
+    // with. Their state reflect the mempool.
+    BOOST_CHECK(p.addTxToReconcile(txB));
+    BOOST_CHECK(!p.addTxToReconcile(txB));
+    BOOST_CHECK(!p.addTxToReconcile(txA));
+    BOOST_CHECK(p.isAccepted(txA->GetId()));
+    BOOST_CHECK(!p.isAccepted(txB->GetId()));
+    BOOST_CHECK_EQUAL(p.getConfidence(txA->GetId()), 0);
+    BOOST_CHECK_EQUAL(p.getConfidence(txB->GetId()), 0);
+
+    auto invs = AvalancheTest::getInvsForNextPoll(p);
+    BOOST_CHECK_EQUAL(invs.size(), 2);
+    for (const CInv &inv : invs) {
+        BOOST_CHECK_EQUAL(inv.type, MSG_TX);
+        BOOST_CHECK(inv.hash == txA->GetId() || inv.hash == txB->GetId());
+    }
+
+    // Answer each poll, voting yes for txA and with voteOther for the others.
+    int nextNodeIndex = 0;
+    auto registerNewVote = [&](uint32_t voteOther) {
+        const uint64_t round = AvalancheTest::getRound(p);
+        invs = AvalancheTest::getInvsForNextPoll(p);
+        AvalancheTest::runEventLoop(p);
+
+        std::vector<AvalancheVote> votes;
+        for (const CInv &inv : invs) {
+            votes.emplace_back(inv.hash == txA->GetId() ? 0 : voteOther,
+                               inv.hash);
+        }
+
+        auto nodeid = avanodes[nextNodeIndex++ % avanodes.size()]->GetId();
+        BOOST_CHECK(
+            p.registerVotes(nodeid, {round, 0, votes}, updates, txUpdates));
+    };
+
+    // Vote until both transactions are finalized, the votes agree with the
+    // state of the transactions so it never flips.
+    for (int i = 0; i < AVALANCHE_FINALIZATION_SCORE + 5; i++) {
+        registerNewVote(1);
+        BOOST_CHECK(updates.empty());
+        BOOST_CHECK(txUpdates.empty());
+    }
+
+    BOOST_CHECK(p.isAccepted(txA->GetId()));
+    BOOST_CHECK_EQUAL(p.getConfidence(txA->GetId()),
+                      AVALANCHE_FINALIZATION_SCORE - 1);
+
+    registerNewVote(1);
+    BOOST_CHECK(updates.empty());
+    BOOST_CHECK_EQUAL(txUpdates.size(), 2);
+    for (const AvalancheTxUpdate &u : txUpdates) {
+        BOOST_CHECK_EQUAL(u.getStatus(),
+                          u.getTxId() == txA->GetId()
+                              ? AvalancheTxUpdate::Status::Finalized
+                              : AvalancheTxUpdate::Status::Invalid);
+    }
+    txUpdates = {};
+
+    // Once the decision is finalized, there is no poll for it.
+    BOOST_CHECK_EQUAL(p.getConfidence(txA->GetId()), -1);
+    BOOST_CHECK_EQUAL(p.getConfidence(txB->GetId()), -1);
+    invs = AvalancheTest::getInvsForNextPoll(p);
+    BOOST_CHECK_EQUAL(invs.size(), 0);
+
+    // Finalizing txA invalidates its conflicts, even if they are undecided.
+    BOOST_CHECK(p.addTxToReconcile(txC));
+    BOOST_CHECK(p.isAccepted(txA->GetId()));
+    BOOST_CHECK(!p.isAccepted(txC->GetId()));
+    for (int i = 0; i < AVALANCHE_FINALIZATION_SCORE + 5; i++) {
+        registerNewVote(-1);
+        BOOST_CHECK(txUpdates.empty());
+        BOOST_CHECK_EQUAL(p.getConfidence(txC->GetId()), 0);
+    }
+
+    registerNewVote(-1);
+    BOOST_CHECK_EQUAL(txUpdates.size(), 2);
+    BOOST_CHECK(txUpdates[0].getTxId() == txA->GetId());
+    BOOST_CHECK_EQUAL(txUpdates[0].getStatus(),
+                      AvalancheTxUpdate::Status::Finalized);
+    BOOST_CHECK(txUpdates[1].getTxId() == txC->GetId());
+    BOOST_CHECK_EQUAL(txUpdates[1].getStatus(),
+                      AvalancheTxUpdate::Status::Invalid);
+    txUpdates = {};
+    BOOST_CHECK_EQUAL(p.getConfidence(txC->GetId()), -1);
+
+    // Removing a transaction also removes its conflicts.
+    BOOST_CHECK(p.addTxToReconcile(txC));
+    BOOST_CHECK_EQUAL(AvalancheTest::getInvsForNextPoll(p).size(), 2);
+    p.removeTx(*txA);
+    BOOST_CHECK_EQUAL(p.getConfidence(txA->GetId()), -1);
+    BOOST_CHECK_EQUAL(p.getConfidence(txC->GetId()), -1);
+    BOOST_CHECK_EQUAL(AvalancheTest::getInvsForNextPoll(p).size(), 0);
+
+    {
+        LOCK(g_mempool.cs);
+        g_mempool.clear();
+    }
+    connman->ClearNodes();
+}
+
+BOOST_AUTO_TEST_CASE(tx_poll_batching) {
+    const Config &config = GetConfig();
+
+    auto connman = std::make_unique<CConnmanTest>(config, 0x1337, 0x1337);
+    AvalancheProcessor p(connman.get());
+
+    CBlock block = CreateAndProcessBlock({}, CScript());
+    const CBlockIndex *pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(block.GetHash());
+    }
+    BOOST_CHECK(p.addBlockToReconcile(pindex));
+
+    // Add more transactions than what fit in a poll.
+    for (size_t i = 0; i < AVALANCHE_MAX_ELEMENT_POLL + 10; i++) {
+        const COutPoint prevout(TxId(InsecureRand256()), 0);
+        BOOST_CHECK(p.addTxToReconcile(MakeSpend(prevout, 1000)));
+    }
+
+    // Blocks come first, and transactions fill the rest of the poll.
+    auto invs = AvalancheTest::getInvsForNextPoll(p);
+    BOOST_CHECK_EQUAL(invs.size(), AVALANCHE_MAX_ELEMENT_POLL);
+    BOOST_CHECK_EQUAL(invs[0].type, MSG_BLOCK);
+    BOOST_CHECK(invs[0].hash == block.GetHash());
+    for (size_t i = 1; i < invs.size(); i++) {
+        BOOST_CHECK_EQUAL(invs[i].type, MSG_TX);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(tx_vote_records_limit) {
+    const Config &config = GetConfig();
+
+    auto connman = std::make_unique<CConnmanTest>(config, 0x1337, 0x1337);
+    AvalancheProcessor p(connman.get());
+
+    std::vector<CTransactionRef> txs;
+    for (size_t i = 0; i < AVALANCHE_MAX_TX_VOTE_RECORDS; i++) {
+        const COutPoint prevout(TxId(InsecureRand256()), 0);
+        txs.push_back(MakeSpend(prevout, 1000));
+        BOOST_CHECK(p.addTxToReconcile(txs.back()));
+    }
+
+    // No more transactions are voted on once the limit is reached.
+    CTransactionRef tx = MakeSpend(COutPoint(TxId(InsecureRand256()), 0), 1000);
+    BOOST_CHECK(!p.addTxToReconcile(tx));
+    BOOST_CHECK_EQUAL(p.getConfidence(tx->GetId()), -1);
+
+    // Removing a transaction makes room for another one.
+    p.removeTx(*txs[0]);
+    BOOST_CHECK(p.addTxToReconcile(tx));
+    BOOST_CHECK_EQUAL(p.getConfidence(tx->GetId()), 0);
+}
+
+BOOST_AUTO_TEST_CASE(tx_mempool_removal) {
+    const Config &config = GetConfig();
+
+    auto connman = std::make_unique<CConnmanTest>(config, 0x1337, 0x1337);
+    auto peerLogic = std::make_unique<PeerLogicValidation>(
+        connman.get(), nullptr, scheduler, false);
+    g_avalanche = std::make_unique<AvalancheProcessor>(connman.get());
+
+    // txA is in the mempool, and txB is double spending it.
+    const COutPoint prevout(m_coinbase_txns[0]->GetId(), 0);
+    CTransactionRef txA = MakeSpend(prevout, 1000);
+    CTransactionRef txB = MakeSpend(prevout, 2000);
+    {
+        LOCK2(cs_main, g_mempool.cs);
+        TestMemPoolEntryHelper entry;
+        g_mempool.addUnchecked(entry.FromTx(txA));
+    }
+
+    BOOST_CHECK(g_avalanche->addTxToReconcile(txB));
+    BOOST_CHECK_EQUAL(g_avalanche->getConfidence(txA->GetId()), 0);
+    BOOST_CHECK_EQUAL(g_avalanche->getConfidence(txB->GetId()), 0);
+
+    // Evicting txA from the mempool stops the votes on it and its double
+    // spend.
+    {
+        LOCK(g_mempool.cs);
+        g_mempool.clear();
+    }
+    peerLogic->TransactionRemovedFromMempool(txA);
+    BOOST_CHECK_EQUAL(g_avalanche->getConfidence(txA->GetId()), -1);
+    BOOST_CHECK_EQUAL(g_avalanche->getConfidence(txB->GetId()), -1);
+
+    g_avalanche.reset();
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_tx_votes) {
+    const Config &config = GetConfig();
+
+    auto connman = std::make_unique<CConnmanTest>(config, 0x1337, 0x1337);
+    auto peerLogic = std::make_unique<PeerLogicValidation>(
+        connman.get(), nullptr, scheduler, false);
+
+    AvalancheProcessor p(connman.get());
+
+    std::vector<TxId> txids;
+    for (int i = 0; i < 20; i++) {
+        CTransactionRef tx =
+            MakeSpend(COutPoint(TxId(InsecureRand256()), 0), 1000);
+        BOOST_CHECK(p.addTxToReconcile(tx));
+        txids.push_back(tx->GetId());
+    }
+
+    ConnectNodes(config, p, NODE_AVALANCHE, *peerLogic, connman.get());
+    ConnectNodes(config, p, NODE_AVALANCHE, *peerLogic, connman.get());
+
+    // Several threads poll and register yes votes until all the transactions
+    // are finalized. Polls are sent one at a time, but the votes are
+    // registered concurrently.
+    Mutex cs_poll;
+    Mutex cs_finalized;
+    std::map<TxId, int> finalized;
+    std::atomic<bool> done{false};
+    // Boost checks are not thread safe, count the failures instead.
+    std::atomic<int> rejected{0};
+
+    auto vote = [&]() {
+        for (int i = 0; i < 10000 && !done; i++) {
+            NodeId nodeid;
+            uint64_t round;
+            std::vector<CInv> invs;
+            {
+                LOCK(cs_poll);
+                nodeid = AvalancheTest::getSuitableNodeToQuery(p);
+                round = AvalancheTest::getRound(p);
+                AvalancheTest::runEventLoop(p);
+                invs = AvalancheTest::getQueryInvs(p, nodeid, round);
+            }
+
+            if (invs.empty()) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            std::vector<AvalancheVote> votes;
+            for (const CInv &inv : invs) {
+                votes.emplace_back(0, inv.hash);
+            }
+
+            std::vector<AvalancheBlockUpdate> updates;
+            std::vector<AvalancheTxUpdate> txUpdates;
+            if (!p.registerVotes(nodeid, {round, 0, votes}, updates,
+                                 txUpdates)) {
+                rejected++;
+            }
+
+            LOCK(cs_finalized);
+            for (const AvalancheTxUpdate &u : txUpdates) {
+                if (u.getStatus() == AvalancheTxUpdate::Status::Finalized) {
+                    finalized[u.getTxId()]++;
+                }
+            }
+            done = finalized.size() == txids.size();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; i++) {
+        threads.emplace_back(vote);
+    }
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    // Each transaction was finalized exactly once.
+    BOOST_CHECK_EQUAL(rejected, 0);
+    BOOST_CHECK_EQUAL(finalized.size(), txids.size());
+    for (const TxId &txid : txids) {
+        BOOST_CHECK_EQUAL(finalized[txid], 1);
+        BOOST_CHECK_EQUAL(p.getConfidence(txid), -1);
+    }
+    BOOST_CHECK(AvalancheTest::getInvsForNextPoll(p).empty());
+
+    connman->ClearNodes();
+}
+
 BOOST_AUTO_TEST_CASE(poll_and_response) {
     const Config &config = GetConfig();
 
@@ -504,6 +833,7 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
     AvalancheProcessor p(connman.get());
 
     std::vector<AvalancheBlockUpdate> updates;
+    std::vector<AvalancheTxUpdate> txUpdates;
 
     CBlock block = CreateAndProcessBlock({}, CScript());
     const BlockHash blockHash = block.GetHash();
@@ -542,7 +872,7 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
 
     // Respond to the request.
     AvalancheResponse resp = {round, 0, {AvalancheVote(0, blockHash)}};
-    BOOST_CHECK(p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // Now that avanode fullfilled his request, it is added back to the list of
@@ -550,7 +880,7 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
     BOOST_CHECK_EQUAL(AvalancheTest::getSuitableNodeToQuery(p), avanodeid);
 
     // Sending a response when not polled fails.
-    BOOST_CHECK(!p.registerVotes(avanodeid, next(resp), updates));
+    BOOST_CHECK(!p.registerVotes(avanodeid, next(resp), updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // Trigger a poll on avanode.
@@ -563,21 +893,21 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
     resp = {
         round, 0, {AvalancheVote(0, blockHash), AvalancheVote(0, blockHash)}};
     AvalancheTest::runEventLoop(p);
-    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(AvalancheTest::getSuitableNodeToQuery(p), avanodeid);
 
     // 2. Not enough results.
     resp = {AvalancheTest::getRound(p), 0, {}};
     AvalancheTest::runEventLoop(p);
-    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(AvalancheTest::getSuitableNodeToQuery(p), avanodeid);
 
     // 3. Do not match the poll.
     resp = {AvalancheTest::getRound(p), 0, {AvalancheVote()}};
     AvalancheTest::runEventLoop(p);
-    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(AvalancheTest::getSuitableNodeToQuery(p), avanodeid);
 
@@ -586,22 +916,22 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
     AvalancheTest::runEventLoop(p);
 
     resp = {queryRound + 1, 0, {AvalancheVote()}};
-    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     resp = {queryRound - 1, 0, {AvalancheVote()}};
-    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // 5. Making request for invalid nodes do not work. Request is not
     // discarded.
     resp = {queryRound, 0, {AvalancheVote(0, blockHash)}};
-    BOOST_CHECK(!p.registerVotes(avanodeid + 1234, resp, updates));
+    BOOST_CHECK(!p.registerVotes(avanodeid + 1234, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
 
     // Proper response gets processed and avanode is available again.
     resp = {queryRound, 0, {AvalancheVote(0, blockHash)}};
-    BOOST_CHECK(p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(AvalancheTest::getSuitableNodeToQuery(p), avanodeid);
 
@@ -619,7 +949,7 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
             0,
             {AvalancheVote(0, blockHash), AvalancheVote(0, blockHash2)}};
     AvalancheTest::runEventLoop(p);
-    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(!p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(AvalancheTest::getSuitableNodeToQuery(p), avanodeid);
 
@@ -628,7 +958,7 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
             0,
             {AvalancheVote(0, blockHash2), AvalancheVote(0, blockHash)}};
     AvalancheTest::runEventLoop(p);
-    BOOST_CHECK(p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(AvalancheTest::getSuitableNodeToQuery(p), avanodeid);
 
@@ -636,7 +966,7 @@ BOOST_AUTO_TEST_CASE(poll_and_response) {
     pindex2->nStatus = pindex2->nStatus.withFailed();
     resp = {AvalancheTest::getRound(p), 0, {AvalancheVote(0, blockHash)}};
     AvalancheTest::runEventLoop(p);
-    BOOST_CHECK(p.registerVotes(avanodeid, resp, updates));
+    BOOST_CHECK(p.registerVotes(avanodeid, resp, updates, txUpdates));
     BOOST_CHECK_EQUAL(updates.size(), 0);
     BOOST_CHECK_EQUAL(AvalancheTest::getSuitableNodeToQuery(p), avanodeid);
 
@@ -659,6 +989,7 @@ BOOST_AUTO_TEST_CASE(poll_inflight_timeout) {
     AvalancheProcessor p(connman.get());
 
     std::vector<AvalancheBlockUpdate> updates;
+    std::vector<AvalancheTxUpdate> txUpdates;
 
     CBlock block = CreateAndProcessBlock({}, CScript());
     const BlockHash blockHash = block.GetHash();
@@ -695,7 +1026,7 @@ BOOST_AUTO_TEST_CASE(poll_inflight_timeout) {
         std::this_thread::sleep_for(std::chrono::milliseconds(1));
         AvalancheTest::runEventLoop(p);
 
-        bool ret = p.registerVotes(avanodeid, next(resp), updates);
+        bool ret = p.registerVotes(avanodeid, next(resp), updates, txUpdates);
         if (std::chrono::steady_clock::now() > start + queryTimeDuration) {
             // We waited for too long, bail. Because we can't know for sure when
             // previous steps ran, ret is not deterministic and we do not check
@@ -711,7 +1042,8 @@ BOOST_AUTO_TEST_CASE(poll_inflight_timeout) {
         AvalancheTest::runEventLoop(p);
         std::this_thread::sleep_for(queryTimeDuration);
         AvalancheTest::runEventLoop(p);
-        BOOST_CHECK(!p.registerVotes(avanodeid, next(resp), updates));
+        BOOST_CHECK(
+            !p.registerVotes(avanodeid, next(resp), updates, txUpdates));
     }
 
     connman->ClearNodes();
@@ -765,11 +1097,12 @@ BOOST_AUTO_TEST_CASE(poll_inflight_count) {
     BOOST_CHECK_EQUAL(AvalancheTest::getSuitableNodeToQuery(p), suitablenodeid);
 
     std::vector<AvalancheBlockUpdate> updates;
+    std::vector<AvalancheTxUpdate> txUpdates;
 
     // Send one response, now we can poll again.
     auto it = node_round_map.begin();
     AvalancheResponse resp = {it->second, 0, {AvalancheVote(0, blockHash)}};
-    BOOST_CHECK(p.registerVotes(it->first, resp, updates));
+    BOOST_CHECK(p.registerVotes(it->first, resp, updates, txUpdates));
     node_round_map.erase(it);
 
     invs = AvalancheTest::getInvsForNextPoll(p);
@@ -789,6 +1122,7 @@ BOOST_AUTO_TEST_CASE(quorum_diversity) {
 
     AvalancheProcessor p(connman.get());
     std::vector<AvalancheBlockUpdate> updates;
+    std::vector<AvalancheTxUpdate> txUpdates;
 
     CBlock block = CreateAndProcessBlock({}, CScript());
     const BlockHash blockHash = block.GetHash();
@@ -815,7 +1149,8 @@ BOOST_AUTO_TEST_CASE(quorum_diversity) {
     // Check that all nodes can vote.
     for (size_t i = 0; i < avanodes.size(); i++) {
         AvalancheTest::runEventLoop(p);
-        BOOST_CHECK(p.registerVotes(avanodes[i]->GetId(), next(resp), updates));
+        BOOST_CHECK(p.registerVotes(avanodes[i]->GetId(), next(resp), updates,
+                                    txUpdates));
     }
 
     // Generate a query for every single node.
@@ -845,12 +1180,13 @@ BOOST_AUTO_TEST_CASE(quorum_diversity) {
         }
 
         BOOST_CHECK(p.registerVotes(
-            nodeid, {r, 0, {AvalancheVote(0, blockHash)}}, updates));
+            nodeid, {r, 0, {AvalancheVote(0, blockHash)}}, updates, txUpdates));
         BOOST_CHECK_EQUAL(p.getConfidence(pindex), confidence);
     }
 
-    BOOST_CHECK(p.registerVotes(
-        firstNodeId, {round, 0, {AvalancheVote(0, blockHash)}}, updates));
+    BOOST_CHECK(p.registerVotes(firstNodeId,
+                                {round, 0, {AvalancheVote(0, blockHash)}},
+                                updates, txUpdates));
     BOOST_CHECK_EQUAL(p.getConfidence(pindex), confidence + 1);
 
     connman->ClearNodes();
@@ -918,8 +1254,9 @@ BOOST_AUTO_TEST_CASE(event_loop) {
         std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
 
     std::vector<AvalancheBlockUpdate> updates;
+    std::vector<AvalancheTxUpdate> txUpdates;
     p.registerVotes(nodeid, {queryRound, 100, {AvalancheVote(0, blockHash)}},
-                    updates);
+                    updates, txUpdates);
     for (int i = 0; i < 10000; i++) {
         // We make sure that we do not get a request before queryTime.
         boost::this_thread::sleep_for(boost::chrono::milliseconds(1));
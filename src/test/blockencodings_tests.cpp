@@ -402,6 +402,45 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(LargeMempoolRoundTripTest) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block(BuildBlockTestCase());
+
+    // Enough transactions for the mempool to be hashed on several threads.
+    LOCK2(cs_main, pool.cs);
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42 * SATOSHI;
+    for (size_t i = 0; i < 4 * MIN_SHORTID_SCAN_TXS_PER_THREAD; i++) {
+        tx.vin[0].prevout = InsecureRandOutPoint();
+        pool.addUnchecked(entry.FromTx(tx));
+    }
+    pool.addUnchecked(entry.FromTx(block.vtx[2]));
+    for (size_t i = 0; i < 4 * MIN_SHORTID_SCAN_TXS_PER_THREAD; i++) {
+        tx.vin[0].prevout = InsecureRandOutPoint();
+        pool.addUnchecked(entry.FromTx(tx));
+    }
+
+    // The result does not depend on the number of threads.
+    CBlockHeaderAndShortTxIDs shortIDs(block);
+    for (int nThreads : {1, 3, 4}) {
+        PartiallyDownloadedBlock partialBlock(GetConfig(), &pool);
+        BOOST_CHECK(partialBlock.InitData(shortIDs, extra_txn, nThreads) ==
+                    READ_STATUS_OK);
+        BOOST_CHECK(partialBlock.IsTxAvailable(0));
+        BOOST_CHECK(!partialBlock.IsTxAvailable(1));
+        BOOST_CHECK(partialBlock.IsTxAvailable(2));
+
+        CBlock block2;
+        BOOST_CHECK(partialBlock.FillBlock(block2, {block.vtx[1]}) ==
+                    READ_STATUS_OK);
+        BOOST_CHECK_EQUAL(block.GetHash().ToString(),
+                          block2.GetHash().ToString());
+    }
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = BlockHash(InsecureRand256());
@@ -0,0 +1,316 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/blockfilterindex.h>
+
+#include <blockfilter.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <config.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <miner.h>
+#include <pow.h>
+#include <undo.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(blockfilterindex_tests)
+
+static void CheckFilterLookups(BlockFilterIndex &filter_index,
+                               const CBlockIndex *block_index,
+                               uint256 &last_header) {
+    BlockFilter expected_filter;
+    {
+        CBlock block;
+        CBlockUndo block_undo;
+        BOOST_REQUIRE(ReadBlockFromDisk(block, block_index,
+                                        Params().GetConsensus()));
+        if (block_index->nHeight > 0) {
+            BOOST_REQUIRE(UndoReadFromDisk(block_undo, block_index));
+        }
+        expected_filter = BlockFilter(filter_index.GetFilterType(), block,
+                                      block_undo);
+    }
+
+    BlockFilter filter;
+    uint256 filter_header;
+    std::vector<BlockFilter> filters;
+    std::vector<uint256> filter_hashes;
+
+    BOOST_CHECK(filter_index.LookupFilter(block_index, filter));
+    BOOST_CHECK(filter_index.LookupFilterHeader(block_index, filter_header));
+    BOOST_CHECK(filter_index.LookupFilterRange(block_index->nHeight,
+                                               block_index, filters));
+    BOOST_CHECK(filter_index.LookupFilterHashRange(block_index->nHeight,
+                                                   block_index, filter_hashes));
+
+    BOOST_CHECK_EQUAL(filters.size(), 1U);
+    BOOST_CHECK_EQUAL(filter_hashes.size(), 1U);
+
+    BOOST_CHECK(filter.GetHash() == expected_filter.GetHash());
+    BOOST_CHECK(filter_header == expected_filter.ComputeHeader(last_header));
+    BOOST_CHECK(filters[0].GetHash() == expected_filter.GetHash());
+    BOOST_CHECK(filter_hashes[0] == expected_filter.GetHash());
+
+    last_header = filter_header;
+}
+
+static CBlock CreateBlock(const CBlockIndex *prev,
+                          const CScript &scriptPubKey) {
+    const Config &config = GetConfig();
+    std::unique_ptr<CBlockTemplate> pblocktemplate =
+        BlockAssembler(config, g_mempool).CreateNewBlock(scriptPubKey);
+    CBlock &block = pblocktemplate->block;
+    block.hashPrevBlock = prev->GetBlockHash();
+    block.nTime = prev->nTime + 1;
+
+    // Replace mempool-selected txns with just the coinbase.
+    CMutableTransaction coinbase(*block.vtx[0]);
+    coinbase.vin[0].scriptSig = CScript() << (prev->nHeight + 1) << OP_0;
+    block.vtx.resize(1);
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+
+    while (!CheckProofOfWork(block.GetHash(), block.nBits,
+                             config.GetChainParams().GetConsensus())) {
+        ++block.nNonce;
+    }
+
+    return block;
+}
+
+static bool BuildChain(const CBlockIndex *pindex,
+                       const CScript &coinbase_script_pub_key, size_t length,
+                       std::vector<std::shared_ptr<CBlock>> &chain) {
+    chain.resize(length);
+    for (auto &block : chain) {
+        block = std::make_shared<CBlock>(
+            CreateBlock(pindex, coinbase_script_pub_key));
+
+        CValidationState state;
+        if (!ProcessNewBlockHeaders(GetConfig(), {block->GetBlockHeader()},
+                                    state, &pindex)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_initial_sync, TestChain100Setup) {
+    BlockFilterIndex filter_index(BlockFilterType::BASIC, 1 << 20, true);
+
+    uint256 last_header;
+
+    // Filter should not be found in the index before it is started.
+    {
+        LOCK(cs_main);
+
+        BlockFilter filter;
+        uint256 filter_header;
+        std::vector<BlockFilter> filters;
+        std::vector<uint256> filter_hashes;
+
+        for (const CBlockIndex *block_index = chainActive.Genesis();
+             block_index != nullptr;
+             block_index = chainActive.Next(block_index)) {
+            BOOST_CHECK(!filter_index.LookupFilter(block_index, filter));
+            BOOST_CHECK(
+                !filter_index.LookupFilterHeader(block_index, filter_header));
+            BOOST_CHECK(!filter_index.LookupFilterRange(block_index->nHeight,
+                                                        block_index, filters));
+            BOOST_CHECK(!filter_index.LookupFilterHashRange(
+                block_index->nHeight, block_index, filter_hashes));
+        }
+    }
+
+    // BlockUntilSyncedToCurrentChain should return false before index is
+    // started.
+    BOOST_CHECK(!filter_index.BlockUntilSyncedToCurrentChain());
+
+    filter_index.Start();
+
+    // Allow filter index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!filter_index.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // Check that filter index has all blocks that were in the chain before it
+    // started.
+    {
+        LOCK(cs_main);
+        const CBlockIndex *block_index;
+        for (block_index = chainActive.Genesis(); block_index != nullptr;
+             block_index = chainActive.Next(block_index)) {
+            CheckFilterLookups(filter_index, block_index, last_header);
+        }
+
+        // The whole chain can be looked up as a range.
+        std::vector<BlockFilter> filters;
+        std::vector<uint256> filter_hashes;
+        BOOST_CHECK(
+            filter_index.LookupFilterRange(0, chainActive.Tip(), filters));
+        BOOST_CHECK(filter_index.LookupFilterHashRange(0, chainActive.Tip(),
+                                                       filter_hashes));
+        BOOST_CHECK_EQUAL(filters.size(), chainActive.Height() + 1U);
+        BOOST_CHECK_EQUAL(filter_hashes.size(), chainActive.Height() + 1U);
+        for (size_t i = 0; i < filters.size(); ++i) {
+            BOOST_CHECK(filters[i].GetBlockHash() ==
+                        chainActive[i]->GetBlockHash());
+            BOOST_CHECK(filters[i].GetHash() == filter_hashes[i]);
+        }
+
+        // Invalid ranges are rejected.
+        BOOST_CHECK(
+            !filter_index.LookupFilterRange(-1, chainActive.Tip(), filters));
+        BOOST_CHECK(!filter_index.LookupFilterRange(
+            chainActive.Height() + 1, chainActive.Tip(), filters));
+    }
+
+    // Create two forks.
+    const CBlockIndex *tip;
+    {
+        LOCK(cs_main);
+        tip = chainActive.Tip();
+    }
+    CScript coinbase_script_pub_key_A =
+        CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CScript coinbase_script_pub_key_B =
+        CScript() << OP_DUP << OP_HASH160
+                  << ToByteVector(coinbaseKey.GetPubKey().GetID())
+                  << OP_EQUALVERIFY << OP_CHECKSIG;
+    std::vector<std::shared_ptr<CBlock>> chainA, chainB;
+    BOOST_REQUIRE(BuildChain(tip, coinbase_script_pub_key_A, 10, chainA));
+    BOOST_REQUIRE(BuildChain(tip, coinbase_script_pub_key_B, 10, chainB));
+
+    // Check that new blocks on chain A get indexed.
+    uint256 chainA_last_header = last_header;
+    for (size_t i = 0; i < 2; i++) {
+        const auto &block = chainA[i];
+        BOOST_REQUIRE(ProcessNewBlock(GetConfig(), block, true, nullptr));
+    }
+    for (size_t i = 0; i < 2; i++) {
+        const auto &block = chainA[i];
+        const CBlockIndex *block_index;
+        {
+            LOCK(cs_main);
+            block_index = LookupBlockIndex(block->GetHash());
+        }
+
+        BOOST_CHECK(filter_index.BlockUntilSyncedToCurrentChain());
+        CheckFilterLookups(filter_index, block_index, chainA_last_header);
+    }
+
+    // Reorg to chain B.
+    uint256 chainB_last_header = last_header;
+    for (size_t i = 0; i < 3; i++) {
+        const auto &block = chainB[i];
+        BOOST_REQUIRE(ProcessNewBlock(GetConfig(), block, true, nullptr));
+    }
+    for (size_t i = 0; i < 3; i++) {
+        const auto &block = chainB[i];
+        const CBlockIndex *block_index;
+        {
+            LOCK(cs_main);
+            block_index = LookupBlockIndex(block->GetHash());
+        }
+
+        BOOST_CHECK(filter_index.BlockUntilSyncedToCurrentChain());
+        CheckFilterLookups(filter_index, block_index, chainB_last_header);
+    }
+
+    // The blocks of the stale chain A are no longer served, since their
+    // entries were overwritten by chain B.
+    for (size_t i = 0; i < 2; i++) {
+        const auto &block = chainA[i];
+        const CBlockIndex *block_index;
+        {
+            LOCK(cs_main);
+            block_index = LookupBlockIndex(block->GetHash());
+        }
+
+        BlockFilter filter;
+        BOOST_CHECK(!filter_index.LookupFilter(block_index, filter));
+    }
+
+    // Reorg back to chain A.
+    for (size_t i = 2; i < 4; i++) {
+        const auto &block = chainA[i];
+        BOOST_REQUIRE(ProcessNewBlock(GetConfig(), block, true, nullptr));
+    }
+
+    // Check that chain A is indexed again with the right headers.
+    chainA_last_header = last_header;
+    for (size_t i = 0; i < 4; i++) {
+        const auto &block = chainA[i];
+        const CBlockIndex *block_index;
+        {
+            LOCK(cs_main);
+            block_index = LookupBlockIndex(block->GetHash());
+        }
+
+        BOOST_CHECK(filter_index.BlockUntilSyncedToCurrentChain());
+        CheckFilterLookups(filter_index, block_index, chainA_last_header);
+    }
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    filter_index.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_FIXTURE_TEST_CASE(blockfilterindex_init_destroy, BasicTestingSetup) {
+    SetDataDir("tempdir");
+
+    BlockFilterIndex *filter_index;
+
+    filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+    BOOST_CHECK(filter_index == nullptr);
+
+    BOOST_CHECK(
+        InitBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, true, false));
+
+    filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+    BOOST_CHECK(filter_index != nullptr);
+    BOOST_CHECK(filter_index->GetFilterType() == BlockFilterType::BASIC);
+
+    // Initialize returns false if index already exists.
+    BOOST_CHECK(
+        !InitBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, true, false));
+
+    int iter_count = 0;
+    ForEachBlockFilterIndex(
+        [&iter_count](BlockFilterIndex &_index) { iter_count++; });
+    BOOST_CHECK_EQUAL(iter_count, 1);
+
+    BOOST_CHECK(DestroyBlockFilterIndex(BlockFilterType::BASIC));
+
+    // Destroy returns false because index was already destroyed.
+    BOOST_CHECK(!DestroyBlockFilterIndex(BlockFilterType::BASIC));
+
+    filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+    BOOST_CHECK(filter_index == nullptr);
+
+    // Reinitialize index.
+    BOOST_CHECK(
+        InitBlockFilterIndex(BlockFilterType::BASIC, 1 << 20, true, false));
+
+    DestroyAllBlockFilterIndexes();
+
+    filter_index = GetBlockFilterIndex(BlockFilterType::BASIC);
+    BOOST_CHECK(filter_index == nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
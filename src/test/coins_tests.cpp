@@ -16,7 +16,9 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <atomic>
 #include <map>
+#include <thread>
 #include <vector>
 
 namespace {
@@ -909,4 +911,240 @@ BOOST_AUTO_TEST_CASE(coin_write) {
     }
 }
 
+// Randomized simulation of a CCoinsViewCache stacked on a
+// CCoinsViewShardedCache, itself on top of CCoinsViewTest. The sharded cache
+// must behave like a regular cache layer.
+BOOST_AUTO_TEST_CASE(sharded_cache_simulation_test) {
+    std::map<COutPoint, Coin> result;
+
+    CCoinsViewTest base;
+    CCoinsViewShardedCache sharded(&base, 4);
+    auto child = std::make_unique<CCoinsViewCacheTest>(&sharded);
+
+    std::vector<TxId> txids;
+    txids.resize(NUM_SIMULATION_ITERATIONS / 8);
+    for (size_t i = 0; i < txids.size(); i++) {
+        txids[i] = TxId(InsecureRand256());
+    }
+
+    for (unsigned int i = 0; i < NUM_SIMULATION_ITERATIONS / 4; i++) {
+        const COutPoint outpoint(txids[InsecureRandRange(txids.size())], 0);
+        Coin &coin = result[outpoint];
+
+        // Modifications are done either through the child cache or directly
+        // on the sharded cache.
+        const bool direct = InsecureRandBool();
+        if (direct) {
+            child->Flush();
+        }
+
+        if (InsecureRandRange(5) == 0 || coin.IsSpent()) {
+            CTxOut txout;
+            txout.nValue = int64_t(InsecureRand32()) * SATOSHI;
+            txout.scriptPubKey.assign(InsecureRandBits(6), 0);
+            const bool overwrite = !coin.IsSpent() || InsecureRand32() & 1;
+            coin = Coin(txout, 1, false);
+            if (direct) {
+                sharded.AddCoin(outpoint, coin, overwrite);
+            } else {
+                child->AddCoin(outpoint, coin, overwrite);
+            }
+        } else {
+            coin.Clear();
+            if (direct) {
+                BOOST_CHECK(sharded.SpendCoin(outpoint));
+            } else {
+                BOOST_CHECK(child->SpendCoin(outpoint));
+            }
+        }
+
+        if (InsecureRandRange(10) == 0) {
+            sharded.Uncache(
+                COutPoint(txids[InsecureRandRange(txids.size())], 0));
+        }
+
+        if (InsecureRandRange(100) == 0) {
+            child->Flush();
+            if (InsecureRandBool()) {
+                sharded.SetBestBlock(BlockHash(InsecureRand256()));
+                BOOST_CHECK(sharded.Flush());
+                BOOST_CHECK_EQUAL(sharded.GetCacheSize(), 0U);
+                BOOST_CHECK(base.GetBestBlock() == sharded.GetBestBlock());
+            }
+        }
+    }
+
+    child->Flush();
+    for (const auto &entry : result) {
+        Coin coin;
+        const bool have = sharded.GetCoin(entry.first, coin);
+        BOOST_CHECK(have == sharded.HaveCoin(entry.first));
+        BOOST_CHECK(have == !entry.second.IsSpent());
+        BOOST_CHECK(!have || coin == entry.second);
+    }
+    BOOST_CHECK(sharded.DynamicMemoryUsage() > 0);
+
+    sharded.SetBestBlock(BlockHash(InsecureRand256()));
+    BOOST_CHECK(sharded.Flush());
+    for (const auto &entry : result) {
+        Coin coin;
+        const bool have = base.GetCoin(entry.first, coin);
+        BOOST_CHECK(!have || coin == entry.second);
+        BOOST_CHECK(have || entry.second.IsSpent());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sharded_cache_concurrency_test) {
+    CCoinsView base;
+    CCoinsViewShardedCache sharded(&base);
+
+    std::vector<COutPoint> outpoints;
+    for (uint32_t i = 0; i < 1000; i++) {
+        outpoints.emplace_back(TxId(InsecureRand256()), i);
+        CTxOut txout(int64_t(i) * SATOSHI, CScript() << OP_TRUE);
+        sharded.AddCoin(outpoints.back(), Coin(txout, i, false), false);
+    }
+
+    // Readers only ever see coins with the value they were created with, while
+    // every other coin is being spent concurrently.
+    std::atomic<bool> ok{true};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&] {
+            for (int round = 0; round < 10; round++) {
+                for (const COutPoint &outpoint : outpoints) {
+                    Coin coin;
+                    if (sharded.GetCoin(outpoint, coin) &&
+                        coin.GetTxOut().nValue !=
+                            int64_t(outpoint.GetN()) * SATOSHI) {
+                        ok = false;
+                    }
+                }
+            }
+        });
+    }
+
+    for (size_t i = 0; i < outpoints.size(); i += 2) {
+        BOOST_CHECK(sharded.SpendCoin(outpoints[i]));
+    }
+
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+
+    BOOST_CHECK(ok);
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        BOOST_CHECK_EQUAL(sharded.HaveCoin(outpoints[i]), i % 2 == 1);
+    }
+    BOOST_CHECK_EQUAL(sharded.GetCacheSize(), outpoints.size() / 2);
+}
+
+namespace {
+//! Coins view over a map, which several threads can read from at once.
+class CCoinsViewMap : public CCoinsView {
+    BlockHash hashBestBlock_;
+    std::map<COutPoint, Coin> map_;
+
+public:
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override {
+        auto it = map_.find(outpoint);
+        if (it == map_.end()) {
+            return false;
+        }
+        coin = it->second;
+        return true;
+    }
+
+    BlockHash GetBestBlock() const override { return hashBestBlock_; }
+
+    bool BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) override {
+        for (auto it = mapCoins.begin(); it != mapCoins.end();
+             it = mapCoins.erase(it)) {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY)) {
+                continue;
+            }
+            if (it->second.coin.IsSpent()) {
+                map_.erase(it->first);
+            } else {
+                map_[it->first] = it->second.coin;
+            }
+        }
+        hashBestBlock_ = hashBlock;
+        return true;
+    }
+};
+} // namespace
+
+BOOST_AUTO_TEST_CASE(sharded_cache_guarded_read_test) {
+    CCoinsViewMap base;
+    CCoinsViewShardedCache sharded(&base);
+
+    // Each block spends the outputs created by the previous one and creates
+    // as many new ones.
+    static const int NUM_BLOCKS = 200;
+    static const uint32_t NUM_OUTPUTS = 20;
+    std::vector<TxId> txids;
+    std::map<BlockHash, int> heights;
+    std::vector<BlockHash> hashes;
+    for (int i = 0; i < NUM_BLOCKS; i++) {
+        txids.emplace_back(InsecureRand256());
+        hashes.emplace_back(InsecureRand256());
+        heights.emplace(hashes.back(), i);
+    }
+
+    auto connect = [&](int height) {
+        CCoinsViewCache view(&sharded);
+        for (uint32_t n = 0; n < NUM_OUTPUTS; n++) {
+            if (height > 0) {
+                BOOST_CHECK(view.SpendCoin(COutPoint(txids[height - 1], n)));
+            }
+            CTxOut txout(int64_t(n + 1) * SATOSHI, CScript() << OP_TRUE);
+            view.AddCoin(COutPoint(txids[height], n),
+                         Coin(txout, height, false), false);
+        }
+        view.SetBestBlock(hashes[height]);
+        view.Flush();
+    };
+    connect(0);
+
+    // Readers holding a ReadGuard see the coins of the block they are told is
+    // the best one, while blocks are connected and the cache is flushed.
+    std::atomic<bool> done{false};
+    std::atomic<bool> ok{true};
+    std::atomic<int> reads{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&] {
+            while (!done) {
+                CCoinsViewShardedCache::ReadGuard guard(sharded);
+                const int height = heights.at(sharded.GetBestBlock());
+                for (uint32_t n = 0; n < NUM_OUTPUTS; n++) {
+                    if (!sharded.HaveCoin(COutPoint(txids[height], n)) ||
+                        (height > 0 &&
+                         sharded.HaveCoin(COutPoint(txids[height - 1], n)))) {
+                        ok = false;
+                    }
+                }
+                reads++;
+            }
+        });
+    }
+
+    for (int height = 1; height < NUM_BLOCKS; height++) {
+        connect(height);
+        if (height % 3 == 0) {
+            BOOST_CHECK(sharded.Flush());
+        }
+    }
+    done = true;
+    for (std::thread &reader : readers) {
+        reader.join();
+    }
+
+    BOOST_CHECK(ok);
+    BOOST_CHECK(reads > 0);
+    BOOST_CHECK(sharded.Flush());
+    BOOST_CHECK(base.GetBestBlock() == hashes.back());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
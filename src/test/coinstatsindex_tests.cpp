@@ -0,0 +1,135 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/coinstatsindex.h>
+
+#include <chain.h>
+#include <coins.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <script/sighashtype.h>
+#include <script/standard.h>
+#include <txdb.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+
+BOOST_AUTO_TEST_SUITE(coinstatsindex_tests)
+
+/**
+ * Check the indexed statistics as of the tip against a scan of the coins
+ * database.
+ */
+static void CheckTipStats(const CoinStatsIndex &index) {
+    FlushStateToDisk();
+
+    uint64_t nTransactionOutputs = 0;
+    Amount nTotalAmount = Amount::zero();
+    CUtxoCommit commitment;
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    while (pcursor->Valid()) {
+        COutPoint outpoint;
+        Coin coin;
+        BOOST_REQUIRE(pcursor->GetKey(outpoint) && pcursor->GetValue(coin));
+        nTransactionOutputs++;
+        nTotalAmount += coin.GetTxOut().nValue;
+        commitment.Add(outpoint, coin);
+        pcursor->Next();
+    }
+
+    BlockCoinStats stats;
+    BOOST_REQUIRE(index.LookUpStats(chainActive.Tip(), stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, nTransactionOutputs);
+    BOOST_CHECK_EQUAL(stats.nTotalAmount, nTotalAmount);
+    BOOST_CHECK(stats.commitment == commitment);
+}
+
+BOOST_FIXTURE_TEST_CASE(coinstatsindex_initial_sync, TestChain100Setup) {
+    CoinStatsIndex coinstatsindex(1 << 20, true);
+
+    BlockCoinStats stats;
+    BOOST_CHECK(!coinstatsindex.LookUpStats(chainActive.Tip(), stats));
+    BOOST_CHECK(!coinstatsindex.BlockUntilSyncedToCurrentChain());
+
+    coinstatsindex.Start();
+
+    // Allow the index to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!coinstatsindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    // The genesis block doesn't add to the UTXO set.
+    BOOST_CHECK(coinstatsindex.LookUpStats(chainActive.Genesis(), stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, 0U);
+    BOOST_CHECK(stats.commitment == CUtxoCommit());
+    BOOST_CHECK_EQUAL(stats.nBlockOutputs, 1U);
+
+    // Every coinbase of the chain is unspent.
+    BOOST_CHECK(coinstatsindex.LookUpStats(chainActive.Tip(), stats));
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs, m_coinbase_txns.size());
+    CheckTipStats(coinstatsindex);
+
+    // Spend a coinbase in a new block.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetId(), 0);
+    spend.vout.resize(2);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    spend.vout[1].nValue = 22 * CENT;
+    spend.vout[1].scriptPubKey = scriptPubKey;
+
+    std::vector<uint8_t> vchSig;
+    uint256 sighash = SignatureHash(scriptPubKey, CTransaction(spend), 0,
+                                    SigHashType().withForkId(),
+                                    m_coinbase_txns[0]->vout[0].nValue);
+    BOOST_CHECK(coinbaseKey.SignECDSA(sighash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    spend.vin[0].scriptSig << vchSig;
+
+    BlockCoinStats prev_stats;
+    BOOST_CHECK(coinstatsindex.LookUpStats(chainActive.Tip(), prev_stats));
+
+    const CBlock block = CreateAndProcessBlock({spend}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK(coinstatsindex.BlockUntilSyncedToCurrentChain());
+
+    BOOST_CHECK(coinstatsindex.LookUpStats(chainActive.Tip(), stats));
+    BOOST_CHECK_EQUAL(stats.nBlockInputs, 1U);
+    BOOST_CHECK_EQUAL(stats.nBlockOutputs, 3U);
+    BOOST_CHECK_EQUAL(stats.nBlockTotalOut, 33 * CENT);
+    BOOST_CHECK_EQUAL(stats.nBlockTotalFee,
+                      m_coinbase_txns[0]->vout[0].nValue - 33 * CENT);
+    // One coin spent, one coinbase and two outputs created.
+    BOOST_CHECK_EQUAL(stats.nTransactionOutputs,
+                      prev_stats.nTransactionOutputs + 2);
+    CheckTipStats(coinstatsindex);
+
+    // The statistics as of the previous blocks are still available.
+    BlockCoinStats old_stats;
+    BOOST_CHECK(coinstatsindex.LookUpStats(chainActive.Tip()->pprev,
+                                           old_stats));
+    BOOST_CHECK(old_stats.commitment == prev_stats.commitment);
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    coinstatsindex.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
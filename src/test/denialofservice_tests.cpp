@@ -14,6 +14,7 @@
 #include <pow.h>
 #include <script/sign.h>
 #include <serialize.h>
+#include <txorphanpool.h>
 #include <util/system.h>
 #include <validation.h>
 
@@ -22,6 +23,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <cstdint>
+#include <limits>
 
 struct CConnmanTest : public CConnman {
     using CConnman::CConnman;
@@ -41,16 +43,11 @@ struct CConnmanTest : public CConnman {
 // Tests these internal-to-net_processing.cpp methods:
 extern bool AddOrphanTx(const CTransactionRef &tx, NodeId peer);
 extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans,
+                                      uint64_t nMaxOrphansSize);
 
-struct COrphanTx {
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
 extern CCriticalSection g_cs_orphans;
-extern std::map<uint256, COrphanTx>
-    mapOrphanTransactions GUARDED_BY(g_cs_orphans);
+extern COrphanTxPool g_orphans GUARDED_BY(g_cs_orphans);
 
 static CService ip(uint32_t i) {
     struct in_addr s;
@@ -392,14 +389,10 @@ BOOST_AUTO_TEST_CASE(DoS_bantime) {
     peerLogic->FinalizeNode(config, dummyNode.GetId(), dummy);
 }
 
+static std::vector<CTransactionRef> vOrphans;
+
 static CTransactionRef RandomOrphan() {
-    std::map<uint256, COrphanTx>::iterator it;
-    LOCK2(cs_main, g_cs_orphans);
-    it = mapOrphanTransactions.lower_bound(InsecureRand256());
-    if (it == mapOrphanTransactions.end()) {
-        it = mapOrphanTransactions.begin();
-    }
-    return it->second.tx;
+    return vOrphans[InsecureRandRange(vOrphans.size())];
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
@@ -419,7 +412,9 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
         tx.vout[0].scriptPubKey =
             GetScriptForDestination(key.GetPubKey().GetID());
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        LOCK(g_cs_orphans);
+        vOrphans.push_back(MakeTransactionRef(tx));
+        AddOrphanTx(vOrphans.back(), i);
     }
 
     // ... and 50 that depend on other orphans:
@@ -435,7 +430,9 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
             GetScriptForDestination(key.GetPubKey().GetID());
         SignSignature(keystore, *txPrev, tx, 0, SigHashType());
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        LOCK(g_cs_orphans);
+        vOrphans.push_back(MakeTransactionRef(tx));
+        AddOrphanTx(vOrphans.back(), i);
     }
 
     // This really-big orphan should be ignored:
@@ -458,24 +455,84 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
         }
 
+        LOCK(g_cs_orphans);
         BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
     }
 
     LOCK2(cs_main, g_cs_orphans);
     // Test EraseOrphansFor:
     for (NodeId i = 0; i < 3; i++) {
-        size_t sizeBefore = mapOrphanTransactions.size();
+        size_t sizeBefore = g_orphans.Size();
         EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
+        BOOST_CHECK(g_orphans.Size() < sizeBefore);
+        BOOST_CHECK_EQUAL(g_orphans.PeerTxCount(i), 0);
     }
 
     // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
+    const uint64_t nMaxSize = std::numeric_limits<uint64_t>::max();
+    LimitOrphanTxSize(40, nMaxSize);
+    BOOST_CHECK(g_orphans.Size() <= 40);
+    LimitOrphanTxSize(10, nMaxSize);
+    BOOST_CHECK(g_orphans.Size() <= 10);
+    LimitOrphanTxSize(0, nMaxSize);
+    BOOST_CHECK_EQUAL(g_orphans.Size(), 0);
+    BOOST_CHECK_EQUAL(g_orphans.TotalTxSize(), 0);
+    vOrphans.clear();
+}
+
+BOOST_AUTO_TEST_CASE(DoS_orphan_limits) {
+    COrphanTxPool pool;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1 * CENT;
+
+    // Peer 0 sends 20 orphans, and peers 1 to 3 send 5 orphans each.
+    std::vector<CTransactionRef> vPeer0Txs;
+    for (int i = 0; i < 35; i++) {
+        tx.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 0);
+        CTransactionRef ptx = MakeTransactionRef(tx);
+        const NodeId peer = i < 20 ? 0 : 1 + i % 3;
+        BOOST_CHECK(pool.AddTx(ptx, peer, i));
+        BOOST_CHECK(!pool.AddTx(ptx, peer, i));
+        if (peer == 0) {
+            vPeer0Txs.push_back(ptx);
+        }
+    }
+    const size_t nTxSize = vPeer0Txs[0]->GetTotalSize();
+    BOOST_CHECK_EQUAL(pool.Size(), 35);
+    BOOST_CHECK_EQUAL(pool.TotalTxSize(), 35 * nTxSize);
+    BOOST_CHECK_EQUAL(pool.GetChildren(vPeer0Txs[0]->vin[0].prevout).size(), 1);
+
+    // Peer 0 is limited to a quarter of the pool, its oldest orphans go.
+    BOOST_CHECK_EQUAL(pool.LimitOrphans(40, 1000 * nTxSize), 10);
+    BOOST_CHECK_EQUAL(pool.PeerTxCount(0), 10);
+    for (size_t i = 0; i < vPeer0Txs.size(); i++) {
+        BOOST_CHECK_EQUAL(pool.HaveTx(vPeer0Txs[i]->GetId()), i >= 10);
+    }
+    BOOST_CHECK(pool.GetChildren(vPeer0Txs[0]->vin[0].prevout).empty());
+
+    // The size limit applies the same way.
+    BOOST_CHECK_EQUAL(pool.LimitOrphans(40, 20 * nTxSize), 5);
+    BOOST_CHECK_EQUAL(pool.PeerTxSize(0), 5 * nTxSize);
+    BOOST_CHECK_EQUAL(pool.TotalTxSize(), 20 * nTxSize);
+
+    // Then the peers holding the most are evicted from first.
+    BOOST_CHECK_EQUAL(pool.LimitOrphans(16, 1000 * nTxSize), 4);
+    for (NodeId peer = 0; peer < 4; peer++) {
+        BOOST_CHECK_EQUAL(pool.PeerTxCount(peer), 4);
+    }
+
+    BOOST_CHECK_EQUAL(pool.EraseForPeer(0), 4);
+    BOOST_CHECK_EQUAL(pool.PeerTxCount(0), 0);
+    // Peers 3 and 1 sent the orphans expiring at 23 and 24.
+    BOOST_CHECK_EQUAL(pool.EraseExpired(24), 2);
+    BOOST_CHECK_EQUAL(pool.PeerTxCount(1), 3);
+    BOOST_CHECK_EQUAL(pool.PeerTxCount(3), 3);
+    BOOST_CHECK_EQUAL(pool.EraseTx(vPeer0Txs[0]->GetId()), 0);
+    BOOST_CHECK_EQUAL(pool.EraseTx(vPeer0Txs[19]->GetId()), 0);
+    BOOST_CHECK_EQUAL(pool.Size(), 10);
+    BOOST_CHECK_EQUAL(pool.TotalTxSize(), 10 * nTxSize);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -130,4 +130,92 @@ BOOST_AUTO_TEST_CASE(flatfile_flush) {
     BOOST_CHECK_EQUAL(fs::file_size(seq.FileName(FlatFilePos(0, 1))), 1);
 }
 
+BOOST_AUTO_TEST_CASE(flatfile_map) {
+    auto data_dir = SetDataDir("flatfile_test");
+    FlatFileSeq seq(data_dir, "a", 100);
+
+    std::string line1("It takes advantage of the nature of information being "
+                      "easy to spread but hard to stifle.");
+    std::string line2("The proof-of-work chain is a solution to the Byzantine "
+                      "Generals' Problem.");
+
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, 0)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line1, 256);
+    }
+    const size_t size1 = fs::file_size(seq.FileName(FlatFilePos(0, 0)));
+
+    // Missing and empty files are not mapped.
+    BOOST_CHECK(!MappedFlatFile::Open(seq.FileName(FlatFilePos(1, 0))));
+
+    if (!MappedFlatFile::IsSupported()) {
+        BOOST_CHECK(!MappedFlatFile::Open(seq.FileName(FlatFilePos(0, 0))));
+        return;
+    }
+
+    FlatFileMapCache cache(1, size1 * 4);
+    std::shared_ptr<const MappedFlatFile> mapped = cache.Get(seq, 0, 0);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK_EQUAL(mapped->size(), size1);
+    {
+        std::string text;
+        SpanReader(SER_DISK, CLIENT_VERSION,
+                   Span<const uint8_t>(mapped->data(), mapped->size())) >>
+            LIMITED_STRING(text, 256);
+        BOOST_CHECK_EQUAL(text, line1);
+    }
+
+    // The cached mapping is returned while it is long enough.
+    BOOST_CHECK(cache.Get(seq, 0, size1) == mapped);
+    BOOST_CHECK(!cache.Get(seq, 0, size1 + 1));
+
+    // Once the file grows, it is mapped again.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(0, size1)), SER_DISK,
+                       CLIENT_VERSION);
+        file << LIMITED_STRING(line2, 256);
+    }
+    const size_t size2 = fs::file_size(seq.FileName(FlatFilePos(0, 0)));
+    std::shared_ptr<const MappedFlatFile> remapped =
+        cache.Get(seq, 0, size2);
+    BOOST_REQUIRE(remapped);
+    BOOST_CHECK(remapped != mapped);
+    BOOST_CHECK_EQUAL(remapped->size(), size2);
+    {
+        std::string text;
+        SpanReader(SER_DISK, CLIENT_VERSION,
+                   Span<const uint8_t>(remapped->data() + size1,
+                                       remapped->size() - size1)) >>
+            LIMITED_STRING(text, 256);
+        BOOST_CHECK_EQUAL(text, line2);
+    }
+
+    // The previous mapping is still valid while it is held.
+    BOOST_CHECK_EQUAL(mapped->size(), size1);
+    BOOST_CHECK(std::equal(mapped->data(), mapped->data() + size1,
+                           remapped->data()));
+
+    // Only the most recently used file stays mapped.
+    {
+        CAutoFile file(seq.Open(FlatFilePos(1, 0)), SER_DISK, CLIENT_VERSION);
+        file << LIMITED_STRING(line2, 256);
+    }
+    BOOST_CHECK(cache.Get(seq, 1, 0));
+    BOOST_CHECK(cache.Get(seq, 0, 0) != remapped);
+
+    cache.Erase(0);
+    cache.Clear();
+
+    // The least recently used files are unmapped beyond the byte limit, and
+    // files larger than it are not mapped.
+    FlatFileMapCache small_cache(2, size2 + 1);
+    mapped = small_cache.Get(seq, 0, 0);
+    BOOST_REQUIRE(mapped);
+    BOOST_CHECK(small_cache.Get(seq, 1, 0));
+    BOOST_CHECK(small_cache.Get(seq, 0, 0) != mapped);
+    FlatFileMapCache tiny_cache(2, size1);
+    BOOST_CHECK(!tiny_cache.Get(seq, 0, 0));
+    BOOST_CHECK(tiny_cache.Get(seq, 1, 0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,165 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <graphene.h>
+
+#include <config.h>
+#include <consensus/merkle.h>
+#include <random.h>
+#include <streams.h>
+#include <txmempool.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+
+BOOST_FIXTURE_TEST_SUITE(graphene_tests, TestingSetup)
+
+static CTransactionRef MakeRandomTx() {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(TxId(InsecureRand256()), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42 * SATOSHI;
+    return MakeTransactionRef(tx);
+}
+
+static CBlock BuildBlock(size_t nTxs) {
+    CBlock block;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].scriptSig.resize(10);
+    coinbase.vout.resize(1);
+    coinbase.vout[0].nValue = 42 * SATOSHI;
+    block.vtx.push_back(MakeTransactionRef(coinbase));
+    for (size_t i = 0; i < nTxs; i++) {
+        block.vtx.push_back(MakeRandomTx());
+    }
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+    block.nVersion = 42;
+    block.hashPrevBlock = BlockHash(InsecureRand256());
+    block.nBits = 0x207fffff;
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(iblt_list_entries) {
+    CIblt iblt(10);
+    std::set<uint64_t> positive, negative;
+
+    // Keys both inserted and erased cancel out.
+    for (uint64_t i = 0; i < 1000; i++) {
+        iblt.Insert(i);
+        iblt.Erase(i);
+    }
+    BOOST_CHECK(iblt.ListEntries(positive, negative));
+    BOOST_CHECK(positive.empty() && negative.empty());
+
+    for (uint64_t i = 1000; i < 1005; i++) {
+        iblt.Insert(i);
+    }
+    for (uint64_t i = 2000; i < 2005; i++) {
+        iblt.Erase(i);
+    }
+    BOOST_CHECK(iblt.ListEntries(positive, negative));
+    BOOST_CHECK(positive == std::set<uint64_t>({1000, 1001, 1002, 1003, 1004}));
+    BOOST_CHECK(negative == std::set<uint64_t>({2000, 2001, 2002, 2003, 2004}));
+
+    // Too many differences for the table.
+    for (uint64_t i = 3000; i < 3100; i++) {
+        iblt.Insert(i);
+    }
+    positive.clear();
+    negative.clear();
+    BOOST_CHECK(!iblt.ListEntries(positive, negative));
+
+    // Serialization round trip.
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << iblt;
+    CIblt iblt2;
+    stream >> iblt2;
+    BOOST_CHECK_EQUAL(iblt2.CellCount(), iblt.CellCount());
+}
+
+BOOST_AUTO_TEST_CASE(filter_contains) {
+    CGrapheneFilter filter(100, 0.01);
+    std::vector<uint64_t> keys;
+    for (int i = 0; i < 100; i++) {
+        keys.push_back(InsecureRandBits(64));
+        filter.Insert(keys.back());
+    }
+    for (const uint64_t key : keys) {
+        BOOST_CHECK(filter.Contains(key));
+    }
+
+    // About 1% of other keys match.
+    int nFalsePositives = 0;
+    for (int i = 0; i < 10000; i++) {
+        nFalsePositives += filter.Contains(InsecureRandBits(64));
+    }
+    BOOST_CHECK_LT(nFalsePositives, 300);
+
+    // The default filter matches everything.
+    BOOST_CHECK(CGrapheneFilter().Contains(InsecureRandBits(64)));
+}
+
+BOOST_AUTO_TEST_CASE(graphene_block_round_trip) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CBlock block = BuildBlock(200);
+
+    LOCK2(cs_main, pool.cs);
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        pool.addUnchecked(entry.FromTx(block.vtx[i]));
+    }
+    for (size_t i = 0; i < 1000; i++) {
+        pool.addUnchecked(entry.FromTx(MakeRandomTx()));
+    }
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << CGrapheneBlock(block, pool.size());
+    // Much smaller than the 6 bytes per transaction of compact blocks.
+    BOOST_CHECK_LT(stream.size(), 6 * block.vtx.size());
+
+    CGrapheneBlock grblk;
+    stream >> grblk;
+    CBlock block2;
+    BOOST_CHECK(DecodeGrapheneBlock(GetConfig(), grblk, pool, block2) ==
+                READ_STATUS_OK);
+    BOOST_CHECK(block2.GetHash() == block.GetHash());
+    BOOST_CHECK(block2.vtx.size() == block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK(block2.vtx[i]->GetId() == block.vtx[i]->GetId());
+    }
+
+    // Missing transactions cannot be recovered.
+    pool.removeRecursive(*block.vtx[1]);
+    BOOST_CHECK(DecodeGrapheneBlock(GetConfig(), grblk, pool, block2) ==
+                READ_STATUS_FAILED);
+
+    // Nor a block which is not in canonical order.
+    std::swap(block.vtx[1], block.vtx[2]);
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    pool.addUnchecked(entry.FromTx(block.vtx[2]));
+    BOOST_CHECK(DecodeGrapheneBlock(GetConfig(),
+                                    CGrapheneBlock(block, pool.size()), pool,
+                                    block2) == READ_STATUS_FAILED);
+
+    // Blocks without a coinbase are invalid.
+    block.vtx[0] = block.vtx[1];
+    BOOST_CHECK(DecodeGrapheneBlock(GetConfig(),
+                                    CGrapheneBlock(block, pool.size()), pool,
+                                    block2) == READ_STATUS_INVALID);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -227,6 +227,92 @@ static void TestPackageSelection(const CChainParams &chainparams,
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetId() == lowFeeTxId2);
 }
 
+// Test suite for the incremental transaction selection, reusing the blockchain
+// created in CreateNewBlock_validity.
+static void
+TestIncrementalSelection(const CChainParams &chainparams,
+                         const CScript &scriptPubKey,
+                         const std::vector<CTransactionRef> &txFirst)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main, ::g_mempool.cs) {
+    TestMemPoolEntryHelper entry;
+    IncrementalBlockTemplate incremental(g_mempool);
+    BlockAssembler::Options options;
+    options.blockMinFeeRate = blockMinFeeRate;
+    options.incrementalTemplate = &incremental;
+    auto templateHas = [&](const TxId &txid) {
+        std::unique_ptr<CBlockTemplate> pblocktemplate =
+            BlockAssembler(chainparams, g_mempool, options)
+                .CreateNewBlock(scriptPubKey);
+        for (const auto &txn : pblocktemplate->block.vtx) {
+            if (txn->GetId() == txid) {
+                return true;
+            }
+        }
+        return false;
+    };
+
+    int64_t nTime = GetTime();
+    SetMockTime(nTime);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout = COutPoint(txFirst[0]->GetId(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = int64_t(5000000000LL - 10000) * SATOSHI;
+    TxId parentTxId = tx.GetId();
+    g_mempool.addUnchecked(entry.Fee(10000 * SATOSHI)
+                               .Time(GetTime())
+                               .SpendsCoinbase(true)
+                               .FromTx(tx));
+    BOOST_CHECK(templateHas(parentTxId));
+
+    // A child of a selected transaction is appended.
+    tx.vin[0].prevout = COutPoint(parentTxId, 0);
+    tx.vout[0].nValue = int64_t(5000000000LL - 20000) * SATOSHI;
+    TxId childTxId = tx.GetId();
+    g_mempool.addUnchecked(entry.Fee(10000 * SATOSHI).FromTx(tx));
+    BOOST_CHECK(templateHas(childTxId));
+
+    // A free transaction is not appended, and neither is its child which pays
+    // for both, as appending never pulls in transactions left out.
+    tx.vin[0].prevout = COutPoint(txFirst[1]->GetId(), 0);
+    tx.vout[0].nValue = int64_t(5000000000LL) * SATOSHI;
+    TxId freeTxId = tx.GetId();
+    g_mempool.addUnchecked(
+        entry.Fee(Amount::zero()).SpendsCoinbase(true).FromTx(tx));
+    BOOST_CHECK(!templateHas(freeTxId));
+
+    tx.vin[0].prevout = COutPoint(freeTxId, 0);
+    tx.vout[0].nValue = int64_t(5000000000LL - 50000) * SATOSHI;
+    TxId cpfpTxId = tx.GetId();
+    g_mempool.addUnchecked(
+        entry.Fee(50000 * SATOSHI).SpendsCoinbase(false).FromTx(tx));
+    BOOST_CHECK(!templateHas(cpfpTxId));
+    BOOST_CHECK_EQUAL(AssemblerForTest(chainparams, g_mempool)
+                          .CreateNewBlock(scriptPubKey)
+                          ->block.vtx.size(),
+                      5UL);
+
+    // Once the rebuild interval elapsed, the transactions are selected again
+    // from the whole mempool.
+    SetMockTime(nTime + BLOCK_TEMPLATE_REBUILD_INTERVAL);
+    BOOST_CHECK(templateHas(freeTxId));
+    BOOST_CHECK(templateHas(cpfpTxId));
+
+    // Transactions leaving the mempool leave the selection.
+    g_mempool.removeRecursive(*g_mempool.get(parentTxId));
+    BOOST_CHECK(!templateHas(parentTxId));
+    BOOST_CHECK(!templateHas(childTxId));
+    BOOST_CHECK(templateHas(cpfpTxId));
+
+    // So do the ones cleared without notification.
+    g_mempool.clear();
+    BOOST_CHECK(!templateHas(cpfpTxId));
+
+    SetMockTime(0);
+}
+
 void TestCoinbaseMessageEB(uint64_t eb, std::string cbmsg) {
     GlobalConfig config;
     config.SetMaxBlockSize(eb);
@@ -713,6 +799,9 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity) {
 
     TestPackageSelection(chainparams, scriptPubKey, txFirst);
 
+    g_mempool.clear();
+    TestIncrementalSelection(chainparams, scriptPubKey, txFirst);
+
     fCheckpointsEnabled = true;
 }
 
@@ -10,6 +10,7 @@
 #include <config.h>
 #include <hash.h>
 #include <netbase.h>
+#include <netmessagemaker.h>
 #include <serialize.h>
 #include <streams.h>
 
@@ -19,6 +20,20 @@
 
 #include <memory>
 #include <string>
+#include <thread>
+#include <vector>
+
+#ifndef WIN32
+#include <sys/socket.h>
+#endif
+
+struct CConnmanTest : public CConnman {
+    using CConnman::CConnman;
+    size_t SocketSendData(CNode *pnode) {
+        LOCK(pnode->cs_vSend);
+        return CConnman::SocketSendData(pnode);
+    }
+};
 
 class CAddrManSerializationMock : public CAddrMan {
 public:
@@ -340,4 +355,168 @@ BOOST_AUTO_TEST_CASE(ipv4_peer_with_ipv6_addrMe_test) {
     BOOST_CHECK(1);
 }
 
+BOOST_AUTO_TEST_CASE(shared_payload) {
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    const std::vector<uint256> hashes{InsecureRand256(), InsecureRand256()};
+
+    CSerializedNetMsg msg = msgMaker.Make(NetMsgType::INV, hashes);
+    std::shared_ptr<const CSharedNetMsgPayload> payload =
+        msgMaker.MakePayload(0, hashes);
+    BOOST_CHECK(payload->data == msg.data);
+    BOOST_CHECK(payload->hash == Hash(msg.data.begin(), msg.data.end()));
+
+    CSerializedNetMsg shared = msgMaker.MakeShared(NetMsgType::INV, payload);
+    BOOST_CHECK_EQUAL(shared.command, NetMsgType::INV);
+    BOOST_CHECK(shared.data.empty());
+    BOOST_CHECK(shared.shared_payload == payload);
+
+    CSendBuffer buffer(payload);
+    BOOST_CHECK(buffer.data() == payload->data.data());
+    BOOST_CHECK_EQUAL(buffer.size(), payload->data.size());
+}
+
+BOOST_AUTO_TEST_CASE(net_message_buffer_pool) {
+    CNetMessageBufferPool pool;
+
+    // Sizes are rounded up to their size class.
+    CNetMessageBufferPool::Buffer buffer = pool.Get(1000);
+    BOOST_CHECK(buffer.empty());
+    BOOST_CHECK_EQUAL(buffer.capacity(), 1024U);
+    BOOST_CHECK_EQUAL(pool.GetStats().nMisses, 1U);
+
+    buffer.resize(1000);
+    pool.Release(std::move(buffer));
+    CNetMessageBufferPool::Stats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBuffers, 1U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 1024U);
+
+    // A size of the same class reuses the buffer.
+    buffer = pool.Get(513);
+    BOOST_CHECK(buffer.empty());
+    BOOST_CHECK_EQUAL(buffer.capacity(), 1024U);
+    stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nBuffers, 0U);
+    BOOST_CHECK_EQUAL(stats.nBytes, 0U);
+
+    // Larger sizes get a buffer of the largest class, which is not pooled
+    // anymore once it has grown past it.
+    const size_t nMaxClassSize = size_t(1)
+                                 << CNetMessageBufferPool::MAX_CLASS_BITS;
+    buffer = pool.Get(4 * nMaxClassSize);
+    BOOST_CHECK_EQUAL(buffer.capacity(), nMaxClassSize);
+    buffer.resize(4 * nMaxClassSize);
+    pool.Release(std::move(buffer));
+    BOOST_CHECK_EQUAL(pool.GetStats().nBuffers, 0U);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(send_short_writes) {
+    CConnmanTest connman(GetConfig(), 0x1337, 0x1337);
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    int fd[2];
+    BOOST_REQUIRE_EQUAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fd), 0);
+    // A small send buffer makes the writes stop in the middle of the queued
+    // headers and payloads.
+    int nSendBufferSize = 4096;
+    BOOST_REQUIRE_EQUAL(setsockopt(fd[0], SOL_SOCKET, SO_SNDBUF,
+                                   &nSendBufferSize, sizeof(nSendBufferSize)),
+                        0);
+
+    in_addr ipv4Addr;
+    ipv4Addr.s_addr = 0xa0b0c001;
+    CAddress addr(CService(ipv4Addr, 7777), NODE_NETWORK);
+    CNode node(0, NODE_NETWORK, 0, fd[0], addr, 0, 0, CAddress(), "", false);
+    // Nothing is ever sent to this one, its queue is the expected stream.
+    CNode unsent(1, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, CAddress(),
+                 "", false);
+
+    // Messages of various sizes, one in three sharing the same payload.
+    std::shared_ptr<const CSharedNetMsgPayload> payload =
+        msgMaker.MakePayload(0, std::vector<uint8_t>(3000, 0x42));
+    for (int i = 0; i < 100; i++) {
+        for (CNode *pnode : {&node, &unsent}) {
+            if (i % 3 == 0) {
+                connman.PushMessage(
+                    pnode, msgMaker.MakeShared(NetMsgType::TX, payload));
+            } else {
+                connman.PushMessage(
+                    pnode, msgMaker.Make(NetMsgType::INV,
+                                         std::vector<uint8_t>(i * 37, i)));
+            }
+        }
+    }
+
+    std::vector<uint8_t> expected;
+    {
+        LOCK(unsent.cs_vSend);
+        for (const CSendBuffer &buffer : unsent.vSendMsg) {
+            expected.insert(expected.end(), buffer.data(),
+                            buffer.data() + buffer.size());
+        }
+    }
+
+    // Read random amounts, so that each write resumes at a different offset
+    // in the queued buffers.
+    std::vector<uint8_t> received;
+    int nShortWrites = 0;
+    while (true) {
+        uint8_t buf[2000];
+        ssize_t nBytes =
+            recv(fd[1], buf, 1 + InsecureRandRange(sizeof(buf)), MSG_DONTWAIT);
+        if (nBytes > 0) {
+            received.insert(received.end(), buf, buf + nBytes);
+        }
+
+        connman.SocketSendData(&node);
+        LOCK(node.cs_vSend);
+        if (node.nSendOffset > 0) {
+            nShortWrites++;
+        }
+        if (nBytes <= 0 && node.vSendMsg.empty()) {
+            break;
+        }
+    }
+
+    BOOST_CHECK(nShortWrites > 0);
+    BOOST_CHECK(received == expected);
+    {
+        LOCK(node.cs_vSend);
+        BOOST_CHECK_EQUAL(node.nSendSize, 0);
+        BOOST_CHECK_EQUAL(node.nSendOffset, 0);
+        BOOST_CHECK_EQUAL(node.nSendBytes, expected.size());
+    }
+
+    close(fd[1]);
+}
+#endif
+
+BOOST_AUTO_TEST_CASE(poisson_next_send_inbound_shared) {
+    CConnman connman(GetConfig(), 0x1337, 0x1337);
+
+    // The message handler threads all get the same time for a given period,
+    // so that the inbound peers share a single timer.
+    const int64_t now = GetTimeMicros();
+    std::vector<int64_t> results(8);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < results.size(); i++) {
+        threads.emplace_back([&connman, &results, now, i]() {
+            results[i] = connman.PoissonNextSendInbound(now, 5);
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    for (int64_t result : results) {
+        BOOST_CHECK_EQUAL(result, results[0]);
+    }
+    BOOST_CHECK(results[0] >= now);
+
+    // The time is only replaced once it expired.
+    BOOST_CHECK_EQUAL(connman.PoissonNextSendInbound(now, 5), results[0]);
+    const int64_t later = results[0] + 1;
+    BOOST_CHECK(connman.PoissonNextSendInbound(later, 5) >= later);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
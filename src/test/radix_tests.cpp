@@ -10,6 +10,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <limits>
+#include <set>
 #include <type_traits>
 
 BOOST_FIXTURE_TEST_SUITE(radix_tests, BasicTestingSetup)
@@ -307,6 +308,91 @@ BOOST_AUTO_TEST_CASE(const_tree_test) {
     CheckConstTree(mytree, false);
 }
 
+BOOST_AUTO_TEST_CASE(uint256_test) {
+    typedef TestElement<uint256> E;
+    RadixTree<E> mytree;
+
+    // Keys that only differ in their first, last and middle bytes.
+    const uint256 zero;
+    const uint256 first = uint256S("01");
+    const uint256 last = uint256S(
+        "0100000000000000000000000000000000000000000000000000000000000000");
+    const uint256 middle = uint256S("0100000000000000");
+    const uint256 low = uint256S("10");
+
+    for (const uint256 &key : {zero, first, last, middle, low}) {
+        BOOST_CHECK_EQUAL(mytree.get(key), NULLPTR(E));
+        BOOST_CHECK(mytree.insert(RCUPtr<E>::make(key)));
+    }
+
+    for (const uint256 &key : {zero, first, last, middle, low}) {
+        BOOST_CHECK(!mytree.insert(RCUPtr<E>::make(key)));
+        BOOST_CHECK(mytree.get(key)->getId() == key);
+    }
+
+    BOOST_CHECK_EQUAL(mytree.get(uint256S("02")), NULLPTR(E));
+    BOOST_CHECK_EQUAL(mytree.get(uint256S("11")), NULLPTR(E));
+
+    for (const uint256 &key : {zero, first, last, middle, low}) {
+        BOOST_CHECK(mytree.remove(key));
+        BOOST_CHECK_EQUAL(mytree.get(key), NULLPTR(E));
+        BOOST_CHECK(!mytree.remove(key));
+    }
+
+    // The top levels of the tree use the least significant bytes, which are
+    // the random ones of block hashes.
+    const uint256 key = uint256S(
+        "c000000000000000000000000000000000000000000000000000000000000a5b");
+    BOOST_CHECK_EQUAL(GetRadixKeyBits<4>(key, 252) & 0xf, 0xb);
+    BOOST_CHECK_EQUAL(GetRadixKeyBits<4>(key, 248) & 0xf, 0x5);
+    BOOST_CHECK_EQUAL(GetRadixKeyBits<4>(key, 244) & 0xf, 0xa);
+    BOOST_CHECK_EQUAL(GetRadixKeyBits<4>(key, 0) & 0xf, 0xc);
+}
+
+BOOST_AUTO_TEST_CASE(for_each_leaf_test) {
+    typedef TestElement<uint64_t> E;
+    RadixTree<E> mytree;
+
+    std::set<uint64_t> visited;
+    auto visit = [&](const E &e) {
+        BOOST_CHECK(visited.insert(e.getId()).second);
+        return true;
+    };
+
+    // Walking an empty tree visits nothing.
+    BOOST_CHECK(mytree.forEachLeaf(visit));
+    BOOST_CHECK(visited.empty());
+
+    std::set<uint64_t> expected;
+    MMIXLinearCongruentialGenerator lcg;
+    for (int i = 0; i < 1000; i++) {
+        uint64_t v = (uint64_t(lcg.next()) << 32) | lcg.next();
+        expected.insert(v);
+        BOOST_CHECK(mytree.insert(RCUPtr<E>::make(v)));
+    }
+
+    // Every element is visited exactly once.
+    BOOST_CHECK(mytree.forEachLeaf(visit));
+    BOOST_CHECK(visited == expected);
+
+    // The walk stops as soon as the callback returns false.
+    size_t count = 0;
+    BOOST_CHECK(!mytree.forEachLeaf([&](const E &) { return ++count < 10; }));
+    BOOST_CHECK_EQUAL(count, 10);
+
+    // Removed elements are not visited anymore.
+    for (uint64_t v : expected) {
+        BOOST_CHECK(mytree.remove(v));
+    }
+
+    visited.clear();
+    BOOST_CHECK(mytree.forEachLeaf(visit));
+    BOOST_CHECK(visited.empty());
+
+    // Cleanup after ourselves.
+    RCULock::synchronize();
+}
+
 #define THREADS 128
 #define ELEMENTS 65536
 
@@ -0,0 +1,103 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <index/spentindex.h>
+
+#include <chain.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <script/interpreter.h>
+#include <script/sighashtype.h>
+#include <script/standard.h>
+#include <util/time.h>
+#include <validation.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_AUTO_TEST_SUITE(spentindex_tests)
+
+BOOST_FIXTURE_TEST_CASE(spentindex_initial_sync, TestChain100Setup) {
+    SpentIndex spentindex(1 << 20, true);
+
+    // Spend the first coinbase before the index is started.
+    const CScript coinbase_script =
+        CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    const COutPoint coinbase_outpoint(m_coinbase_txns[0]->GetId(), 0);
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = coinbase_outpoint;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey =
+        GetScriptForDestination(coinbaseKey.GetPubKey().GetID());
+
+    std::vector<uint8_t> vchSig;
+    uint256 sighash = SignatureHash(coinbase_script, CTransaction(spend), 0,
+                                    SigHashType().withForkId(),
+                                    m_coinbase_txns[0]->vout[0].nValue);
+    BOOST_CHECK(coinbaseKey.SignECDSA(sighash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    spend.vin[0].scriptSig << vchSig;
+
+    const CBlock block = CreateAndProcessBlock({spend}, coinbase_script);
+    const TxId spend_txid = CTransaction(spend).GetId();
+
+    SpentInfo info;
+    BOOST_CHECK(!spentindex.FindSpentInfo(coinbase_outpoint, info));
+
+    // BlockUntilSyncedToCurrentChain should return false before spentindex is
+    // started.
+    BOOST_CHECK(!spentindex.BlockUntilSyncedToCurrentChain());
+
+    spentindex.Start();
+
+    // Allow spentindex to catch up with the block index.
+    constexpr int64_t timeout_ms = 10 * 1000;
+    int64_t time_start = GetTimeMillis();
+    while (!spentindex.BlockUntilSyncedToCurrentChain()) {
+        BOOST_REQUIRE(time_start + timeout_ms > GetTimeMillis());
+        MilliSleep(100);
+    }
+
+    BOOST_CHECK(spentindex.FindSpentInfo(coinbase_outpoint, info));
+    BOOST_CHECK(info.txid == spend_txid);
+    BOOST_CHECK_EQUAL(info.index, 0U);
+    BOOST_CHECK_EQUAL(info.height, 101);
+
+    // Unspent outputs are not in the index.
+    BOOST_CHECK(!spentindex.FindSpentInfo(COutPoint(spend_txid, 0), info));
+    BOOST_CHECK(!spentindex.FindSpentInfo(
+        COutPoint(m_coinbase_txns[1]->GetId(), 0), info));
+
+    // Replace the block with one that doesn't include the spend, the entry
+    // must be erased.
+    {
+        CValidationState state;
+        CBlockIndex *pindex;
+        {
+            LOCK(cs_main);
+            pindex = LookupBlockIndex(block.GetHash());
+        }
+        BOOST_CHECK(InvalidateBlock(GetConfig(), state, pindex));
+    }
+    CreateAndProcessBlock({}, coinbase_script);
+    BOOST_CHECK(spentindex.BlockUntilSyncedToCurrentChain());
+
+    BOOST_CHECK(!spentindex.FindSpentInfo(coinbase_outpoint, info));
+
+    // shutdown sequence (c.f. Shutdown() in init.cpp)
+    spentindex.Stop();
+
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+
+    // Rest of shutdown sequence and destructors happen in ~TestingSetup()
+}
+
+BOOST_AUTO_TEST_SUITE_END()
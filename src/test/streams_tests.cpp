@@ -118,6 +118,33 @@ BOOST_AUTO_TEST_CASE(streams_vector_reader) {
     BOOST_CHECK_THROW(new_reader >> d, std::ios_base::failure);
 }
 
+BOOST_AUTO_TEST_CASE(streams_span_reader) {
+    const std::vector<uint8_t> vch = {1, 255, 3, 4, 5, 6};
+
+    SpanReader reader(SER_NETWORK, INIT_PROTO_VERSION,
+                      Span<const uint8_t>(vch.data() + 1, vch.size() - 1));
+    BOOST_CHECK_EQUAL(reader.size(), 5);
+    BOOST_CHECK(!reader.empty());
+
+    // Read a single byte as a (signed) int8_t.
+    int8_t a;
+    reader >> a;
+    BOOST_CHECK_EQUAL(a, -1);
+    BOOST_CHECK_EQUAL(reader.size(), 4);
+
+    // Read a 4 bytes as an unsigned uint32_t.
+    uint32_t b;
+    reader >> b;
+    // 100992003 = 3,4,5,6 in little-endian base-256
+    BOOST_CHECK_EQUAL(b, 100992003);
+    BOOST_CHECK_EQUAL(reader.size(), 0);
+    BOOST_CHECK(reader.empty());
+
+    // Reading after the end of the span throws an error.
+    uint8_t c;
+    BOOST_CHECK_THROW(reader >> c, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(bitstream_reader_writer) {
     CDataStream data(SER_NETWORK, INIT_PROTO_VERSION);
 
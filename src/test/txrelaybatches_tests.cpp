@@ -0,0 +1,195 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txrelaybatches.h>
+
+#include <txmempool.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(txrelaybatches_tests, BasicTestingSetup)
+
+/** Add n transactions to the mempool, and return their txids. */
+static std::vector<TxId> AddTxs(CTxMemPool &pool, size_t n) {
+    std::vector<TxId> txids;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    for (size_t i = 0; i < n; i++) {
+        CMutableTransaction mtx;
+        mtx.vin.emplace_back(COutPoint(TxId(InsecureRand256()), 0));
+        mtx.vout.emplace_back(1000 * SATOSHI, CScript() << OP_TRUE);
+        pool.addUnchecked(entry.Fee(1000 * SATOSHI).FromTx(mtx));
+        txids.push_back(mtx.GetId());
+    }
+    return txids;
+}
+
+/** Collect up to max transactions from nSeq on. */
+static std::vector<TxId> Collect(const CTxRelayBatches &batches,
+                                 uint64_t &nSeq, size_t max = -1) {
+    std::vector<TxId> txids;
+    if (max > 0) {
+        batches.ForEachFrom(nSeq, [&](const TxId &txid) {
+            txids.push_back(txid);
+            return txids.size() < max;
+        });
+    }
+    return txids;
+}
+
+static bool Contains(const std::vector<TxId> &txids, const TxId &txid) {
+    return std::find(txids.begin(), txids.end(), txid) != txids.end();
+}
+
+BOOST_AUTO_TEST_CASE(batch_content) {
+    CTxMemPool pool;
+    CTxRelayBatches batches;
+    std::vector<TxId> txids = AddTxs(pool, 3);
+
+    // Transactions queued twice are batched once, and the ones which left the
+    // mempool are not batched.
+    const TxId missing(InsecureRand256());
+    for (const TxId &txid : txids) {
+        batches.Queue(txid);
+    }
+    batches.Queue(txids[0]);
+    batches.Queue(missing);
+    batches.MakeBatch(pool, 1000, 0);
+    BOOST_CHECK_EQUAL(batches.BatchCount(), 1);
+    BOOST_CHECK_EQUAL(batches.NextSeq(), 3);
+
+    uint64_t nSeq = 0;
+    std::vector<TxId> relayed = Collect(batches, nSeq);
+    BOOST_CHECK_EQUAL(relayed.size(), 3);
+    BOOST_CHECK_EQUAL(nSeq, 3);
+    for (const TxId &txid : txids) {
+        BOOST_CHECK(Contains(relayed, txid));
+    }
+    BOOST_CHECK(!Contains(relayed, missing));
+
+    // Nothing queued, no new batch.
+    batches.MakeBatch(pool, 2000, 0);
+    BOOST_CHECK_EQUAL(batches.BatchCount(), 1);
+    BOOST_CHECK(Collect(batches, nSeq).empty());
+}
+
+BOOST_AUTO_TEST_CASE(resume_from_sequence) {
+    CTxMemPool pool;
+    CTxRelayBatches batches;
+
+    // Make 10 batches of 5 transactions each.
+    std::vector<TxId> all;
+    for (int i = 0; i < 10; i++) {
+        for (const TxId &txid : AddTxs(pool, 5)) {
+            batches.Queue(txid);
+        }
+        batches.MakeBatch(pool, 1000 + i, 0);
+        uint64_t nSeq = 5 * i;
+        std::vector<TxId> batch = Collect(batches, nSeq);
+        BOOST_CHECK_EQUAL(batch.size(), 5);
+        all.insert(all.end(), batch.begin(), batch.end());
+    }
+    BOOST_CHECK_EQUAL(batches.BatchCount(), 10);
+    BOOST_CHECK_EQUAL(batches.NextSeq(), 50);
+
+    // Starting from any sequence number, including in the middle of a batch,
+    // returns the transactions from there on in order.
+    for (uint64_t nStart = 0; nStart <= 50; nStart++) {
+        uint64_t nSeq = nStart;
+        std::vector<TxId> relayed = Collect(batches, nSeq);
+        BOOST_CHECK_EQUAL(nSeq, 50);
+        BOOST_CHECK(relayed == std::vector<TxId>(all.begin() + nStart,
+                                                 all.end()));
+    }
+
+    // A peer stopping because of its per trickle limit resumes where it
+    // stopped, across batch boundaries.
+    uint64_t nSeq = 3;
+    std::vector<TxId> relayed;
+    while (nSeq < 50) {
+        std::vector<TxId> part = Collect(batches, nSeq, 4);
+        BOOST_CHECK(part.size() == 4 || nSeq == 50);
+        relayed.insert(relayed.end(), part.begin(), part.end());
+    }
+    BOOST_CHECK(relayed == std::vector<TxId>(all.begin() + 3, all.end()));
+}
+
+BOOST_AUTO_TEST_CASE(batch_expiry) {
+    CTxMemPool pool;
+    CTxRelayBatches batches;
+
+    std::vector<TxId> first = AddTxs(pool, 4);
+    for (const TxId &txid : first) {
+        batches.Queue(txid);
+    }
+    batches.MakeBatch(pool, 1000, 0);
+
+    std::vector<TxId> second = AddTxs(pool, 2);
+    for (const TxId &txid : second) {
+        batches.Queue(txid);
+    }
+    batches.MakeBatch(pool, 2000, 0);
+    BOOST_CHECK_EQUAL(batches.BatchCount(), 2);
+
+    // Expire the first batch. A peer which did not announce it skips it.
+    batches.MakeBatch(pool, 3000, 1500);
+    BOOST_CHECK_EQUAL(batches.BatchCount(), 1);
+    uint64_t nSeq = 1;
+    std::vector<TxId> relayed = Collect(batches, nSeq);
+    BOOST_CHECK_EQUAL(nSeq, 6);
+    BOOST_CHECK_EQUAL(relayed.size(), 2);
+    for (const TxId &txid : second) {
+        BOOST_CHECK(Contains(relayed, txid));
+    }
+
+    // Once all the batches expired, peers have nothing to announce and the
+    // sequence numbers keep increasing.
+    batches.MakeBatch(pool, 4000, 3500);
+    BOOST_CHECK_EQUAL(batches.BatchCount(), 0);
+    nSeq = 0;
+    BOOST_CHECK(Collect(batches, nSeq).empty());
+    BOOST_CHECK_EQUAL(nSeq, 0);
+    BOOST_CHECK_EQUAL(batches.NextSeq(), 6);
+}
+
+BOOST_AUTO_TEST_CASE(per_peer_filtering) {
+    CTxMemPool pool;
+    CTxRelayBatches batches;
+
+    std::vector<TxId> txids = AddTxs(pool, 6);
+    for (const TxId &txid : txids) {
+        batches.Queue(txid);
+    }
+    batches.MakeBatch(pool, 1000, 0);
+
+    // Each peer filters the shared batches on its own, and both reach the end
+    // of the batches.
+    std::vector<TxId> relayedA, relayedB;
+    uint64_t nSeqA = 0, nSeqB = 0;
+    batches.ForEachFrom(nSeqA, [&](const TxId &txid) {
+        if (txid.GetUint64(0) % 2 == 0) {
+            relayedA.push_back(txid);
+        }
+        return true;
+    });
+    batches.ForEachFrom(nSeqB, [&](const TxId &txid) {
+        if (txid.GetUint64(0) % 2 == 1) {
+            relayedB.push_back(txid);
+        }
+        return true;
+    });
+    BOOST_CHECK_EQUAL(nSeqA, 6);
+    BOOST_CHECK_EQUAL(nSeqB, 6);
+    BOOST_CHECK_EQUAL(relayedA.size() + relayedB.size(), 6);
+    for (const TxId &txid : txids) {
+        BOOST_CHECK(Contains(relayedA, txid) != Contains(relayedB, txid));
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
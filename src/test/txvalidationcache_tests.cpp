@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include <chain.h>
+#include <chainparams.h>
 #include <config.h>
 #include <consensus/validation.h>
 #include <key.h>
@@ -93,6 +94,166 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup) {
     BOOST_CHECK_EQUAL(g_mempool.size(), 0U);
 }
 
+/** Set fParallelBlockConnect for the lifetime of the guard. */
+class ParallelBlockConnectGuard {
+private:
+    const bool fPrevious;
+
+public:
+    explicit ParallelBlockConnectGuard(bool fParallel)
+        : fPrevious(fParallelBlockConnect) {
+        fParallelBlockConnect = fParallel;
+    }
+    ~ParallelBlockConnectGuard() { fParallelBlockConnect = fPrevious; }
+};
+
+BOOST_FIXTURE_TEST_CASE(parallel_connect_test, TestChain100Setup) {
+    // Make sure the input checks deferred to the input checking threads when
+    // connecting blocks in parallel are still enforced.
+    ParallelBlockConnectGuard parallel(true);
+
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+
+    auto spend = [&](const CTransactionRef &prevTx, const Amount value,
+                     uint32_t nSequence = CTxIn::SEQUENCE_FINAL) {
+        CMutableTransaction tx;
+        tx.nVersion = 2;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(prevTx->GetId(), 0);
+        tx.vin[0].nSequence = nSequence;
+        tx.vout.resize(1);
+        tx.vout[0].nValue = value;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<uint8_t> vchSig;
+        uint256 hash =
+            SignatureHash(prevTx->vout[0].scriptPubKey, CTransaction(tx), 0,
+                          SigHashType().withForkId(), prevTx->vout[0].nValue);
+        BOOST_CHECK(coinbaseKey.SignECDSA(hash, vchSig));
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        tx.vin[0].scriptSig << vchSig;
+        return tx;
+    };
+
+    const CTransactionRef &coinbase = m_coinbase_txns[0];
+    const Amount coinbaseValue = coinbase->vout[0].nValue;
+    CBlock block;
+
+    // Spending more than the input is worth.
+    block = CreateAndProcessBlock({spend(coinbase, coinbaseValue + SATOSHI)},
+                                  scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() != block.GetHash());
+
+    // Double spend within the block.
+    block = CreateAndProcessBlock(
+        {spend(coinbase, 11 * CENT), spend(coinbase, 12 * CENT)},
+        scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() != block.GetHash());
+
+    // Spending an immature coinbase.
+    block = CreateAndProcessBlock({spend(m_coinbase_txns.back(), 11 * CENT)},
+                                  scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() != block.GetHash());
+
+    // A chain of transactions within the same block is fine.
+    CMutableTransaction parent = spend(coinbase, 11 * CENT);
+    CMutableTransaction child =
+        spend(MakeTransactionRef(parent), 10 * CENT);
+    block = CreateAndProcessBlock({parent, child}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    // Sequence locks are enforced once CSV is active.
+    const Consensus::Params &params =
+        GetConfig().GetChainParams().GetConsensus();
+    while (chainActive.Height() < params.CSVHeight) {
+        CreateAndProcessBlock({}, scriptPubKey);
+    }
+    const CTransactionRef confirmed =
+        MakeTransactionRef(spend(m_coinbase_txns[1], 11 * CENT));
+    block = CreateAndProcessBlock({CMutableTransaction(*confirmed)},
+                                  scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    // A relative lock of 2 blocks is not met by the next block.
+    block = CreateAndProcessBlock({spend(confirmed, 10 * CENT, 2)},
+                                  scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() != block.GetHash());
+
+    // A relative lock of 1 block is.
+    block = CreateAndProcessBlock({spend(confirmed, 10 * CENT, 1)},
+                                  scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+}
+
+BOOST_AUTO_TEST_CASE(txinputcheck_test) {
+    // The checks CTxInputCheck runs in place of ConnectBlock when connecting
+    // blocks in parallel. Sigops are no longer counted once SCRIPT_ZERO_SIGOPS
+    // is set, so they are checked here with the flags from before.
+    CBlockIndex prev;
+    prev.nHeight = 999;
+    CBlockIndex index;
+    index.nHeight = 1000;
+    index.pprev = &prev;
+
+    CScript redeemScript = CScript() << OP_0 << OP_IF;
+    for (int i = 0; i < 20; i++) {
+        redeemScript << OP_CHECKMULTISIG;
+    }
+    redeemScript << OP_ENDIF << OP_TRUE;
+    const CScript p2sh = GetScriptForDestination(CScriptID(redeemScript));
+
+    // Each input counts 20 sigops for each of its 20 OP_CHECKMULTISIG.
+    auto check = [&](size_t nInputs, uint32_t nSequence, uint32_t nFlags,
+                     TxInputCheckResult &result) {
+        CMutableTransaction mtx;
+        mtx.nVersion = 2;
+        std::vector<Coin> spentCoins;
+        for (size_t i = 0; i < nInputs; i++) {
+            mtx.vin.emplace_back(COutPoint(TxId(InsecureRand256()), 0),
+                                 CScript() << ToByteVector(redeemScript),
+                                 nSequence);
+            spentCoins.emplace_back(CTxOut(COIN, p2sh), 990, false);
+        }
+        mtx.vout.emplace_back(COIN, CScript() << OP_TRUE);
+        const CTransaction tx(mtx);
+        return CTxInputCheck(tx, &spentCoins, index, nFlags,
+                             LOCKTIME_VERIFY_SEQUENCE, result)();
+    };
+
+    {
+        TxInputCheckResult result;
+        BOOST_CHECK(
+            check(50, CTxIn::SEQUENCE_FINAL, SCRIPT_VERIFY_P2SH, result));
+        BOOST_CHECK(result.fChecked);
+        BOOST_CHECK_EQUAL(result.nSigOpsCount, 50 * 400);
+        BOOST_CHECK(result.txfee == 49 * COIN);
+    }
+    {
+        TxInputCheckResult result;
+        BOOST_CHECK(
+            !check(51, CTxIn::SEQUENCE_FINAL, SCRIPT_VERIFY_P2SH, result));
+        BOOST_CHECK_EQUAL(result.state.GetRejectReason(), "bad-txn-sigops");
+    }
+    {
+        TxInputCheckResult result;
+        BOOST_CHECK(check(51, CTxIn::SEQUENCE_FINAL,
+                          SCRIPT_VERIFY_P2SH | SCRIPT_ZERO_SIGOPS, result));
+        BOOST_CHECK_EQUAL(result.nSigOpsCount, 0);
+    }
+
+    // The coins were confirmed at height 990, 10 blocks below the block.
+    {
+        TxInputCheckResult result;
+        BOOST_CHECK(check(1, 10, SCRIPT_VERIFY_P2SH, result));
+    }
+    {
+        TxInputCheckResult result;
+        BOOST_CHECK(!check(1, 11, SCRIPT_VERIFY_P2SH, result));
+        BOOST_CHECK_EQUAL(result.state.GetRejectReason(), "bad-txns-nonfinal");
+    }
+}
+
 static inline bool
 CheckInputs(const CTransaction &tx, CValidationState &state,
             const CCoinsViewCache &view, bool fScriptChecks,
@@ -0,0 +1,221 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <utxocommit.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <coins.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <key.h>
+#include <random.h>
+#include <script/interpreter.h>
+#include <script/sighashtype.h>
+#include <streams.h>
+#include <txdb.h>
+#include <validation.h>
+#include <version.h>
+
+#include <test/test_bitcoin.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(utxocommit_tests, BasicTestingSetup)
+
+static Coin RandomCoin(uint32_t nHeight) {
+    CTxOut out(int64_t(InsecureRandRange(1000000)) * SATOSHI,
+               CScript() << ToByteVector(InsecureRand256()));
+    return Coin(std::move(out), nHeight, InsecureRandBool());
+}
+
+BOOST_AUTO_TEST_CASE(utxocommit_set_test) {
+    std::vector<std::pair<COutPoint, Coin>> coins;
+    for (uint32_t i = 0; i < 50; i++) {
+        coins.emplace_back(COutPoint(TxId(InsecureRand256()), i),
+                           RandomCoin(i));
+    }
+
+    const CUtxoCommit empty;
+    BOOST_CHECK(empty == CUtxoCommit());
+
+    // The commitment doesn't depend on the order coins are added in.
+    CUtxoCommit forward, backward;
+    for (const auto &c : coins) {
+        forward.Add(c.first, c.second);
+    }
+    for (auto it = coins.rbegin(); it != coins.rend(); ++it) {
+        backward.Add(it->first, it->second);
+    }
+    BOOST_CHECK(forward != empty);
+    BOOST_CHECK(forward == backward);
+
+    // Commitments to disjoint sets can be combined.
+    CUtxoCommit front, back;
+    for (size_t i = 0; i < coins.size(); i++) {
+        (i < coins.size() / 2 ? front : back)
+            .Add(coins[i].first, coins[i].second);
+    }
+    BOOST_CHECK(front != forward);
+    front.Add(back);
+    BOOST_CHECK(front == forward);
+
+    // The coin metadata is committed to.
+    CUtxoCommit other;
+    for (const auto &c : coins) {
+        Coin coin(c.second.GetTxOut(), c.second.GetHeight() + 1,
+                  c.second.IsCoinBase());
+        other.Add(c.first, coin);
+    }
+    BOOST_CHECK(other != forward);
+
+    // Removing all coins gets back to the empty set.
+    for (const auto &c : coins) {
+        forward.Remove(c.first, c.second);
+    }
+    BOOST_CHECK(forward == empty);
+
+    // Serialization round trip.
+    CDataStream ss(SER_DISK, PROTOCOL_VERSION);
+    ss << backward;
+    CUtxoCommit deserialized;
+    ss >> deserialized;
+    BOOST_CHECK(deserialized == backward);
+    BOOST_CHECK(deserialized.GetHash() == backward.GetHash());
+
+    backward.Clear();
+    BOOST_CHECK(backward == empty);
+}
+
+/** Compute the commitment from a full scan of the coins database. */
+static uint256 ComputeUtxoCommitment() {
+    FlushStateToDisk();
+    CUtxoCommit commit;
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    BOOST_CHECK(commit.AddCoinView(pcursor.get()));
+    return commit.GetHash();
+}
+
+static uint256 GetTipUtxoCommitment() {
+    LOCK(cs_main);
+    uint256 hash;
+    BOOST_CHECK(GetUtxoCommitment(hash));
+    return hash;
+}
+
+BOOST_FIXTURE_TEST_CASE(utxocommit_chain_test, TestChain100Setup) {
+    uint256 hash;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(!GetUtxoCommitment(hash));
+        BOOST_CHECK(LoadUtxoCommitment());
+    }
+    const uint256 hashBefore = GetTipUtxoCommitment();
+    BOOST_CHECK(hashBefore == ComputeUtxoCommitment());
+
+    // Connect a block spending a coinbase, so both inputs and outputs are
+    // accounted for, and an output created within the block.
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout = COutPoint(m_coinbase_txns[0]->GetId(), 0);
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11 * CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<uint8_t> vchSig;
+    uint256 sighash = SignatureHash(scriptPubKey, CTransaction(spend), 0,
+                                    SigHashType().withForkId(),
+                                    m_coinbase_txns[0]->vout[0].nValue);
+    BOOST_CHECK(coinbaseKey.SignECDSA(sighash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    spend.vin[0].scriptSig << vchSig;
+
+    CMutableTransaction child;
+    child.nVersion = 1;
+    child.vin.resize(1);
+    child.vin[0].prevout = COutPoint(spend.GetId(), 0);
+    child.vout.resize(1);
+    child.vout[0].nValue = 10 * CENT;
+    child.vout[0].scriptPubKey = scriptPubKey;
+
+    vchSig.clear();
+    sighash = SignatureHash(scriptPubKey, CTransaction(child), 0,
+                            SigHashType().withForkId(), spend.vout[0].nValue);
+    BOOST_CHECK(coinbaseKey.SignECDSA(sighash, vchSig));
+    vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+    child.vin[0].scriptSig << vchSig;
+
+    CBlock block = CreateAndProcessBlock({spend, child}, scriptPubKey);
+    BOOST_CHECK(chainActive.Tip()->GetBlockHash() == block.GetHash());
+
+    const uint256 hashAfter = GetTipUtxoCommitment();
+    BOOST_CHECK(hashAfter != hashBefore);
+    BOOST_CHECK(hashAfter == ComputeUtxoCommitment());
+
+    // The commitment is persisted along with the coins.
+    {
+        LOCK(cs_main);
+        BlockHash hashBlock;
+        CUtxoCommit stored;
+        BOOST_CHECK(pcoinsdbview->GetUtxoCommitment(hashBlock, stored));
+        BOOST_CHECK(hashBlock == block.GetHash());
+        BOOST_CHECK(stored.GetHash() == hashAfter);
+    }
+
+    // Disconnecting the block restores the previous commitment.
+    CBlockIndex *pindex;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(block.GetHash());
+    }
+    CValidationState state;
+    BOOST_CHECK(InvalidateBlock(GetConfig(), state, pindex));
+    BOOST_CHECK(GetTipUtxoCommitment() == hashBefore);
+    BOOST_CHECK(hashBefore == ComputeUtxoCommitment());
+
+    // Reloading picks up the stored commitment.
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(LoadUtxoCommitment());
+    }
+    BOOST_CHECK(GetTipUtxoCommitment() == hashBefore);
+}
+
+BOOST_FIXTURE_TEST_CASE(utxocommit_genesis_test, TestChain100Setup) {
+    // Start over from an empty chain, with the commitment maintained from
+    // before the genesis block is connected.
+    {
+        LOCK(cs_main);
+        UnloadBlockIndex();
+        pcoinsTip.reset();
+        pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
+        pcoinsTip.reset(new CCoinsViewShardedCache(pcoinsdbview.get()));
+        pblocktree.reset(new CBlockTreeDB(1 << 20, true));
+        BOOST_CHECK(LoadUtxoCommitment());
+    }
+    BOOST_CHECK(LoadGenesisBlock(Params()));
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(GetConfig(), state));
+    BOOST_CHECK_EQUAL(chainActive.Height(), 0);
+
+    // The genesis coinbase is not spendable, so it is not committed to.
+    BOOST_CHECK(GetTipUtxoCommitment() == CUtxoCommit().GetHash());
+    BOOST_CHECK(GetTipUtxoCommitment() == ComputeUtxoCommitment());
+
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey())
+                                     << OP_CHECKSIG;
+    for (int i = 0; i < 3; i++) {
+        CreateAndProcessBlock({}, scriptPubKey);
+    }
+    BOOST_CHECK_EQUAL(chainActive.Height(), 3);
+    BOOST_CHECK(GetTipUtxoCommitment() == ComputeUtxoCommitment());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -17,6 +17,9 @@
 #include <validation.h>
 #include <validationinterface.h>
 
+#include <atomic>
+#include <thread>
+
 struct RegtestingSetup : public TestingSetup {
     RegtestingSetup() : TestingSetup(CBaseChainParams::REGTEST) {}
 };
@@ -205,4 +208,88 @@ BOOST_AUTO_TEST_CASE(processnewblock_signals_ordering) {
     BOOST_CHECK_EQUAL(sub.m_expected_tip, chainActive.Tip()->GetBlockHash());
 }
 
+BOOST_AUTO_TEST_CASE(processnewblockheaders_batch) {
+    GlobalConfig config;
+    const CChainParams &chainParams = config.GetChainParams();
+    const Consensus::Params &params = chainParams.GetConsensus();
+
+    // A batch large enough to be hashed on several threads.
+    std::vector<CBlockHeader> headers;
+    BlockHash prev_hash = chainParams.GenesisBlock().GetHash();
+    CBlockHeader header = Block(config, prev_hash)->GetBlockHeader();
+    for (int i = 0; i < 1000; i++) {
+        header.hashPrevBlock = prev_hash;
+        header.nTime++;
+        header.nNonce = 0;
+        while (!CheckProofOfWork(header.GetHash(), header.nBits, params)) {
+            ++header.nNonce;
+        }
+        headers.push_back(header);
+        prev_hash = header.GetHash();
+    }
+
+    // Break the proof of work of one of the headers.
+    CBlockHeader &bad = headers[600];
+    while (CheckProofOfWork(bad.GetHash(), bad.nBits, params)) {
+        ++bad.nNonce;
+    }
+
+    CValidationState state;
+    const CBlockIndex *pindex = nullptr;
+    CBlockHeader first_invalid;
+    BOOST_CHECK(!ProcessNewBlockHeaders(config, headers, state, &pindex,
+                                        &first_invalid, /*nHashThreads=*/4));
+    BOOST_CHECK_EQUAL(state.GetRejectReason(), "high-hash");
+    BOOST_CHECK_EQUAL(first_invalid.GetHash(), bad.GetHash());
+    BOOST_REQUIRE(pindex);
+    BOOST_CHECK_EQUAL(pindex->GetBlockHash(), headers[599].GetHash());
+    BOOST_CHECK_EQUAL(pindex->nHeight, 600);
+
+    LOCK(cs_main);
+    BOOST_CHECK(!LookupBlockIndex(bad.GetHash()));
+}
+
+BOOST_AUTO_TEST_CASE(lookupblockindex_without_cs_main) {
+    GlobalConfig config;
+    const CChainParams &chainParams = config.GetChainParams();
+
+    std::vector<CBlockHeader> headers;
+    BlockHash prev_hash = chainParams.GenesisBlock().GetHash();
+    for (int i = 0; i < 100; i++) {
+        headers.push_back(GoodBlock(config, prev_hash)->GetBlockHeader());
+        prev_hash = headers.back().GetHash();
+    }
+
+    // Look the headers up without cs_main while they are being indexed. The
+    // checks are counted rather than reported, Boost.Test is not thread safe.
+    std::atomic<bool> done{false};
+    std::atomic<int> mismatches{0};
+    std::thread reader([&] {
+        while (!done) {
+            for (const CBlockHeader &header : headers) {
+                const CBlockIndex *pindex = LookupBlockIndex(header.GetHash());
+                if (pindex &&
+                    (pindex->GetBlockHash() != header.GetHash() ||
+                     pindex->pprev->GetBlockHash() != header.hashPrevBlock)) {
+                    mismatches++;
+                }
+            }
+        }
+    });
+
+    for (const CBlockHeader &header : headers) {
+        CValidationState state;
+        BOOST_CHECK(ProcessNewBlockHeaders(config, {header}, state));
+    }
+    done = true;
+    reader.join();
+    BOOST_CHECK_EQUAL(mismatches, 0);
+
+    for (size_t i = 0; i < headers.size(); i++) {
+        const CBlockIndex *pindex = LookupBlockIndex(headers[i].GetHash());
+        BOOST_REQUIRE(pindex);
+        BOOST_CHECK_EQUAL(pindex->nHeight, int(i + 1));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -131,4 +131,23 @@ BOOST_AUTO_TEST_CASE(validation_load_external_block_file) {
     BOOST_CHECK_NO_THROW({ LoadExternalBlockFile(config, fp, 0); });
 }
 
+BOOST_AUTO_TEST_CASE(read_raw_block_from_disk) {
+    const Consensus::Params &params =
+        GetConfig().GetChainParams().GetConsensus();
+    const CBlockIndex *pindex;
+    {
+        LOCK(cs_main);
+        pindex = chainActive.Tip();
+    }
+
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, params));
+    std::vector<uint8_t> expected;
+    CVectorWriter(SER_NETWORK, PROTOCOL_VERSION, expected, 0, block);
+
+    std::vector<uint8_t> raw_block;
+    BOOST_CHECK(ReadRawBlockFromDisk(raw_block, pindex));
+    BOOST_CHECK(raw_block == expected);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
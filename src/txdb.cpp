@@ -27,6 +27,7 @@ static const char DB_BEST_BLOCK = 'B';
 static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
+static const char DB_UTXO_COMMITMENT = 'U';
 static const char DB_LAST_BLOCK = 'l';
 
 namespace {
@@ -105,6 +106,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
     // A vector is used for future extensibility, as we may want to support
     // interrupting after partial writes from multiple independent reorgs.
     batch.Erase(DB_BEST_BLOCK);
+    batch.Erase(DB_UTXO_COMMITMENT);
     batch.Write(DB_HEAD_BLOCKS, std::vector<BlockHash>{hashBlock, old_tip});
 
     for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
@@ -138,6 +140,11 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
     // In the last batch, mark the database as consistent with hashBlock again.
     batch.Erase(DB_HEAD_BLOCKS);
     batch.Write(DB_BEST_BLOCK, hashBlock);
+    if (pendingUtxoCommit) {
+        batch.Write(DB_UTXO_COMMITMENT,
+                    std::make_pair(hashBlock, *pendingUtxoCommit));
+        pendingUtxoCommit.reset();
+    }
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n",
              batch.SizeEstimate() * (1.0 / 1048576.0));
@@ -149,6 +156,21 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) {
     return ret;
 }
 
+void CCoinsViewDB::SetUtxoCommitment(const CUtxoCommit &commit) {
+    pendingUtxoCommit = std::make_unique<CUtxoCommit>(commit);
+}
+
+bool CCoinsViewDB::GetUtxoCommitment(BlockHash &hashBlock,
+                                     CUtxoCommit &commit) const {
+    std::pair<BlockHash, CUtxoCommit> entry;
+    if (!db.Read(DB_UTXO_COMMITMENT, entry)) {
+        return false;
+    }
+    hashBlock = entry.first;
+    commit = entry.second;
+    return true;
+}
+
 size_t CCoinsViewDB::EstimateSize() const {
     return db.EstimateSize(DB_COIN, char(DB_COIN + 1));
 }
@@ -11,6 +11,7 @@
 #include <dbwrapper.h>
 #include <flatfile.h>
 #include <primitives/block.h>
+#include <utxocommit.h>
 
 #include <map>
 #include <memory>
@@ -43,6 +44,14 @@ static const int64_t nMaxBlockDBCache = 2;
 // a meaningful difference:
 // https://github.com/bitcoin/bitcoin/pull/8273#issuecomment-229601991
 static const int64_t nMaxTxIndexCache = 1024;
+//! Max memory allocated to coinstats index DB specific cache (MiB)
+static const int64_t nMaxCoinStatsIndexCache = 8;
+//! Max memory allocated to address index DB specific cache (MiB)
+static const int64_t nMaxAddressIndexCache = 1024;
+//! Max memory allocated to spent index DB specific cache (MiB)
+static const int64_t nMaxSpentIndexCache = 1024;
+//! Max memory allocated to all block filter index caches combined in MiB.
+static const int64_t nMaxFilterIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
 
@@ -51,6 +60,9 @@ class CCoinsViewDB final : public CCoinsView {
 protected:
     CDBWrapper db;
 
+    //! UTXO commitment to store along with the next BatchWrite.
+    std::unique_ptr<CUtxoCommit> pendingUtxoCommit;
+
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false,
                           bool fWipe = false);
@@ -62,6 +74,17 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const BlockHash &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    /**
+     * Set the commitment to the UTXO set as of the best block of the next
+     * BatchWrite, to be written atomically with it.
+     */
+    void SetUtxoCommitment(const CUtxoCommit &commit);
+    /**
+     * Read the stored UTXO commitment and the block it was computed at.
+     * Returns false if no commitment is stored.
+     */
+    bool GetUtxoCommitment(BlockHash &hashBlock, CUtxoCommit &commit) const;
+
     //! Attempt to update from an older database format.
     //! Returns whether an error occurred.
     bool Upgrade();
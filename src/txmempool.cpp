@@ -552,7 +552,7 @@ void CTxMemPool::removeRecursive(const CTransaction &origTx,
 }
 
 void CTxMemPool::removeForReorg(const Config &config,
-                                const CCoinsViewCache *pcoins,
+                                const CCoinsView *pcoins,
                                 unsigned int nMemPoolHeight, int flags) {
     // Remove transactions spending a coinbase which are now immature and
     // no-longer-final transactions.
@@ -580,7 +580,8 @@ void CTxMemPool::removeForReorg(const Config &config,
                     continue;
                 }
 
-                const Coin &coin = pcoins->AccessCoin(txin.prevout);
+                Coin coin;
+                pcoins->GetCoin(txin.prevout, coin);
                 if (nCheckFrequency != 0) {
                     assert(!coin.IsSpent());
                 }
@@ -690,7 +691,7 @@ static void CheckInputsAndUpdateCoins(const CTransaction &tx,
     UpdateCoins(mempoolDuplicate, tx, std::numeric_limits<int>::max());
 }
 
-void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
+void CTxMemPool::check(const CCoinsView *pcoins) const {
     LOCK(cs);
     if (nCheckFrequency == 0) {
         return;
@@ -707,7 +708,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
     uint64_t checkTotal = 0;
     uint64_t innerUsage = 0;
 
-    CCoinsViewCache mempoolDuplicate(const_cast<CCoinsViewCache *>(pcoins));
+    CCoinsViewCache mempoolDuplicate(const_cast<CCoinsView *>(pcoins));
     const int64_t spendheight = GetSpendHeight(mempoolDuplicate);
 
     std::list<const CTxMemPoolEntry *> waitingOnDependants;
@@ -608,7 +608,7 @@ public:
      * are in the mapNextTx array). If sanity-checking is turned off, check does
      * nothing.
      */
-    void check(const CCoinsViewCache *pcoins) const;
+    void check(const CCoinsView *pcoins) const;
     void setSanityCheck(double dFrequency = 1.0) {
         LOCK(cs);
         nCheckFrequency = static_cast<uint32_t>(dFrequency * 4294967295.0);
@@ -629,7 +629,7 @@ public:
     void removeRecursive(
         const CTransaction &tx,
         MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
-    void removeForReorg(const Config &config, const CCoinsViewCache *pcoins,
+    void removeForReorg(const Config &config, const CCoinsView *pcoins,
                         unsigned int nMemPoolHeight, int flags)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     void removeConflicts(const CTransaction &tx) EXCLUSIVE_LOCKS_REQUIRED(cs);
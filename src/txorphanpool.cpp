@@ -0,0 +1,153 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txorphanpool.h>
+
+#include <algorithm>
+#include <cassert>
+#include <tuple>
+
+bool COrphanTxPool::AddTx(const CTransactionRef &tx, NodeId peer,
+                          int64_t nTimeExpire) {
+    const size_t nTxSize = tx->GetTotalSize();
+    auto ret = orphans.insert(COrphanTx{tx, peer, nTimeExpire, nTxSize});
+    if (!ret.second) {
+        return false;
+    }
+    for (const CTxIn &txin : tx->vin) {
+        mapOrphansByPrev[txin.prevout].insert(ret.first);
+    }
+
+    PeerUsage &usage = mapPeerUsage[peer];
+    usage.nTxs++;
+    usage.nTxsSize += nTxSize;
+    nTotalTxSize += nTxSize;
+    return true;
+}
+
+bool COrphanTxPool::HaveTx(const TxId &txid) const {
+    return orphans.count(txid) != 0;
+}
+
+void COrphanTxPool::Erase(txiter it) {
+    for (const CTxIn &txin : it->tx->vin) {
+        auto itPrev = mapOrphansByPrev.find(txin.prevout);
+        if (itPrev == mapOrphansByPrev.end()) {
+            continue;
+        }
+        itPrev->second.erase(it);
+        if (itPrev->second.empty()) {
+            mapOrphansByPrev.erase(itPrev);
+        }
+    }
+
+    auto itPeer = mapPeerUsage.find(it->fromPeer);
+    assert(itPeer != mapPeerUsage.end());
+    itPeer->second.nTxs--;
+    itPeer->second.nTxsSize -= it->nTxSize;
+    if (itPeer->second.nTxs == 0) {
+        mapPeerUsage.erase(itPeer);
+    }
+    nTotalTxSize -= it->nTxSize;
+
+    orphans.erase(it);
+}
+
+int COrphanTxPool::EraseTx(const TxId &txid) {
+    auto it = orphans.find(txid);
+    if (it == orphans.end()) {
+        return 0;
+    }
+    Erase(it);
+    return 1;
+}
+
+int COrphanTxPool::EraseForPeer(NodeId peer) {
+    auto &index = orphans.get<peer_index>();
+    auto range = index.equal_range(std::make_tuple(peer));
+    int nErased = 0;
+    while (range.first != range.second) {
+        Erase(orphans.project<txid_index>(range.first++));
+        nErased++;
+    }
+    return nErased;
+}
+
+int COrphanTxPool::EraseExpired(int64_t nNow) {
+    auto &index = orphans.get<expiry_index>();
+    int nErased = 0;
+    while (!index.empty() && index.begin()->nTimeExpire <= nNow) {
+        Erase(orphans.project<txid_index>(index.begin()));
+        nErased++;
+    }
+    return nErased;
+}
+
+void COrphanTxPool::EraseOldest(NodeId peer) {
+    auto &index = orphans.get<peer_index>();
+    auto it = index.lower_bound(std::make_tuple(peer));
+    assert(it != index.end() && it->fromPeer == peer);
+    Erase(orphans.project<txid_index>(it));
+}
+
+unsigned int COrphanTxPool::LimitOrphans(size_t nMaxTxs, size_t nMaxTxsSize) {
+    unsigned int nEvicted = 0;
+
+    const size_t nMaxPeerTxs = (nMaxTxs + PEER_SHARE - 1) / PEER_SHARE;
+    const size_t nMaxPeerTxsSize = (nMaxTxsSize + PEER_SHARE - 1) / PEER_SHARE;
+    for (auto it = mapPeerUsage.begin(); it != mapPeerUsage.end();) {
+        // Evicting the last orphan of a peer erases its usage.
+        const NodeId peer = (it++)->first;
+        while (PeerTxCount(peer) > nMaxPeerTxs ||
+               PeerTxSize(peer) > nMaxPeerTxsSize) {
+            EraseOldest(peer);
+            nEvicted++;
+        }
+    }
+
+    while (orphans.size() > nMaxTxs || nTotalTxSize > nMaxTxsSize) {
+        auto itLargest = std::max_element(
+            mapPeerUsage.begin(), mapPeerUsage.end(),
+            [](const std::pair<const NodeId, PeerUsage> &a,
+               const std::pair<const NodeId, PeerUsage> &b) {
+                return std::make_pair(a.second.nTxsSize, a.second.nTxs) <
+                       std::make_pair(b.second.nTxsSize, b.second.nTxs);
+            });
+        assert(itLargest != mapPeerUsage.end());
+        EraseOldest(itLargest->first);
+        nEvicted++;
+    }
+
+    return nEvicted;
+}
+
+void COrphanTxPool::Clear() {
+    orphans.clear();
+    mapOrphansByPrev.clear();
+    mapPeerUsage.clear();
+    nTotalTxSize = 0;
+}
+
+std::vector<COrphanTx>
+COrphanTxPool::GetChildren(const COutPoint &prevout) const {
+    std::vector<COrphanTx> children;
+    auto itPrev = mapOrphansByPrev.find(prevout);
+    if (itPrev != mapOrphansByPrev.end()) {
+        children.reserve(itPrev->second.size());
+        for (const txiter &it : itPrev->second) {
+            children.push_back(*it);
+        }
+    }
+    return children;
+}
+
+size_t COrphanTxPool::PeerTxCount(NodeId peer) const {
+    auto it = mapPeerUsage.find(peer);
+    return it == mapPeerUsage.end() ? 0 : it->second.nTxs;
+}
+
+size_t COrphanTxPool::PeerTxSize(NodeId peer) const {
+    auto it = mapPeerUsage.find(peer);
+    return it == mapPeerUsage.end() ? 0 : it->second.nTxsSize;
+}
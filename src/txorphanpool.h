@@ -0,0 +1,135 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANPOOL_H
+#define BITCOIN_TXORPHANPOOL_H
+
+#include <coins.h>
+#include <net.h>
+#include <primitives/transaction.h>
+#include <txmempool.h>
+
+#include <boost/multi_index/composite_key.hpp>
+#include <boost/multi_index/hashed_index.hpp>
+#include <boost/multi_index/member.hpp>
+#include <boost/multi_index/ordered_index.hpp>
+#include <boost/multi_index_container.hpp>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+struct COrphanTx {
+    CTransactionRef tx;
+    NodeId fromPeer;
+    int64_t nTimeExpire;
+    //! Serialized size of the transaction, accounted against the pool limits.
+    size_t nTxSize;
+};
+
+/**
+ * Pool of the transactions received with missing inputs. Orphans are indexed
+ * by txid, by peer and by expiry time, and by the outpoints they spend, so
+ * that erasing the orphans of a peer, the expired ones, or the ones spending
+ * an outpoint does not scan the pool.
+ *
+ * The pool is limited both in number of transactions and in their total size,
+ * and each peer may only hold a share of either limit. Locking is left to the
+ * owner of the pool.
+ */
+class COrphanTxPool {
+public:
+    //! Each peer may hold up to 1 / PEER_SHARE of the pool limits.
+    static const size_t PEER_SHARE = 4;
+
+    //! Add an orphan, returns false if it is already in the pool.
+    bool AddTx(const CTransactionRef &tx, NodeId peer, int64_t nTimeExpire);
+    bool HaveTx(const TxId &txid) const;
+    //! Return the number of orphans erased, 0 or 1.
+    int EraseTx(const TxId &txid);
+    //! Erase the orphans received from a peer, and return their number.
+    int EraseForPeer(NodeId peer);
+    //! Erase the orphans expiring at nNow or before, and return their number.
+    int EraseExpired(int64_t nNow);
+    /**
+     * Evict orphans until each peer holds at most its share of the limits,
+     * then until the pool is within the limits, and return the number of
+     * orphans evicted. The oldest orphans of the peer holding the most are
+     * evicted first.
+     */
+    unsigned int LimitOrphans(size_t nMaxTxs, size_t nMaxTxsSize);
+    void Clear();
+
+    //! The orphans spending an outpoint.
+    std::vector<COrphanTx> GetChildren(const COutPoint &prevout) const;
+
+    size_t Size() const { return orphans.size(); }
+    size_t TotalTxSize() const { return nTotalTxSize; }
+    size_t PeerTxCount(NodeId peer) const;
+    size_t PeerTxSize(NodeId peer) const;
+
+private:
+    // extracts the transaction id of an orphan
+    struct orphantx_txid {
+        typedef TxId result_type;
+        result_type operator()(const COrphanTx &orphan) const {
+            return orphan.tx->GetId();
+        }
+    };
+
+    // multi_index tag names
+    struct txid_index {};
+    struct peer_index {};
+    struct expiry_index {};
+
+    typedef boost::multi_index_container<
+        COrphanTx,
+        boost::multi_index::indexed_by<
+            // sorted by txid
+            boost::multi_index::hashed_unique<
+                boost::multi_index::tag<txid_index>, orphantx_txid,
+                SaltedTxidHasher>,
+            // sorted by peer, then by expiry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<peer_index>,
+                boost::multi_index::composite_key<
+                    COrphanTx,
+                    boost::multi_index::member<COrphanTx, NodeId,
+                                               &COrphanTx::fromPeer>,
+                    boost::multi_index::member<COrphanTx, int64_t,
+                                               &COrphanTx::nTimeExpire>>>,
+            // sorted by expiry time
+            boost::multi_index::ordered_non_unique<
+                boost::multi_index::tag<expiry_index>,
+                boost::multi_index::member<COrphanTx, int64_t,
+                                           &COrphanTx::nTimeExpire>>>>
+        indexed_orphan_set;
+    typedef indexed_orphan_set::iterator txiter;
+
+    struct CompareIteratorByTxId {
+        bool operator()(const txiter &a, const txiter &b) const {
+            return a->tx->GetId() < b->tx->GetId();
+        }
+    };
+
+    struct PeerUsage {
+        size_t nTxs = 0;
+        size_t nTxsSize = 0;
+    };
+
+    indexed_orphan_set orphans;
+    std::unordered_map<COutPoint, std::set<txiter, CompareIteratorByTxId>,
+                       SaltedOutpointHasher>
+        mapOrphansByPrev;
+    std::map<NodeId, PeerUsage> mapPeerUsage;
+    size_t nTotalTxSize = 0;
+
+    void Erase(txiter it);
+    //! Evict the oldest orphan of a peer.
+    void EraseOldest(NodeId peer);
+};
+
+#endif // BITCOIN_TXORPHANPOOL_H
@@ -0,0 +1,69 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txrelaybatches.h>
+
+#include <txmempool.h>
+
+#include <algorithm>
+
+void CTxRelayBatches::MakeBatch(CTxMemPool &pool, int64_t nNow,
+                                int64_t nExpireTime) {
+    while (!vBatches.empty() && vBatches.front().nTime < nExpireTime) {
+        vBatches.pop_front();
+    }
+    if (vQueue.empty()) {
+        return;
+    }
+
+    Batch batch;
+    batch.nFirstSeq = nNextSeq;
+    batch.nTime = nNow;
+    batch.vtxid.reserve(vQueue.size());
+    {
+        LOCK(pool.cs);
+        // Topologically and fee-rate sort the inventory we send for privacy
+        // and priority reasons.
+        std::sort(vQueue.begin(), vQueue.end(),
+                  [&pool](const TxId &a, const TxId &b) {
+                      return pool.CompareDepthAndScore(a, b);
+                  });
+        vQueue.erase(std::unique(vQueue.begin(), vQueue.end()), vQueue.end());
+        for (const TxId &txid : vQueue) {
+            // Not in the mempool anymore? don't bother sending it.
+            if (pool.exists(txid)) {
+                batch.vtxid.push_back(txid);
+            }
+        }
+    }
+    vQueue.clear();
+
+    nNextSeq += batch.vtxid.size();
+    vBatches.push_back(std::move(batch));
+}
+
+void CTxRelayBatches::ForEachFrom(
+    uint64_t &nSeq, const std::function<bool(const TxId &)> &fn) const {
+    // Start from the batch holding nSeq, the last one starting at or before
+    // it.
+    auto it = std::upper_bound(vBatches.begin(), vBatches.end(), nSeq,
+                               [](uint64_t seq, const Batch &batch) {
+                                   return seq < batch.nFirstSeq;
+                               });
+    if (it != vBatches.begin()) {
+        it--;
+    }
+
+    for (; it != vBatches.end(); it++) {
+        const uint64_t nEndSeq = it->nFirstSeq + it->vtxid.size();
+        nSeq = std::max(nSeq, it->nFirstSeq);
+        while (nSeq < nEndSeq) {
+            const TxId &txid = it->vtxid[nSeq - it->nFirstSeq];
+            nSeq++;
+            if (!fn(txid)) {
+                return;
+            }
+        }
+    }
+}
@@ -0,0 +1,63 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRELAYBATCHES_H
+#define BITCOIN_TXRELAYBATCHES_H
+
+#include <primitives/transaction.h>
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+class CTxMemPool;
+
+/**
+ * Transactions relayed to all the peers. They are queued, then sorted into a
+ * batch once for all the peers when one of them is due an announcement.
+ * Relayed transactions are numbered in sequence, and each peer announces the
+ * batches from the sequence number it has reached.
+ *
+ * Batches only hold txids, so that they do not keep the transactions alive
+ * once they leave the mempool. Locking is left to the owner.
+ */
+class CTxRelayBatches {
+public:
+    //! Queue a transaction to be added to the next batch.
+    void Queue(const TxId &txid) { vQueue.push_back(txid); }
+
+    /**
+     * Drop the batches made before nExpireTime, then sort the queued
+     * transactions still in the mempool into a new batch made at nNow.
+     */
+    void MakeBatch(CTxMemPool &pool, int64_t nNow, int64_t nExpireTime);
+
+    /**
+     * Call fn on the batched transactions from sequence number nSeq on, and
+     * advance nSeq past each of them, until fn returns false. The
+     * transactions of the expired batches are skipped.
+     */
+    void ForEachFrom(uint64_t &nSeq,
+                     const std::function<bool(const TxId &)> &fn) const;
+
+    //! Sequence number of the next transaction added to a batch.
+    uint64_t NextSeq() const { return nNextSeq; }
+    size_t BatchCount() const { return vBatches.size(); }
+
+private:
+    struct Batch {
+        //! Sequence number of the first transaction of the batch.
+        uint64_t nFirstSeq;
+        //! Time the batch was made, in microseconds.
+        int64_t nTime;
+        std::vector<TxId> vtxid;
+    };
+
+    std::vector<TxId> vQueue;
+    std::deque<Batch> vBatches;
+    uint64_t nNextSeq = 0;
+};
+
+#endif // BITCOIN_TXRELAYBATCHES_H
@@ -0,0 +1,121 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <utxocommit.h>
+
+#include <coins.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <undo.h>
+#include <util/system.h>
+#include <version.h>
+
+#include <cassert>
+
+/**
+ * Serialize a coin the way it is committed to: its outpoint, followed by its
+ * height and coinbase flag and the output itself.
+ */
+static CDataStream SerializeCoin(const COutPoint &outpoint, const Coin &coin) {
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << outpoint;
+    ss << uint32_t(coin.GetHeight() * 2 + coin.IsCoinBase());
+    ss << coin.GetTxOut();
+    return ss;
+}
+
+CUtxoCommit::CUtxoCommit() {
+    Clear();
+}
+
+void CUtxoCommit::Add(const COutPoint &outpoint, const Coin &coin) {
+    assert(!coin.IsSpent());
+    CDataStream ss = SerializeCoin(outpoint, coin);
+    secp256k1_multiset_add(secp256k1_context_no_precomp, &multiset,
+                           reinterpret_cast<const uint8_t *>(ss.data()),
+                           ss.size());
+}
+
+void CUtxoCommit::Remove(const COutPoint &outpoint, const Coin &coin) {
+    assert(!coin.IsSpent());
+    CDataStream ss = SerializeCoin(outpoint, coin);
+    secp256k1_multiset_remove(secp256k1_context_no_precomp, &multiset,
+                              reinterpret_cast<const uint8_t *>(ss.data()),
+                              ss.size());
+}
+
+void CUtxoCommit::Add(const CUtxoCommit &other) {
+    secp256k1_multiset_combine(secp256k1_context_no_precomp, &multiset,
+                               &other.multiset);
+}
+
+bool CUtxoCommit::AddCoinView(CCoinsViewCursor *pcursor) {
+    while (pcursor->Valid()) {
+        COutPoint outpoint;
+        Coin coin;
+        if (!pcursor->GetKey(outpoint) || !pcursor->GetValue(coin)) {
+            return error("%s: unable to read value", __func__);
+        }
+        Add(outpoint, coin);
+        pcursor->Next();
+    }
+    return true;
+}
+
+void CUtxoCommit::ApplyBlock(const CBlock &block, const CBlockUndo &blockundo,
+                             int nHeight, bool fConnect) {
+    assert(blockundo.vtxundo.size() + 1 == block.vtx.size());
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = *block.vtx[i];
+        for (size_t o = 0; o < tx.vout.size(); o++) {
+            // Unspendable outputs are not added to the UTXO set.
+            if (tx.vout[o].scriptPubKey.IsUnspendable()) {
+                continue;
+            }
+
+            const COutPoint outpoint(tx.GetId(), o);
+            const Coin coin(tx.vout[o], nHeight, tx.IsCoinBase());
+            if (fConnect) {
+                Add(outpoint, coin);
+            } else {
+                Remove(outpoint, coin);
+            }
+        }
+
+        if (tx.IsCoinBase()) {
+            continue;
+        }
+
+        const CTxUndo &txundo = blockundo.vtxundo[i - 1];
+        assert(txundo.vprevout.size() == tx.vin.size());
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            if (fConnect) {
+                Remove(tx.vin[j].prevout, txundo.vprevout[j]);
+            } else {
+                Add(tx.vin[j].prevout, txundo.vprevout[j]);
+            }
+        }
+    }
+}
+
+void CUtxoCommit::ConnectBlock(const CBlock &block, const CBlockUndo &blockundo,
+                               int nHeight) {
+    ApplyBlock(block, blockundo, nHeight, true);
+}
+
+void CUtxoCommit::DisconnectBlock(const CBlock &block,
+                                  const CBlockUndo &blockundo, int nHeight) {
+    ApplyBlock(block, blockundo, nHeight, false);
+}
+
+uint256 CUtxoCommit::GetHash() const {
+    uint256 hash;
+    secp256k1_multiset_finalize(secp256k1_context_no_precomp, hash.begin(),
+                                &multiset);
+    return hash;
+}
+
+void CUtxoCommit::Clear() {
+    secp256k1_multiset_init(secp256k1_context_no_precomp, &multiset);
+}
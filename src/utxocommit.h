@@ -0,0 +1,99 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTXOCOMMIT_H
+#define BITCOIN_UTXOCOMMIT_H
+
+#include <uint256.h>
+
+#include <secp256k1_multiset.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <ios>
+
+class CBlock;
+class CBlockUndo;
+class CCoinsViewCursor;
+class Coin;
+class COutPoint;
+
+/**
+ * A commitment to a set of unspent transaction outputs, using the elliptic
+ * curve multiset hash (ECMH) of libsecp256k1's multiset module.
+ *
+ * Coins can be added and removed in any order and commitments to disjoint sets
+ * can be combined, so that a commitment to the UTXO set can be maintained
+ * incrementally as blocks are connected and disconnected, instead of being
+ * recomputed from a full scan of the set.
+ */
+class CUtxoCommit {
+private:
+    secp256k1_multiset multiset;
+
+    void ApplyBlock(const CBlock &block, const CBlockUndo &blockundo,
+                    int nHeight, bool fConnect);
+
+public:
+    //! Commitment to the empty set.
+    CUtxoCommit();
+
+    void Add(const COutPoint &outpoint, const Coin &coin);
+    void Remove(const COutPoint &outpoint, const Coin &coin);
+
+    //! Add the coins of another commitment, assumed to be disjoint.
+    void Add(const CUtxoCommit &other);
+
+    /**
+     * Add all the coins from the cursor.
+     * Returns false if reading from the cursor failed.
+     */
+    bool AddCoinView(CCoinsViewCursor *pcursor);
+
+    /**
+     * Apply connecting the block at height nHeight: remove the coins it spends,
+     * as found in its undo data, and add the outputs it creates. The outputs
+     * spent within the block are added and removed, which cancels out.
+     */
+    void ConnectBlock(const CBlock &block, const CBlockUndo &blockundo,
+                      int nHeight);
+
+    //! Revert ConnectBlock.
+    void DisconnectBlock(const CBlock &block, const CBlockUndo &blockundo,
+                         int nHeight);
+
+    //! 32 bytes hash of the committed set.
+    uint256 GetHash() const;
+
+    void Clear();
+
+    friend bool operator==(const CUtxoCommit &a, const CUtxoCommit &b) {
+        return a.GetHash() == b.GetHash();
+    }
+    friend bool operator!=(const CUtxoCommit &a, const CUtxoCommit &b) {
+        return !(a == b);
+    }
+
+    /**
+     * The layout of secp256k1_multiset is implementation defined, so the
+     * commitment is stored as the canonical 64 bytes encoding of its point.
+     */
+    template <typename Stream> void Serialize(Stream &s) const {
+        uint8_t data[64];
+        secp256k1_multiset_serialize(secp256k1_context_no_precomp, data,
+                                     &multiset);
+        s.write(reinterpret_cast<const char *>(data), sizeof(data));
+    }
+
+    template <typename Stream> void Unserialize(Stream &s) {
+        uint8_t data[64];
+        s.read(reinterpret_cast<char *>(data), sizeof(data));
+        if (!secp256k1_multiset_parse(secp256k1_context_no_precomp, &multiset,
+                                      data)) {
+            throw std::ios_base::failure("Invalid UTXO commitment");
+        }
+    }
+};
+
+#endif // BITCOIN_UTXOCOMMIT_H
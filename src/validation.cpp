@@ -18,6 +18,7 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
 #include <flatfile.h>
 #include <fs.h>
 #include <hash.h>
@@ -45,6 +46,7 @@
 #include <util/moneystr.h>
 #include <util/strencodings.h>
 #include <util/system.h>
+#include <utxocommit.h>
 #include <validationinterface.h>
 #include <warnings.h>
 
@@ -53,8 +55,11 @@
 
 #include <atomic>
 #include <future>
+#include <iterator>
+#include <limits>
 #include <sstream>
 #include <thread>
+#include <unordered_set>
 
 #include <core_io.h> // For debugging
 #include <key_io.h>  // For debugging
@@ -133,6 +138,11 @@ public:
     CBlockIndex *pindexBestInvalid = nullptr;
     CBlockIndex *pindexBestParked = nullptr;
     CBlockIndex const *pindexFinalized = nullptr;
+    /**
+     * Commitment to the UTXO set as of the tip of pcoinsTip, or null if it is
+     * not maintained (see -utxocommitment).
+     */
+    std::unique_ptr<CUtxoCommit> m_utxo_commit GUARDED_BY(cs_main);
 
     bool LoadBlockIndex(const Config &config, CBlockTreeDB &blocktree)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -144,10 +154,12 @@ public:
     /**
      * If a block header hasn't already been seen, call CheckBlockHeader on it,
      * ensure that it doesn't descend from an invalid block, and then add it to
-     * mapBlockIndex.
+     * mapBlockIndex. The hash of the header is passed in, as it is computed
+     * before cs_main is held for batches of headers.
      */
     bool AcceptBlockHeader(const Config &config, const CBlockHeader &block,
-                           CValidationState &state, CBlockIndex **ppindex)
+                           const BlockHash &hash, CValidationState &state,
+                           CBlockIndex **ppindex)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     bool AcceptBlock(const Config &config,
                      const std::shared_ptr<const CBlock> &pblock,
@@ -155,14 +167,17 @@ public:
                      const FlatFilePos *dbp, bool *fNewBlock)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
-    // Block (dis)connection on a given view:
+    // Block (dis)connection on a given view, optionally returning the undo
+    // data of the block:
     DisconnectResult DisconnectBlock(const CBlock &block,
                                      const CBlockIndex *pindex,
-                                     CCoinsViewCache &view);
+                                     CCoinsViewCache &view,
+                                     CBlockUndo *pblockundo = nullptr);
     bool ConnectBlock(const CBlock &block, CValidationState &state,
                       CBlockIndex *pindex, CCoinsViewCache &view,
                       const CChainParams &params,
-                      BlockValidationOptions options, bool fJustCheck = false)
+                      BlockValidationOptions options, bool fJustCheck = false,
+                      CBlockUndo *pblockundo = nullptr)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     // Block disconnection on our pcoinsTip:
@@ -210,9 +225,13 @@ private:
                     DisconnectedBlockTransactions &disconnectpool)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
-    CBlockIndex *AddToBlockIndex(const CBlockHeader &block)
+    CBlockIndex *AddToBlockIndex(const CBlockHeader &block,
+                                 const BlockHash &hash)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
-    /** Create a new block index entry for a given block hash */
+    /**
+     * Create a new block index entry for a given block hash. It is only
+     * published in blockIndexTree by LoadBlockIndex, once it is filled.
+     */
     CBlockIndex *InsertBlockIndex(const BlockHash &hash)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /**
@@ -250,12 +269,16 @@ private:
 RecursiveMutex cs_main;
 
 BlockMap &mapBlockIndex = g_chainstate.mapBlockIndex;
+// Never freed, so its entries are not reclaimed during static destruction,
+// after RCU stopped.
+BlockIndexTree &blockIndexTree = *new BlockIndexTree();
 CChain &chainActive = g_chainstate.chainActive;
 CBlockIndex *pindexBestHeader = nullptr;
 Mutex g_best_block_mutex;
 std::condition_variable g_best_block_cv;
 uint256 g_best_block;
 int nScriptCheckThreads = 0;
+bool fParallelBlockConnect = DEFAULT_PARALLEL_CONNECT;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
@@ -340,7 +363,7 @@ CBlockIndex *FindForkInGlobalIndex(const CChain &chain,
 }
 
 std::unique_ptr<CCoinsViewDB> pcoinsdbview;
-std::unique_ptr<CCoinsViewCache> pcoinsTip;
+std::unique_ptr<CCoinsViewShardedCache> pcoinsTip;
 std::unique_ptr<CBlockTreeDB> pblocktree;
 
 enum class FlushStateMode { NONE, IF_NEEDED, PERIODIC, ALWAYS };
@@ -356,6 +379,12 @@ static void FindFilesToPrune(std::set<int> &setFilesToPrune,
 static FILE *OpenUndoFile(const FlatFilePos &pos, bool fReadOnly = false);
 static FlatFileSeq BlockFileSeq();
 static FlatFileSeq UndoFileSeq();
+
+/** Mappings of the block and undo files, used to read them. */
+static FlatFileMapCache g_mapped_block_files(MAX_MAPPED_BLOCK_FILES,
+                                             MAX_MAPPED_BLOCK_FILE_BYTES);
+static FlatFileMapCache g_mapped_undo_files(MAX_MAPPED_BLOCK_FILES,
+                                            MAX_MAPPED_BLOCK_FILE_BYTES);
 static uint32_t GetNextBlockScriptFlags(const Consensus::Params &params,
                                         const CBlockIndex *pindex);
 
@@ -528,7 +557,8 @@ static bool CheckInputsFromMempoolAndCache(
             assert(txFrom->vout.size() > txin.prevout.GetN());
             assert(txFrom->vout[txin.prevout.GetN()] == coin.GetTxOut());
         } else {
-            const Coin &coinFromDisk = pcoinsTip->AccessCoin(txin.prevout);
+            Coin coinFromDisk;
+            pcoinsTip->GetCoin(txin.prevout, coinFromDisk);
             assert(!coinFromDisk.IsSpent());
             assert(coinFromDisk.GetTxOut() == coin.GetTxOut());
         }
@@ -900,7 +930,7 @@ bool GetTransaction(const TxId &txid, CTransactionRef &txOut,
         // use coin database to locate block that contains transaction, and scan
         // it
         if (fAllowSlow) {
-            const Coin &coin = AccessByTxid(*pcoinsTip, txid);
+            const Coin coin = AccessByTxid(*pcoinsTip, txid);
             if (!coin.IsSpent()) {
                 pindexSlow = chainActive[coin.GetHeight()];
             }
@@ -952,23 +982,75 @@ static bool WriteBlockToDisk(const CBlock &block, FlatFilePos &pos,
     return true;
 }
 
+/**
+ * Look up the record at pos, as written by WriteBlockToDisk or
+ * UndoWriteToDisk, in a memory mapping of its file. Only the files that blocks
+ * are no longer appended to are mapped. The span covers the record and the
+ * extra_size bytes following it, and is valid as long as the file is held.
+ */
+static bool GetMappedRecord(FlatFileMapCache &cache, const FlatFileSeq &seq,
+                            const FlatFilePos &pos, size_t extra_size,
+                            std::shared_ptr<const MappedFlatFile> &file,
+                            Span<const uint8_t> &record) {
+    {
+        LOCK(cs_LastBlockFile);
+        if (pos.nFile >= nLastBlockFile) {
+            return false;
+        }
+    }
+
+    // The record is preceded by its size.
+    if (pos.nPos < sizeof(uint32_t)) {
+        return false;
+    }
+    file = cache.Get(seq, pos.nFile, pos.nPos);
+    if (!file) {
+        return false;
+    }
+    const uint32_t nSize = ReadLE32(file->data() + pos.nPos - sizeof(uint32_t));
+    const size_t nEnd = size_t(pos.nPos) + nSize + extra_size;
+    if (nEnd > file->size()) {
+        // Undo data may still be appended to the file after it was mapped.
+        file = cache.Get(seq, pos.nFile, nEnd);
+        if (!file) {
+            return false;
+        }
+    }
+
+    record = Span<const uint8_t>(file->data() + pos.nPos, nSize + extra_size);
+    return true;
+}
+
 bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
                        const Consensus::Params &params) {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
-                     pos.ToString());
-    }
+    std::shared_ptr<const MappedFlatFile> mapped_file;
+    Span<const uint8_t> record;
+    if (GetMappedRecord(g_mapped_block_files, BlockFileSeq(), pos, 0,
+                        mapped_file, record)) {
+        // Read block from the page cache
+        try {
+            SpanReader(SER_DISK, CLIENT_VERSION, record) >> block;
+        } catch (const std::exception &e) {
+            return error("%s: Deserialize error - %s at %s", __func__,
+                         e.what(), pos.ToString());
+        }
+    } else {
+        // Open history file to read
+        CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return error("ReadBlockFromDisk: OpenBlockFile failed for %s",
+                         pos.ToString());
+        }
 
-    // Read block
-    try {
-        filein >> block;
-    } catch (const std::exception &e) {
-        return error("%s: Deserialize or I/O error - %s at %s", __func__,
-                     e.what(), pos.ToString());
+        // Read block
+        try {
+            filein >> block;
+        } catch (const std::exception &e) {
+            return error("%s: Deserialize or I/O error - %s at %s", __func__,
+                         e.what(), pos.ToString());
+        }
     }
 
     // Check the header
@@ -1001,6 +1083,115 @@ bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
     return true;
 }
 
+template <typename Stream>
+static bool UndoReadFromStream(Stream &filein, CBlockUndo &blockundo,
+                               const CBlockIndex *pindex) {
+    uint256 hashChecksum;
+    // We need a CHashVerifier as reserializing may lose data
+    CHashVerifier<Stream> verifier(&filein);
+    try {
+        verifier << pindex->pprev->GetBlockHash();
+        verifier >> blockundo;
+        filein >> hashChecksum;
+    } catch (const std::exception &e) {
+        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
+    }
+
+    // Verify checksum
+    if (hashChecksum != verifier.GetHash()) {
+        return error("%s: Checksum mismatch", __func__);
+    }
+
+    return true;
+}
+
+bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
+    FlatFilePos pos = pindex->GetUndoPos();
+    if (pos.IsNull()) {
+        return error("%s: no undo data available", __func__);
+    }
+
+    // Read from the page cache, the undo data being followed by its checksum
+    std::shared_ptr<const MappedFlatFile> mapped_file;
+    Span<const uint8_t> record;
+    if (GetMappedRecord(g_mapped_undo_files, UndoFileSeq(), pos,
+                        sizeof(uint256), mapped_file, record)) {
+        SpanReader filein(SER_DISK, CLIENT_VERSION, record);
+        return UndoReadFromStream(filein, blockundo, pindex);
+    }
+
+    // Open history file to read
+    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
+    if (filein.IsNull()) {
+        return error("%s: OpenUndoFile failed", __func__);
+    }
+
+    return UndoReadFromStream(filein, blockundo, pindex);
+}
+
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CBlockIndex *pindex) {
+    block.clear();
+
+    FlatFilePos pos;
+    {
+        LOCK(cs_main);
+        pos = pindex->GetBlockPos();
+    }
+
+    std::shared_ptr<const MappedFlatFile> mapped_file;
+    Span<const uint8_t> record;
+    if (GetMappedRecord(g_mapped_block_files, BlockFileSeq(), pos, 0,
+                        mapped_file, record)) {
+        block.assign(record.begin(), record.end());
+    } else {
+        // The block is preceded by its size.
+        if (pos.nPos < sizeof(uint32_t)) {
+            return error("%s: Invalid block position %s", __func__,
+                         pos.ToString());
+        }
+        CAutoFile filein(
+            OpenBlockFile(FlatFilePos(pos.nFile, pos.nPos - sizeof(uint32_t)),
+                          true),
+            SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull()) {
+            return error("%s: OpenBlockFile failed for %s", __func__,
+                         pos.ToString());
+        }
+
+        try {
+            uint32_t nSize;
+            filein >> nSize;
+            if (pos.nPos + uint64_t(nSize) >
+                fs::file_size(GetBlockPosFilename(pos))) {
+                return error("%s: Block size %u out of bounds at %s",
+                             __func__, nSize, pos.ToString());
+            }
+            block.resize(nSize);
+            filein.read(reinterpret_cast<char *>(block.data()), nSize);
+        } catch (const std::exception &e) {
+            return error("%s: I/O error - %s at %s", __func__, e.what(),
+                         pos.ToString());
+        }
+    }
+
+    // Check the header, the rest of the block is trusted as much as it is by
+    // ReadBlockFromDisk.
+    CBlockHeader header;
+    try {
+        VectorReader(SER_DISK, CLIENT_VERSION, block, 0) >> header;
+    } catch (const std::exception &e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(),
+                     pos.ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash()) {
+        return error("%s: GetHash() doesn't match index for %s at %s",
+                     __func__, pindex->ToString(), pos.ToString());
+    }
+
+    return true;
+}
+
 Amount GetBlockSubsidy(int nHeight, const Consensus::Params &consensusParams) {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
     // Force block reward to zero when right shift is undefined.
@@ -1400,38 +1591,6 @@ bool UndoWriteToDisk(const CBlockUndo &blockundo, FlatFilePos &pos,
     return true;
 }
 
-static bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex) {
-    FlatFilePos pos = pindex->GetUndoPos();
-    if (pos.IsNull()) {
-        return error("%s: no undo data available", __func__);
-    }
-
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull()) {
-        return error("%s: OpenUndoFile failed", __func__);
-    }
-
-    // Read block
-    uint256 hashChecksum;
-    // We need a CHashVerifier as reserializing may lose data
-    CHashVerifier<CAutoFile> verifier(&filein);
-    try {
-        verifier << pindex->pprev->GetBlockHash();
-        verifier >> blockundo;
-        filein >> hashChecksum;
-    } catch (const std::exception &e) {
-        return error("%s: Deserialize or I/O error - %s", __func__, e.what());
-    }
-
-    // Verify checksum
-    if (hashChecksum != verifier.GetHash()) {
-        return error("%s: Checksum mismatch", __func__);
-    }
-
-    return true;
-}
-
 /** Abort with a message */
 static bool AbortNode(const std::string &strMessage,
                       const std::string &userMessage = "") {
@@ -1469,7 +1628,7 @@ DisconnectResult UndoCoinSpend(const Coin &undo, CCoinsViewCache &view,
         // this information only in undo records for the last spend of a
         // transactions' outputs. This implies that it must be present for some
         // other output of the same tx.
-        const Coin &alternate = AccessByTxid(view, out.GetTxId());
+        const Coin alternate = AccessByTxid(view, out.GetTxId());
         if (alternate.IsSpent()) {
             // Adding output for transaction without known metadata
             return DISCONNECT_FAILED;
@@ -1497,14 +1656,20 @@ DisconnectResult UndoCoinSpend(const Coin &undo, CCoinsViewCache &view,
  */
 DisconnectResult CChainState::DisconnectBlock(const CBlock &block,
                                               const CBlockIndex *pindex,
-                                              CCoinsViewCache &view) {
+                                              CCoinsViewCache &view,
+                                              CBlockUndo *pblockundo) {
     CBlockUndo blockUndo;
     if (!UndoReadFromDisk(blockUndo, pindex)) {
         error("DisconnectBlock(): failure reading undo data");
         return DISCONNECT_FAILED;
     }
 
-    return ApplyBlockUndo(blockUndo, block, pindex, view);
+    DisconnectResult res = ApplyBlockUndo(blockUndo, block, pindex, view);
+    if (pblockundo) {
+        // The legacy undo records missing their metadata were completed.
+        *pblockundo = std::move(blockUndo);
+    }
+    return res;
 }
 
 DisconnectResult ApplyBlockUndo(const CBlockUndo &blockUndo,
@@ -1612,11 +1777,62 @@ static bool WriteUndoDataForBlock(const CBlockUndo &blockundo,
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
+static CCheckQueue<CWorkerTask> workerqueue(128);
 
 void ThreadScriptCheck() {
     RenameThread("bitcoin-scriptch");
-    scriptcheckqueue.Thread();
+    workerqueue.Thread();
+}
+
+void RunWorkerTasks(std::vector<CWorkerTask> &tasks) {
+    CCheckQueueControl<CWorkerTask> control(&workerqueue);
+    control.Add(tasks);
+    control.Wait();
+}
+
+/** Queue script checks on the script checking threads. */
+static void AddScriptChecks(CCheckQueueControl<CWorkerTask> &control,
+                            std::vector<CScriptCheck> &vChecks) {
+    std::vector<CWorkerTask> tasks;
+    tasks.reserve(vChecks.size());
+    for (CScriptCheck &check : vChecks) {
+        tasks.emplace_back(std::move(check));
+    }
+    control.Add(tasks);
+}
+
+bool CTxInputCheck::operator()() {
+    const CTransaction &tx = *ptx;
+    CValidationState &state = presult->state;
+
+    if (pspentCoins) {
+        if (!Consensus::CheckTxInputs(tx, state, *pspentCoins,
+                                      pindex->nHeight, presult->txfee)) {
+            return false;
+        }
+        presult->nSigOpsCount =
+            GetTransactionSigOpCount(tx, *pspentCoins, nFlags);
+    } else {
+        presult->nSigOpsCount = GetSigOpCountWithoutP2SH(tx, nFlags);
+    }
+
+    if (presult->nSigOpsCount > MAX_TX_SIGOPS_COUNT) {
+        return state.DoS(100, false, REJECT_INVALID, "bad-txn-sigops");
+    }
+
+    if (pspentCoins) {
+        std::vector<int> prevheights(tx.vin.size());
+        for (size_t j = 0; j < tx.vin.size(); j++) {
+            prevheights[j] = (*pspentCoins)[j].GetHeight();
+        }
+
+        if (!SequenceLocks(tx, nLockTimeFlags, &prevheights, *pindex)) {
+            return state.DoS(100, false, REJECT_INVALID, "bad-txns-nonfinal");
+        }
+    }
+
+    presult->fChecked = true;
+    return true;
 }
 
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
@@ -1721,6 +1937,21 @@ static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
 
+/**
+ * The two blocks in the chain violating BIP30, whose coinbase overwrites the
+ * unspent outputs of an earlier coinbase with the same txid.
+ */
+static bool IsBIP30Repeat(const CBlockIndex &block_index) {
+    return (block_index.nHeight == 91842 &&
+            block_index.GetBlockHash() ==
+                uint256S("0x00000000000a4d0a398161ffc163c503763b1f4360639393e0"
+                         "e4c8e300e0caec")) ||
+           (block_index.nHeight == 91880 &&
+            block_index.GetBlockHash() ==
+                uint256S("0x00000000000743f190a18c5577a3c2d2a1f610ae9601ac046a"
+                         "38084ccb7cd721"));
+}
+
 /**
  * Apply the effects of this block (with given index) on the UTXO set
  * represented by coins. Validity checks that depend on the UTXO set are also
@@ -1730,8 +1961,8 @@ static int64_t nBlocksTotal = 0;
 bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
                                CBlockIndex *pindex, CCoinsViewCache &view,
                                const CChainParams &params,
-                               BlockValidationOptions options,
-                               bool fJustCheck) {
+                               BlockValidationOptions options, bool fJustCheck,
+                               CBlockUndo *pblockundo) {
     AssertLockHeld(cs_main);
     assert(pindex);
     assert(*pindex->phashBlock == block.GetHash());
@@ -1836,14 +2067,7 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
     // applied to all blocks except the two in the chain that violate it. This
     // prevents exploiting the issue against nodes during their initial block
     // download.
-    bool fEnforceBIP30 = !((pindex->nHeight == 91842 &&
-                            pindex->GetBlockHash() ==
-                                uint256S("0x00000000000a4d0a398161ffc163c503763"
-                                         "b1f4360639393e0e4c8e300e0caec")) ||
-                           (pindex->nHeight == 91880 &&
-                            pindex->GetBlockHash() ==
-                                uint256S("0x00000000000743f190a18c5577a3c2d2a1f"
-                                         "610ae9601ac046a38084ccb7cd721")));
+    bool fEnforceBIP30 = !IsBIP30Repeat(*pindex);
 
     // Once BIP34 activated it was not possible to create new duplicate
     // coinbases and thus other than starting with the 2 existing duplicate
@@ -1916,8 +2140,37 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
     CBlockUndo blockundo;
     blockundo.vtxundo.resize(block.vtx.size() - 1);
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks ? &scriptcheckqueue
-                                                           : nullptr);
+    // In parallel mode, the input checks and coin prefetches run on the script
+    // checking threads along with the script checks.
+    CCheckQueueControl<CWorkerTask> control(
+        fScriptChecks || fParallelBlockConnect ? &workerqueue : nullptr);
+
+    // In parallel mode, the coins spent by the block are loaded into the
+    // backing view of view by the script checking threads, while the loop
+    // below spends them in order. This is only done when the backing view
+    // supports concurrent reads. The coins created by the block are not in it,
+    // so are not looked up there.
+    const CCoinsViewShardedCache *prefetchView =
+        dynamic_cast<const CCoinsViewShardedCache *>(view.GetBackend());
+    if (fParallelBlockConnect && nScriptCheckThreads && prefetchView) {
+        std::unordered_set<TxId, SaltedTxidHasher> blockTxIds;
+        for (const auto &ptx : block.vtx) {
+            blockTxIds.insert(ptx->GetId());
+        }
+        std::vector<CWorkerTask> vPrefetch;
+        for (const auto &ptx : block.vtx) {
+            if (ptx->IsCoinBase()) {
+                continue;
+            }
+            for (const CTxIn &txin : ptx->vin) {
+                if (!blockTxIds.count(txin.prevout.GetTxId())) {
+                    vPrefetch.emplace_back(
+                        CCoinPrefetch(*prefetchView, txin.prevout));
+                }
+            }
+        }
+        control.Add(vPrefetch);
+    }
 
     // Add all outputs
     try {
@@ -1938,12 +2191,77 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
             REJECT_INVALID, "tx-duplicate");
     }
 
+    // In parallel mode, only the spends are done here, in block order so that
+    // double spends are still detected. The fee, sigops and sequence lock
+    // checks are deferred to the script checking threads, which work on the
+    // spent coins recorded in the undo data. The script checks are only queued
+    // once these checks passed, as when the block is connected serially.
+    // The results must outlive the control, which waits for pending checks
+    // when it goes out of scope.
+    std::vector<TxInputCheckResult> inputResults;
+    std::vector<CScriptCheck> vDeferredScriptChecks;
+    if (fParallelBlockConnect) {
+        inputResults.resize(block.vtx.size());
+    }
+
     size_t txIndex = 0;
     for (const auto &ptx : block.vtx) {
         const CTransaction &tx = *ptx;
         const bool isCoinBase = tx.IsCoinBase();
         nInputs += tx.vin.size();
 
+        if (fParallelBlockConnect) {
+            // The coinbase comes first and has no undo entry.
+            const size_t nTx = isCoinBase ? 0 : txIndex + 1;
+            const std::vector<Coin> *pspentCoins = nullptr;
+            if (!isCoinBase) {
+                if (!view.HaveInputs(tx)) {
+                    return state.DoS(
+                        100,
+                        error("%s: inputs of %s missing or spent", __func__,
+                              tx.GetId().ToString()),
+                        REJECT_INVALID, "bad-txns-inputs-missingorspent");
+                }
+
+                // Don't cache results if we're actually connecting blocks
+                // (still consult the cache, though).
+                bool fCacheResults = fJustCheck;
+
+                std::vector<CScriptCheck> vChecks;
+                int nSigChecksRet;
+                if (!CheckInputs(tx, state, view, fScriptChecks, flags,
+                                 fCacheResults, fCacheResults,
+                                 PrecomputedTransactionData(tx), nSigChecksRet,
+                                 nSigChecksTxLimiters.at(txIndex),
+                                 &nSigChecksBlockLimiter, &vChecks)) {
+                    if (!nSigChecksBlockLimiter.check()) {
+                        return state.DoS(
+                            100, false, REJECT_INVALID, "blk-bad-inputs",
+                            false, "CheckInputs exceeded SigChecks limit");
+                    }
+                    return error("ConnectBlock(): CheckInputs on %s failed "
+                                 "with %s",
+                                 tx.GetId().ToString(),
+                                 FormatStateMessage(state));
+                }
+
+                std::move(vChecks.begin(), vChecks.end(),
+                          std::back_inserter(vDeferredScriptChecks));
+
+                CTxUndo &txundo = blockundo.vtxundo.at(txIndex);
+                SpendCoins(view, tx, txundo, pindex->nHeight);
+                pspentCoins = &txundo.vprevout;
+                txIndex++;
+            }
+
+            std::vector<CWorkerTask> vInputChecks;
+            vInputChecks.emplace_back(
+                CTxInputCheck(tx, pspentCoins, *pindex, flags, nLockTimeFlags,
+                              inputResults.at(nTx)));
+            control.Add(vInputChecks);
+            continue;
+        }
+
         Amount txfee = Amount::zero();
         if (!isCoinBase && !Consensus::CheckTxInputs(tx, state, view,
                                                      pindex->nHeight, txfee)) {
@@ -2016,7 +2334,7 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
                          tx.GetId().ToString(), FormatStateMessage(state));
         }
 
-        control.Add(vChecks);
+        AddScriptChecks(control, vChecks);
 
         // Note: this must execute in the same iteration as CheckTxInputs (not
         // in a separate loop) in order to detect double spends. However,
@@ -2027,6 +2345,44 @@ bool CChainState::ConnectBlock(const CBlock &block, CValidationState &state,
         txIndex++;
     }
 
+    if (fParallelBlockConnect) {
+        // Only the input checks and coin prefetches were queued so far.
+        if (!control.Wait()) {
+            // Report the first failure we know about. The queue stops running
+            // checks once one has failed, so there must be one.
+            for (size_t i = 0; i < block.vtx.size(); i++) {
+                const TxInputCheckResult &result = inputResults[i];
+                if (!result.fChecked && !result.state.IsValid()) {
+                    state = result.state;
+                    return error("%s: input checks on %s failed with %s",
+                                 __func__, block.vtx[i]->GetId().ToString(),
+                                 FormatStateMessage(state));
+                }
+            }
+            return state.DoS(100, false, REJECT_INVALID, "blk-bad-inputs",
+                             false, "parallel input check failed");
+        }
+
+        for (const TxInputCheckResult &result : inputResults) {
+            nFees += result.txfee;
+            if (!MoneyRange(nFees)) {
+                return state.DoS(
+                    100,
+                    error("%s: accumulated fee in the block out of range.",
+                          __func__),
+                    REJECT_INVALID, "bad-txns-accumulated-fee-outofrange");
+            }
+
+            nSigOpsCount += result.nSigOpsCount;
+            if (nSigOpsCount > nMaxSigOpsCount) {
+                return state.DoS(100, error("ConnectBlock(): too many sigops"),
+                                 REJECT_INVALID, "bad-blk-sigops");
+            }
+        }
+
+        AddScriptChecks(control, vDeferredScriptChecks);
+    }
+
     int64_t nTime3 = GetTimeMicros();
     nTimeConnect += nTime3 - nTime2;
     LogPrint(BCLog::BENCH,
@@ -2098,6 +2454,10 @@ MinerFundSuccess:
         return false;
     }
 
+    if (pblockundo) {
+        *pblockundo = std::move(blockundo);
+    }
+
     if (!pindex->IsValid(BlockValidity::SCRIPTS)) {
         pindex->RaiseValidity(BlockValidity::SCRIPTS);
         setDirtyBlockIndex.insert(pindex);
@@ -2258,6 +2618,10 @@ static bool FlushStateToDisk(const CChainParams &chainparams,
 
                 // Flush the chainstate (which may refer to block index
                 // entries).
+                if (g_chainstate.m_utxo_commit) {
+                    pcoinsdbview->SetUtxoCommitment(
+                        *g_chainstate.m_utxo_commit);
+                }
                 if (!pcoinsTip->Flush()) {
                     return AbortNode(state, "Failed to write to coin database");
                 }
@@ -2351,11 +2715,19 @@ bool CChainState::DisconnectTip(const Config &config, CValidationState &state,
     {
         CCoinsViewCache view(pcoinsTip.get());
         assert(view.GetBestBlock() == pindexDelete->GetBlockHash());
-        if (DisconnectBlock(block, pindexDelete, view) != DISCONNECT_OK) {
+        CBlockUndo blockundo;
+        if (DisconnectBlock(block, pindexDelete, view, &blockundo) !=
+            DISCONNECT_OK) {
             return error("DisconnectTip(): DisconnectBlock %s failed",
                          pindexDelete->GetBlockHash().ToString());
         }
 
+        // The outputs of the genesis block are not in the UTXO set.
+        if (m_utxo_commit && pindexDelete->nHeight > 0) {
+            m_utxo_commit->DisconnectBlock(block, blockundo,
+                                           pindexDelete->nHeight);
+        }
+
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -2599,8 +2971,10 @@ bool CChainState::ConnectTip(const Config &config, CValidationState &state,
              (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
     {
         CCoinsViewCache view(pcoinsTip.get());
+        CBlockUndo blockundo;
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, params,
-                               BlockValidationOptions(config));
+                               BlockValidationOptions(config),
+                               /*fJustCheck=*/false, &blockundo);
         GetMainSignals().BlockChecked(blockConnecting, state);
         if (!rv) {
             if (state.IsInvalid()) {
@@ -2623,6 +2997,26 @@ bool CChainState::ConnectTip(const Config &config, CValidationState &state,
                          FormatStateMessage(state));
         }
 
+        // The outputs of the genesis block are not in the UTXO set, as its
+        // coinbase is not spendable.
+        if (m_utxo_commit && pindexNew->nHeight > 0) {
+            // The undo data doesn't record the coins overwritten by the
+            // coinbase of the blocks violating BIP30, which are still in
+            // pcoinsTip.
+            if (IsBIP30Repeat(*pindexNew)) {
+                const CTransaction &coinbase = *blockConnecting.vtx[0];
+                for (size_t o = 0; o < coinbase.vout.size(); o++) {
+                    const COutPoint outpoint(coinbase.GetId(), o);
+                    Coin coin;
+                    if (pcoinsTip->GetCoin(outpoint, coin)) {
+                        m_utxo_commit->Remove(outpoint, coin);
+                    }
+                }
+            }
+            m_utxo_commit->ConnectBlock(blockConnecting, blockundo,
+                                        pindexNew->nHeight);
+        }
+
         nTime3 = GetTimeMicros();
         nTimeConnectTotal += nTime3 - nTime2;
         LogPrint(BCLog::BENCH,
@@ -3450,11 +3844,11 @@ bool IsBlockFinalized(const CBlockIndex *pindex) {
            pindexFinalized->GetAncestor(pindex->nHeight) == pindex;
 }
 
-CBlockIndex *CChainState::AddToBlockIndex(const CBlockHeader &block) {
+CBlockIndex *CChainState::AddToBlockIndex(const CBlockHeader &block,
+                                          const BlockHash &hash) {
     AssertLockHeld(cs_main);
 
     // Check for duplicate
-    BlockHash hash = block.GetHash();
     BlockMap::iterator it = mapBlockIndex.find(hash);
     if (it != mapBlockIndex.end()) {
         return it->second;
@@ -3489,6 +3883,9 @@ CBlockIndex *CChainState::AddToBlockIndex(const CBlockHeader &block) {
         pindexBestHeader = pindexNew;
     }
 
+    // Publish the entry once the fields read without cs_main are set.
+    PublishBlockIndex(pindexNew);
+
     setDirtyBlockIndex.insert(pindexNew);
     return pindexNew;
 }
@@ -3565,7 +3962,15 @@ static bool FindBlockPos(FlatFilePos &pos, unsigned int nAddSize,
     }
 
     if (!fKnown) {
-        while (vinfoBlockFile[nFile].nSize + nAddSize >= MAX_BLOCKFILE_SIZE) {
+        unsigned int max_blockfile_size = MAX_BLOCKFILE_SIZE;
+        if (gArgs.GetBoolArg("-fastprune", false)) {
+            max_blockfile_size = 0x10000; // 64 KiB
+            if (nAddSize >= max_blockfile_size) {
+                // Always allow a block to be stored in a file of its own.
+                max_blockfile_size = nAddSize + 1;
+            }
+        }
+        while (vinfoBlockFile[nFile].nSize + nAddSize >= max_blockfile_size) {
             nFile++;
             if (vinfoBlockFile.size() <= nFile) {
                 vinfoBlockFile.resize(nFile + 1);
@@ -3641,12 +4046,13 @@ static bool FindUndoPos(CValidationState &state, int nFile, FlatFilePos &pos,
  * Do not call this for any check that depends on the context.
  * For context-dependent calls, see ContextualCheckBlockHeader.
  */
-static bool CheckBlockHeader(const CBlockHeader &block, CValidationState &state,
+static bool CheckBlockHeader(const CBlockHeader &block, const BlockHash &hash,
+                             CValidationState &state,
                              const Consensus::Params &params,
                              BlockValidationOptions validationOptions) {
     // Check proof of work matches claimed amount
     if (validationOptions.shouldValidatePoW() &&
-        !CheckProofOfWork(block.GetHash(), block.nBits, params)) {
+        !CheckProofOfWork(hash, block.nBits, params)) {
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false,
                          "proof of work failed");
     }
@@ -3664,7 +4070,8 @@ bool CheckBlock(const CBlock &block, CValidationState &state,
 
     // Check that the header is valid (particularly PoW).  This is mostly
     // redundant with the call in AcceptBlockHeader.
-    if (!CheckBlockHeader(block, state, params, validationOptions)) {
+    if (!CheckBlockHeader(block, block.GetHash(), state, params,
+                          validationOptions)) {
         return false;
     }
 
@@ -3752,6 +4159,7 @@ bool CheckBlock(const CBlock &block, CValidationState &state,
  */
 static bool ContextualCheckBlockHeader(const CChainParams &params,
                                        const CBlockHeader &block,
+                                       const BlockHash &hash,
                                        CValidationState &state,
                                        const CBlockIndex *pindexPrev,
                                        int64_t nAdjustedTime) {
@@ -3773,7 +4181,7 @@ static bool ContextualCheckBlockHeader(const CChainParams &params,
 
         // Check that the block chain matches the known block chain up to a
         // checkpoint.
-        if (!Checkpoints::CheckBlock(checkpoints, nHeight, block.GetHash())) {
+        if (!Checkpoints::CheckBlock(checkpoints, nHeight, hash)) {
             return state.DoS(100,
                              error("%s: rejected by checkpoint lock-in at %d",
                                    __func__, nHeight),
@@ -3967,13 +4375,13 @@ static bool ContextualCheckBlock(const CBlock &block, CValidationState &state,
  */
 bool CChainState::AcceptBlockHeader(const Config &config,
                                     const CBlockHeader &block,
+                                    const BlockHash &hash,
                                     CValidationState &state,
                                     CBlockIndex **ppindex) {
     AssertLockHeld(cs_main);
     const CChainParams &chainparams = config.GetChainParams();
 
     // Check for duplicate
-    BlockHash hash = block.GetHash();
     BlockMap::iterator miSelf = mapBlockIndex.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -3993,7 +4401,7 @@ bool CChainState::AcceptBlockHeader(const Config &config,
             return true;
         }
 
-        if (!CheckBlockHeader(block, state, chainparams.GetConsensus(),
+        if (!CheckBlockHeader(block, hash, state, chainparams.GetConsensus(),
                               BlockValidationOptions(config))) {
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__,
                          hash.ToString(), FormatStateMessage(state));
@@ -4013,8 +4421,8 @@ bool CChainState::AcceptBlockHeader(const Config &config,
                              REJECT_INVALID, "bad-prevblk");
         }
 
-        if (!ContextualCheckBlockHeader(chainparams, block, state, pindexPrev,
-                                        GetAdjustedTime())) {
+        if (!ContextualCheckBlockHeader(chainparams, block, hash, state,
+                                        pindexPrev, GetAdjustedTime())) {
             return error("%s: Consensus::ContextualCheckBlockHeader: %s, %s",
                          __func__, hash.ToString(), FormatStateMessage(state));
         }
@@ -4063,7 +4471,7 @@ bool CChainState::AcceptBlockHeader(const Config &config,
     }
 
     if (pindex == nullptr) {
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
     }
 
     if (ppindex) {
@@ -4074,23 +4482,72 @@ bool CChainState::AcceptBlockHeader(const Config &config,
     return true;
 }
 
+/** Minimum number of headers hashed by each thread hashing a batch. */
+static constexpr size_t MIN_HEADERS_PER_HASH_THREAD = 250;
+/** Maximum number of threads hashing a batch of headers. */
+static constexpr size_t MAX_HEADER_HASH_THREADS = 8;
+
+std::vector<BlockHash>
+HashBlockHeaders(const std::vector<CBlockHeader> &headers, int nThreads) {
+    std::vector<BlockHash> hashes(headers.size());
+    auto hashSlice = [&headers, &hashes](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            hashes[i] = headers[i].GetHash();
+        }
+    };
+
+    const size_t nSlices =
+        std::min<size_t>({size_t(std::max(nThreads, 1)),
+                          MAX_HEADER_HASH_THREADS,
+                          headers.size() / MIN_HEADERS_PER_HASH_THREAD});
+    if (nSlices <= 1) {
+        hashSlice(0, headers.size());
+        return hashes;
+    }
+
+    const size_t nSliceSize = (headers.size() + nSlices - 1) / nSlices;
+    std::vector<CWorkerTask> tasks;
+    for (size_t begin = 0; begin < headers.size(); begin += nSliceSize) {
+        const size_t end = std::min(begin + nSliceSize, headers.size());
+        tasks.emplace_back([&hashSlice, begin, end]() {
+            hashSlice(begin, end);
+            return true;
+        });
+    }
+    RunWorkerTasks(tasks);
+    return hashes;
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const Config &config,
                             const std::vector<CBlockHeader> &headers,
                             CValidationState &state,
                             const CBlockIndex **ppindex,
+                            CBlockHeader *first_invalid, int nHashThreads) {
+    return ProcessNewBlockHeaders(config, headers,
+                                  HashBlockHeaders(headers, nHashThreads),
+                                  state, ppindex, first_invalid);
+}
+
+bool ProcessNewBlockHeaders(const Config &config,
+                            const std::vector<CBlockHeader> &headers,
+                            const std::vector<BlockHash> &hashes,
+                            CValidationState &state,
+                            const CBlockIndex **ppindex,
                             CBlockHeader *first_invalid) {
+    assert(hashes.size() == headers.size());
     if (first_invalid != nullptr) {
         first_invalid->SetNull();
     }
 
     {
         LOCK(cs_main);
-        for (const CBlockHeader &header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader &header = headers[i];
             // Use a temp pindex instead of ppindex to avoid a const_cast
             CBlockIndex *pindex = nullptr;
-            if (!g_chainstate.AcceptBlockHeader(config, header, state,
-                                                &pindex)) {
+            if (!g_chainstate.AcceptBlockHeader(config, header, hashes[i],
+                                                state, &pindex)) {
                 if (first_invalid) {
                     *first_invalid = header;
                 }
@@ -4156,7 +4613,7 @@ bool CChainState::AcceptBlock(const Config &config,
     }
 
     CBlockIndex *pindex = nullptr;
-    if (!AcceptBlockHeader(config, block, state, &pindex)) {
+    if (!AcceptBlockHeader(config, block, block.GetHash(), state, &pindex)) {
         return false;
     }
 
@@ -4357,8 +4814,8 @@ bool TestBlockValidity(CValidationState &state, const CChainParams &params,
     indexDummy.phashBlock = &block_hash;
 
     // NOTE: CheckBlockHeader is called by CheckBlock
-    if (!ContextualCheckBlockHeader(params, block, state, pindexPrev,
-                                    GetAdjustedTime())) {
+    if (!ContextualCheckBlockHeader(params, block, block_hash, state,
+                                    pindexPrev, GetAdjustedTime())) {
         return error("%s: Consensus::ContextualCheckBlockHeader: %s", __func__,
                      FormatStateMessage(state));
     }
@@ -4441,6 +4898,8 @@ void PruneOneBlockFile(const int fileNumber) {
 void UnlinkPrunedFiles(const std::set<int> &setFilesToPrune) {
     for (const int i : setFilesToPrune) {
         FlatFilePos pos(i, 0);
+        g_mapped_block_files.Erase(i);
+        g_mapped_undo_files.Erase(i);
         fs::remove(BlockFileSeq().FileName(pos));
         fs::remove(UndoFileSeq().FileName(pos));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, i);
@@ -4637,6 +5096,9 @@ bool CChainState::LoadBlockIndex(const Config &config,
          mapBlockIndex) {
         CBlockIndex *pindex = item.second;
         vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
+        // The entries are only published once they were filled from the
+        // database, as InsertBlockIndex creates them empty.
+        PublishBlockIndex(pindex);
     }
 
     sort(vSortedByHeight.begin(), vSortedByHeight.end());
@@ -5098,12 +5560,62 @@ bool ReplayBlocks(const Consensus::Params &params, CCoinsView *view) {
     return g_chainstate.ReplayBlocks(params, view);
 }
 
+bool LoadUtxoCommitment() {
+    AssertLockHeld(cs_main);
+
+    auto commit = std::make_unique<CUtxoCommit>();
+    if (pcoinsTip->GetBestBlock().IsNull()) {
+        // No block was connected yet, the UTXO set is empty.
+        g_chainstate.m_utxo_commit = std::move(commit);
+        return true;
+    }
+
+    BlockHash hashStored;
+    if (pcoinsdbview->GetUtxoCommitment(hashStored, *commit) &&
+        hashStored == pcoinsTip->GetBestBlock()) {
+        LogPrintf("Loaded UTXO commitment %s at block %s\n",
+                  commit->GetHash().ToString(), hashStored.ToString());
+        g_chainstate.m_utxo_commit = std::move(commit);
+        return true;
+    }
+
+    // The stored commitment is missing or stale: flush the coins cache so the
+    // database is up to date and compute the commitment from scratch.
+    LogPrintf("Computing UTXO commitment, this may take a while...\n");
+    if (!pcoinsTip->Flush()) {
+        return error("%s: failed to flush the coins cache", __func__);
+    }
+
+    commit->Clear();
+    std::unique_ptr<CCoinsViewCursor> pcursor(pcoinsdbview->Cursor());
+    if (!commit->AddCoinView(pcursor.get())) {
+        return error("%s: failed to read the coins database", __func__);
+    }
+
+    LogPrintf("Computed UTXO commitment %s at block %s\n",
+              commit->GetHash().ToString(),
+              pcursor->GetBestBlock().ToString());
+    g_chainstate.m_utxo_commit = std::move(commit);
+    return true;
+}
+
+bool GetUtxoCommitment(uint256 &hash) {
+    AssertLockHeld(cs_main);
+    if (!g_chainstate.m_utxo_commit) {
+        return false;
+    }
+
+    hash = g_chainstate.m_utxo_commit->GetHash();
+    return true;
+}
+
 // May NOT be used after any connections are up as much of the peer-processing
 // logic assumes a consistent block index state
 void CChainState::UnloadBlockIndex() {
     nBlockSequenceId = 1;
     m_failed_blocks.clear();
     setBlockIndexCandidates.clear();
+    m_utxo_commit.reset();
 }
 
 // May NOT be used after any connections are up as much
@@ -5126,10 +5638,13 @@ void UnloadBlockIndex() {
     setDirtyFileInfo.clear();
 
     for (const BlockMap::value_type &entry : mapBlockIndex) {
+        blockIndexTree.remove(entry.first);
         delete entry.second;
     }
 
     mapBlockIndex.clear();
+    // Reclaim the entries removed from blockIndexTree.
+    RCULock::synchronize();
     fHavePruned = false;
 
     g_chainstate.UnloadBlockIndex();
@@ -5176,7 +5691,7 @@ bool CChainState::LoadGenesisBlock(const CChainParams &chainparams) {
         if (blockPos.IsNull()) {
             return error("%s: writing genesis block to disk failed", __func__);
         }
-        CBlockIndex *pindex = AddToBlockIndex(block);
+        CBlockIndex *pindex = AddToBlockIndex(block, block.GetHash());
         ReceivedBlockTransactions(block, pindex, blockPos);
     } catch (const std::runtime_error &e) {
         return error("%s: failed to write genesis block: %s", __func__,
@@ -5190,15 +5705,166 @@ bool LoadGenesisBlock(const CChainParams &chainparams) {
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+/**
+ * Map of disk positions for blocks with unknown parent (only used for
+ * reindex). Only accessed from the import thread.
+ */
+static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
+
+/**
+ * Scan a stream of blocks, each preceded by the disk magic and its size, and
+ * pass the blocks that can be deserialized to fn along with their position in
+ * the stream. Scanning stops at the end of the stream or when fn returns
+ * false.
+ */
+static void ScanBlockFile(
+    const CChainParams &chainparams, CBufferedFile &blkdat,
+    const std::function<bool(const std::shared_ptr<CBlock> &, uint64_t)> &fn) {
+    uint64_t nRewind = blkdat.GetPos();
+    while (!blkdat.eof()) {
+        boost::this_thread::interruption_point();
+
+        blkdat.SetPos(nRewind);
+        // Start one byte further next time, in case of failure.
+        nRewind++;
+        // Remove former limit.
+        blkdat.SetLimit();
+        unsigned int nSize = 0;
+        try {
+            // Locate a header.
+            uint8_t buf[CMessageHeader::MESSAGE_START_SIZE];
+            blkdat.FindByte(chainparams.DiskMagic()[0]);
+            nRewind = blkdat.GetPos() + 1;
+            blkdat >> buf;
+            if (memcmp(buf, chainparams.DiskMagic().data(),
+                       CMessageHeader::MESSAGE_START_SIZE)) {
+                continue;
+            }
+
+            // Read size.
+            blkdat >> nSize;
+            if (nSize < 80) {
+                continue;
+            }
+        } catch (const std::exception &) {
+            // No valid block header found; don't complain.
+            break;
+        }
+
+        try {
+            // read block
+            uint64_t nBlockPos = blkdat.GetPos();
+            blkdat.SetLimit(nBlockPos + nSize);
+            blkdat.SetPos(nBlockPos);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            blkdat >> *pblock;
+            nRewind = blkdat.GetPos();
+
+            if (!fn(pblock, nBlockPos)) {
+                break;
+            }
+        } catch (const std::exception &e) {
+            LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
+                      e.what());
+        }
+    }
+}
+
+/**
+ * Store a block read from a block file, then the blocks previously read from
+ * disk whose parent was unknown. Returns false if the import must stop.
+ */
+static bool AcceptImportedBlock(const Config &config,
+                                const std::shared_ptr<CBlock> &pblock,
+                                const BlockHash &hash, FlatFilePos *dbp,
+                                int &nLoaded) {
+    const CChainParams &chainparams = config.GetChainParams();
+    const CBlock &block = *pblock;
+
+    {
+        LOCK(cs_main);
+        // detect out of order blocks, and store them for later
+        if (hash != chainparams.GetConsensus().hashGenesisBlock &&
+            !LookupBlockIndex(block.hashPrevBlock)) {
+            LogPrint(BCLog::REINDEX,
+                     "%s: Out of order block %s, parent %s not known\n",
+                     __func__, hash.ToString(), block.hashPrevBlock.ToString());
+            if (dbp) {
+                mapBlocksUnknownParent.insert(
+                    std::make_pair(block.hashPrevBlock, *dbp));
+            }
+            return true;
+        }
+
+        // process in case the block isn't known yet
+        CBlockIndex *pindex = LookupBlockIndex(hash);
+        if (!pindex || !pindex->nStatus.hasData()) {
+            CValidationState state;
+            if (g_chainstate.AcceptBlock(config, pblock, state, true, dbp,
+                                         nullptr)) {
+                nLoaded++;
+            }
+            if (state.IsError()) {
+                return false;
+            }
+        } else if (hash != chainparams.GetConsensus().hashGenesisBlock &&
+                   pindex->nHeight % 1000 == 0) {
+            LogPrint(BCLog::REINDEX,
+                     "Block Import: already had block %s at height %d\n",
+                     hash.ToString(), pindex->nHeight);
+        }
+    }
+
+    // Activate the genesis block so normal node progress can continue
+    if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+        CValidationState state;
+        if (!ActivateBestChain(config, state)) {
+            return false;
+        }
+    }
+
+    NotifyHeaderTip();
+
+    // Recursively process earlier encountered successors of this block
+    std::deque<uint256> queue;
+    queue.push_back(hash);
+    while (!queue.empty()) {
+        uint256 head = queue.front();
+        queue.pop_front();
+        std::pair<std::multimap<uint256, FlatFilePos>::iterator,
+                  std::multimap<uint256, FlatFilePos>::iterator>
+            range = mapBlocksUnknownParent.equal_range(head);
+        while (range.first != range.second) {
+            std::multimap<uint256, FlatFilePos>::iterator it = range.first;
+            std::shared_ptr<CBlock> pblockrecursive =
+                std::make_shared<CBlock>();
+            if (ReadBlockFromDisk(*pblockrecursive, it->second,
+                                  chainparams.GetConsensus())) {
+                LogPrint(BCLog::REINDEX,
+                         "%s: Processing out of order child %s of %s\n",
+                         __func__, pblockrecursive->GetHash().ToString(),
+                         head.ToString());
+                LOCK(cs_main);
+                CValidationState dummy;
+                if (g_chainstate.AcceptBlock(config, pblockrecursive, dummy,
+                                             true, &it->second, nullptr)) {
+                    nLoaded++;
+                    queue.push_back(pblockrecursive->GetHash());
+                }
+            }
+            range.first++;
+            mapBlocksUnknownParent.erase(it);
+            NotifyHeaderTip();
+        }
+    }
+
+    return true;
+}
+
 bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
                            FlatFilePos *dbp) {
-    // Map of disk positions for blocks with unknown parent (only used for
-    // reindex)
-    static std::multimap<uint256, FlatFilePos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
-    const CChainParams &chainparams = config.GetChainParams();
-
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile
@@ -5206,151 +5872,363 @@ bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
         // so any transaction can fit in the buffer.
         CBufferedFile blkdat(fileIn, 2 * MAX_TX_SIZE, MAX_TX_SIZE + 8, SER_DISK,
                              CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
-            boost::this_thread::interruption_point();
+        ScanBlockFile(config.GetChainParams(), blkdat,
+                      [&](const std::shared_ptr<CBlock> &pblock,
+                          uint64_t nBlockPos) {
+                          if (dbp) {
+                              dbp->nPos = nBlockPos;
+                          }
+                          return AcceptImportedBlock(config, pblock,
+                                                     pblock->GetHash(), dbp,
+                                                     nLoaded);
+                      });
+    } catch (const std::runtime_error &e) {
+        AbortNode(std::string("System error: ") + e.what());
+    }
 
-            blkdat.SetPos(nRewind);
-            // Start one byte further next time, in case of failure.
-            nRewind++;
-            // Remove former limit.
-            blkdat.SetLimit();
-            unsigned int nSize = 0;
-            try {
-                // Locate a header.
-                uint8_t buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.DiskMagic()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> buf;
-                if (memcmp(buf, chainparams.DiskMagic().data(),
-                           CMessageHeader::MESSAGE_START_SIZE)) {
-                    continue;
-                }
+    if (nLoaded > 0) {
+        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded,
+                  GetTimeMillis() - nStart);
+    }
 
-                // Read size.
-                blkdat >> nSize;
-                if (nSize < 80) {
-                    continue;
-                }
-            } catch (const std::exception &) {
-                // No valid block header found; don't complain.
-                break;
-            }
+    return nLoaded > 0;
+}
 
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp) {
-                    dbp->nPos = nBlockPos;
-                }
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock &block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                const BlockHash hash = block.GetHash();
-                {
-                    LOCK(cs_main);
-                    // detect out of order blocks, and store them for later
-                    if (hash != chainparams.GetConsensus().hashGenesisBlock &&
-                        !LookupBlockIndex(block.hashPrevBlock)) {
-                        LogPrint(
-                            BCLog::REINDEX,
-                            "%s: Out of order block %s, parent %s not known\n",
-                            __func__, hash.ToString(),
-                            block.hashPrevBlock.ToString());
-                        if (dbp) {
-                            mapBlocksUnknownParent.insert(
-                                std::make_pair(block.hashPrevBlock, *dbp));
-                        }
-                        continue;
-                    }
+namespace {
 
-                    // process in case the block isn't known yet
-                    CBlockIndex *pindex = LookupBlockIndex(hash);
-                    if (!pindex || !pindex->nStatus.hasData()) {
-                        CValidationState state;
-                        if (g_chainstate.AcceptBlock(config, pblock, state,
-                                                     true, dbp, nullptr)) {
-                            nLoaded++;
-                        }
-                        if (state.IsError()) {
-                            break;
-                        }
-                    } else if (hash != chainparams.GetConsensus()
-                                           .hashGenesisBlock &&
-                               pindex->nHeight % 1000 == 0) {
-                        LogPrint(
-                            BCLog::REINDEX,
-                            "Block Import: already had block %s at height %d\n",
-                            hash.ToString(), pindex->nHeight);
-                    }
-                }
+/** A block read by a reindex reader thread, with its hash and position. */
+struct ReindexBlock {
+    std::shared_ptr<CBlock> block;
+    BlockHash hash;
+    FlatFilePos pos;
+    //! Serialized size of the block, accounted against the read-ahead limit.
+    size_t nSize = 0;
+};
 
-                // Activate the genesis block so normal node progress can
-                // continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(config, state)) {
-                        break;
-                    }
-                }
+/** Statistics about reading a block file. */
+struct ReindexFileStats {
+    size_t nBlocks = 0;
+    uint64_t nBytes = 0;
+    //! Time spent reading and deserializing the file, in microseconds.
+    int64_t nReadTime = 0;
+    //! Time spent hashing and checking its blocks, in microseconds.
+    int64_t nCheckTime = 0;
+};
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this
-                // block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, FlatFilePos>::iterator,
-                              std::multimap<uint256, FlatFilePos>::iterator>
-                        range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, FlatFilePos>::iterator it =
-                            range.first;
-                        std::shared_ptr<CBlock> pblockrecursive =
-                            std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second,
-                                              chainparams.GetConsensus())) {
-                            LogPrint(
-                                BCLog::REINDEX,
-                                "%s: Processing out of order child %s of %s\n",
-                                __func__, pblockrecursive->GetHash().ToString(),
-                                head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (g_chainstate.AcceptBlock(
-                                    config, pblockrecursive, dummy, true,
-                                    &it->second, nullptr)) {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
-                        }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
-                    }
-                }
-            } catch (const std::exception &e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__,
-                          e.what());
+/** The blocks of a block file read so far, and whether it is fully read. */
+struct ReindexFile {
+    std::deque<ReindexBlock> blocks;
+    ReindexFileStats stats;
+    bool done = false;
+};
+
+/**
+ * Reads the block files concurrently during a reindex. Each reader thread
+ * claims the next block file, deserializes it through a large read-ahead
+ * buffer and runs the context free checks on its blocks, then queues them for
+ * the import thread, which consumes the files in order. Readers stay at most
+ * one file per thread ahead of the import thread, and the blocks queued for
+ * files the import thread has not reached yet are limited to
+ * REINDEX_MAX_READ_AHEAD bytes, so that memory usage is bounded regardless of
+ * the size of the block files.
+ */
+class ReindexFileReader {
+private:
+    const Config &m_config;
+    const int m_num_threads;
+
+    Mutex m_mutex;
+    std::condition_variable m_cond;
+    //! Next file to be claimed by a reader.
+    int m_next_read GUARDED_BY(m_mutex) = 0;
+    //! File being consumed by the import thread.
+    int m_next_import GUARDED_BY(m_mutex) = 0;
+    //! First file that could not be opened, ending the reindex.
+    int m_end GUARDED_BY(m_mutex) = std::numeric_limits<int>::max();
+    //! Serialized size of the queued blocks.
+    size_t m_queued_bytes GUARDED_BY(m_mutex) = 0;
+    bool m_stop GUARDED_BY(m_mutex) = false;
+    //! Set when a block file could not be opened or read.
+    bool m_failed GUARDED_BY(m_mutex) = false;
+    std::map<int, ReindexFile> m_files GUARDED_BY(m_mutex);
+
+    std::vector<std::thread> m_threads;
+
+    void ThreadRead();
+    void ReadFile(int nFile);
+
+public:
+    ReindexFileReader(const Config &config, int num_threads);
+    ~ReindexFileReader();
+
+    /**
+     * Wait for the given block file to be opened by a reader and make it the
+     * file being imported. Returns false if it does not exist.
+     */
+    bool StartFile(int nFile);
+
+    /**
+     * Wait for the next block of the file being imported. Returns false once
+     * all its blocks have been returned.
+     */
+    bool NextBlock(int nFile, ReindexBlock &block);
+
+    /** Release the file being imported and return its statistics. */
+    ReindexFileStats FinishFile(int nFile);
+
+    /** Whether a block file could not be opened or read. */
+    bool Failed() {
+        LOCK(m_mutex);
+        return m_failed;
+    }
+};
+
+ReindexFileReader::ReindexFileReader(const Config &config, int num_threads)
+    : m_config(config), m_num_threads(num_threads) {
+    for (int i = 0; i < m_num_threads; i++) {
+        m_threads.emplace_back(&TraceThread<std::function<void()>>,
+                               "reindex",
+                               std::function<void()>(std::bind(
+                                   &ReindexFileReader::ThreadRead, this)));
+    }
+}
+
+ReindexFileReader::~ReindexFileReader() {
+    {
+        LOCK(m_mutex);
+        m_stop = true;
+    }
+    m_cond.notify_all();
+    for (std::thread &thread : m_threads) {
+        thread.join();
+    }
+}
+
+void ReindexFileReader::ThreadRead() {
+    while (true) {
+        int nFile;
+        {
+            WAIT_LOCK(m_mutex, lock);
+            m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+                return m_stop || m_next_read >= m_end ||
+                       m_next_read < m_next_import + m_num_threads;
+            });
+            if (m_stop || m_next_read >= m_end) {
+                return;
             }
+            nFile = m_next_read++;
         }
+
+        ReadFile(nFile);
+        m_cond.notify_all();
+    }
+}
+
+void ReindexFileReader::ReadFile(int nFile) {
+    FlatFilePos pos(nFile, 0);
+    if (!fs::exists(GetBlockPosFilename(pos))) {
+        // No block files left to reindex
+        LOCK(m_mutex);
+        m_end = std::min(m_end, nFile);
+        return;
+    }
+    FILE *fileIn = OpenBlockFile(pos, true);
+    if (!fileIn) {
+        // This error is logged in OpenBlockFile
+        LOCK(m_mutex);
+        m_end = std::min(m_end, nFile);
+        m_failed = true;
+        return;
+    }
+
+    {
+        LOCK(m_mutex);
+        m_files.emplace(nFile, ReindexFile());
+    }
+    m_cond.notify_all();
+
+    const CChainParams &chainparams = m_config.GetChainParams();
+    const BlockValidationOptions validationOptions(m_config);
+    const int64_t nStart = GetTimeMicros();
+    int64_t nCheckTime = 0;
+    int64_t nWaitTime = 0;
+    uint64_t nBytes = 0;
+    try {
+        // Reading ahead must not go further than the buffer can rewind, so
+        // that the stream can be rewound to the start of the current block.
+        CBufferedFile blkdat(fileIn, REINDEX_READ_AHEAD,
+                             REINDEX_READ_AHEAD / 2 + 8, SER_DISK,
+                             CLIENT_VERSION);
+        ScanBlockFile(
+            chainparams, blkdat,
+            [&](const std::shared_ptr<CBlock> &pblock, uint64_t nBlockPos) {
+                const int64_t nCheckStart = GetTimeMicros();
+                // Checking the block here, while no other thread has access
+                // to it, caches the result of the context free checks that
+                // AcceptBlock would otherwise perform under cs_main. A block
+                // failing them is checked again there and marked invalid.
+                CValidationState state;
+                CheckBlock(*pblock, state, chainparams.GetConsensus(),
+                           validationOptions);
+                ReindexBlock block{
+                    pblock, pblock->GetHash(), FlatFilePos(nFile, nBlockPos),
+                    ::GetSerializeSize(*pblock, PROTOCOL_VERSION)};
+                const int64_t nWaitStart = GetTimeMicros();
+                nCheckTime += nWaitStart - nCheckStart;
+
+                // The file being imported is never held back, so the import
+                // thread cannot wait on a reader that waits on it.
+                WAIT_LOCK(m_mutex, lock);
+                m_cond.wait(lock, [&]() EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+                    return m_stop || nFile == m_next_import ||
+                           m_queued_bytes < REINDEX_MAX_READ_AHEAD;
+                });
+                // Time spent held back by the read ahead limit is not reading.
+                nWaitTime += GetTimeMicros() - nWaitStart;
+                if (m_stop) {
+                    return false;
+                }
+                m_queued_bytes += block.nSize;
+                m_files[nFile].blocks.push_back(std::move(block));
+                m_cond.notify_all();
+                return true;
+            });
+        nBytes = blkdat.GetPos();
     } catch (const std::runtime_error &e) {
         AbortNode(std::string("System error: ") + e.what());
+        LOCK(m_mutex);
+        m_failed = true;
     }
 
-    if (nLoaded > 0) {
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded,
-                  GetTimeMillis() - nStart);
+    LOCK(m_mutex);
+    ReindexFile &file = m_files[nFile];
+    file.stats.nBytes = nBytes;
+    file.stats.nCheckTime = nCheckTime;
+    file.stats.nReadTime =
+        GetTimeMicros() - nStart - nCheckTime - nWaitTime;
+    file.done = true;
+}
+
+bool ReindexFileReader::StartFile(int nFile) {
+    WAIT_LOCK(m_mutex, lock);
+    m_next_import = nFile;
+    m_cond.notify_all();
+    while (!m_files.count(nFile) && nFile < m_end) {
+        m_cond.wait_for(lock, std::chrono::milliseconds(100));
+        boost::this_thread::interruption_point();
     }
+    return m_files.count(nFile);
+}
 
-    return nLoaded > 0;
+bool ReindexFileReader::NextBlock(int nFile, ReindexBlock &block) {
+    WAIT_LOCK(m_mutex, lock);
+    ReindexFile &file = m_files.at(nFile);
+    while (file.blocks.empty() && !file.done) {
+        m_cond.wait_for(lock, std::chrono::milliseconds(100));
+        boost::this_thread::interruption_point();
+    }
+    if (file.blocks.empty()) {
+        return false;
+    }
+    block = std::move(file.blocks.front());
+    file.blocks.pop_front();
+    file.stats.nBlocks++;
+    m_queued_bytes -= block.nSize;
+    m_cond.notify_all();
+    return true;
+}
+
+ReindexFileStats ReindexFileReader::FinishFile(int nFile) {
+    LOCK(m_mutex);
+    auto it = m_files.find(nFile);
+    ReindexFileStats stats = it->second.stats;
+    for (const ReindexBlock &block : it->second.blocks) {
+        m_queued_bytes -= block.nSize;
+    }
+    m_files.erase(it);
+    m_next_import = nFile + 1;
+    m_cond.notify_all();
+    return stats;
+}
+
+} // namespace
+
+bool ReindexBlockFiles(const Config &config, int num_threads) {
+    const int64_t nStart = GetTimeMicros();
+
+    ReindexFileReader reader(config, num_threads);
+
+    int nLoaded = 0;
+    size_t nBlocks = 0;
+    uint64_t nBytes = 0;
+    int64_t nReadTime = 0;
+    int64_t nCheckTime = 0;
+    int64_t nAcceptTime = 0;
+    int64_t nWaitTime = 0;
+    bool fSuccess = true;
+    for (int nFile = 0;; nFile++) {
+        int64_t nWaitStart = GetTimeMicros();
+        if (!reader.StartFile(nFile)) {
+            break;
+        }
+        nWaitTime += GetTimeMicros() - nWaitStart;
+
+        LogPrintf("Reindexing block file blk%05u.dat...\n",
+                  (unsigned int)nFile);
+        int64_t nAcceptFileTime = 0;
+        try {
+            ReindexBlock block;
+            while (true) {
+                nWaitStart = GetTimeMicros();
+                if (!reader.NextBlock(nFile, block)) {
+                    break;
+                }
+                const int64_t nAcceptStart = GetTimeMicros();
+                nWaitTime += nAcceptStart - nWaitStart;
+                boost::this_thread::interruption_point();
+                if (!AcceptImportedBlock(config, block.block, block.hash,
+                                         &block.pos, nLoaded)) {
+                    fSuccess = false;
+                    break;
+                }
+                nAcceptFileTime += GetTimeMicros() - nAcceptStart;
+            }
+        } catch (const std::runtime_error &e) {
+            AbortNode(std::string("System error: ") + e.what());
+            fSuccess = false;
+        }
+        const ReindexFileStats stats = reader.FinishFile(nFile);
+
+        LogPrint(BCLog::REINDEX,
+                 "Block file blk%05u.dat: %u blocks, %.2f MiB, read in %.2fms, "
+                 "checked in %.2fms, accepted in %.2fms\n",
+                 (unsigned int)nFile, stats.nBlocks,
+                 stats.nBytes * (1.0 / 1024 / 1024), stats.nReadTime * 0.001,
+                 stats.nCheckTime * 0.001, nAcceptFileTime * 0.001);
+
+        nBlocks += stats.nBlocks;
+        nBytes += stats.nBytes;
+        nReadTime += stats.nReadTime;
+        nCheckTime += stats.nCheckTime;
+        nAcceptTime += nAcceptFileTime;
+
+        if (!fSuccess) {
+            break;
+        }
+    }
+
+    // Throughputs of the reader stages are per thread.
+    const double nMiB = nBytes * (1.0 / 1024 / 1024);
+    LogPrintf("Reindexed %u blocks (%.1f MiB) in %dms with %d reader "
+              "threads: read %.1f MiB/s, checked %.1f blocks/s, accepted %.1f "
+              "blocks/s, waited %dms for readers\n",
+              nBlocks, nMiB, (GetTimeMicros() - nStart) / 1000, num_threads,
+              nReadTime > 0 ? nMiB * 1000000 / nReadTime : 0.0,
+              nCheckTime > 0 ? nBlocks * 1000000.0 / nCheckTime : 0.0,
+              nAcceptTime > 0 ? nBlocks * 1000000.0 / nAcceptTime : 0.0,
+              nWaitTime / 1000);
+
+    return fSuccess && !reader.Failed();
 }
 
 void CChainState::CheckBlockIndex(const Consensus::Params &consensusParams) {
@@ -15,6 +15,7 @@
 #include <blockfileinfo.h>
 #include <coins.h>
 #include <consensus/consensus.h>
+#include <consensus/validation.h>
 #include <flatfile.h>
 #include <fs.h>
 #include <protocol.h> // For CMessageHeader::MessageMagic
@@ -27,6 +28,7 @@
 #include <atomic>
 #include <cstdint>
 #include <exception>
+#include <functional>
 #include <map>
 #include <memory>
 #include <set>
@@ -38,6 +40,7 @@ class arith_uint256;
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
 class CChainParams;
 class CChain;
 class CCoinsViewDB;
@@ -47,7 +50,6 @@ class Config;
 class CScriptCheck;
 class CTxMemPool;
 class CTxUndo;
-class CValidationState;
 
 struct FlatFilePos;
 struct ChainTxData;
@@ -89,10 +91,26 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 /** The pre-allocation chunk size for rev?????.dat files (since 0.8) */
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
+/** Number of block files, and of undo files, kept memory mapped for reading */
+static const size_t MAX_MAPPED_BLOCK_FILES = 16;
+/** Maximum size of the block files, and of the undo files, kept mapped */
+static const size_t MAX_MAPPED_BLOCK_FILE_BYTES = 512 * 1024 * 1024;
 /** Maximum number of script-checking threads allowed */
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
+/** Maximum number of threads reading block files during a reindex */
+static const int MAX_REINDEX_THREADS = 4;
+/** -reindexthreads default (number of block file reader threads, 0 = auto) */
+static const int DEFAULT_REINDEX_THREADS = 0;
+/** Size of the read-ahead buffer of each block file reader thread */
+static const uint64_t REINDEX_READ_AHEAD = 0x1000000; // 16 MiB
+/** Maximum size of the blocks queued ahead of the file being reindexed */
+static const uint64_t REINDEX_MAX_READ_AHEAD = 0x4000000; // 64 MiB
+/** Default for -parallelconnect */
+static const bool DEFAULT_PARALLEL_CONNECT = false;
+/** Default for -utxocommitment */
+static const bool DEFAULT_UTXO_COMMITMENT = false;
 /**
  * Number of blocks that can be requested at any given time from a single peer.
  */
@@ -150,6 +168,10 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_COINSTATSINDEX = false;
+static const bool DEFAULT_ADDRESSINDEX = false;
+static const bool DEFAULT_SPENTINDEX = false;
+static const char *const DEFAULT_BLOCKFILTERINDEX = "0";
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -persistmempool */
@@ -167,6 +189,7 @@ static const unsigned int MAX_BLOCKS_TO_ANNOUNCE = 8;
 static const int MAX_UNCONNECTING_HEADERS = 10;
 
 static const bool DEFAULT_PEERBLOOMFILTERS = true;
+static const bool DEFAULT_PEERBLOCKFILTERS = false;
 
 /** Default for -stopatheight */
 static const int DEFAULT_STOPATHEIGHT = 0;
@@ -192,6 +215,11 @@ extern uint256 g_best_block;
 extern std::atomic_bool fImporting;
 extern std::atomic_bool fReindex;
 extern int nScriptCheckThreads;
+/**
+ * Whether ConnectBlock defers the UTXO dependent transaction checks to the
+ * input checking threads.
+ */
+extern bool fParallelBlockConnect;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -333,15 +361,41 @@ bool ProcessNewBlock(const Config &config,
  * @param[out] ppindex       If set, the pointer will be set to point to the
  *                           last new block index object for the given headers.
  * @param[out] first_invalid First header that fails validation, if one exists.
+ * @param[in]  nHashThreads  Maximum number of threads hashing the headers,
+ *                           including the calling one.
  * @return True if block headers were accepted as valid.
  */
 bool ProcessNewBlockHeaders(const Config &config,
                             const std::vector<CBlockHeader> &block,
                             CValidationState &state,
                             const CBlockIndex **ppindex = nullptr,
+                            CBlockHeader *first_invalid = nullptr,
+                            int nHashThreads = nScriptCheckThreads)
+    LOCKS_EXCLUDED(cs_main);
+
+/**
+ * Process incoming block headers, which were already hashed with
+ * HashBlockHeaders.
+ *
+ * @param[in]  hashes        The hashes of the headers, in the same order.
+ */
+bool ProcessNewBlockHeaders(const Config &config,
+                            const std::vector<CBlockHeader> &block,
+                            const std::vector<BlockHash> &hashes,
+                            CValidationState &state,
+                            const CBlockIndex **ppindex = nullptr,
                             CBlockHeader *first_invalid = nullptr)
     LOCKS_EXCLUDED(cs_main);
 
+/**
+ * Hash a batch of headers, on up to nThreads threads including the calling one
+ * for large batches. This is most of the cost of checking their proof of work,
+ * and is done before cs_main is taken.
+ */
+std::vector<BlockHash>
+HashBlockHeaders(const std::vector<CBlockHeader> &headers,
+                 int nThreads = nScriptCheckThreads);
+
 /**
  * Open a block file (blk?????.dat).
  */
@@ -358,6 +412,13 @@ fs::path GetBlockPosFilename(const FlatFilePos &pos);
 bool LoadExternalBlockFile(const Config &config, FILE *fileIn,
                            FlatFilePos *dbp = nullptr);
 
+/**
+ * Reindex the blocks of the blk?????.dat files, in order, using num_threads
+ * threads to read and deserialize them ahead of the calling thread. Returns
+ * false if a block file could not be read or a block could not be stored.
+ */
+bool ReindexBlockFiles(const Config &config, int num_threads);
+
 /**
  * Ensures we have a genesis block in the block tree, possibly writing one to
  * disk.
@@ -381,7 +442,8 @@ bool LoadChainTip(const Config &config) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 void UnloadBlockIndex();
 
 /**
- * Run an instance of the script checking thread.
+ * Run an instance of the script checking thread. The same threads run the
+ * other checks of ConnectBlock and the work split by RunWorkerTasks().
  */
 void ThreadScriptCheck();
 
@@ -657,11 +719,110 @@ public:
     ScriptExecutionMetrics GetScriptExecutionMetrics() const { return metrics; }
 };
 
+/**
+ * Outcome of a CTxInputCheck, written by the thread that ran it.
+ */
+struct TxInputCheckResult {
+    CValidationState state;
+    Amount txfee = Amount::zero();
+    uint64_t nSigOpsCount = 0;
+    bool fChecked = false;
+};
+
+/**
+ * Closure representing the UTXO dependent checks of one block transaction that
+ * are not script checks: input amounts and fee, sigops count and BIP68 sequence
+ * locks. It only looks at the coins spent by the transaction, as recorded in
+ * its undo data, so it can run once the inputs have been removed from the view
+ * and without access to it.
+ * Note that this stores references to the transaction, its spent coins, the
+ * block index and the result, which must all outlive the check.
+ */
+class CTxInputCheck {
+private:
+    const CTransaction *ptx;
+    const std::vector<Coin> *pspentCoins;
+    const CBlockIndex *pindex;
+    uint32_t nFlags;
+    int nLockTimeFlags;
+    TxInputCheckResult *presult;
+
+public:
+    /**
+     * pspentCoinsIn must be nullptr for the coinbase, in which case only the
+     * sigops are counted.
+     */
+    CTxInputCheck(const CTransaction &txIn,
+                  const std::vector<Coin> *pspentCoinsIn,
+                  const CBlockIndex &indexIn, uint32_t nFlagsIn,
+                  int nLockTimeFlagsIn, TxInputCheckResult &resultIn)
+        : ptx(&txIn), pspentCoins(pspentCoinsIn), pindex(&indexIn),
+          nFlags(nFlagsIn), nLockTimeFlags(nLockTimeFlagsIn),
+          presult(&resultIn) {}
+
+    bool operator()();
+};
+
+/**
+ * Closure loading a coin into the cache of a view, so that connecting a block
+ * finds the coins it spends in memory rather than reading them one by one from
+ * the database. The view must support concurrent reads, which is the case of
+ * CCoinsViewShardedCache.
+ */
+class CCoinPrefetch {
+private:
+    const CCoinsView *pview;
+    COutPoint outpoint;
+
+public:
+    CCoinPrefetch(const CCoinsView &viewIn, const COutPoint &outpointIn)
+        : pview(&viewIn), outpoint(outpointIn) {}
+
+    bool operator()() {
+        pview->HaveCoin(outpoint);
+        return true;
+    }
+};
+
+/**
+ * Task run by the script checking threads: a CScriptCheck, CTxInputCheck or
+ * CCoinPrefetch of ConnectBlock, or one slice of some work split across
+ * threads, such as hashing a large batch of headers or the mempool into short
+ * ids. It returns false if it failed.
+ */
+class CWorkerTask {
+private:
+    std::function<bool()> func;
+
+public:
+    CWorkerTask() {}
+    explicit CWorkerTask(std::function<bool()> funcIn)
+        : func(std::move(funcIn)) {}
+
+    bool operator()() { return func(); }
+
+    void swap(CWorkerTask &task) { func.swap(task.func); }
+};
+
+/**
+ * Run the tasks on the script checking threads and on the calling thread, and
+ * wait for all of them. The threads are started once, rather than for each
+ * message whose processing is split.
+ */
+void RunWorkerTasks(std::vector<CWorkerTask> &tasks);
+
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock &block, const FlatFilePos &pos,
                        const Consensus::Params &params);
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
                        const Consensus::Params &params);
+/**
+ * Read the serialized bytes of the block at pindex, which are the same on disk
+ * and on the network, without deserializing them.
+ */
+bool ReadRawBlockFromDisk(std::vector<uint8_t> &block,
+                          const CBlockIndex *pindex);
+bool UndoReadFromDisk(CBlockUndo &blockundo, const CBlockIndex *pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -710,6 +871,19 @@ public:
 /** Replay blocks that aren't fully applied to the database. */
 bool ReplayBlocks(const Consensus::Params &params, CCoinsView *view);
 
+/**
+ * Start maintaining a commitment to the UTXO set as blocks are connected and
+ * disconnected. The commitment stored in the coins database is used if it is
+ * up to date, otherwise it is computed from a full scan of the UTXO set.
+ */
+bool LoadUtxoCommitment() EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+/**
+ * Get the hash of the commitment to the UTXO set as of the chain tip.
+ * Returns false if the commitment is not maintained.
+ */
+bool GetUtxoCommitment(uint256 &hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
 /** Find the last common block between the parameter chain and a locator. */
 CBlockIndex *FindForkInGlobalIndex(const CChain &chain,
                                    const CBlockLocator &locator)
@@ -772,7 +946,7 @@ extern std::unique_ptr<CCoinsViewDB> pcoinsdbview;
 /**
  * Global variable that points to the active CCoinsView (protected by cs_main)
  */
-extern std::unique_ptr<CCoinsViewCache> pcoinsTip;
+extern std::unique_ptr<CCoinsViewShardedCache> pcoinsTip;
 
 /**
  * Global variable that points to the active block tree (protected by cs_main)
@@ -5,6 +5,7 @@
 
 #include <validationinterface.h>
 
+#include <avalanche.h>
 #include <scheduler.h>
 #include <txmempool.h>
 #include <util/system.h>
@@ -26,6 +27,7 @@ struct ValidationInterfaceConnections {
     boost::signals2::scoped_connection Broadcast;
     boost::signals2::scoped_connection BlockChecked;
     boost::signals2::scoped_connection NewPoWValidBlock;
+    boost::signals2::scoped_connection TransactionAvalancheUpdated;
 };
 
 struct MainSignalsInstance {
@@ -50,6 +52,8 @@ struct MainSignalsInstance {
     boost::signals2::signal<void(const CBlockIndex *,
                                  const std::shared_ptr<const CBlock> &)>
         NewPoWValidBlock;
+    boost::signals2::signal<void(const AvalancheTxUpdate &)>
+        TransactionAvalancheUpdated;
 
     // We are not allowed to assume the scheduler only runs in one thread,
     // but must ensure all callbacks happen in-order, so we end up creating
@@ -142,6 +146,10 @@ void RegisterValidationInterface(CValidationInterface *pwalletIn) {
     conns.NewPoWValidBlock = g_signals.m_internals->NewPoWValidBlock.connect(
         std::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn,
                   std::placeholders::_1, std::placeholders::_2));
+    conns.TransactionAvalancheUpdated =
+        g_signals.m_internals->TransactionAvalancheUpdated.connect(
+            std::bind(&CValidationInterface::TransactionAvalancheUpdated,
+                      pwalletIn, std::placeholders::_1));
 }
 
 void UnregisterValidationInterface(CValidationInterface *pwalletIn) {
@@ -228,3 +236,9 @@ void CMainSignals::NewPoWValidBlock(
     const CBlockIndex *pindex, const std::shared_ptr<const CBlock> &block) {
     m_internals->NewPoWValidBlock(pindex, block);
 }
+
+void CMainSignals::TransactionAvalancheUpdated(
+    const AvalancheTxUpdate &update) {
+    m_internals->m_schedulerClient.AddToProcessQueue(
+        [update, this] { m_internals->TransactionAvalancheUpdated(update); });
+}
@@ -13,6 +13,7 @@
 #include <memory>
 
 extern CCriticalSection cs_main;
+class AvalancheTxUpdate;
 class CBlock;
 class CBlockIndex;
 struct CBlockLocator;
@@ -158,6 +159,14 @@ protected:
      */
     virtual void NewPoWValidBlock(const CBlockIndex *pindex,
                                   const std::shared_ptr<const CBlock> &block){};
+    /**
+     * Notifies listeners that avalanche changed its decision about a
+     * transaction, or finalized it.
+     *
+     * Called on a background thread.
+     */
+    virtual void TransactionAvalancheUpdated(const AvalancheTxUpdate &update) {
+    }
     friend void ::RegisterValidationInterface(CValidationInterface *);
     friend void ::UnregisterValidationInterface(CValidationInterface *);
     friend void ::UnregisterAllValidationInterfaces();
@@ -210,6 +219,7 @@ public:
     void BlockChecked(const CBlock &, const CValidationState &);
     void NewPoWValidBlock(const CBlockIndex *,
                           const std::shared_ptr<const CBlock> &);
+    void TransactionAvalancheUpdated(const AvalancheTxUpdate &);
 };
 
 CMainSignals &GetMainSignals();
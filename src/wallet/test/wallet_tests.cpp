@@ -247,6 +247,7 @@ static int64_t AddTx(CWallet &wallet, uint32_t lockTime, int64_t mockTime,
         block = inserted.first->second;
         block->nTime = blockTime;
         block->phashBlock = &hash;
+        PublishBlockIndex(block);
     }
 
     CWalletTx wtx(&wallet, MakeTransactionRef(tx));
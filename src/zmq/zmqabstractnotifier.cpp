@@ -18,3 +18,8 @@ bool CZMQAbstractNotifier::NotifyTransaction(
     const CTransaction & /*transaction*/) {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyTransactionAvalanche(
+    const AvalancheTxUpdate & /*update*/) {
+    return true;
+}
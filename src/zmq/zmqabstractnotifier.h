@@ -7,6 +7,7 @@
 
 #include <zmq/zmqconfig.h>
 
+class AvalancheTxUpdate;
 class CBlockIndex;
 class CZMQAbstractNotifier;
 
@@ -31,6 +32,7 @@ public:
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyTransactionAvalanche(const AvalancheTxUpdate &update);
 
 protected:
     void *psocket;
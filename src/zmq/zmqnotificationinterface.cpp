@@ -48,6 +48,8 @@ CZMQNotificationInterface *CZMQNotificationInterface::Create() {
         CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] =
         CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
+    factories["pubavalanchetx"] =
+        CZMQAbstractNotifier::Create<CZMQPublishAvalancheTransactionNotifier>;
 
     for (const auto &entry : factories) {
         std::string arg("-zmq" + entry.first);
@@ -180,4 +182,18 @@ void CZMQNotificationInterface::BlockDisconnected(
     }
 }
 
+void CZMQNotificationInterface::TransactionAvalancheUpdated(
+    const AvalancheTxUpdate &update) {
+    for (std::list<CZMQAbstractNotifier *>::iterator i = notifiers.begin();
+         i != notifiers.end();) {
+        CZMQAbstractNotifier *notifier = *i;
+        if (notifier->NotifyTransactionAvalanche(update)) {
+            i++;
+        } else {
+            notifier->Shutdown();
+            i = notifiers.erase(i);
+        }
+    }
+}
+
 CZMQNotificationInterface *g_zmq_notification_interface = nullptr;
@@ -36,6 +36,7 @@ protected:
     void UpdatedBlockTip(const CBlockIndex *pindexNew,
                          const CBlockIndex *pindexFork,
                          bool fInitialDownload) override;
+    void TransactionAvalancheUpdated(const AvalancheTxUpdate &update) override;
 
 private:
     CZMQNotificationInterface();
@@ -4,6 +4,7 @@
 
 #include <zmq/zmqpublishnotifier.h>
 
+#include <avalanche.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <config.h>
@@ -21,6 +22,7 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX = "hashtx";
 static const char *MSG_RAWBLOCK = "rawblock";
 static const char *MSG_RAWTX = "rawtx";
+static const char *MSG_AVALANCHETX = "avalanchetx";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void *data, size_t size, ...) {
@@ -194,3 +196,15 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+bool CZMQPublishAvalancheTransactionNotifier::NotifyTransactionAvalanche(
+    const AvalancheTxUpdate &update) {
+    uint256 txid = update.getTxId();
+    LogPrint(BCLog::ZMQ, "zmq: Publish avalanchetx %s\n", txid.GetHex());
+    char data[33];
+    for (unsigned int i = 0; i < 32; i++) {
+        data[31 - i] = txid.begin()[i];
+    }
+    data[32] = update.getStatus();
+    return SendMessage(MSG_AVALANCHETX, data, 33);
+}
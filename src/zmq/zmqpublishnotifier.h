@@ -47,4 +47,10 @@ public:
     bool NotifyTransaction(const CTransaction &transaction) override;
 };
 
+class CZMQPublishAvalancheTransactionNotifier
+    : public CZMQAbstractPublishNotifier {
+public:
+    bool NotifyTransactionAvalanche(const AvalancheTxUpdate &update) override;
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
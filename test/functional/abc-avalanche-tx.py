@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test avalanche voting on transactions.
+
+The first two nodes use -enableavalanche and poll each other about the
+transactions they receive from the network, the last one does not.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    wait_until,
+)
+
+
+def messages_received(node, command):
+    return sum(peer['bytesrecv_per_msg'].get(command, 0)
+               for peer in node.getpeerinfo())
+
+
+class AvalancheTxTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        self.setup_clean_chain = True
+        self.extra_args = [["-enableavalanche"], ["-enableavalanche"], []]
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_wallet()
+
+    def run_test(self):
+        node0, node1, node2 = self.nodes
+        node0.generate(101)
+        self.sync_all()
+
+        assert_raises_rpc_error(-1, "Avalanche is not enabled",
+                                node2.getavalanchetxinfo, "00" * 32)
+        assert_raises_rpc_error(-5, "Transaction is not being voted on",
+                                node0.getavalanchetxinfo, "00" * 32)
+
+        self.log.info("Vote on transactions received from the network")
+        txid = node1.sendtoaddress(node1.getnewaddress(), 1)
+        self.sync_mempools()
+        info = node0.getavalanchetxinfo(txid)
+        assert_equal(info['txid'], txid)
+        assert_equal(info['accepted'], True)
+        wait_until(lambda: messages_received(node0, 'avaresponse') > 0)
+        assert messages_received(node1, 'avapoll') > 0
+        assert_equal(messages_received(node2, 'avapoll'), 0)
+
+        self.log.info("Stop voting on mined transactions")
+        node0.generate(1)
+        self.sync_blocks()
+
+        def not_voted_on():
+            try:
+                node0.getavalanchetxinfo(txid)
+            except Exception:
+                return True
+            return False
+        wait_until(not_voted_on)
+
+
+if __name__ == '__main__':
+    AvalancheTxTest().main()
@@ -7,10 +7,14 @@
 - Start a single node and generate 3 blocks.
 - Stop the node and restart it with -reindex. Verify that the node has reindexed up to block 3.
 - Stop the node and restart it with -reindex-chainstate. Verify that the node has reindexed up to block 3.
+- Write enough blocks with -fastprune to span several block files and repeat
+  the -reindex with a single and with several block file reader threads.
 """
 
+import os
+
 from test_framework.test_framework import BitcoinTestFramework
-from test_framework.util import wait_until
+from test_framework.util import assert_greater_than, wait_until
 
 
 class ReindexTest(BitcoinTestFramework):
@@ -19,13 +23,16 @@ class ReindexTest(BitcoinTestFramework):
         self.setup_clean_chain = True
         self.num_nodes = 1
 
-    def reindex(self, justchainstate=False):
+    def reindex(self, justchainstate=False, reindex_args=None, nblocks=3):
+        if reindex_args is None:
+            reindex_args = []
         self.nodes[0].generatetoaddress(
-            3, self.nodes[0].get_deterministic_priv_key().address)
+            nblocks, self.nodes[0].get_deterministic_priv_key().address)
         blockcount = self.nodes[0].getblockcount()
         self.stop_nodes()
         extra_args = [
-            ["-reindex-chainstate" if justchainstate else "-reindex"]]
+            ["-reindex-chainstate" if justchainstate else "-reindex"] +
+            reindex_args]
         self.start_nodes(extra_args)
         wait_until(lambda: self.nodes[0].getblockcount() == blockcount)
         self.log.info("Success")
@@ -36,6 +43,16 @@ class ReindexTest(BitcoinTestFramework):
         self.reindex(False)
         self.reindex(True)
 
+        # With -fastprune the block files are 64 KiB, so that these blocks
+        # span several files for the reader threads to read concurrently.
+        self.restart_node(0, ["-fastprune"])
+        self.reindex(False, ["-fastprune", "-reindexthreads=1"], nblocks=1000)
+        blocks_dir = os.path.join(self.nodes[0].datadir, "regtest", "blocks")
+        num_files = len([f for f in os.listdir(blocks_dir)
+                         if f.startswith("blk") and f.endswith(".dat")])
+        assert_greater_than(num_files, 2)
+        self.reindex(False, ["-fastprune", "-reindexthreads=4"])
+
 
 if __name__ == '__main__':
     ReindexTest().main()
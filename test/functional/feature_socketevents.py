@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the -socketevents option.
+
+Relay blocks between two nodes with every socket events backend supported on
+this platform, and check that unknown modes are rejected. With epoll, check that
+the sockets of idle peers are not checked by the socket handler.
+"""
+
+import sys
+import time
+
+from test_framework.address import script_to_p2sh
+from test_framework.messages import MY_SUBVERSION
+from test_framework.mininode import P2PInterface
+from test_framework.script import CScript, OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.test_node import ErrorMatch
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+    disconnect_nodes,
+)
+
+
+ADDRESS = script_to_p2sh(CScript([OP_TRUE]))
+
+
+def socket_checks(node):
+    return [peer['socketchecks'] for peer in node.getpeerinfo()
+            if peer['subver'] == MY_SUBVERSION.decode()][0]
+
+
+class SocketEventsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        self.setup_nodes()
+
+    def check_idle_peer(self, mode):
+        peer = self.nodes[0].add_p2p_connection(P2PInterface())
+        peer.sync_with_ping()
+        # Let the node send its initial messages to the peer.
+        time.sleep(1)
+        checks = socket_checks(self.nodes[0])
+        time.sleep(2)
+        checks = socket_checks(self.nodes[0]) - checks
+        self.log.info(
+            "idle peer socket checked {} times in 2s".format(checks))
+        if mode == 'epoll':
+            assert checks <= 2
+        else:
+            # The socket of each peer is checked at least every 50ms.
+            assert checks >= 10
+        self.nodes[0].disconnect_p2ps()
+
+    def run_test(self):
+        modes = ['select']
+        if sys.platform != 'win32':
+            modes.append('poll')
+        if sys.platform.startswith('linux'):
+            modes.append('epoll')
+
+        for mode in modes:
+            self.log.info("test -socketevents={}".format(mode))
+            self.restart_node(0, ["-socketevents={}".format(mode)])
+            self.restart_node(1, ["-socketevents={}".format(mode)])
+            connect_nodes(self.nodes[0], self.nodes[1])
+
+            self.nodes[0].generatetoaddress(10, ADDRESS)
+            self.sync_all()
+            self.nodes[1].generatetoaddress(10, ADDRESS)
+            self.sync_all()
+            assert_equal(self.nodes[0].getbestblockhash(),
+                         self.nodes[1].getbestblockhash())
+
+            self.check_idle_peer(mode)
+            disconnect_nodes(self.nodes[0], self.nodes[1])
+
+        self.log.info("test invalid -socketevents")
+        self.stop_node(0)
+        self.nodes[0].assert_start_raises_init_error(
+            ["-socketevents=invalid"],
+            r"Error: Invalid -socketevents \('invalid'\), only .* are "
+            r"supported on this platform",
+            match=ErrorMatch.PARTIAL_REGEX)
+
+
+if __name__ == '__main__':
+    SocketEventsTest().main()
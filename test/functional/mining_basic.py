@@ -6,6 +6,7 @@
 
 - getmininginfo
 - getblocktemplate proposal mode
+- getblocktemplate compact format
 - submitblock"""
 
 import copy
@@ -15,6 +16,8 @@ from test_framework.blocktools import create_coinbase
 from test_framework.messages import (
     CBlock,
     CBlockHeader,
+    COIN,
+    ser_compact_size,
 )
 from test_framework.mininode import (
     P2PDataStore,
@@ -252,6 +255,41 @@ class MiningTest(BitcoinTestFramework):
         assert_equal(node.submitblock(
             hexdata=block.serialize().hex()), 'duplicate')
 
+        self.log.info("getblocktemplate: Test compact format")
+        key = node.get_deterministic_priv_key()
+        coinbase = node.getblock(node.generatetoaddress(
+            101, key.address)[0])['tx'][0]
+        utxo = node.gettxout(coinbase, 0)
+        rawtx = node.createrawtransaction(
+            [{'txid': coinbase, 'vout': 0}],
+            {key.address: utxo['value'] - Decimal('0.001')})
+        rawtx = node.signrawtransactionwithkey(rawtx, [key.key], [{
+            'txid': coinbase, 'vout': 0,
+            'scriptPubKey': utxo['scriptPubKey']['hex'],
+            'amount': utxo['value']}])['hex']
+        node.sendrawtransaction(rawtx)
+
+        tmpl = node.getblocktemplate()
+        compact_tmpl = node.getblocktemplate({'format': 'compact'})
+        assert 'transactions' not in compact_tmpl
+        assert_equal(compact_tmpl['previousblockhash'],
+                     tmpl['previousblockhash'])
+        assert_equal(len(tmpl['transactions']), 1)
+        assert_equal(tmpl['transactions'][0]['data'], rawtx)
+        assert_equal(tmpl['transactions'][0]['fee'], Decimal('0.001') * COIN)
+        expected = ser_compact_size(len(tmpl['transactions']))
+        for tx in tmpl['transactions']:
+            expected += bytes.fromhex(tx['data'])
+            expected += tx['fee'].to_bytes(8, 'little', signed=True)
+            expected += tx['sigops'].to_bytes(8, 'little', signed=True)
+        assert_equal(compact_tmpl['transactionsdata'], expected.hex())
+        # The rendered transactions are reused until the template changes
+        assert_equal(node.getblocktemplate()['transactions'],
+                     tmpl['transactions'])
+
+        assert_raises_rpc_error(-8, "Invalid format", node.getblocktemplate,
+                                {'format': 'binary'})
+
 
 if __name__ == '__main__':
     MiningTest().main()
@@ -0,0 +1,65 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test graphene block relay.
+
+Both nodes use -graphene. Blocks whose transactions are all in the mempool of
+the receiver are relayed as graphene blocks, the others fall back to compact
+block relay.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+    disconnect_nodes,
+    sync_blocks,
+    sync_mempools,
+)
+
+
+def messages_received(node, command):
+    return sum(peer['bytesrecv_per_msg'].get(command, 0)
+               for peer in node.getpeerinfo())
+
+
+class GrapheneTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [["-graphene"], ["-graphene"]]
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_wallet()
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        node0.generate(101)
+        self.sync_all()
+        assert messages_received(node1, 'sendgraphene') > 0
+
+        self.log.info("Relay a block of mempool transactions as graphene")
+        address = node1.getnewaddress()
+        for _ in range(20):
+            node0.sendtoaddress(address, 1)
+        sync_mempools(self.nodes)
+        node0.generate(1)
+        sync_blocks(self.nodes)
+        assert_equal(node1.getrawmempool(), [])
+        assert messages_received(node1, 'grblk') > 0
+
+        self.log.info("Fall back to compact blocks for missing transactions")
+        disconnect_nodes(node0, node1)
+        txid = node0.sendtoaddress(address, 1)
+        connect_nodes(node0, node1)
+        assert txid not in node1.getrawmempool()
+        blocktxn = messages_received(node1, 'blocktxn')
+        node0.generate(1)
+        sync_blocks(self.nodes)
+        assert messages_received(node1, 'blocktxn') > blocktxn
+        assert_equal(node1.getbestblockhash(), node0.getbestblockhash())
+
+
+if __name__ == '__main__':
+    GrapheneTest().main()
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test relay through a node processing its peers on several threads.
+
+Node 1 uses -msghandlerthreads and is the only connection between nodes 0 and
+2, so that all the blocks, headers and transactions relayed between them go
+through its message handler threads.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+    wait_until,
+)
+
+
+class MessageHandlerThreadsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        self.setup_clean_chain = True
+        self.extra_args = [[], ["-msghandlerthreads=4"], []]
+
+    def skip_test_if_missing_module(self):
+        self.skip_if_no_wallet()
+
+    def setup_network(self):
+        self.setup_nodes()
+        connect_nodes(self.nodes[0], self.nodes[1])
+        connect_nodes(self.nodes[2], self.nodes[1])
+
+    def run_test(self):
+        self.log.info("Relay blocks through the multithreaded node")
+        self.nodes[0].generate(101)
+        self.sync_all()
+        self.nodes[2].generate(101)
+        self.sync_all()
+        assert_equal(self.nodes[0].getblockcount(), 202)
+
+        self.log.info("Relay transactions through the multithreaded node")
+        address = self.nodes[2].getnewaddress()
+        txids = [self.nodes[0].sendtoaddress(address, 1) for _ in range(20)]
+        self.sync_mempools()
+        assert_equal(sorted(self.nodes[2].getrawmempool()), sorted(txids))
+
+        self.nodes[2].generate(1)
+        self.sync_all()
+        assert_equal(self.nodes[0].getrawmempool(), [])
+
+        self.log.info("Check that all the peers get answered")
+        self.nodes[1].ping()
+        wait_until(lambda: all('pingtime' in peer
+                               for peer in self.nodes[1].getpeerinfo()))
+
+
+if __name__ == '__main__':
+    MessageHandlerThreadsTest().main()
@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the announcement of relayed transactions.
+
+Transactions relayed to all the peers are announced from batches shared by
+all of them. Check that each peer still applies its own fee filter and bloom
+filter to the shared batches.
+"""
+
+import struct
+
+from test_framework.address import script_to_p2sh
+from test_framework.messages import (
+    CInv,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxOut,
+    msg_feefilter,
+    msg_filterload,
+    msg_getdata,
+    msg_tx,
+    ser_uint256,
+)
+from test_framework.mininode import (
+    mininode_lock,
+    P2PInterface,
+)
+from test_framework.script import (
+    CScript,
+    hash160,
+    OP_EQUAL,
+    OP_HASH160,
+    OP_TRUE,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.txtools import pad_tx
+from test_framework.util import wait_until
+
+REDEEM_SCRIPT = CScript([OP_TRUE])
+P2SH_SCRIPT = CScript([OP_HASH160, hash160(REDEEM_SCRIPT), OP_EQUAL])
+
+
+def murmur3(seed, data):
+    """MurmurHash3 (x86_32), as used by bloom filters."""
+    c1 = 0xcc9e2d51
+    c2 = 0x1b873593
+
+    def rotl32(x, r):
+        return ((x << r) | (x >> (32 - r))) & 0xffffffff
+
+    h1 = seed
+    nblocks = len(data) // 4
+    for i in range(nblocks):
+        k1 = struct.unpack("<I", data[4 * i:4 * i + 4])[0]
+        k1 = rotl32((k1 * c1) & 0xffffffff, 15)
+        h1 ^= (k1 * c2) & 0xffffffff
+        h1 = (rotl32(h1, 13) * 5 + 0xe6546b64) & 0xffffffff
+
+    tail = data[4 * nblocks:]
+    k1 = 0
+    for i in reversed(range(len(tail))):
+        k1 = (k1 << 8) | tail[i]
+    if tail:
+        k1 = rotl32((k1 * c1) & 0xffffffff, 15)
+        h1 ^= (k1 * c2) & 0xffffffff
+
+    h1 ^= len(data)
+    h1 ^= h1 >> 16
+    h1 = (h1 * 0x85ebca6b) & 0xffffffff
+    h1 ^= h1 >> 13
+    h1 = (h1 * 0xc2b2ae35) & 0xffffffff
+    h1 ^= h1 >> 16
+    return h1
+
+
+def bloom_filter(elements, size=512, nHashFuncs=5, nTweak=0):
+    """Return a filterload message for a filter matching elements."""
+    data = bytearray(size)
+    for element in elements:
+        for i in range(nHashFuncs):
+            seed = (i * 0xFBA4C795 + nTweak) & 0xffffffff
+            bit = murmur3(seed, element) % (size * 8)
+            data[bit >> 3] |= 1 << (bit & 7)
+    return msg_filterload(bytes(data), nHashFuncs, nTweak, 0)
+
+
+class TxInvStore(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        self.tx_invs = set()
+        self.txs = set()
+
+    def on_inv(self, message):
+        for i in message.inv:
+            if i.type == 1:
+                self.tx_invs.add(i.hash)
+
+    def on_tx(self, message):
+        message.tx.rehash()
+        self.txs.add(message.tx.sha256)
+
+    def has_txs(self, txs):
+        with mininode_lock:
+            return all(tx.sha256 in self.txs for tx in txs)
+
+    def has_invs(self, txs):
+        with mininode_lock:
+            return all(tx.sha256 in self.tx_invs for tx in txs)
+
+    def has_any_inv(self, txs):
+        with mininode_lock:
+            return any(tx.sha256 in self.tx_invs for tx in txs)
+
+
+class TxRelayTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def spend(self, coinbase_txid, fee_rate):
+        """Spend a coinbase paying fee_rate satoshis per byte."""
+        tx = CTransaction()
+        tx.vin.append(
+            CTxIn(COutPoint(int(coinbase_txid, 16), 0),
+                  CScript([bytes(REDEEM_SCRIPT)])))
+        tx.vout.append(CTxOut(0, P2SH_SCRIPT))
+        pad_tx(tx)
+        tx.vout[0].nValue = 50 * 100000000 - fee_rate * len(tx.serialize())
+        tx.rehash()
+        return tx
+
+    def run_test(self):
+        node = self.nodes[0]
+        node.generatetoaddress(110, script_to_p2sh(REDEEM_SCRIPT))
+        coinbases = [node.getblock(node.getblockhash(height))['tx'][0]
+                     for height in range(1, 11)]
+
+        low = self.spend(coinbases[0], 10)
+        high = self.spend(coinbases[1], 20)
+        marker = self.spend(coinbases[2], 20)
+
+        sender = node.add_p2p_connection(TxInvStore())
+        peer_all = node.add_p2p_connection(TxInvStore())
+        peer_fee = node.add_p2p_connection(TxInvStore())
+        peer_bloom = node.add_p2p_connection(TxInvStore())
+
+        # The fee filter is in satoshis per kilobyte.
+        peer_fee.send_and_ping(msg_feefilter(15000))
+        peer_bloom.send_and_ping(bloom_filter(
+            [ser_uint256(high.sha256), ser_uint256(marker.sha256)]))
+
+        self.log.info("Relay transactions to peers with different filters")
+        sender.send_message(msg_tx(low))
+        sender.send_message(msg_tx(high))
+        sender.sync_with_ping()
+        assert low.hash in node.getrawmempool()
+        assert high.hash in node.getrawmempool()
+        wait_until(lambda: peer_all.has_invs([low, high]))
+
+        # The batch holding low and high is made by now, so the marker comes
+        # in a later batch. Once a peer announced the marker, it went through
+        # the whole batch holding low and high.
+        self.log.info("Relay a marker transaction to all the peers")
+        sender.send_and_ping(msg_tx(marker))
+        for peer in [peer_all, peer_fee, peer_bloom]:
+            wait_until(lambda: peer.has_invs([marker]))
+
+        self.log.info("Check that each peer applied its own filters")
+        assert peer_fee.has_invs([high])
+        assert not peer_fee.has_any_inv([low])
+        assert peer_bloom.has_invs([high])
+        assert not peer_bloom.has_any_inv([low])
+        assert not sender.has_any_inv([low, high, marker])
+
+        # The announced transactions are served from the relay map, to any
+        # number of peers.
+        self.log.info("Request the announced transactions")
+        for peer in [peer_all, peer_fee, peer_bloom]:
+            peer.send_message(msg_getdata([CInv(1, high.sha256)]))
+        peer_all.send_message(msg_getdata([CInv(1, low.sha256)]))
+        for peer in [peer_all, peer_fee, peer_bloom]:
+            wait_until(lambda: peer.has_txs([high]))
+        wait_until(lambda: peer_all.has_txs([low]))
+
+
+if __name__ == '__main__':
+    TxRelayTest().main()
@@ -95,6 +95,11 @@ class NetTest(BitcoinTestFramework):
         assert_equal(self.nodes[0].getnetworkinfo()['networkactive'], True)
         assert_equal(self.nodes[0].getnetworkinfo()['connections'], 2)
 
+        # The payloads of the messages received so far went through the pool
+        pool = self.nodes[0].getnetworkinfo()['recvbufferpool']
+        assert_greater_than(pool['hits'] + pool['misses'], 0)
+        assert_greater_than_or_equal(pool['bytes'], pool['buffers'] * 512)
+
     def _test_getaddednodeinfo(self):
         assert_equal(self.nodes[0].getaddednodeinfo(), [])
         # add a node (node2) to node0
@@ -28,6 +28,9 @@ from test_framework.messages import (
     msg_block,
     MSG_BLOCK,
     msg_blocktxn,
+    msg_cfcheckpt,
+    msg_cfheaders,
+    msg_cfilter,
     msg_cmpctblock,
     msg_feefilter,
     msg_getaddr,
@@ -60,6 +63,9 @@ MESSAGEMAP = {
     b"addr": msg_addr,
     b"block": msg_block,
     b"blocktxn": msg_blocktxn,
+    b"cfcheckpt": msg_cfcheckpt,
+    b"cfheaders": msg_cfheaders,
+    b"cfilter": msg_cfilter,
     b"cmpctblock": msg_cmpctblock,
     b"feefilter": msg_feefilter,
     b"getaddr": msg_getaddr,
@@ -353,6 +359,12 @@ class P2PInterface(P2PConnection):
 
     def on_blocktxn(self, message): pass
 
+    def on_cfcheckpt(self, message): pass
+
+    def on_cfheaders(self, message): pass
+
+    def on_cfilter(self, message): pass
+
     def on_cmpctblock(self, message): pass
 
     def on_feefilter(self, message): pass